@@ -0,0 +1,75 @@
+/*
+ * bookmarks-generate.c
+ * Writes a large vinagre-bookmarks.xml for the parser benchmark
+ * This file is part of vinagre
+ *
+ * Copyright (C) 2026 - The Vinagre developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: bookmarks-generate [ITEMS [FOLDERS]] > bookmarks.xml
+ *
+ * Writes ITEMS (50000 by default) VNC bookmarks with every element
+ * vinagre_connection_fill_writer produces, spread evenly over FOLDERS
+ * folders, or all at the top level when FOLDERS is 0 (the default).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+int
+main (int argc, char **argv)
+{
+  gint items = 50000, folders = 0, per_folder = 0, i;
+
+  if (argc > 1)
+    items = atoi (argv[1]);
+  if (argc > 2)
+    folders = atoi (argv[2]);
+  if (items <= 0 || folders < 0 || folders > items)
+    {
+      g_printerr ("Usage: %s [ITEMS [FOLDERS]]\n", argv[0]);
+      return 1;
+    }
+  if (folders)
+    per_folder = items / folders;
+
+  printf ("<?xml version=\"1.0\"?>\n<vinagre-bookmarks>\n");
+  for (i = 0; i < items; i++)
+    {
+      if (per_folder && i % per_folder == 0 && i / per_folder < folders)
+	printf ("%s<folder name=\"folder-%05d\">\n",
+		i ? "</folder>\n" : "", i / per_folder);
+
+      /* Names out of order, so the sort does real work */
+      printf ("<item><protocol>vnc</protocol><name>host-%06d</name>"
+	      "<host>10.%d.%d.%d</host><port>%d</port>"
+	      "<view_only>0</view_only><scaling>0</scaling>"
+	      "<keep_ratio>1</keep_ratio><fullscreen>0</fullscreen>"
+	      "<depth_profile>0</depth_profile><lossy_encoding>0</lossy_encoding>"
+	      "<ssh_tunnel_host></ssh_tunnel_host></item>\n",
+	      (gint) (((gint64) i * 7919) % items),
+	      (i >> 16) & 255, (i >> 8) & 255, i & 255,
+	      5900 + i % 100);
+    }
+  if (per_folder)
+    printf ("</folder>\n");
+  printf ("</vinagre-bookmarks>\n");
+
+  return 0;
+}
+/* vim: set ts=8: */
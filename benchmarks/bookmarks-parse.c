@@ -0,0 +1,381 @@
+/*
+ * bookmarks-parse.c
+ * Compares the DOM and the streaming bookmarks parsers
+ * This file is part of vinagre
+ *
+ * Copyright (C) 2026 - The Vinagre developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: bookmarks-parse FILE [RUNS]
+ *        bookmarks-parse dom|reader FILE
+ *
+ * The first form runs each parser RUNS times (3 by default), each run in
+ * its own process so the peak RSS of one does not hide the other's. The
+ * second form runs a single parser once.
+ *
+ * "dom" is the parser vinagre used before: xmlReadFile, then a walk of the
+ * whole tree. "reader" follows vinagre_bookmarks_parse_reader: one <item>
+ * expanded at a time. Both build the same plain entries, with the
+ * protocol lookup and the per-field scan of vinagre_bookmarks_parse_item,
+ * and both insert like vinagre_bookmarks_insert does, so the numbers only
+ * differ by the parser. Entries stand in for the GObjects and plugins,
+ * which cost the same either way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <libxml/parser.h>
+#include <libxml/xmlreader.h>
+
+typedef struct _Entry Entry;
+struct _Entry
+{
+  gchar  *name;
+  gchar  *host;
+  gchar  *protocol;
+  gint    port;
+  GSList *children;	/* Folders only */
+  Entry  *parent;
+};
+
+static Entry *
+entry_new_folder (const gchar *name)
+{
+  Entry *entry = g_slice_new0 (Entry);
+
+  entry->name = g_strdup (name);
+  return entry;
+}
+
+static gint
+entry_compare (const Entry *a, const Entry *b)
+{
+  return g_strcmp0 (a->name, b->name);
+}
+
+/* Like vinagre_bookmarks_entry_add_child and vinagre_bookmarks_insert:
+ * prepend now, sort once when asked */
+static void
+entry_insert (GSList **entries, Entry *parent, Entry *entry)
+{
+  entry->parent = parent;
+  if (parent)
+    parent->children = g_slist_prepend (parent->children, entry);
+  else
+    *entries = g_slist_prepend (*entries, entry);
+}
+
+static GSList *
+entries_sort (GSList *entries)
+{
+  GSList *l;
+
+  for (l = entries; l; l = l->next)
+    ((Entry *) l->data)->children = entries_sort (((Entry *) l->data)->children);
+
+  return g_slist_sort (entries, (GCompareFunc) entry_compare);
+}
+
+static guint
+entries_count (GSList *entries)
+{
+  guint n = 0;
+
+  for (; entries; entries = entries->next)
+    n += 1 + entries_count (((Entry *) entries->data)->children);
+
+  return n;
+}
+
+/* The protocol first, then every field, as the connection parses it */
+static Entry *
+parse_item (xmlNode *root)
+{
+  Entry   *entry;
+  xmlNode *curr;
+  xmlChar *s_value;
+  gchar   *protocol = NULL;
+
+  for (curr = root->children; curr; curr = curr->next)
+    {
+      if (xmlStrcmp (curr->name, BAD_CAST "protocol"))
+	continue;
+
+      s_value = xmlNodeGetContent (curr);
+      protocol = g_strdup ((const gchar *) s_value);
+      xmlFree (s_value);
+      break;
+    }
+
+  entry = g_slice_new0 (Entry);
+  entry->protocol = protocol ? protocol : g_strdup ("vnc");
+
+  for (curr = root->children; curr; curr = curr->next)
+    {
+      s_value = xmlNodeGetContent (curr);
+
+      if (!xmlStrcmp (curr->name, BAD_CAST "host"))
+	entry->host = g_strdup ((const gchar *) s_value);
+      else if (!xmlStrcmp (curr->name, BAD_CAST "name"))
+	entry->name = g_strdup ((const gchar *) s_value);
+      else if (!xmlStrcmp (curr->name, BAD_CAST "port"))
+	entry->port = atoi ((const char *) s_value);
+
+      xmlFree (s_value);
+    }
+
+  return entry;
+}
+
+static void
+parse_dom (xmlNode *root, Entry *parent, GSList **entries)
+{
+  xmlNode *curr;
+  xmlChar *folder_name;
+  Entry   *entry;
+
+  for (curr = root; curr; curr = curr->next)
+    {
+      if (curr->type != XML_ELEMENT_NODE)
+	continue;
+
+      if (!xmlStrcmp (curr->name, BAD_CAST "folder"))
+	{
+	  folder_name = xmlGetProp (curr, BAD_CAST "name");
+	  if (folder_name && *folder_name)
+	    {
+	      entry = entry_new_folder ((const gchar *) folder_name);
+	      entry_insert (entries, parent, entry);
+	      parse_dom (curr->children, entry, entries);
+	    }
+	  xmlFree (folder_name);
+	}
+      else if (!xmlStrcmp (curr->name, BAD_CAST "item"))
+	entry_insert (entries, parent, parse_item (curr));
+    }
+}
+
+static gboolean
+run_dom (const gchar *filename, GSList **entries)
+{
+  xmlDocPtr  doc;
+  xmlNodePtr root;
+
+  doc = xmlReadFile (filename, NULL, XML_PARSE_NOERROR);
+  if (!doc)
+    return FALSE;
+
+  root = xmlDocGetRootElement (doc);
+  if (root && !xmlStrcmp (root->name, BAD_CAST "vinagre-bookmarks"))
+    parse_dom (root->children, NULL, entries);
+
+  xmlFreeDoc (doc);
+  return TRUE;
+}
+
+static gboolean
+parse_reader (xmlTextReaderPtr reader, GSList **entries)
+{
+  GSList        *folders = NULL;
+  Entry         *entry, *parent;
+  const xmlChar *name;
+  xmlChar       *folder_name;
+  xmlNode       *node;
+  gint           depth = 0;
+  int            ret;
+
+  if (xmlTextReaderIsEmptyElement (reader))
+    return TRUE;
+
+  ret = xmlTextReaderRead (reader);
+  while (ret == 1)
+    {
+      name = xmlTextReaderConstName (reader);
+      parent = folders ? folders->data : NULL;
+
+      if (xmlTextReaderNodeType (reader) == XML_READER_TYPE_END_ELEMENT)
+	{
+	  if (xmlTextReaderDepth (reader) == 0)
+	    break;
+
+	  if (!xmlStrcmp (name, BAD_CAST "folder") && folders)
+	    {
+	      folders = g_slist_delete_link (folders, folders);
+	      depth--;
+	    }
+	}
+      else if (xmlTextReaderNodeType (reader) == XML_READER_TYPE_ELEMENT)
+	{
+	  if (xmlTextReaderDepth (reader) != depth + 1)
+	    {
+	      ret = xmlTextReaderNext (reader);
+	      continue;
+	    }
+
+	  if (!xmlStrcmp (name, BAD_CAST "folder"))
+	    {
+	      folder_name = xmlTextReaderGetAttribute (reader, BAD_CAST "name");
+	      if (!folder_name || !*folder_name)
+		{
+		  xmlFree (folder_name);
+		  ret = xmlTextReaderNext (reader);
+		  continue;
+		}
+
+	      entry = entry_new_folder ((const gchar *) folder_name);
+	      entry_insert (entries, parent, entry);
+	      if (!xmlTextReaderIsEmptyElement (reader))
+		{
+		  folders = g_slist_prepend (folders, entry);
+		  depth++;
+		}
+	      xmlFree (folder_name);
+	    }
+	  else if (!xmlStrcmp (name, BAD_CAST "item"))
+	    {
+	      node = xmlTextReaderExpand (reader);
+	      if (!node)
+		{
+		  ret = -1;
+		  break;
+		}
+
+	      entry_insert (entries, parent, parse_item (node));
+	      ret = xmlTextReaderNext (reader);
+	      continue;
+	    }
+	}
+
+      ret = xmlTextReaderRead (reader);
+    }
+
+  g_slist_free (folders);
+  return ret != -1;
+}
+
+static gboolean
+run_reader (const gchar *filename, GSList **entries)
+{
+  xmlTextReaderPtr reader;
+  gboolean         ok = FALSE;
+  int              ret;
+
+  reader = xmlReaderForFile (filename, NULL, XML_PARSE_NOERROR);
+  if (!reader)
+    return FALSE;
+
+  do
+    ret = xmlTextReaderRead (reader);
+  while (ret == 1 && xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT);
+
+  if (ret == 1 && !xmlStrcmp (xmlTextReaderConstName (reader), BAD_CAST "vinagre-bookmarks"))
+    ok = parse_reader (reader, entries);
+
+  xmlFreeTextReader (reader);
+  return ok;
+}
+
+static long
+peak_rss (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static int
+run_one (const gchar *mode, const gchar *filename)
+{
+  GSList   *entries = NULL;
+  gint64    start, parsed, sorted;
+  long      base;
+  gboolean  ok;
+
+  xmlInitParser ();
+  base = peak_rss ();
+
+  start = g_get_monotonic_time ();
+  if (!strcmp (mode, "dom"))
+    ok = run_dom (filename, &entries);
+  else if (!strcmp (mode, "reader"))
+    ok = run_reader (filename, &entries);
+  else
+    {
+      g_printerr ("Unknown parser %s\n", mode);
+      return 1;
+    }
+  parsed = g_get_monotonic_time ();
+  entries = entries_sort (entries);
+  sorted = g_get_monotonic_time ();
+
+  if (!ok)
+    {
+      g_printerr ("Could not parse %s\n", filename);
+      return 1;
+    }
+
+  printf ("%-6s %6u entries  parse %8.1f ms  sort %6.1f ms  peak RSS +%ld KiB\n",
+	  mode,
+	  entries_count (entries),
+	  (parsed - start) / 1000.0,
+	  (sorted - parsed) / 1000.0,
+	  peak_rss () - base);
+  fflush (stdout);
+
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar *modes[] = { "dom", "reader" };
+  gint         runs = 3, i, m, status;
+  pid_t        pid;
+
+  if (argc == 3 && (!strcmp (argv[1], "dom") || !strcmp (argv[1], "reader")))
+    return run_one (argv[1], argv[2]);
+
+  if (argc < 2 || argc > 3)
+    {
+      g_printerr ("Usage: %s FILE [RUNS]\n"
+		  "       %s dom|reader FILE\n", argv[0], argv[0]);
+      return 1;
+    }
+  if (argc == 3)
+    runs = MAX (atoi (argv[2]), 1);
+
+  for (i = 0; i < runs; i++)
+    for (m = 0; m < (gint) G_N_ELEMENTS (modes); m++)
+      {
+	fflush (stdout);
+	pid = fork ();
+	if (pid == 0)
+	  _exit (run_one (modes[m], argv[1]));
+	if (pid < 0 || waitpid (pid, &status, 0) < 0 ||
+	    !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+	  return 1;
+      }
+
+  return 0;
+}
+/* vim: set ts=8: */
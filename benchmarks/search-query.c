@@ -0,0 +1,383 @@
+/*
+ * search-query.c
+ * Times queries against the connect dialog's host index
+ * This file is part of vinagre
+ *
+ * Copyright (C) 2026 - The Vinagre developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: search-query [ITEMS [RUNS [QUERY...]]]
+ *
+ * Indexes ITEMS (100000 by default) hosts named like the ones
+ * bookmarks-generate writes, a tenth of them used at least once, then
+ * runs each QUERY (a built-in mix when none is given) RUNS times (1000
+ * by default) and prints its mean and worst time.
+ *
+ * The index and the query follow vinagre-search.c line for line: the
+ * same trigrams, posting lists, ranking and top-k insertion. Only the
+ * GObject wrapper and the bookmark and mDNS sources are left out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#define WORD_START '\001'
+#define GRAM(a, b, c) (((guint32) (guchar) (a) << 16) | \
+		       ((guint32) (guchar) (b) << 8) | \
+		       (guint32) (guchar) (c))
+
+#define MAX_RESULTS 10
+
+typedef struct
+{
+  guint   uses;
+  guint64 last_used;
+} Usage;
+
+typedef struct
+{
+  gchar *label;
+  gchar *host;
+  guint  id;
+  gchar *key;
+  gchar *collate_key;
+  Usage *usage;
+} Item;
+
+static GPtrArray  *items;
+static GHashTable *grams;
+static GHashTable *usage;
+static guint64     clock_ticks;
+
+static gboolean
+is_word_char (guchar c)
+{
+  return c >= 0x80 || g_ascii_isalnum (c);
+}
+
+static void
+key_grams (const gchar *key, GArray *out)
+{
+  const guchar *p;
+  guint32       gram;
+
+  for (p = (const guchar *) key; *p; p++)
+    {
+      if (is_word_char (p[0]) &&
+	  (p == (const guchar *) key || !is_word_char (p[-1])))
+	{
+	  gram = GRAM (WORD_START, WORD_START, p[0]);
+	  g_array_append_val (out, gram);
+	  if (p[1])
+	    {
+	      gram = GRAM (WORD_START, p[0], p[1]);
+	      g_array_append_val (out, gram);
+	    }
+	}
+
+      if (p[1] && p[2])
+	{
+	  gram = GRAM (p[0], p[1], p[2]);
+	  g_array_append_val (out, gram);
+	}
+    }
+}
+
+static gboolean
+posting_seek (GArray *ids, guint id, guint *cursor)
+{
+  guint lo = *cursor, hi, step = 1, mid;
+
+  while (lo + step < ids->len && g_array_index (ids, guint, lo + step) < id)
+    {
+      lo += step;
+      step *= 2;
+    }
+
+  hi = MIN (lo + step, ids->len);
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (g_array_index (ids, guint, mid) < id)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  *cursor = lo;
+  return lo < ids->len && g_array_index (ids, guint, lo) == id;
+}
+
+static void
+add_item (const gchar *label, const gchar *host, const gchar *protocol)
+{
+  Item   *item;
+  GArray *item_grams, *ids;
+  gchar  *text;
+  guint   i;
+  guint32 gram;
+
+  item = g_slice_new0 (Item);
+  item->label = g_strdup (label);
+  item->host = g_strdup (host);
+  item->id = items->len;
+  text = g_strdup_printf ("%s %s %s", label, host, protocol);
+  item->key = g_utf8_strdown (text, -1);
+  item->collate_key = g_utf8_collate_key (label, -1);
+  item->usage = g_hash_table_lookup (usage, host);
+  g_free (text);
+  g_ptr_array_add (items, item);
+
+  item_grams = g_array_new (FALSE, FALSE, sizeof (guint32));
+  key_grams (item->key, item_grams);
+  for (i = 0; i < item_grams->len; i++)
+    {
+      gram = g_array_index (item_grams, guint32, i);
+      ids = g_hash_table_lookup (grams, GUINT_TO_POINTER (gram));
+      if (!ids)
+	{
+	  ids = g_array_new (FALSE, FALSE, sizeof (guint));
+	  g_hash_table_insert (grams, GUINT_TO_POINTER (gram), ids);
+	}
+      else if (g_array_index (ids, guint, ids->len - 1) == item->id)
+	continue;
+
+      g_array_append_val (ids, item->id);
+    }
+  g_array_free (item_grams, TRUE);
+}
+
+static void
+record_use (const gchar *host)
+{
+  Usage *u;
+  Item  *item;
+  guint  i;
+
+  u = g_hash_table_lookup (usage, host);
+  if (!u)
+    {
+      u = g_new0 (Usage, 1);
+      g_hash_table_insert (usage, g_strdup (host), u);
+      for (i = 0; i < items->len; i++)
+	{
+	  item = g_ptr_array_index (items, i);
+	  if (!strcmp (item->host, host))
+	    item->usage = u;
+	}
+    }
+  u->uses++;
+  u->last_used = ++clock_ticks;
+}
+
+static gdouble
+score (Item *item)
+{
+  Usage *u;
+
+  u = item->usage;
+  if (!u)
+    return 0;
+
+  return u->uses / (1.0 + (clock_ticks - u->last_used) / 16.0);
+}
+
+static gint
+compare (Item *a, gdouble score_a, Item *b, gdouble score_b)
+{
+  if (score_a != score_b)
+    return score_a > score_b ? -1 : 1;
+  return strcmp (a->collate_key, b->collate_key);
+}
+
+static guint
+query (const gchar *text)
+{
+  GPtrArray  *lists;
+  GArray     *shortest = NULL, *ids;
+  Item       *top[MAX_RESULTS], *item;
+  gdouble     scores[MAX_RESULTS], s;
+  gchar      *lower, **terms, **term;
+  guint      *cursors;
+  guint       i, j, n_top = 0, len;
+  gboolean    found = TRUE;
+
+  lists = g_ptr_array_new ();
+  lower = g_utf8_strdown (text, -1);
+  terms = g_strsplit_set (lower, " \t", -1);
+
+  for (term = terms; *term && found; term++)
+    {
+      len = strlen (*term);
+      if (len == 0)
+	continue;
+
+      if (len < 3)
+	{
+	  ids = g_hash_table_lookup (grams,
+				     GUINT_TO_POINTER (len == 1 ?
+						       GRAM (WORD_START, WORD_START, (*term)[0]) :
+						       GRAM (WORD_START, (*term)[0], (*term)[1])));
+	  found = ids != NULL;
+	  if (found)
+	    g_ptr_array_add (lists, ids);
+	  continue;
+	}
+
+      for (i = 0; i + 2 < len && found; i++)
+	{
+	  ids = g_hash_table_lookup (grams,
+				     GUINT_TO_POINTER (GRAM ((*term)[i], (*term)[i + 1], (*term)[i + 2])));
+	  found = ids != NULL;
+	  if (found)
+	    g_ptr_array_add (lists, ids);
+	}
+    }
+
+  if (!found || lists->len == 0)
+    goto out;
+
+  for (i = 0; i < lists->len; i++)
+    if (!shortest || ((GArray *) g_ptr_array_index (lists, i))->len < shortest->len)
+      shortest = g_ptr_array_index (lists, i);
+
+  cursors = g_new0 (guint, lists->len);
+  for (i = 0; i < shortest->len; i++)
+    {
+      item = g_ptr_array_index (items, g_array_index (shortest, guint, i));
+
+      for (j = 0; j < lists->len; j++)
+	if (g_ptr_array_index (lists, j) != shortest &&
+	    !posting_seek (g_ptr_array_index (lists, j), item->id, &cursors[j]))
+	  break;
+      if (j < lists->len)
+	continue;
+
+      for (term = terms; *term; term++)
+	if (strlen (*term) >= 3 && !strstr (item->key, *term))
+	  break;
+      if (*term)
+	continue;
+
+      s = score (item);
+      if (n_top == MAX_RESULTS &&
+	  compare (item, s, top[n_top - 1], scores[n_top - 1]) >= 0)
+	continue;
+
+      if (n_top < MAX_RESULTS)
+	n_top++;
+      for (j = n_top - 1;
+	   j > 0 && compare (item, s, top[j - 1], scores[j - 1]) < 0;
+	   j--)
+	{
+	  top[j] = top[j - 1];
+	  scores[j] = scores[j - 1];
+	}
+      top[j] = item;
+      scores[j] = s;
+    }
+  g_free (cursors);
+
+out:
+  g_ptr_array_free (lists, TRUE);
+  g_strfreev (terms);
+  g_free (lower);
+  return n_top;
+}
+
+static gchar *
+host_name (gint i)
+{
+  return g_strdup_printf ("10.%d.%d.%d:%d",
+			  (i >> 16) & 255, (i >> 8) & 255, i & 255,
+			  5900 + i % 100);
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar  *mix[] = { "h", "ho", "host", "host-01", "host-012345",
+			  "10.1", "10.1.2", "vnc host-0", "5901", "nomatch" };
+  const gchar **queries = mix;
+  gint          n_items = 100000, runs = 1000, n_queries = G_N_ELEMENTS (mix);
+  gint          i, q;
+  gint64        start, elapsed, total, worst;
+  gchar        *label, *host;
+  guint         found = 0;
+
+  if (argc > 1)
+    n_items = atoi (argv[1]);
+  if (argc > 2)
+    runs = atoi (argv[2]);
+  if (argc > 3)
+    {
+      queries = (const gchar **) argv + 3;
+      n_queries = argc - 3;
+    }
+  if (n_items <= 0 || runs <= 0)
+    {
+      g_printerr ("Usage: %s [ITEMS [RUNS [QUERY...]]]\n", argv[0]);
+      return 1;
+    }
+
+  items = g_ptr_array_new ();
+  grams = g_hash_table_new (g_direct_hash, g_direct_equal);
+  usage = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Uses first, as the saved ones are loaded before any host is indexed */
+  for (i = 0; i < n_items; i += 10)
+    {
+      host = host_name (i);
+      record_use (host);
+      g_free (host);
+    }
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_items; i++)
+    {
+      label = g_strdup_printf ("host-%06d", (gint) (((gint64) i * 7919) % n_items));
+      host = host_name (i);
+      add_item (label, host, "vnc");
+      g_free (label);
+      g_free (host);
+    }
+  printf ("indexed %d items in %.1f ms, %u trigrams\n",
+	  n_items,
+	  (g_get_monotonic_time () - start) / 1000.0,
+	  g_hash_table_size (grams));
+
+  for (q = 0; q < n_queries; q++)
+    {
+      total = worst = 0;
+      for (i = 0; i < runs; i++)
+	{
+	  start = g_get_monotonic_time ();
+	  found = query (queries[q]);
+	  elapsed = g_get_monotonic_time () - start;
+	  total += elapsed;
+	  worst = MAX (worst, elapsed);
+	}
+
+      printf ("%-14s %2u results  mean %7.3f ms  worst %7.3f ms\n",
+	      queries[q], found, total / 1000.0 / runs, worst / 1000.0);
+    }
+
+  return 0;
+}
+/* vim: set ts=8: */
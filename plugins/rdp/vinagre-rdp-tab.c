@@ -135,6 +135,46 @@ rdp_tab_get_tooltip (VinagreTab *tab)
 				  _("Port:"), vinagre_connection_get_port (conn));
 }
 
+static void
+rdp_tab_get_dimensions (VinagreTab *tab, int *w, int *h)
+{
+  VinagreRdpTabPrivate *priv = VINAGRE_RDP_TAB (tab)->priv;
+
+  if (priv->surface == NULL)
+    {
+      *w = *h = -1;
+      return;
+    }
+
+  *w = cairo_image_surface_get_width (priv->surface);
+  *h = cairo_image_surface_get_height (priv->surface);
+}
+
+static gboolean
+rdp_tab_get_regions (VinagreTab         *tab,
+                     const GdkRectangle *areas,
+                     gint                n_areas,
+                     GdkPixbuf         **regions)
+{
+  VinagreRdpTabPrivate *priv = VINAGRE_RDP_TAB (tab)->priv;
+  GdkRectangle          fb = { 0, }, clip;
+  gint                  i;
+
+  if (priv->surface == NULL)
+    return FALSE;
+
+  fb.width = cairo_image_surface_get_width (priv->surface);
+  fb.height = cairo_image_surface_get_height (priv->surface);
+  for (i = 0; i < n_areas; i++)
+    regions[i] = gdk_rectangle_intersect (&areas[i], &fb, &clip) ?
+                 gdk_pixbuf_get_from_surface (priv->surface,
+                                              clip.x, clip.y,
+                                              clip.width, clip.height) :
+                 NULL;
+
+  return TRUE;
+}
+
 static void
 free_frdpEvent (gpointer event,
                 G_GNUC_UNUSED gpointer user_data)
@@ -264,6 +304,8 @@ vinagre_rdp_tab_class_init (VinagreRdpTabClass *klass)
 
   tab_class->impl_get_tooltip = rdp_tab_get_tooltip;
   tab_class->impl_get_connected_actions = rdp_get_connected_actions;
+  tab_class->impl_get_dimensions = rdp_tab_get_dimensions;
+  tab_class->impl_get_regions = rdp_tab_get_regions;
 
   g_type_class_add_private (object_class, sizeof (VinagreRdpTabPrivate));
 }
@@ -493,6 +535,7 @@ frdp_end_paint (rdpContext *context)
   rdpGdi               *gdi = context->gdi;
   double                pos_x, pos_y;
   gint                  x, y, w, h;
+  GdkRectangle          area;
 
   if (gdi->primary->hdc->hwnd->invalid->null)
     return;
@@ -502,6 +545,12 @@ frdp_end_paint (rdpContext *context)
   w = gdi->primary->hdc->hwnd->invalid->w;
   h = gdi->primary->hdc->hwnd->invalid->h;
 
+  area.x = x;
+  area.y = y;
+  area.width = w;
+  area.height = h;
+  vinagre_tab_add_damage (VINAGRE_TAB (rdp_tab), &area);
+
   if (priv->scaling)
     {
       pos_x = priv->offset_x + x * priv->scale;
@@ -1143,6 +1192,10 @@ init_display (VinagreRdpTab *rdp_tab)
   priv->display = gtk_drawing_area_new ();
   if (priv->display)
     {
+      /* Before our own draw handler, which stops the emission */
+      vinagre_tab_add_view (VINAGRE_TAB (rdp_tab), priv->display);
+      vinagre_tab_set_has_screenshot (VINAGRE_TAB (rdp_tab), TRUE);
+
       g_signal_connect (priv->display, "draw",
                         G_CALLBACK (frdp_drawing_area_draw), rdp_tab);
 
@@ -1171,8 +1224,6 @@ init_display (VinagreRdpTab *rdp_tab)
 
       gtk_widget_show (priv->display);
 
-      vinagre_tab_add_view (VINAGRE_TAB (rdp_tab), priv->display);
-
       if (fullscreen)
         gtk_window_fullscreen (window);
 
@@ -34,6 +34,8 @@ struct _VinagreSpiceConnectionPrivate
   gboolean scaling;
   gboolean resize_guest;
   gboolean auto_clipboard;
+  gint	   image_compression;
+  gint	   video_codec;
   gint	   fd;
   gchar	   *ssh_tunnel_host;
   GSocket  *socket;
@@ -47,6 +49,8 @@ enum
   PROP_SCALING,
   PROP_RESIZE_GUEST,
   PROP_AUTO_CLIPBOARD,
+  PROP_IMAGE_COMPRESSION,
+  PROP_VIDEO_CODEC,
   PROP_FD,
   PROP_SSH_TUNNEL_HOST,
   PROP_SOCKET
@@ -65,6 +69,8 @@ vinagre_spice_connection_init (VinagreSpiceConnection *conn)
   conn->priv->scaling = FALSE;
   conn->priv->resize_guest = TRUE;
   conn->priv->auto_clipboard = TRUE;
+  conn->priv->image_compression = 0;
+  conn->priv->video_codec = 0;
   conn->priv->fd = 0;
   conn->priv->ssh_tunnel_host = NULL;
   conn->priv->socket = NULL;
@@ -132,6 +138,14 @@ vinagre_spice_connection_set_property (GObject *object, guint prop_id, const GVa
       vinagre_spice_connection_set_auto_clipboard (conn, g_value_get_boolean (value));
       break;
 
+    case PROP_IMAGE_COMPRESSION:
+      vinagre_spice_connection_set_image_compression (conn, g_value_get_int (value));
+      break;
+
+    case PROP_VIDEO_CODEC:
+      vinagre_spice_connection_set_video_codec (conn, g_value_get_int (value));
+      break;
+
     case PROP_SSH_TUNNEL_HOST:
       vinagre_spice_connection_set_ssh_tunnel_host (conn, g_value_get_string (value));
       break;
@@ -181,6 +195,14 @@ vinagre_spice_connection_get_property (GObject *object, guint prop_id, GValue *v
       g_value_set_boolean (value, conn->priv->auto_clipboard);
       break;
 
+    case PROP_IMAGE_COMPRESSION:
+      g_value_set_int (value, conn->priv->image_compression);
+      break;
+
+    case PROP_VIDEO_CODEC:
+      g_value_set_int (value, conn->priv->video_codec);
+      break;
+
     case PROP_SSH_TUNNEL_HOST:
       g_value_set_string (value, conn->priv->ssh_tunnel_host);
       break;
@@ -209,6 +231,8 @@ spice_fill_writer (VinagreConnection *conn, xmlTextWriter *writer)
   xmlTextWriterWriteFormatElement (writer, BAD_CAST "scaling", "%d", spice_conn->priv->scaling);
   xmlTextWriterWriteFormatElement (writer, BAD_CAST "resize_guest", "%d", spice_conn->priv->resize_guest);
   xmlTextWriterWriteFormatElement (writer, BAD_CAST "auto_clipboard", "%d", spice_conn->priv->auto_clipboard);
+  xmlTextWriterWriteFormatElement (writer, BAD_CAST "image_compression", "%d", spice_conn->priv->image_compression);
+  xmlTextWriterWriteFormatElement (writer, BAD_CAST "video_codec", "%d", spice_conn->priv->video_codec);
 
   if (spice_conn->priv->ssh_tunnel_host && *spice_conn->priv->ssh_tunnel_host)
     xmlTextWriterWriteFormatElement (writer, BAD_CAST "ssh_tunnel_host", "%s", spice_conn->priv->ssh_tunnel_host);
@@ -243,6 +267,14 @@ spice_parse_item (VinagreConnection *conn, xmlNode *root)
 	{
 	  vinagre_spice_connection_set_auto_clipboard (spice_conn, vinagre_utils_parse_boolean ((const gchar *)s_value));
 	}
+      else if (!xmlStrcmp(curr->name, BAD_CAST "image_compression"))
+	{
+	  vinagre_spice_connection_set_image_compression (spice_conn, atoi ((const char *)s_value));
+	}
+      else if (!xmlStrcmp(curr->name, BAD_CAST "video_codec"))
+	{
+	  vinagre_spice_connection_set_video_codec (spice_conn, atoi ((const char *)s_value));
+	}
       else if (!xmlStrcmp(curr->name, BAD_CAST "ssh_tunnel_host"))
 	{
 	  vinagre_spice_connection_set_ssh_tunnel_host (spice_conn, (const gchar *)s_value);
@@ -273,13 +305,18 @@ static void
 spice_parse_options_widget (VinagreConnection *conn, GtkWidget *widget)
 {
   GtkWidget *view_only, *scaling, *ssh_host, *resize_guest, *auto_clipboard;
+  GtkWidget *compression_combo, *codec_combo;
+  gint       compression, codec;
 
   view_only = g_object_get_data (G_OBJECT (widget), "view_only");
   scaling = g_object_get_data (G_OBJECT (widget), "scaling");
   resize_guest = g_object_get_data (G_OBJECT (widget), "resize_guest");
   auto_clipboard = g_object_get_data (G_OBJECT (widget), "auto_clipboard");
   ssh_host = g_object_get_data (G_OBJECT (widget), "ssh_host");
-  if (!view_only || !scaling || !ssh_host || !resize_guest || !auto_clipboard)
+  compression_combo = g_object_get_data (G_OBJECT (widget), "compression_combo");
+  codec_combo = g_object_get_data (G_OBJECT (widget), "codec_combo");
+  if (!view_only || !scaling || !ssh_host || !resize_guest || !auto_clipboard ||
+      !compression_combo || !codec_combo)
     {
       g_warning ("Wrong widget passed to spice_parse_options_widget()");
       return;
@@ -290,6 +327,12 @@ spice_parse_options_widget (VinagreConnection *conn, GtkWidget *widget)
   vinagre_cache_prefs_set_boolean ("spice-connection", "resize-guest", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (resize_guest)));
   vinagre_cache_prefs_set_boolean ("spice-connection", "auto-clipboard", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (auto_clipboard)));
   vinagre_cache_prefs_set_string  ("spice-connection", "ssh-tunnel-host", gtk_entry_get_text (GTK_ENTRY (ssh_host)));
+  /* Nothing selected (-1) means the server default, which is 0 */
+  compression = MAX (gtk_combo_box_get_active (GTK_COMBO_BOX (compression_combo)), 0);
+  codec = MAX (gtk_combo_box_get_active (GTK_COMBO_BOX (codec_combo)), 0);
+
+  vinagre_cache_prefs_set_integer ("spice-connection", "image-compression", compression);
+  vinagre_cache_prefs_set_integer ("spice-connection", "video-codec", codec);
 
   g_object_set (conn,
 		"resize-guest", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (resize_guest)),
@@ -297,6 +340,8 @@ spice_parse_options_widget (VinagreConnection *conn, GtkWidget *widget)
 		"view-only", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (view_only)),
 		"scaling", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (scaling)),
 		"ssh-tunnel-host", gtk_entry_get_text (GTK_ENTRY (ssh_host)),
+		"image-compression", compression,
+		"video-codec", codec,
 		NULL);
 }
 
@@ -368,6 +413,30 @@ vinagre_spice_connection_class_init (VinagreSpiceConnectionClass *klass)
 							 G_PARAM_CONSTRUCT |
 							 G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class,
+				   PROP_IMAGE_COMPRESSION,
+				   g_param_spec_int ("image-compression",
+						     "Image compression",
+						     "Preferred image compression: server default, GLZ, LZ4 or QUIC",
+						     0,
+						     VINAGRE_SPICE_IMAGE_COMPRESSION_QUIC,
+						     0,
+						     G_PARAM_READWRITE |
+						     G_PARAM_CONSTRUCT |
+						     G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+				   PROP_VIDEO_CODEC,
+				   g_param_spec_int ("video-codec",
+						     "Video codec",
+						     "Preferred codec for video streams: server default, MJPEG, VP8, VP9 or H.264",
+						     0,
+						     VINAGRE_SPICE_VIDEO_CODEC_H264,
+						     0,
+						     G_PARAM_READWRITE |
+						     G_PARAM_CONSTRUCT |
+						     G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class,
 				   PROP_FD,
 				   g_param_spec_int ("fd",
@@ -491,6 +560,42 @@ vinagre_spice_connection_get_auto_clipboard (VinagreSpiceConnection *conn)
   return conn->priv->auto_clipboard;
 }
 
+void
+vinagre_spice_connection_set_image_compression (VinagreSpiceConnection *conn,
+						gint                    value)
+{
+  g_return_if_fail (VINAGRE_IS_SPICE_CONNECTION (conn));
+  g_return_if_fail (value >= 0 && value <= VINAGRE_SPICE_IMAGE_COMPRESSION_QUIC);
+
+  conn->priv->image_compression = value;
+}
+
+gint
+vinagre_spice_connection_get_image_compression (VinagreSpiceConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_SPICE_CONNECTION (conn), 0);
+
+  return conn->priv->image_compression;
+}
+
+void
+vinagre_spice_connection_set_video_codec (VinagreSpiceConnection *conn,
+					  gint                    value)
+{
+  g_return_if_fail (VINAGRE_IS_SPICE_CONNECTION (conn));
+  g_return_if_fail (value >= 0 && value <= VINAGRE_SPICE_VIDEO_CODEC_H264);
+
+  conn->priv->video_codec = value;
+}
+
+gint
+vinagre_spice_connection_get_video_codec (VinagreSpiceConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_SPICE_CONNECTION (conn), 0);
+
+  return conn->priv->video_codec;
+}
+
 void
 vinagre_spice_connection_set_fd (VinagreSpiceConnection *conn,
 				 gint		         value)
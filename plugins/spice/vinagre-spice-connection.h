@@ -34,6 +34,24 @@ G_BEGIN_DECLS
 #define VINAGRE_IS_SPICE_CONNECTION_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), VINAGRE_TYPE_SPICE_CONNECTION))
 #define VINAGRE_SPICE_CONNECTION_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), VINAGRE_TYPE_SPICE_CONNECTION, VinagreSpiceConnectionClass))
 
+/* Stored in bookmarks, keep the values */
+typedef enum
+{
+  VINAGRE_SPICE_IMAGE_COMPRESSION_DEFAULT = 0,
+  VINAGRE_SPICE_IMAGE_COMPRESSION_GLZ,
+  VINAGRE_SPICE_IMAGE_COMPRESSION_LZ4,
+  VINAGRE_SPICE_IMAGE_COMPRESSION_QUIC
+} VinagreSpiceImageCompression;
+
+typedef enum
+{
+  VINAGRE_SPICE_VIDEO_CODEC_DEFAULT = 0,
+  VINAGRE_SPICE_VIDEO_CODEC_MJPEG,
+  VINAGRE_SPICE_VIDEO_CODEC_VP8,
+  VINAGRE_SPICE_VIDEO_CODEC_VP9,
+  VINAGRE_SPICE_VIDEO_CODEC_H264
+} VinagreSpiceVideoCodec;
+
 typedef struct _VinagreSpiceConnectionClass   VinagreSpiceConnectionClass;
 typedef struct _VinagreSpiceConnection        VinagreSpiceConnection;
 typedef struct _VinagreSpiceConnectionPrivate VinagreSpiceConnectionPrivate;
@@ -86,6 +104,14 @@ gboolean	    vinagre_spice_connection_get_auto_clipboard (VinagreSpiceConnection
 void		    vinagre_spice_connection_set_auto_clipboard (VinagreSpiceConnection *conn,
 								 gboolean value);
 
+gint		    vinagre_spice_connection_get_image_compression (VinagreSpiceConnection *conn);
+void		    vinagre_spice_connection_set_image_compression (VinagreSpiceConnection *conn,
+								    gint value);
+
+gint		    vinagre_spice_connection_get_video_codec (VinagreSpiceConnection *conn);
+void		    vinagre_spice_connection_set_video_codec (VinagreSpiceConnection *conn,
+							      gint value);
+
 G_END_DECLS
 
 #endif /* __VINAGRE_SPICE_CONNECTION_H__  */
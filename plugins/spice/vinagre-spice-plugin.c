@@ -215,7 +215,7 @@ ssh_tunnel_check_toggled_cb (GtkToggleButton *button, GObject *box)
 static GtkWidget *
 impl_get_connect_widget (VinagreProtocol *plugin, VinagreConnection *conn)
 {
-  GtkWidget *box, *label, *check, *p_entry, *box2, *ssh_host_entry, *grid;
+  GtkWidget *box, *label, *check, *p_entry, *box2, *ssh_host_entry, *grid, *combo;
   gchar	    *str, *ssh_host;
   gboolean  has_conn = VINAGRE_IS_SPICE_CONNECTION (conn);
 
@@ -304,6 +304,45 @@ impl_get_connect_widget (VinagreProtocol *plugin, VinagreConnection *conn)
 
   gtk_grid_attach (GTK_GRID (grid), box2, 1, 3, 1, 1);
 
+  /* Image compression combo box */
+  box2 = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  label = gtk_label_new_with_mnemonic (_("_Image Compression:"));
+  gtk_misc_set_alignment (GTK_MISC (label), 0, 0.5);
+  gtk_box_pack_start (GTK_BOX (box2), GTK_WIDGET (label), FALSE, FALSE, 0);
+
+  combo = gtk_combo_box_text_new ();
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), _("Use Server Settings"));
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), "GLZ");
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), "LZ4");
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), "QUIC");
+  gtk_combo_box_set_active (GTK_COMBO_BOX (combo),
+			    has_conn ? vinagre_spice_connection_get_image_compression (VINAGRE_SPICE_CONNECTION (conn))
+			    : vinagre_cache_prefs_get_integer ("spice-connection", "image-compression", 0));
+  g_object_set_data (G_OBJECT (box), "compression_combo", combo);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+  gtk_box_pack_start (GTK_BOX (box2), GTK_WIDGET (combo), FALSE, FALSE, 0);
+  gtk_grid_attach (GTK_GRID (grid), box2, 1, 4, 1, 1);
+
+  /* Video codec combo box */
+  box2 = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  label = gtk_label_new_with_mnemonic (_("Video _Codec:"));
+  gtk_misc_set_alignment (GTK_MISC (label), 0, 0.5);
+  gtk_box_pack_start (GTK_BOX (box2), GTK_WIDGET (label), FALSE, FALSE, 0);
+
+  combo = gtk_combo_box_text_new ();
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), _("Use Server Settings"));
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), "MJPEG");
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), "VP8");
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), "VP9");
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), "H.264");
+  gtk_combo_box_set_active (GTK_COMBO_BOX (combo),
+			    has_conn ? vinagre_spice_connection_get_video_codec (VINAGRE_SPICE_CONNECTION (conn))
+			    : vinagre_cache_prefs_get_integer ("spice-connection", "video-codec", 0));
+  g_object_set_data (G_OBJECT (box), "codec_combo", combo);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+  gtk_box_pack_start (GTK_BOX (box2), GTK_WIDGET (combo), FALSE, FALSE, 0);
+  gtk_grid_attach (GTK_GRID (grid), box2, 1, 5, 1, 1);
+
   /* Password */
   box2 = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
 
@@ -22,16 +22,18 @@
 
 #include <config.h>
 #include <glib/gi18n.h>
+#include <spice-client-glib-2.0/spice-client.h>
 #include <spice-client-glib-2.0/spice-session.h>
 #include <spice-client-glib-2.0/spice-audio.h>
 #include <spice-client-gtk-3.0/spice-widget.h>
 #include <gdk/gdkkeysyms.h>
 
 #include <vinagre/vinagre-prefs.h>
+#include <vinagre/vinagre-debug.h>
+#include <vinagre/vinagre-tunnel.h>
 
 #include "vinagre-spice-tab.h"
 #include "vinagre-spice-connection.h"
-#include "vinagre-spice-tunnel.h"
 #include "vinagre-vala.h"
 
 #define VINAGRE_SPICE_TAB_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), VINAGRE_TYPE_SPICE_TAB, VinagreSpiceTabPrivate))
@@ -39,22 +41,58 @@
 /* From spice-protocol.h */
 #define SPICE_MAX_PASSWORD_LENGTH 60
 
+/* How often the bitrate shown in the tooltip is refreshed, in seconds */
+#define STATS_INTERVAL 2
+
+/* Times in a row a lost SSH tunnel is rebuilt before giving up */
+#define MAX_TUNNEL_RETRIES 3
+
+#ifdef SPICE_GTK_CHECK_VERSION
+#if SPICE_GTK_CHECK_VERSION(0, 35, 0)
+#define change_preferred_compression spice_display_channel_change_preferred_compression
+#define change_preferred_video_codec spice_display_channel_change_preferred_video_codec_type
+#define HAVE_PREFERRED_COMPRESSION 1
+#define HAVE_PREFERRED_VIDEO_CODEC 1
+#else
+#if SPICE_GTK_CHECK_VERSION(0, 31, 0)
+#define change_preferred_compression spice_display_change_preferred_compression
+#define HAVE_PREFERRED_COMPRESSION 1
+#endif
+#if SPICE_GTK_CHECK_VERSION(0, 34, 0)
+#define change_preferred_video_codec spice_display_change_preferred_video_codec_type
+#define HAVE_PREFERRED_VIDEO_CODEC 1
+#endif
+#endif
+#endif
+
 typedef struct _VinagreSpiceDisplay
 {
-  GtkWidget  *display;
+  GtkWidget    *display;
+  GtkWidget    *window; /* NULL for the display shown in the tab itself */
+  SpiceChannel *channel;
+  gint          id;
 } VinagreSpiceDisplay;
 
 struct _VinagreSpiceTabPrivate
 {
   SpiceSession *spice;
   SpiceAudio *audio;
-  GtkWidget  *display, *align;
+  GtkWidget  *display, *align; /* display is NULL while channel 0 is down */
+  gboolean   initialized;
   gboolean   mouse_grabbed;
   GSList     *connected_actions, *initialized_actions;
   GtkWidget  *viewonly_button, *scaling_button;
   GtkAction  *scaling_action, *viewonly_action, *original_size_action, *resize_guest_action, *auto_clipboard_action;
   gulong     signal_align;
-  VinagreSpiceDisplay *wins[4]; /* TODO: handle multi-display */
+  VinagreSpiceDisplay *wins[4];
+  VinagreTunnel *tunnel; /* Every channel connects through it */
+  GCancellable  *tunnel_cancellable;
+  guint      tunnel_retries;
+
+  /* Tooltip statistics */
+  guint      stats_timeout;
+  guint64    stats_bytes;
+  guint      stats_kbps;
 };
 
 G_DEFINE_TYPE (VinagreSpiceTab, vinagre_spice_tab, VINAGRE_TYPE_TAB)
@@ -67,6 +105,7 @@ enum
 
 static void open_spice (VinagreSpiceTab *spice_tab);
 static void setup_toolbar (VinagreSpiceTab *spice_tab);
+static void destroy_spice_display (VinagreSpiceTab *tab, VinagreSpiceDisplay *display);
 
 static void
 vinagre_spice_tab_get_property (GObject	   *object,
@@ -132,15 +171,194 @@ spice_get_initialized_actions (VinagreTab *tab)
   return spice_tab->priv->initialized_actions;
 }
 
+static const gchar *
+image_compression_name (gint compression)
+{
+  switch (compression)
+    {
+    case VINAGRE_SPICE_IMAGE_COMPRESSION_GLZ:
+      return "GLZ";
+    case VINAGRE_SPICE_IMAGE_COMPRESSION_LZ4:
+      return "LZ4";
+    case VINAGRE_SPICE_IMAGE_COMPRESSION_QUIC:
+      return "QUIC";
+    default:
+      return _("Server default");
+    }
+}
+
+static const gchar *
+video_codec_name (gint codec)
+{
+  switch (codec)
+    {
+    case VINAGRE_SPICE_VIDEO_CODEC_MJPEG:
+      return "MJPEG";
+    case VINAGRE_SPICE_VIDEO_CODEC_VP8:
+      return "VP8";
+    case VINAGRE_SPICE_VIDEO_CODEC_VP9:
+      return "VP9";
+    case VINAGRE_SPICE_VIDEO_CODEC_H264:
+      return "H.264";
+    default:
+      return _("Server default");
+    }
+}
+
 static gchar *
 spice_tab_get_tooltip (VinagreTab *tab)
 {
-  VinagreConnection *conn = vinagre_tab_get_conn (tab);
+  VinagreSpiceTab *spice_tab = VINAGRE_SPICE_TAB (tab);
+  VinagreSpiceConnection *conn = VINAGRE_SPICE_CONNECTION (vinagre_tab_get_conn (tab));
+  gchar *base, *stats, *result;
+
+  base = g_markup_printf_escaped ("<b>%s</b> %s\n\n"
+				  "<b>%s</b> %d\n",
+				  _("Host:"), vinagre_connection_get_host (VINAGRE_CONNECTION (conn)),
+				  _("Port:"), vinagre_connection_get_port (VINAGRE_CONNECTION (conn)));
+
+  if (!spice_tab->priv->stats_timeout)
+    return base;
+
+  /* The codec the server picked for a stream is not exposed by spice-gtk,
+   * show what was asked for instead */
+  stats = g_markup_printf_escaped ("<b>%s</b> %s\n"
+				   "<b>%s</b> %s\n"
+				   "<b>%s</b> %u kbit/s",
+				   _("Image compression:"),
+				   image_compression_name (vinagre_spice_connection_get_image_compression (conn)),
+				   _("Video codec:"),
+				   video_codec_name (vinagre_spice_connection_get_video_codec (conn)),
+				   _("Display bitrate:"),
+				   spice_tab->priv->stats_kbps);
+  result = g_strconcat (base, stats, NULL);
+
+  g_free (stats);
+  g_free (base);
+  return result;
+}
 
-  return  g_markup_printf_escaped ("<b>%s</b> %s\n\n"
-				   "<b>%s</b> %d\n",
-				   _("Host:"), vinagre_connection_get_host (conn),
-				   _("Port:"), vinagre_connection_get_port (conn));
+static void
+spice_tab_get_dimensions (VinagreTab *tab, int *w, int *h)
+{
+  VinagreSpiceTab *spice_tab = VINAGRE_SPICE_TAB (tab);
+
+  *w = *h = -1;
+  if (spice_tab->priv->wins[0])
+    g_object_get (spice_tab->priv->wins[0]->channel,
+		  "width", w,
+		  "height", h,
+		  NULL);
+}
+
+/* spice_display_get_pixbuf copies the whole framebuffer, do it only once */
+static gboolean
+spice_tab_get_regions (VinagreTab         *tab,
+		       const GdkRectangle *areas,
+		       gint                n_areas,
+		       GdkPixbuf         **regions)
+{
+  VinagreSpiceTab *spice_tab = VINAGRE_SPICE_TAB (tab);
+  GdkRectangle     fb = { 0, }, clip;
+  GdkPixbuf       *pix;
+  gint             i;
+
+  if (!spice_tab->priv->display)
+    return FALSE;
+
+  pix = spice_display_get_pixbuf (SPICE_DISPLAY (spice_tab->priv->display));
+  if (!pix)
+    return FALSE;
+
+  fb.width = gdk_pixbuf_get_width (pix);
+  fb.height = gdk_pixbuf_get_height (pix);
+  for (i = 0; i < n_areas; i++)
+    {
+      regions[i] = NULL;
+      if (gdk_rectangle_intersect (&areas[i], &fb, &clip))
+	{
+	  GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf (pix, clip.x, clip.y,
+						     clip.width, clip.height);
+	  regions[i] = gdk_pixbuf_copy (sub);
+	  g_object_unref (sub);
+	}
+    }
+
+  g_object_unref (pix);
+  return TRUE;
+}
+
+/* "total-read-bytes" is a gulong: read it through a GValue, which
+ * widens it, rather than into a guint64 that is wider on 32-bit */
+static guint64
+get_display_bytes (VinagreSpiceTab *spice_tab)
+{
+  GValue  bytes = { 0, };
+  guint64 total = 0;
+  guint   i;
+
+  g_value_init (&bytes, G_TYPE_UINT64);
+
+  for (i = 0; i < G_N_ELEMENTS (spice_tab->priv->wins); i++)
+    {
+      VinagreSpiceDisplay *d = spice_tab->priv->wins[i];
+
+      if (!d || !d->channel)
+	continue;
+
+      g_object_get_property (G_OBJECT (d->channel), "total-read-bytes", &bytes);
+      total += g_value_get_uint64 (&bytes);
+    }
+
+  g_value_unset (&bytes);
+  return total;
+}
+
+static gboolean
+update_stats (VinagreSpiceTab *spice_tab)
+{
+  guint64 bytes = get_display_bytes (spice_tab);
+  guint   kbps = spice_tab->priv->stats_kbps;
+
+  if (bytes >= spice_tab->priv->stats_bytes)
+    kbps = (bytes - spice_tab->priv->stats_bytes) * 8 / 1000 / STATS_INTERVAL;
+  spice_tab->priv->stats_bytes = bytes;
+
+  if (kbps != spice_tab->priv->stats_kbps)
+    {
+      spice_tab->priv->stats_kbps = kbps;
+      g_object_notify (G_OBJECT (spice_tab), "tooltip");
+    }
+
+  return TRUE;
+}
+
+static void
+start_stats (VinagreSpiceTab *spice_tab)
+{
+  /* Older spice-gtk do not count the bytes per channel */
+  if (spice_tab->priv->stats_timeout ||
+      !g_object_class_find_property (G_OBJECT_GET_CLASS (spice_tab->priv->wins[0]->channel),
+				     "total-read-bytes"))
+    return;
+
+  spice_tab->priv->stats_bytes = get_display_bytes (spice_tab);
+  spice_tab->priv->stats_kbps = 0;
+  spice_tab->priv->stats_timeout = g_timeout_add_seconds (STATS_INTERVAL,
+							  (GSourceFunc) update_stats,
+							  spice_tab);
+  g_object_notify (G_OBJECT (spice_tab), "tooltip");
+}
+
+static void
+stop_stats (VinagreSpiceTab *spice_tab)
+{
+  if (spice_tab->priv->stats_timeout)
+    {
+      g_source_remove (spice_tab->priv->stats_timeout);
+      spice_tab->priv->stats_timeout = 0;
+      g_object_notify (G_OBJECT (spice_tab), "tooltip");
+    }
 }
 
 static void
@@ -153,6 +371,14 @@ static void
 vinagre_spice_tab_dispose (GObject *object)
 {
   VinagreSpiceTab *spice_tab = VINAGRE_SPICE_TAB (object);
+  guint i;
+
+  /* Nobody cares about the tooltip any more */
+  if (spice_tab->priv->stats_timeout)
+    {
+      g_source_remove (spice_tab->priv->stats_timeout);
+      spice_tab->priv->stats_timeout = 0;
+    }
 
   if (spice_tab->priv->connected_actions)
     {
@@ -172,6 +398,13 @@ vinagre_spice_tab_dispose (GObject *object)
       spice_tab->priv->audio = NULL;
     }
 
+  if (spice_tab->priv->tunnel_cancellable)
+    {
+      g_cancellable_cancel (spice_tab->priv->tunnel_cancellable);
+      g_object_unref (spice_tab->priv->tunnel_cancellable);
+      spice_tab->priv->tunnel_cancellable = NULL;
+    }
+
   if (spice_tab->priv->spice)
     {
       spice_session_disconnect (spice_tab->priv->spice);
@@ -179,6 +412,22 @@ vinagre_spice_tab_dispose (GObject *object)
       spice_tab->priv->spice = NULL;
     }
 
+  if (spice_tab->priv->tunnel)
+    {
+      vinagre_tunnel_free (spice_tab->priv->tunnel);
+      spice_tab->priv->tunnel = NULL;
+    }
+
+  /* The extra windows are not our children, they would outlive the tab.
+   * The display in the tab goes away with it. */
+  spice_tab->priv->display = NULL;
+  for (i = 0; i < G_N_ELEMENTS (spice_tab->priv->wins); i++)
+    if (spice_tab->priv->wins[i])
+      {
+	destroy_spice_display (spice_tab, spice_tab->priv->wins[i]);
+	spice_tab->priv->wins[i] = NULL;
+      }
+
   G_OBJECT_CLASS (vinagre_spice_tab_parent_class)->dispose (object);
 }
 
@@ -208,6 +457,8 @@ vinagre_spice_tab_class_init (VinagreSpiceTabClass *klass)
   tab_class->impl_get_tooltip = spice_tab_get_tooltip;
   tab_class->impl_get_connected_actions = spice_get_connected_actions;
   tab_class->impl_get_initialized_actions = spice_get_initialized_actions;
+  tab_class->impl_get_dimensions = spice_tab_get_dimensions;
+  tab_class->impl_get_regions = spice_tab_get_regions;
 
   g_type_class_add_private (object_class, sizeof (VinagreSpiceTabPrivate));
 }
@@ -219,6 +470,104 @@ idle_close (VinagreTab *tab)
   return FALSE;
 }
 
+static void
+tunnel_ready_cb (GObject      *source,
+		 GAsyncResult *res,
+		 gpointer      user_data)
+{
+  VinagreSpiceTab *spice_tab = user_data;
+  VinagreConnection *conn;
+  GtkWindow  *window;
+  GError     *error = NULL;
+  gint	     fd = -1;
+
+  spice_tab->priv->tunnel = vinagre_tunnel_new_finish (res, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    goto out;
+
+  if (spice_tab->priv->tunnel)
+    fd = vinagre_tunnel_connect (spice_tab->priv->tunnel, &error);
+
+  conn = vinagre_tab_get_conn (VINAGRE_TAB (spice_tab));
+  window = GTK_WINDOW (vinagre_tab_get_window (VINAGRE_TAB (spice_tab)));
+  if (fd < 0)
+    {
+      vinagre_utils_show_error_dialog (_("Error creating the SSH tunnel"),
+				error ? error->message : _("Unknown reason"),
+				window);
+      g_idle_add ((GSourceFunc)idle_close, spice_tab);
+      goto out;
+    }
+
+  /* The other channels ask for their own stream in spice_channel_open_fd_cb() */
+  g_object_set (spice_tab->priv->spice,
+		"password", vinagre_connection_get_password (conn),
+		NULL);
+  if (!spice_session_open_fd (spice_tab->priv->spice, fd))
+    {
+      vinagre_utils_show_error_dialog (_("Error connecting to host."),
+				_("Unknown reason"),
+				window);
+      g_idle_add ((GSourceFunc)idle_close, spice_tab);
+    }
+
+ out:
+  g_clear_error (&error);
+  g_object_unref (spice_tab);
+}
+
+/* Carried on in tunnel_ready_cb, the login may take a while */
+static void
+open_tunnel (VinagreSpiceTab *spice_tab,
+	     const gchar     *host,
+	     const gchar     *port_str,
+	     const gchar     *ssh_tunnel_host)
+{
+  GtkWindow *window = GTK_WINDOW (vinagre_tab_get_window (VINAGRE_TAB (spice_tab)));
+
+  if (!spice_tab->priv->tunnel_cancellable)
+    spice_tab->priv->tunnel_cancellable = g_cancellable_new ();
+
+  vinagre_tunnel_new_async (window, host, port_str, ssh_tunnel_host,
+			    spice_tab->priv->tunnel_cancellable,
+			    tunnel_ready_cb, g_object_ref (spice_tab));
+}
+
+/* Only a lost gateway is worth a new login and reconnection, a session
+ * the server closed through a working tunnel ends the tab as usual */
+static gboolean
+reopen_tunnel (VinagreSpiceTab *spice_tab)
+{
+  gchar *host, *port_str, *ssh_tunnel_host;
+  gint  port;
+
+  if (!spice_tab->priv->tunnel ||
+      spice_tab->priv->tunnel_retries >= MAX_TUNNEL_RETRIES ||
+      vinagre_tunnel_is_alive (spice_tab->priv->tunnel))
+    return FALSE;
+
+  vinagre_debug_message (DEBUG_VIEW, "SSH tunnel lost, reopening it");
+  spice_tab->priv->tunnel_retries++;
+
+  spice_session_disconnect (spice_tab->priv->spice);
+  vinagre_tunnel_free (spice_tab->priv->tunnel);
+  spice_tab->priv->tunnel = NULL;
+
+  g_object_get (vinagre_tab_get_conn (VINAGRE_TAB (spice_tab)),
+		"port", &port,
+		"host", &host,
+		"ssh-tunnel-host", &ssh_tunnel_host,
+		NULL);
+  port_str = g_strdup_printf ("%d", port);
+
+  open_tunnel (spice_tab, host, port_str, ssh_tunnel_host);
+
+  g_free (port_str);
+  g_free (host);
+  g_free (ssh_tunnel_host);
+  return TRUE;
+}
+
 static void
 open_spice (VinagreSpiceTab *spice_tab)
 {
@@ -246,17 +595,13 @@ open_spice (VinagreSpiceTab *spice_tab)
 
   if (fd > 0)
     success = spice_session_open_fd (spice, fd);
+  else if (ssh_tunnel_host && *ssh_tunnel_host)
+    {
+      open_tunnel (spice_tab, host, port_str, ssh_tunnel_host);
+      goto out;
+    }
   else
     {
-      if (ssh_tunnel_host && *ssh_tunnel_host)
-	if (!vinagre_spice_tunnel_create (window, &host, &port_str, ssh_tunnel_host, &error))
-	  {
-	    success = FALSE;
-	    vinagre_utils_show_error_dialog (_("Error creating the SSH tunnel"),
-				      error ? error->message : _("Unknown reason"),
-				      window);
-	    goto out;
-	  }
       g_object_set (spice, "host", host, "port", port_str,
 		    "password", vinagre_connection_get_password (conn),
 		    NULL);
@@ -284,10 +629,13 @@ spice_main_channel_event_cb(SpiceChannel *channel, SpiceChannelEvent event,
 {
   switch (event) {
   case SPICE_CHANNEL_OPENED:
+    spice_tab->priv->tunnel_retries = 0;
     g_signal_emit_by_name (G_OBJECT (spice_tab), "tab-connected");
     break;
   case SPICE_CHANNEL_CLOSED:
-    g_signal_emit_by_name (G_OBJECT (spice_tab), "tab-disconnected");
+    stop_stats (spice_tab);
+    if (!reopen_tunnel (spice_tab))
+      g_signal_emit_by_name (G_OBJECT (spice_tab), "tab-disconnected");
     break;
   case SPICE_CHANNEL_ERROR_AUTH: {
     VinagreTab *tab = VINAGRE_TAB (spice_tab);
@@ -318,7 +666,15 @@ spice_main_channel_event_cb(SpiceChannel *channel, SpiceChannelEvent event,
     vinagre_tab_set_save_credentials (tab, save_in_keyring);
 
     g_object_set (spice_tab->priv->spice, "password", password, NULL);
-    spice_session_connect (spice_tab->priv->spice);
+    if (spice_tab->priv->tunnel)
+      {
+	gint fd = vinagre_tunnel_connect (spice_tab->priv->tunnel, NULL);
+
+	if (fd < 0 || !spice_session_open_fd (spice_tab->priv->spice, fd))
+	  g_signal_emit_by_name (G_OBJECT (spice_tab), "tab-disconnected");
+      }
+    else
+      spice_session_connect (spice_tab->priv->spice);
 
     out:
     g_free (password);
@@ -328,7 +684,9 @@ spice_main_channel_event_cb(SpiceChannel *channel, SpiceChannelEvent event,
   case SPICE_CHANNEL_ERROR_TLS:
   case SPICE_CHANNEL_ERROR_LINK:
   case SPICE_CHANNEL_ERROR_CONNECT:
-    g_signal_emit_by_name (G_OBJECT (spice_tab), "tab-disconnected");
+    stop_stats (spice_tab);
+    if (!reopen_tunnel (spice_tab))
+      g_signal_emit_by_name (G_OBJECT (spice_tab), "tab-disconnected");
     break;
   default:
     g_warning("unhandled main channel event: %d", event);
@@ -336,35 +694,227 @@ spice_main_channel_event_cb(SpiceChannel *channel, SpiceChannelEvent event,
   }
 }
 
+#ifdef HAVE_PREFERRED_COMPRESSION
+static gint
+to_spice_image_compression (gint compression)
+{
+  switch (compression)
+    {
+    case VINAGRE_SPICE_IMAGE_COMPRESSION_GLZ:
+      return SPICE_IMAGE_COMPRESSION_GLZ;
+    case VINAGRE_SPICE_IMAGE_COMPRESSION_LZ4:
+      return SPICE_IMAGE_COMPRESSION_LZ4;
+    case VINAGRE_SPICE_IMAGE_COMPRESSION_QUIC:
+      return SPICE_IMAGE_COMPRESSION_QUIC;
+    default:
+      return SPICE_IMAGE_COMPRESSION_INVALID;
+    }
+}
+#endif
+
+#ifdef HAVE_PREFERRED_VIDEO_CODEC
+static gint
+to_spice_video_codec (gint codec)
+{
+  switch (codec)
+    {
+    case VINAGRE_SPICE_VIDEO_CODEC_MJPEG:
+      return SPICE_VIDEO_CODEC_TYPE_MJPEG;
+    case VINAGRE_SPICE_VIDEO_CODEC_VP8:
+      return SPICE_VIDEO_CODEC_TYPE_VP8;
+    case VINAGRE_SPICE_VIDEO_CODEC_VP9:
+      return SPICE_VIDEO_CODEC_TYPE_VP9;
+    case VINAGRE_SPICE_VIDEO_CODEC_H264:
+      return SPICE_VIDEO_CODEC_TYPE_H264;
+    default:
+      return 0;
+    }
+}
+#endif
+
+/* The preferences can only be sent once the display channel is up */
+static void
+spice_display_channel_event_cb (SpiceChannel *channel, SpiceChannelEvent event,
+				VinagreSpiceTab *spice_tab)
+{
+  VinagreSpiceConnection *conn;
+  gint compression, codec;
+
+  if (event != SPICE_CHANNEL_OPENED)
+    return;
+
+  conn = VINAGRE_SPICE_CONNECTION (vinagre_tab_get_conn (VINAGRE_TAB (spice_tab)));
+  compression = vinagre_spice_connection_get_image_compression (conn);
+  codec = vinagre_spice_connection_get_video_codec (conn);
+
+#ifdef HAVE_PREFERRED_COMPRESSION
+  if (compression != VINAGRE_SPICE_IMAGE_COMPRESSION_DEFAULT)
+    change_preferred_compression (channel, to_spice_image_compression (compression));
+#else
+  if (compression != VINAGRE_SPICE_IMAGE_COMPRESSION_DEFAULT)
+    g_message ("Ignoring the image compression preference, it needs spice-gtk 0.31");
+#endif
+
+#ifdef HAVE_PREFERRED_VIDEO_CODEC
+  if (codec != VINAGRE_SPICE_VIDEO_CODEC_DEFAULT)
+    change_preferred_video_codec (channel, to_spice_video_codec (codec));
+#else
+  if (codec != VINAGRE_SPICE_VIDEO_CODEC_DEFAULT)
+    g_message ("Ignoring the video codec preference, it needs spice-gtk 0.34");
+#endif
+
+  if (spice_tab->priv->wins[0] && spice_tab->priv->wins[0]->channel == channel)
+    start_stats (spice_tab);
+}
+
 static void
 spice_mouse_grab_cb(GtkWidget *widget, gint grabbed, VinagreSpiceTab *spice_tab)
 {
   spice_tab->priv->mouse_grabbed = grabbed;
 }
 
+/* Keep the toggles of the View menu in sync with the connection */
+static void
+setup_spice_display (VinagreSpiceTab *spice_tab, GtkWidget *display)
+{
+  gboolean scaling, resize_guest, auto_clipboard;
+  VinagreConnection *conn = vinagre_tab_get_conn (VINAGRE_TAB (spice_tab));
+
+  g_signal_connect (display, "mouse-grab",
+		    G_CALLBACK (spice_mouse_grab_cb), spice_tab);
+
+  g_object_get (conn,
+		"resize-guest", &resize_guest,
+		"auto-clipboard", &auto_clipboard,
+		"scaling", &scaling,
+		NULL);
+
+  g_object_set (display,
+		"grab-keyboard", TRUE,
+		"grab-mouse", TRUE,
+		"resize-guest", resize_guest,
+		"auto-clipboard", auto_clipboard,
+		"scaling", scaling,
+		NULL);
+  /* TODO: add view-only here when spice-gtk ready */
+}
+
+/* Nothing is drawn for a minimized display, do not even keep its widget
+ * mapped so spice-gtk stops invalidating it on every update */
+static gboolean
+display_window_state_cb (GtkWidget           *window,
+			 GdkEventWindowState *event,
+			 VinagreSpiceDisplay *d)
+{
+  if (event->changed_mask & GDK_WINDOW_STATE_ICONIFIED)
+    gtk_widget_set_visible (d->display,
+			    !(event->new_window_state & GDK_WINDOW_STATE_ICONIFIED));
+
+  return FALSE;
+}
+
+/* The window lives as long as its display channel */
+static gboolean
+display_window_delete_cb (GtkWidget *window, GdkEvent *event, gpointer user_data)
+{
+  gtk_window_iconify (GTK_WINDOW (window));
+  return TRUE;
+}
+
+static GtkWidget *
+create_display_window (VinagreSpiceTab *spice_tab, VinagreSpiceDisplay *d)
+{
+  VinagreTab *tab = VINAGRE_TAB (spice_tab);
+  GtkWidget  *window, *scroll;
+  gchar      *name, *title;
+
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+
+  name = vinagre_connection_get_best_name (vinagre_tab_get_conn (tab));
+  /* Translators: %s is the name of a SPICE connection, %d the number of one of its monitors */
+  title = g_strdup_printf (_("%s - Display %d"), name, d->id + 1);
+  gtk_window_set_title (GTK_WINDOW (window), title);
+  g_free (title);
+  g_free (name);
+
+  gtk_window_set_default_size (GTK_WINDOW (window), 800, 600);
+  gtk_window_set_transient_for (GTK_WINDOW (window),
+				GTK_WINDOW (vinagre_tab_get_window (tab)));
+
+  scroll = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_add_with_viewport (GTK_SCROLLED_WINDOW (scroll), d->display);
+  gtk_container_add (GTK_CONTAINER (window), scroll);
+
+  g_signal_connect (window, "window-state-event",
+		    G_CALLBACK (display_window_state_cb), d);
+  g_signal_connect (window, "delete-event",
+		    G_CALLBACK (display_window_delete_cb), NULL);
+
+  return window;
+}
+
+static void
+spice_display_invalidate_cb (SpiceChannel    *channel,
+			     gint             x,
+			     gint             y,
+			     gint             width,
+			     gint             height,
+			     VinagreSpiceTab *spice_tab)
+{
+  GdkRectangle area = { x, y, width, height };
+
+  vinagre_tab_add_damage (VINAGRE_TAB (spice_tab), &area);
+}
+
 static VinagreSpiceDisplay *
-create_spice_display (VinagreSpiceTab *spice_tab, int id)
+create_spice_display (VinagreSpiceTab *spice_tab, SpiceChannel *channel, int id)
 {
   VinagreSpiceDisplay *d;
   GtkLabel *label;
   gchar	   *name;
-  gboolean scaling, resize_guest, view_only, fullscreen, auto_clipboard;
+  gboolean scaling, resize_guest, view_only, auto_clipboard;
   VinagreTab *tab = VINAGRE_TAB (spice_tab);
   VinagreConnection *conn = vinagre_tab_get_conn (tab);
 
   d = g_new0(VinagreSpiceDisplay, 1);
+  d->id = id;
+  d->channel = channel;
+
+  g_signal_connect (channel, "channel-event",
+		    G_CALLBACK (spice_display_channel_event_cb), spice_tab);
 
   /* Create the display widget */
-  spice_tab->priv->display = d->display = GTK_WIDGET (spice_display_new (spice_tab->priv->spice, id));
+  d->display = GTK_WIDGET (spice_display_new (spice_tab->priv->spice, id));
+  setup_spice_display (spice_tab, d->display);
+
+  /* Further monitors of the guest get their own window */
+  if (id != 0)
+    {
+      d->window = create_display_window (spice_tab, d);
+      gtk_widget_show_all (d->window);
+      return d;
+    }
 
+  spice_tab->priv->display = d->display;
   vinagre_tab_add_view (tab, d->display);
+  g_signal_connect (channel, "display-invalidate",
+		    G_CALLBACK (spice_display_invalidate_cb), spice_tab);
   vinagre_tab_set_has_screenshot (tab, TRUE);
 
-  g_signal_connect (spice_tab->priv->display, "mouse-grab",
-		    G_CALLBACK (spice_mouse_grab_cb), spice_tab);
+  /* Back after a reconnection: keep what the View menu says */
+  if (spice_tab->priv->initialized)
+    {
+      g_object_set (d->display,
+		    "scaling", gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (spice_tab->priv->scaling_action)),
+		    "resize-guest", gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (spice_tab->priv->resize_guest_action)),
+		    "auto-clipboard", gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (spice_tab->priv->auto_clipboard_action)),
+		    NULL);
+      gtk_widget_show_all (GTK_WIDGET (tab));
+      return d;
+    }
+  spice_tab->priv->initialized = TRUE;
 
   g_object_get (conn,
-		"fullscreen", &fullscreen,
 		"resize-guest", &resize_guest,
 		"auto-clipboard", &auto_clipboard,
 		"scaling", &scaling,
@@ -375,14 +925,6 @@ create_spice_display (VinagreSpiceTab *spice_tab, int id)
   gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (spice_tab->priv->resize_guest_action), resize_guest);
   gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (spice_tab->priv->auto_clipboard_action), auto_clipboard);
   gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (spice_tab->priv->viewonly_action), view_only);
-  g_object_set (d->display,
-		"grab-keyboard", TRUE,
-		"grab-mouse", TRUE,
-		"resize-guest", resize_guest,
-		"auto-clipboard", auto_clipboard,
-		"scaling", scaling,
-		NULL);
-  /* TODO: add view-only here when spice-gtk ready */
 
   g_object_get (spice_tab->priv->spice, "uri", &name, NULL); /* TODO: a better friendly name? */
   vinagre_spice_connection_set_desktop_name (VINAGRE_SPICE_CONNECTION (conn), name);
@@ -408,6 +950,44 @@ create_spice_display (VinagreSpiceTab *spice_tab, int id)
 static void
 destroy_spice_display (VinagreSpiceTab *tab, VinagreSpiceDisplay *display)
 {
+  if (display->window)
+    gtk_widget_destroy (display->window);
+
+  /* Channel 0 may come back after a reconnection, make room for it */
+  if (tab->priv->display && tab->priv->display == display->display)
+    {
+      vinagre_tab_set_has_screenshot (VINAGRE_TAB (tab), FALSE);
+      vinagre_tab_remove_view (VINAGRE_TAB (tab));
+      tab->priv->display = NULL;
+    }
+
+  g_signal_handlers_disconnect_by_func (display->channel,
+					spice_display_channel_event_cb,
+					tab);
+  g_signal_handlers_disconnect_by_func (display->channel,
+					spice_display_invalidate_cb,
+					tab);
+  if (tab->priv->wins[0] == display)
+    stop_stats (tab);
+
+  g_free (display);
+}
+
+static void
+spice_channel_open_fd_cb (SpiceChannel *channel, gint with_tls, VinagreSpiceTab *tab)
+{
+  GError *error = NULL;
+  gint fd;
+
+  fd = vinagre_tunnel_connect (tab->priv->tunnel, &error);
+  if (fd < 0)
+    {
+      g_warning (_("Error connecting to host through the SSH tunnel: %s"), error->message);
+      g_error_free (error);
+      return;
+    }
+
+  spice_channel_open_fd (channel, fd);
 }
 
 static void
@@ -418,6 +998,10 @@ spice_channel_new_cb (SpiceSession *s, SpiceChannel *channel, VinagreSpiceTab *t
   g_object_get (channel, "channel-id", &id, NULL);
   g_object_ref (tab);
 
+  if (tab->priv->tunnel)
+    g_signal_connect (channel, "open-fd",
+		      G_CALLBACK (spice_channel_open_fd_cb), tab);
+
   if (SPICE_IS_MAIN_CHANNEL (channel)) {
     g_signal_connect (channel, "channel-event",
 		      G_CALLBACK (spice_main_channel_event_cb), tab);
@@ -428,7 +1012,7 @@ spice_channel_new_cb (SpiceSession *s, SpiceChannel *channel, VinagreSpiceTab *t
       return;
     if (tab->priv->wins[id] != NULL)
       return;
-    tab->priv->wins[id] = create_spice_display (tab, id);
+    tab->priv->wins[id] = create_spice_display (tab, channel, id);
   }
 
   if (SPICE_IS_PLAYBACK_CHANNEL (channel) ||
@@ -632,6 +1216,20 @@ vinagre_spice_tab_init (VinagreSpiceTab *spice_tab)
 		   G_CALLBACK(spice_channel_destroy_cb), spice_tab);
 }
 
+/* Settings of the View menu apply to every monitor of the guest */
+static void
+set_display_property (VinagreSpiceTab *tab, const gchar *name, gboolean value)
+{
+  guint i;
+
+  if (tab->priv->display)
+    g_object_set (tab->priv->display, name, value, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (tab->priv->wins); i++)
+    if (tab->priv->wins[i] && tab->priv->wins[i]->window)
+      g_object_set (tab->priv->wins[i]->display, name, value, NULL);
+}
+
 GtkWidget *
 vinagre_spice_tab_new (VinagreConnection *conn,
 		       VinagreWindow	 *window)
@@ -649,6 +1247,9 @@ vinagre_spice_tab_send_ctrlaltdel (VinagreSpiceTab *tab)
 
   g_return_if_fail (VINAGRE_IS_SPICE_TAB (tab));
 
+  if (!tab->priv->display)
+    return;
+
   spice_display_send_keys (SPICE_DISPLAY (tab->priv->display), keys, sizeof (keys) / sizeof (keys[0]), SPICE_DISPLAY_KEY_EVENT_CLICK);
 }
 
@@ -659,11 +1260,14 @@ vinagre_spice_tab_set_scaling (VinagreSpiceTab *tab, gboolean active)
 
   g_return_val_if_fail (VINAGRE_IS_SPICE_TAB (tab), FALSE);
 
-  g_object_get (tab->priv->display, "scaling", &scaling, NULL);
-  if (scaling == active)
-    return TRUE;
+  if (tab->priv->display)
+    {
+      g_object_get (tab->priv->display, "scaling", &scaling, NULL);
+      if (scaling == active)
+	return TRUE;
+    }
 
-  g_object_set (tab->priv->display, "scaling", active, NULL);
+  set_display_property (tab, "scaling", active);
 
   gtk_toggle_tool_button_set_active (GTK_TOGGLE_TOOL_BUTTON (tab->priv->scaling_button),
 				     active);
@@ -678,6 +1282,9 @@ vinagre_spice_tab_get_scaling (VinagreSpiceTab *tab)
 
   g_return_val_if_fail (VINAGRE_IS_SPICE_TAB (tab), FALSE);
 
+  if (!tab->priv->display)
+    return gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (tab->priv->scaling_action));
+
   g_object_get (tab->priv->display, "scaling", &scaling, NULL);
 
   return scaling;
@@ -713,7 +1320,7 @@ vinagre_spice_tab_set_resize_guest (VinagreSpiceTab *tab, gboolean active)
 {
   g_return_val_if_fail (VINAGRE_IS_SPICE_TAB (tab), FALSE);
 
-  g_object_set (tab->priv->display, "resize-guest", active, NULL);
+  set_display_property (tab, "resize-guest", active);
 
   return TRUE;
 }
@@ -725,6 +1332,9 @@ vinagre_spice_tab_get_resize_guest (VinagreSpiceTab *tab)
 
   g_return_val_if_fail (VINAGRE_IS_SPICE_TAB (tab), FALSE);
 
+  if (!tab->priv->display)
+    return gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (tab->priv->resize_guest_action));
+
   g_object_get (tab->priv->display, "resize-guest", &active, NULL);
 
   return active;
@@ -735,7 +1345,7 @@ vinagre_spice_tab_set_auto_clipboard (VinagreSpiceTab *tab, gboolean active)
 {
   g_return_if_fail (VINAGRE_IS_SPICE_TAB (tab));
 
-  g_object_set (tab->priv->display, "auto-clipboard", active, NULL);
+  set_display_property (tab, "auto-clipboard", active);
 }
 
 gboolean
@@ -745,6 +1355,9 @@ vinagre_spice_tab_get_auto_clipboard (VinagreSpiceTab *tab)
 
   g_return_val_if_fail (VINAGRE_IS_SPICE_TAB (tab), FALSE);
 
+  if (!tab->priv->display)
+    return gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (tab->priv->auto_clipboard_action));
+
   g_object_get (tab->priv->display, "auto-clipboard", &active, NULL);
 
   return active;
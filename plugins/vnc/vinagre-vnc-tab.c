@@ -20,24 +20,71 @@
  */
 
 #include <config.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <vncdisplay.h>
 #include <gdk/gdkkeysyms.h>
 
 #include <vinagre/vinagre-prefs.h>
+#include <vinagre/vinagre-debug.h>
+#include <vinagre/vinagre-tunnel.h>
 
 #include "vinagre-vnc-tab.h"
 #include "vinagre-vnc-connection.h"
-#include "vinagre-vnc-tunnel.h"
 #include "vinagre-vala.h"
 
 #define VINAGRE_VNC_TAB_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), VINAGRE_TYPE_VNC_TAB, VinagreVncTabPrivate))
 
+/* Local clipboard contents larger than this are only sent to the server
+ * once the remote desktop gets the focus, that is, when they may actually
+ * be pasted there */
+#define CLIPBOARD_DEFER_THRESHOLD	(64 * 1024)
+
+/* Seconds between two refreshes of the throughput and latency figures */
+#define STATS_INTERVAL		2
+/* An input event not followed by an update within this delay probably
+ * had no visible effect, do not count it as latency */
+#define STATS_MAX_LATENCY	(2 * G_USEC_PER_SEC)
+
+/* Seconds between two snapshots of the framebuffer kept in the cache,
+ * shown as a placeholder the next time we connect to the same host */
+#define FRAMEBUFFER_SAVE_INTERVAL	60
+
+/* Seconds between two copies of a changed framebuffer. Once the server
+ * is gone there is nothing left to copy, so the newest copy is what a
+ * disconnection leaves in the cache */
+#define FRAMEBUFFER_GRAB_INTERVAL	10
+
+/* Times in a row a lost SSH tunnel is rebuilt before giving up */
+#define MAX_TUNNEL_RETRIES	3
+
 struct _VinagreVncTabPrivate
 {
   GtkWidget  *vnc, *align;
   gboolean   pointer_grab;
-  gchar      *clipboard_str;
+  gchar      *clipboard_str, *clipboard_utf8, *pending_text;
+  guint      clipboard_serial;
+
+  /* Throughput and latency, in framebuffer pixels */
+  guint      stats_timeout_id;
+  gint64     stats_start, input_time, latency;
+  guint      stats_updates;
+  guint64    stats_pixels;
+  gdouble    updates_rate, pixels_rate;
+
+  gboolean   cache_framebuffer;
+  GdkPixbuf  *placeholder;
+  GdkPixbuf  *framebuffer_copy;	/* Not written to the cache yet */
+  gboolean   framebuffer_dirty;
+  guint      framebuffer_timeout_id, framebuffer_ticks;
+  VinagreTunnel *tunnel;
+  GCancellable  *tunnel_cancellable;
+  guint      tunnel_retries;
   GSList     *connected_actions, *initialized_actions;
   GtkWidget  *viewonly_button, *scaling_button;
   GtkAction  *scaling_action, *viewonly_action, *original_size_action, *keep_ratio_action, *ctrlaltdel_action;
@@ -56,6 +103,8 @@ enum
 
 static void open_vnc (VinagreVncTab *vnc_tab);
 static void setup_toolbar (VinagreVncTab *vnc_tab);
+static void stop_framebuffer_cache (VinagreVncTab *vnc_tab);
+static void release_framebuffer_pool (VinagreVncTab *vnc_tab);
 
 static void
 vinagre_vnc_tab_get_property (GObject    *object,
@@ -139,8 +188,9 @@ vnc_tab_get_tooltip (VinagreTab *tab)
 {
   VinagreVncTab *vnc_tab = VINAGRE_VNC_TAB (tab);
   VinagreConnection *conn = vinagre_tab_get_conn (tab);
+  gchar *tooltip, *throughput, *latency, *stats, *result;
 
-  return  g_markup_printf_escaped (
+  tooltip = g_markup_printf_escaped (
 				  "<b>%s</b> %s\n\n"
 				  "<b>%s</b> %s\n"
 				  "<b>%s</b> %d\n"
@@ -149,6 +199,32 @@ vnc_tab_get_tooltip (VinagreTab *tab)
 				  _("Host:"), vinagre_connection_get_host (conn),
 				  _("Port:"), vinagre_connection_get_port (conn),
 				  _("Dimensions:"), vnc_display_get_width (VNC_DISPLAY (vnc_tab->priv->vnc)), vnc_display_get_height (VNC_DISPLAY (vnc_tab->priv->vnc)));
+
+  if (vnc_tab->priv->stats_timeout_id == 0)
+    return tooltip;
+
+  /* Translators: updates of the remote screen per second, and millions of pixels per second */
+  throughput = g_strdup_printf (_("%.1f updates/s, %.2f Mpixels/s"),
+				vnc_tab->priv->updates_rate,
+				vnc_tab->priv->pixels_rate / 1000000);
+  if (vnc_tab->priv->latency > 0)
+    /* Translators: time between a key press or click and the next screen update */
+    latency = g_strdup_printf (_("%d ms"), (gint) (vnc_tab->priv->latency / 1000));
+  else
+    latency = g_strdup (_("Unknown"));
+
+  stats = g_markup_printf_escaped ("\n<b>%s</b> %s\n"
+				   "<b>%s</b> %s",
+				   _("Throughput:"), throughput,
+				   _("Latency:"), latency);
+  g_free (throughput);
+  g_free (latency);
+
+  result = g_strconcat (tooltip, stats, NULL);
+  g_free (tooltip);
+  g_free (stats);
+
+  return result;
 }
 
 static void
@@ -160,12 +236,52 @@ vnc_tab_get_dimensions (VinagreTab *tab, int *w, int *h)
   *h = vinagre_vnc_tab_get_original_height (vnc_tab);
 }
 
+/* vnc_display_get_pixbuf copies the whole framebuffer, do it only once */
+static gboolean
+vnc_tab_get_regions (VinagreTab         *tab,
+		     const GdkRectangle *areas,
+		     gint                n_areas,
+		     GdkPixbuf         **regions)
+{
+  VinagreVncTab *vnc_tab = VINAGRE_VNC_TAB (tab);
+  GdkRectangle   fb = { 0, }, clip;
+  GdkPixbuf     *pix;
+  gint           i;
+
+  pix = vnc_display_get_pixbuf (VNC_DISPLAY (vnc_tab->priv->vnc));
+  if (!pix)
+    return FALSE;
+
+  fb.width = gdk_pixbuf_get_width (pix);
+  fb.height = gdk_pixbuf_get_height (pix);
+  for (i = 0; i < n_areas; i++)
+    {
+      regions[i] = NULL;
+      if (gdk_rectangle_intersect (&areas[i], &fb, &clip))
+	{
+	  GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf (pix, clip.x, clip.y,
+						     clip.width, clip.height);
+	  regions[i] = gdk_pixbuf_copy (sub);
+	  g_object_unref (sub);
+	}
+    }
+
+  g_object_unref (pix);
+  return TRUE;
+}
+
 static void
 vinagre_vnc_tab_finalize (GObject *object)
 {
   VinagreVncTab *vnc_tab = VINAGRE_VNC_TAB (object);
 
   g_free (vnc_tab->priv->clipboard_str);
+  g_free (vnc_tab->priv->clipboard_utf8);
+  g_free (vnc_tab->priv->pending_text);
+  if (vnc_tab->priv->placeholder)
+    g_object_unref (vnc_tab->priv->placeholder);
+  if (vnc_tab->priv->framebuffer_copy)
+    g_object_unref (vnc_tab->priv->framebuffer_copy);
 
   G_OBJECT_CLASS (vinagre_vnc_tab_parent_class)->finalize (object);
 }
@@ -187,6 +303,15 @@ vinagre_vnc_tab_dispose (GObject *object)
       vnc_tab->priv->initialized_actions = NULL;
     }
 
+  if (vnc_tab->priv->stats_timeout_id != 0)
+    {
+      g_source_remove (vnc_tab->priv->stats_timeout_id);
+      vnc_tab->priv->stats_timeout_id = 0;
+    }
+
+  stop_framebuffer_cache (vnc_tab);
+  release_framebuffer_pool (vnc_tab);
+
   if (vnc_tab->priv->signal_clipboard != 0)
     {
       GtkClipboard  *cb = gtk_clipboard_get (GDK_SELECTION_CLIPBOARD);
@@ -196,6 +321,25 @@ vinagre_vnc_tab_dispose (GObject *object)
       vnc_tab->priv->signal_clipboard = 0;
     }
 
+  /* A clipboard request may still be on its way, holding a reference:
+   * make its answer look stale, the display is going away */
+  vnc_tab->priv->clipboard_serial++;
+  g_free (vnc_tab->priv->pending_text);
+  vnc_tab->priv->pending_text = NULL;
+
+  if (vnc_tab->priv->tunnel_cancellable)
+    {
+      g_cancellable_cancel (vnc_tab->priv->tunnel_cancellable);
+      g_object_unref (vnc_tab->priv->tunnel_cancellable);
+      vnc_tab->priv->tunnel_cancellable = NULL;
+    }
+
+  if (vnc_tab->priv->tunnel)
+    {
+      vinagre_tunnel_free (vnc_tab->priv->tunnel);
+      vnc_tab->priv->tunnel = NULL;
+    }
+
   G_OBJECT_CLASS (vinagre_vnc_tab_parent_class)->dispose (object);
 }
 
@@ -226,6 +370,7 @@ vinagre_vnc_tab_class_init (VinagreVncTabClass *klass)
   tab_class->impl_get_connected_actions = vnc_get_connected_actions;
   tab_class->impl_get_initialized_actions = vnc_get_initialized_actions;
   tab_class->impl_get_dimensions = vnc_tab_get_dimensions;
+  tab_class->impl_get_regions = vnc_tab_get_regions;
 
   g_object_class_install_property (object_class,
 				   PROP_ORIGINAL_WIDTH,
@@ -259,6 +404,380 @@ idle_close (VinagreTab *tab)
   return FALSE;
 }
 
+typedef struct
+{
+  GdkPixbuf *pix;
+  gchar     *path;
+} FramebufferJob;
+
+/* Shared by the tabs caching their framebuffer, freed with the last one */
+static GThreadPool *framebuffer_pool = NULL;
+static guint        framebuffer_pool_users = 0;
+
+static gchar *
+framebuffer_cache_path (VinagreVncTab *vnc_tab)
+{
+  VinagreConnection *conn = vinagre_tab_get_conn (VINAGRE_TAB (vnc_tab));
+  gchar *cache_dir, *prefix, *name, *path;
+
+  prefix = vinagre_connection_get_file_prefix (conn);
+  name = g_strconcat (prefix, ".png", NULL);
+  g_free (prefix);
+
+  cache_dir = vinagre_dirs_get_user_cache_dir ();
+  path = g_build_filename (cache_dir, "framebuffers", name, NULL);
+  g_free (cache_dir);
+  g_free (name);
+
+  return path;
+}
+
+static gboolean
+framebuffer_write_cb (const gchar *buf, gsize count, GError **error, gpointer fd)
+{
+  gssize written;
+
+  while (count > 0)
+    {
+      written = write (GPOINTER_TO_INT (fd), buf, count);
+      if (written < 0 && errno == EINTR)
+	continue;
+      if (written < 0)
+	{
+	  g_set_error_literal (error, G_FILE_ERROR,
+			       g_file_error_from_errno (errno),
+			       g_strerror (errno));
+	  return FALSE;
+	}
+      buf += written;
+      count -= written;
+    }
+
+  return TRUE;
+}
+
+static void
+framebuffer_worker (FramebufferJob *job, gpointer user_data)
+{
+  GError  *error = NULL;
+  gchar   *dir, *tmp;
+  gint     fd;
+  gboolean res;
+
+  dir = g_path_get_dirname (job->path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  /* Never leave a truncated image behind if we are interrupted. The
+   * desktop may show anything, only the user gets to read it back.
+   * Two tabs on the same host each get their own temporary file */
+  tmp = g_strconcat (job->path, ".XXXXXX", NULL);
+  fd = g_mkstemp_full (tmp, O_WRONLY, 0600);
+  if (fd < 0)
+    {
+      vinagre_debug_message (DEBUG_VIEW, "Could not cache the framebuffer: %s", g_strerror (errno));
+      goto out;
+    }
+
+  res = gdk_pixbuf_save_to_callback (job->pix, framebuffer_write_cb,
+				     GINT_TO_POINTER (fd), "png", &error, NULL);
+  if (close (fd) != 0 && res)
+    {
+      g_set_error_literal (&error, G_FILE_ERROR, g_file_error_from_errno (errno),
+			   g_strerror (errno));
+      res = FALSE;
+    }
+
+  if (res)
+    g_rename (tmp, job->path);
+  else
+    {
+      vinagre_debug_message (DEBUG_VIEW, "Could not cache the framebuffer: %s", error->message);
+      g_error_free (error);
+      g_unlink (tmp);
+    }
+
+out:
+  g_free (tmp);
+  g_free (job->path);
+  g_object_unref (job->pix);
+  g_slice_free (FramebufferJob, job);
+}
+
+/* Copies the framebuffer if it changed, while the server is still there */
+static void
+grab_framebuffer (VinagreVncTab *vnc_tab)
+{
+  GdkPixbuf *pix;
+
+  if (!vnc_tab->priv->framebuffer_dirty)
+    return;
+
+  pix = vnc_display_get_pixbuf (VNC_DISPLAY (vnc_tab->priv->vnc));
+  if (!pix)
+    return;
+
+  if (vnc_tab->priv->framebuffer_copy)
+    g_object_unref (vnc_tab->priv->framebuffer_copy);
+  vnc_tab->priv->framebuffer_copy = pix;
+  vnc_tab->priv->framebuffer_dirty = FALSE;
+}
+
+static void
+save_framebuffer (VinagreVncTab *vnc_tab)
+{
+  FramebufferJob *job;
+
+  if (!vnc_tab->priv->framebuffer_copy)
+    return;
+
+  job = g_slice_new (FramebufferJob);
+  job->pix = vnc_tab->priv->framebuffer_copy;
+  job->path = framebuffer_cache_path (vnc_tab);
+  vnc_tab->priv->framebuffer_copy = NULL;
+  g_thread_pool_push (framebuffer_pool, job, NULL);
+}
+
+static gboolean
+framebuffer_timeout_cb (VinagreVncTab *vnc_tab)
+{
+  grab_framebuffer (vnc_tab);
+  if (++vnc_tab->priv->framebuffer_ticks % (FRAMEBUFFER_SAVE_INTERVAL / FRAMEBUFFER_GRAB_INTERVAL) == 0)
+    save_framebuffer (vnc_tab);
+  return TRUE;
+}
+
+static void
+start_framebuffer_cache (VinagreVncTab *vnc_tab)
+{
+  if (!vnc_tab->priv->cache_framebuffer ||
+      vnc_tab->priv->framebuffer_timeout_id != 0)
+    return;
+
+  vnc_tab->priv->framebuffer_dirty = TRUE;
+  vnc_tab->priv->framebuffer_ticks = 0;
+  vnc_tab->priv->framebuffer_timeout_id = g_timeout_add_seconds (FRAMEBUFFER_GRAB_INTERVAL,
+								 (GSourceFunc) framebuffer_timeout_cb,
+								 vnc_tab);
+}
+
+/* Writes the last snapshot, then nothing until the next initialization.
+ * When the server closed the connection the framebuffer cannot be read
+ * any more, and the copy the timer took last is written instead */
+static void
+stop_framebuffer_cache (VinagreVncTab *vnc_tab)
+{
+  if (vnc_tab->priv->framebuffer_timeout_id == 0)
+    return;
+
+  g_source_remove (vnc_tab->priv->framebuffer_timeout_id);
+  vnc_tab->priv->framebuffer_timeout_id = 0;
+  grab_framebuffer (vnc_tab);
+  save_framebuffer (vnc_tab);
+}
+
+static void
+use_framebuffer_pool (VinagreVncTab *vnc_tab)
+{
+  if (vnc_tab->priv->cache_framebuffer)
+    return;
+
+  vnc_tab->priv->cache_framebuffer = TRUE;
+  if (framebuffer_pool_users++ == 0)
+    framebuffer_pool = g_thread_pool_new ((GFunc) framebuffer_worker, NULL, 1, FALSE, NULL);
+}
+
+static void
+release_framebuffer_pool (VinagreVncTab *vnc_tab)
+{
+  if (!vnc_tab->priv->cache_framebuffer)
+    return;
+
+  vnc_tab->priv->cache_framebuffer = FALSE;
+  if (--framebuffer_pool_users == 0)
+    {
+      /* Lets the snapshots still queued reach the disk */
+      g_thread_pool_free (framebuffer_pool, FALSE, TRUE);
+      framebuffer_pool = NULL;
+    }
+}
+
+static void
+placeholder_loaded_cb (GObject       *stream,
+		       GAsyncResult  *res,
+		       VinagreVncTab *vnc_tab)
+{
+  GdkPixbuf *pix;
+
+  pix = gdk_pixbuf_new_from_stream_finish (res, NULL);
+
+  /* Too late if the real desktop is already there */
+  if (pix && vinagre_tab_get_state (VINAGRE_TAB (vnc_tab)) != VINAGRE_TAB_STATE_CONNECTED)
+    {
+      if (vnc_tab->priv->placeholder)
+	g_object_unref (vnc_tab->priv->placeholder);
+      vnc_tab->priv->placeholder = pix;
+      gtk_widget_queue_draw (vnc_tab->priv->vnc);
+    }
+  else if (pix)
+    g_object_unref (pix);
+
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
+  g_object_unref (vnc_tab);
+}
+
+static void
+placeholder_opened_cb (GFile         *file,
+		       GAsyncResult  *res,
+		       VinagreVncTab *vnc_tab)
+{
+  GFileInputStream *stream;
+
+  stream = g_file_read_finish (file, res, NULL);
+  if (!stream)
+    {
+      g_object_unref (vnc_tab);
+      return;
+    }
+
+  /* Our reference goes along to placeholder_loaded_cb */
+  gdk_pixbuf_new_from_stream_async (G_INPUT_STREAM (stream),
+				    NULL,
+				    (GAsyncReadyCallback) placeholder_loaded_cb,
+				    vnc_tab);
+}
+
+static void
+load_placeholder (VinagreVncTab *vnc_tab)
+{
+  GFile *file;
+  gchar *path;
+
+  path = framebuffer_cache_path (vnc_tab);
+  file = g_file_new_for_path (path);
+  g_file_read_async (file,
+		     G_PRIORITY_DEFAULT,
+		     NULL,
+		     (GAsyncReadyCallback) placeholder_opened_cb,
+		     g_object_ref (vnc_tab));
+  g_object_unref (file);
+  g_free (path);
+}
+
+/* Shows the last known desktop, dimmed, until the server sends its own */
+static gboolean
+vnc_placeholder_draw_cb (GtkWidget *vnc, cairo_t *cr, VinagreVncTab *vnc_tab)
+{
+  GdkPixbuf *pix = vnc_tab->priv->placeholder;
+  gboolean   scaling;
+
+  if (!pix)
+    return FALSE;
+
+  g_object_get (vinagre_tab_get_conn (VINAGRE_TAB (vnc_tab)),
+		"scaling", &scaling,
+		NULL);
+
+  cairo_save (cr);
+  if (scaling)
+    cairo_scale (cr,
+		 (gdouble) gtk_widget_get_allocated_width (vnc) / gdk_pixbuf_get_width (pix),
+		 (gdouble) gtk_widget_get_allocated_height (vnc) / gdk_pixbuf_get_height (pix));
+  gdk_cairo_set_source_pixbuf (cr, pix, 0, 0);
+  cairo_paint (cr);
+  cairo_restore (cr);
+
+  cairo_set_source_rgba (cr, 0, 0, 0, 0.4);
+  cairo_paint (cr);
+
+  return TRUE;
+}
+
+static void
+tunnel_ready_cb (GObject      *source,
+		 GAsyncResult *res,
+		 gpointer      user_data)
+{
+  VinagreVncTab *vnc_tab = user_data;
+  GtkWindow     *window;
+  GError        *error = NULL;
+  gint          fd = -1;
+
+  vnc_tab->priv->tunnel = vinagre_tunnel_new_finish (res, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    goto out;
+
+  if (vnc_tab->priv->tunnel)
+    fd = vinagre_tunnel_connect (vnc_tab->priv->tunnel, &error);
+
+  window = GTK_WINDOW (vinagre_tab_get_window (VINAGRE_TAB (vnc_tab)));
+  if (fd < 0)
+    {
+      vinagre_utils_show_error_dialog (_("Error creating the SSH tunnel"),
+				error ? error->message : _("Unknown reason"),
+				window);
+      g_idle_add ((GSourceFunc)idle_close, vnc_tab);
+    }
+  /* The display owns the descriptor from now on */
+  else if (vnc_display_open_fd (VNC_DISPLAY (vnc_tab->priv->vnc), fd))
+    gtk_widget_grab_focus (vnc_tab->priv->vnc);
+  else
+    {
+      vinagre_utils_show_error_dialog (_("Error connecting to host."),
+				_("Unknown reason"),
+				window);
+      g_idle_add ((GSourceFunc)idle_close, vnc_tab);
+    }
+
+out:
+  g_clear_error (&error);
+  g_object_unref (vnc_tab);
+}
+
+/* Carried on in tunnel_ready_cb, the login may take a while */
+static void
+open_tunnel (VinagreVncTab *vnc_tab,
+	     const gchar   *host,
+	     const gchar   *port_str,
+	     const gchar   *ssh_tunnel_host)
+{
+  GtkWindow *window = GTK_WINDOW (vinagre_tab_get_window (VINAGRE_TAB (vnc_tab)));
+
+  if (!vnc_tab->priv->tunnel_cancellable)
+    vnc_tab->priv->tunnel_cancellable = g_cancellable_new ();
+
+  vinagre_tunnel_new_async (window, host, port_str, ssh_tunnel_host,
+			    vnc_tab->priv->tunnel_cancellable,
+			    tunnel_ready_cb, g_object_ref (vnc_tab));
+}
+
+/* The display lost its way through the tunnel, log in again and reconnect */
+static void
+reopen_tunnel (VinagreVncTab *vnc_tab)
+{
+  gchar *host, *port_str, *ssh_tunnel_host;
+  gint  port;
+
+  vinagre_debug_message (DEBUG_VIEW, "SSH tunnel lost, reopening it");
+
+  vinagre_tunnel_free (vnc_tab->priv->tunnel);
+  vnc_tab->priv->tunnel = NULL;
+
+  g_object_get (vinagre_tab_get_conn (VINAGRE_TAB (vnc_tab)),
+		"port", &port,
+		"host", &host,
+		"ssh-tunnel-host", &ssh_tunnel_host,
+		NULL);
+  port_str = g_strdup_printf ("%d", port);
+
+  open_tunnel (vnc_tab, host, port_str, ssh_tunnel_host);
+
+  g_free (port_str);
+  g_free (host);
+  g_free (ssh_tunnel_host);
+}
+
 static void
 open_vnc (VinagreVncTab *vnc_tab)
 {
@@ -284,6 +803,14 @@ open_vnc (VinagreVncTab *vnc_tab)
 		"ssh-tunnel-host", &ssh_tunnel_host,
 		NULL);
 
+  /* Off by default, the snapshots keep whatever the desktop showed */
+  if (g_settings_get_boolean (vinagre_prefs_get_default_gsettings (),
+			      "vnc-cache-framebuffer"))
+    {
+      use_framebuffer_pool (vnc_tab);
+      load_placeholder (vnc_tab);
+    }
+
   port_str = g_strdup_printf ("%d", port);
   if (shared == -1)
     g_object_get (vinagre_prefs_get_default (),
@@ -297,19 +824,13 @@ open_vnc (VinagreVncTab *vnc_tab)
 
   if (fd > 0)
     success = vnc_display_open_fd (vnc, fd);
-  else
+  else if (ssh_tunnel_host && *ssh_tunnel_host)
     {
-      if (ssh_tunnel_host && *ssh_tunnel_host)
-	if (!vinagre_vnc_tunnel_create (window, &host, &port_str, ssh_tunnel_host, &error))
-	  {
-	    success = FALSE;
-	    vinagre_utils_show_error_dialog (_("Error creating the SSH tunnel"),
-				      error ? error->message : _("Unknown reason"),
-				      window);
-	    goto out;
-	  }
-      success = vnc_display_open_host (vnc, host, port_str);
+      open_tunnel (vnc_tab, host, port_str, ssh_tunnel_host);
+      goto out;
     }
+  else
+    success = vnc_display_open_host (vnc, host, port_str);
 
   if (success)
     gtk_widget_grab_focus (GTK_WIDGET (vnc));
@@ -337,9 +858,149 @@ vnc_connected_cb (VncDisplay *vnc, VinagreVncTab *tab)
 static void
 vnc_disconnected_cb (VncDisplay *vnc, VinagreVncTab *tab)
 {
+  if (tab->priv->stats_timeout_id != 0)
+    {
+      g_source_remove (tab->priv->stats_timeout_id);
+      tab->priv->stats_timeout_id = 0;
+    }
+
+  stop_framebuffer_cache (tab);
+
+  /* Only a lost gateway gets a new login and another try, a session the
+   * server closed through a working tunnel ends the tab as usual */
+  if (tab->priv->tunnel &&
+      tab->priv->tunnel_retries < MAX_TUNNEL_RETRIES &&
+      !vinagre_tunnel_is_alive (tab->priv->tunnel))
+    {
+      tab->priv->tunnel_retries++;
+      reopen_tunnel (tab);
+      return;
+    }
+
   g_signal_emit_by_name (G_OBJECT (tab), "tab-disconnected");
 }
 
+static gboolean
+stats_timeout_cb (VinagreVncTab *vnc_tab)
+{
+  gint64  now = g_get_monotonic_time ();
+  gdouble elapsed = (gdouble) (now - vnc_tab->priv->stats_start) / G_USEC_PER_SEC;
+
+  vnc_tab->priv->updates_rate = vnc_tab->priv->stats_updates / elapsed;
+  vnc_tab->priv->pixels_rate = vnc_tab->priv->stats_pixels / elapsed;
+  vnc_tab->priv->stats_updates = 0;
+  vnc_tab->priv->stats_pixels = 0;
+  vnc_tab->priv->stats_start = now;
+
+  g_object_notify (G_OBJECT (vnc_tab), "tooltip");
+
+  return TRUE;
+}
+
+/* @area is in framebuffer coordinates, whatever the widget scaling */
+static void
+vnc_update_area (VinagreVncTab *vnc_tab, const GdkRectangle *area)
+{
+  vinagre_tab_add_damage (VINAGRE_TAB (vnc_tab), area);
+  vnc_tab->priv->framebuffer_dirty = TRUE;
+
+  if (vnc_tab->priv->stats_timeout_id != 0)
+    vnc_tab->priv->stats_pixels += (guint64) area->width * area->height;
+}
+
+static void
+vnc_update_done (VinagreVncTab *vnc_tab)
+{
+  gint64 sample;
+
+  if (vnc_tab->priv->stats_timeout_id == 0)
+    return;
+
+  vnc_tab->priv->stats_updates++;
+
+  if (vnc_tab->priv->input_time != 0)
+    {
+      sample = g_get_monotonic_time () - vnc_tab->priv->input_time;
+      if (sample < STATS_MAX_LATENCY)
+	vnc_tab->priv->latency = vnc_tab->priv->latency ?
+				 (vnc_tab->priv->latency * 7 + sample) / 8 :
+				 sample;
+      vnc_tab->priv->input_time = 0;
+    }
+}
+
+static void
+vnc_framebuffer_update_cb (VncDisplay    *vnc,
+			   gint           x,
+			   gint           y,
+			   gint           width,
+			   gint           height,
+			   VinagreVncTab *vnc_tab)
+{
+  GdkRectangle area = { x, y, width, height };
+
+  vnc_update_area (vnc_tab, &area);
+  vnc_update_done (vnc_tab);
+}
+
+/* Older gtk-vnc only tell about updates by redrawing them: map the
+ * redrawn area back to the framebuffer, scaled or centered in the widget */
+static gboolean
+vnc_damage_draw_cb (GtkWidget *vnc, cairo_t *cr, VinagreVncTab *vnc_tab)
+{
+  cairo_rectangle_list_t *rects;
+  GdkRectangle            fb = { 0, }, area;
+  gdouble                 sx = 1, sy = 1, mx = 0, my = 0;
+  gint                    ww, wh, i;
+
+  fb.width = vnc_display_get_width (VNC_DISPLAY (vnc));
+  fb.height = vnc_display_get_height (VNC_DISPLAY (vnc));
+  if (fb.width <= 0 || fb.height <= 0)
+    return FALSE;
+
+  ww = gtk_widget_get_allocated_width (vnc);
+  wh = gtk_widget_get_allocated_height (vnc);
+  if (vnc_display_get_scaling (VNC_DISPLAY (vnc)))
+    {
+      sx = (gdouble) fb.width / ww;
+      sy = (gdouble) fb.height / wh;
+    }
+  else
+    {
+      mx = MAX (0, (ww - fb.width) / 2);
+      my = MAX (0, (wh - fb.height) / 2);
+    }
+
+  rects = cairo_copy_clip_rectangle_list (cr);
+  if (rects->status == CAIRO_STATUS_SUCCESS)
+    for (i = 0; i < rects->num_rectangles; i++)
+      {
+	cairo_rectangle_t *r = &rects->rectangles[i];
+
+	area.x = floor ((r->x - mx) * sx);
+	area.y = floor ((r->y - my) * sy);
+	area.width = ceil ((r->x + r->width - mx) * sx) - area.x;
+	area.height = ceil ((r->y + r->height - my) * sy) - area.y;
+	if (gdk_rectangle_intersect (&area, &fb, &area))
+	  vnc_update_area (vnc_tab, &area);
+      }
+  else
+    vnc_update_area (vnc_tab, &fb);
+  cairo_rectangle_list_destroy (rects);
+  vnc_update_done (vnc_tab);
+
+  return FALSE;
+}
+
+static gboolean
+vnc_stats_input_cb (GtkWidget *vnc, GdkEvent *event, VinagreVncTab *vnc_tab)
+{
+  if (vnc_tab->priv->input_time == 0)
+    vnc_tab->priv->input_time = g_get_monotonic_time ();
+
+  return FALSE;
+}
+
 static void
 vnc_auth_failed_cb (VncDisplay *vnc, const gchar *msg, VinagreVncTab *vnc_tab)
 {
@@ -373,21 +1034,26 @@ vnc_auth_unsupported_cb (VncDisplay *vnc, guint auth_type, VinagreVncTab *vnc_ta
   vinagre_tab_remove_from_notebook (tab);
 }
 
-/* text was actually requested */
+/* text was actually requested, convert it now */
 static void
 copy_cb (GtkClipboard     *clipboard,
          GtkSelectionData *data,
 	 guint             info,
 	 VinagreVncTab    *vnc_tab)
 {
-  gtk_selection_data_set_text (data, vnc_tab->priv->clipboard_str, -1);
+  gsize a, b;
+
+  if (!vnc_tab->priv->clipboard_utf8)
+    vnc_tab->priv->clipboard_utf8 = g_convert (vnc_tab->priv->clipboard_str, -1, "utf-8", "iso8859-1", &a, &b, NULL);
+
+  if (vnc_tab->priv->clipboard_utf8)
+    gtk_selection_data_set_text (data, vnc_tab->priv->clipboard_utf8, -1);
 }
 
 static void
 vnc_server_cut_text_cb (VncDisplay *vnc, const gchar *text, VinagreVncTab *vnc_tab)
 {
   GtkClipboard *cb;
-  gsize a, b;
   GtkTargetEntry targets[] = {
 				{"UTF8_STRING", 0, 0},
 				{"COMPOUND_TEXT", 0, 0},
@@ -399,19 +1065,18 @@ vnc_server_cut_text_cb (VncDisplay *vnc, const gchar *text, VinagreVncTab *vnc_t
     return;
 
   g_free (vnc_tab->priv->clipboard_str);
-  vnc_tab->priv->clipboard_str = g_convert (text, -1, "utf-8", "iso8859-1", &a, &b, NULL);
+  g_free (vnc_tab->priv->clipboard_utf8);
+  vnc_tab->priv->clipboard_str = g_strdup (text);
+  vnc_tab->priv->clipboard_utf8 = NULL;
 
-  if (vnc_tab->priv->clipboard_str)
-    {
-      cb = gtk_clipboard_get (GDK_SELECTION_CLIPBOARD);
+  cb = gtk_clipboard_get (GDK_SELECTION_CLIPBOARD);
 
-      gtk_clipboard_set_with_owner (cb,
-				    targets,
-				    G_N_ELEMENTS(targets),
-				    (GtkClipboardGetFunc) copy_cb,
-				    NULL,
-				    G_OBJECT (vnc_tab));
-    }
+  gtk_clipboard_set_with_owner (cb,
+				targets,
+				G_N_ELEMENTS(targets),
+				(GtkClipboardGetFunc) copy_cb,
+				NULL,
+				G_OBJECT (vnc_tab));
 }
 
 static void
@@ -423,6 +1088,8 @@ vnc_initialized_cb (VncDisplay *vnc, VinagreVncTab *vnc_tab)
   VinagreTab *tab = VINAGRE_TAB (vnc_tab);
   VinagreConnection *conn = vinagre_tab_get_conn (tab);
 
+  vnc_tab->priv->tunnel_retries = 0;
+
   g_object_get (conn,
 		"view-only", &view_only,
 		"scaling", &scaling,
@@ -437,6 +1104,25 @@ vnc_initialized_cb (VncDisplay *vnc, VinagreVncTab *vnc_tab)
   vnc_display_set_keyboard_grab (vnc, TRUE);
   vnc_display_set_pointer_grab (vnc, TRUE);
 
+  if (vnc_tab->priv->placeholder)
+    {
+      g_object_unref (vnc_tab->priv->placeholder);
+      vnc_tab->priv->placeholder = NULL;
+    }
+  start_framebuffer_cache (vnc_tab);
+
+  if (vnc_tab->priv->stats_timeout_id == 0)
+    {
+      vnc_tab->priv->stats_start = g_get_monotonic_time ();
+      vnc_tab->priv->stats_updates = 0;
+      vnc_tab->priv->stats_pixels = 0;
+      vnc_tab->priv->input_time = 0;
+      vnc_tab->priv->latency = 0;
+      vnc_tab->priv->stats_timeout_id = g_timeout_add_seconds (STATS_INTERVAL,
+								 (GSourceFunc) stats_timeout_cb,
+								 vnc_tab);
+    }
+
   vinagre_vnc_connection_set_desktop_name (VINAGRE_VNC_CONNECTION (conn),
 					   vnc_display_get_name (vnc));
 
@@ -575,6 +1261,7 @@ static void
 vnc_bell_cb (VncDisplay *vnc, VinagreVncTab *vnc_tab)
 {
   gdk_window_beep (gtk_widget_get_window (GTK_WIDGET (vnc_tab)));
+  vinagre_tab_trigger_capture (VINAGRE_TAB (vnc_tab), VINAGRE_CAPTURE_TRIGGER_BELL);
 }
 
 static void
@@ -583,6 +1270,7 @@ vnc_desktop_resize_cb (VncDisplay *vnc, int x, int y, VinagreVncTab *tab)
   g_object_notify (G_OBJECT (tab), "original-width");
   g_object_notify (G_OBJECT (tab), "original-height");
   g_object_notify (G_OBJECT (tab), "tooltip");
+  vinagre_tab_trigger_capture (VINAGRE_TAB (tab), VINAGRE_CAPTURE_TRIGGER_RESIZE);
 }
 
 static GSList *
@@ -759,11 +1447,38 @@ setup_toolbar (VinagreVncTab *vnc_tab)
   gtk_toolbar_insert (GTK_TOOLBAR (toolbar), GTK_TOOL_ITEM (button), -1);
 }
 
+typedef struct
+{
+  VinagreVncTab *vnc_tab;
+  guint          serial;
+} ClipboardRequest;
+
+static void
+clipboard_text_received_cb (GtkClipboard     *cb,
+			    const gchar      *text,
+			    ClipboardRequest *request)
+{
+  VinagreVncTab *vnc_tab = request->vnc_tab;
+
+  /* Ignore the answer if the clipboard changed again in the meantime */
+  if (text && request->serial == vnc_tab->priv->clipboard_serial)
+    {
+      if (strlen (text) > CLIPBOARD_DEFER_THRESHOLD &&
+	  !gtk_widget_has_focus (vnc_tab->priv->vnc))
+	vnc_tab->priv->pending_text = g_strdup (text);
+      else
+	vinagre_vnc_tab_paste_text (vnc_tab, text);
+    }
+
+  g_object_unref (vnc_tab);
+  g_slice_free (ClipboardRequest, request);
+}
+
 static void
 vnc_tab_clipboard_cb (GtkClipboard *cb, GdkEvent *event, VinagreVncTab *vnc_tab)
 {
   VinagreTab *tab = VINAGRE_TAB (vnc_tab);
-  gchar *text;
+  ClipboardRequest *request;
 
   if (vinagre_notebook_get_active_tab (vinagre_tab_get_notebook (tab)) != tab)
     return;
@@ -771,12 +1486,29 @@ vnc_tab_clipboard_cb (GtkClipboard *cb, GdkEvent *event, VinagreVncTab *vnc_tab)
   if (VINAGRE_IS_TAB (gtk_clipboard_get_owner (cb)))
     return;
 
-  text = gtk_clipboard_wait_for_text (cb);
-  if (!text)
-    return;
+  vnc_tab->priv->clipboard_serial++;
+  g_free (vnc_tab->priv->pending_text);
+  vnc_tab->priv->pending_text = NULL;
 
-  vinagre_vnc_tab_paste_text (vnc_tab, text);
-  g_free (text);
+  request = g_slice_new (ClipboardRequest);
+  request->vnc_tab = g_object_ref (vnc_tab);
+  request->serial = vnc_tab->priv->clipboard_serial;
+  gtk_clipboard_request_text (cb,
+			      (GtkClipboardTextReceivedFunc) clipboard_text_received_cb,
+			      request);
+}
+
+static gboolean
+vnc_focus_in_cb (GtkWidget *vnc, GdkEvent *event, VinagreVncTab *vnc_tab)
+{
+  if (vnc_tab->priv->pending_text)
+    {
+      vinagre_vnc_tab_paste_text (vnc_tab, vnc_tab->priv->pending_text);
+      g_free (vnc_tab->priv->pending_text);
+      vnc_tab->priv->pending_text = NULL;
+    }
+
+  return FALSE;
 }
 
 static void
@@ -786,6 +1518,8 @@ vinagre_vnc_tab_init (VinagreVncTab *vnc_tab)
 
   vnc_tab->priv = VINAGRE_VNC_TAB_GET_PRIVATE (vnc_tab);
   vnc_tab->priv->clipboard_str = NULL;
+  vnc_tab->priv->clipboard_utf8 = NULL;
+  vnc_tab->priv->pending_text = NULL;
   vnc_tab->priv->connected_actions = create_connected_actions (vnc_tab);
   vnc_tab->priv->initialized_actions = create_initialized_actions (vnc_tab);
 
@@ -853,6 +1587,37 @@ vinagre_vnc_tab_init (VinagreVncTab *vnc_tab)
 		    G_CALLBACK (vnc_desktop_resize_cb),
 		    vnc_tab);
 
+  g_signal_connect (vnc_tab->priv->vnc,
+		    "focus-in-event",
+		    G_CALLBACK (vnc_focus_in_cb),
+		    vnc_tab);
+
+  if (g_signal_lookup ("vnc-framebuffer-update", VNC_TYPE_DISPLAY))
+    g_signal_connect (vnc_tab->priv->vnc,
+		      "vnc-framebuffer-update",
+		      G_CALLBACK (vnc_framebuffer_update_cb),
+		      vnc_tab);
+  else
+    g_signal_connect (vnc_tab->priv->vnc,
+		      "draw",
+		      G_CALLBACK (vnc_damage_draw_cb),
+		      vnc_tab);
+
+  g_signal_connect (vnc_tab->priv->vnc,
+		    "draw",
+		    G_CALLBACK (vnc_placeholder_draw_cb),
+		    vnc_tab);
+
+  g_signal_connect (vnc_tab->priv->vnc,
+		    "key-press-event",
+		    G_CALLBACK (vnc_stats_input_cb),
+		    vnc_tab);
+
+  g_signal_connect (vnc_tab->priv->vnc,
+		    "button-press-event",
+		    G_CALLBACK (vnc_stats_input_cb),
+		    vnc_tab);
+
   /* Setup the clipboard */
   cb = gtk_clipboard_get (GDK_SELECTION_CLIPBOARD);
   vnc_tab->priv->signal_clipboard =  g_signal_connect (cb,
@@ -18,7 +18,11 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#include <libxml/parser.h>
+
 #include "vinagre-bookmarks-entry.h"
+#include "vinagre-plugins-engine.h"
 
 struct _VinagreBookmarksEntryPrivate
 {
@@ -26,9 +30,23 @@ struct _VinagreBookmarksEntryPrivate
   VinagreConnection        *conn;
   gchar                    *name;
   GSList                   *children; // array of VinagreBookmarksEntry
+  gboolean                  children_sorted;
   VinagreBookmarksEntry    *parent;
+
+  /* Until the connection is created, for entries loaded from the cache */
+  gchar                    *protocol;
+  gchar                    *host;
+  gint                      port;
+  gchar                    *label;
+  gchar                    *item;
 };
 
+typedef struct
+{
+  VinagreBookmarksEntry *entry;
+  gchar                 *name;
+} SortItem;
+
 G_DEFINE_TYPE (VinagreBookmarksEntry, vinagre_bookmarks_entry, G_TYPE_OBJECT);
 
 static void
@@ -40,6 +58,7 @@ vinagre_bookmarks_entry_init (VinagreBookmarksEntry *entry)
   entry->priv->conn = NULL;
   entry->priv->name = NULL;
   entry->priv->children = NULL;
+  entry->priv->children_sorted = TRUE;
   entry->priv->parent = NULL;
 }
 
@@ -51,6 +70,11 @@ vinagre_bookmarks_entry_finalize (GObject *object)
   if (entry->priv->node == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
     g_free (entry->priv->name);
 
+  g_free (entry->priv->protocol);
+  g_free (entry->priv->host);
+  g_free (entry->priv->label);
+  g_free (entry->priv->item);
+
   G_OBJECT_CLASS (vinagre_bookmarks_entry_parent_class)->finalize (object);
 }
 
@@ -124,6 +148,78 @@ vinagre_bookmarks_entry_new_conn (VinagreConnection *conn)
 
 }
 
+/**
+ * vinagre_bookmarks_entry_new_conn_lazy:
+ * @protocol: The protocol of the connection
+ * @host: The host of the connection
+ * @port: The port of the connection
+ * @label: The best name of the connection
+ * @item: The <item> element describing the connection in the bookmarks file
+ *
+ * Creates a connection entry without creating the connection itself.
+ * It is parsed from @item by the protocol plugin the first time
+ * vinagre_bookmarks_entry_get_conn() is called.
+ *
+ * Return value: (transfer full):
+ */
+VinagreBookmarksEntry *
+vinagre_bookmarks_entry_new_conn_lazy (const gchar *protocol,
+				       const gchar *host,
+				       gint         port,
+				       const gchar *label,
+				       const gchar *item)
+{
+  VinagreBookmarksEntry *entry;
+
+  g_return_val_if_fail (protocol != NULL, NULL);
+  g_return_val_if_fail (host != NULL, NULL);
+  g_return_val_if_fail (item != NULL, NULL);
+
+  entry = VINAGRE_BOOKMARKS_ENTRY (g_object_new (VINAGRE_TYPE_BOOKMARKS_ENTRY, NULL));
+  vinagre_bookmarks_entry_set_node (entry, VINAGRE_BOOKMARKS_ENTRY_NODE_CONN);
+  entry->priv->protocol = g_strdup (protocol);
+  entry->priv->host = g_strdup (host);
+  entry->priv->port = port;
+  entry->priv->label = g_strdup (label ? label : host);
+  entry->priv->item = g_strdup (item);
+
+  return entry;
+}
+
+static void
+vinagre_bookmarks_entry_load_conn (VinagreBookmarksEntry *entry)
+{
+  VinagreProtocol *ext;
+  xmlDocPtr        doc;
+  xmlNodePtr       root;
+
+  ext = vinagre_plugins_engine_get_plugin_by_protocol (vinagre_plugins_engine_get_default (),
+						       entry->priv->protocol);
+  if (!ext)
+    return;
+
+  doc = xmlReadMemory (entry->priv->item,
+		       strlen (entry->priv->item),
+		       NULL,
+		       NULL,
+		       XML_PARSE_NOERROR);
+  if (!doc)
+    return;
+
+  root = xmlDocGetRootElement (doc);
+  if (root)
+    {
+      entry->priv->conn = vinagre_protocol_new_connection (ext);
+      vinagre_connection_parse_item (entry->priv->conn, root);
+
+      /* From now on the connection is the one to ask */
+      g_free (entry->priv->item);
+      entry->priv->item = NULL;
+    }
+
+  xmlFreeDoc (doc);
+}
+
 void
 vinagre_bookmarks_entry_set_node (VinagreBookmarksEntry *entry, VinagreBookmarksEntryNode node)
 {
@@ -175,6 +271,9 @@ vinagre_bookmarks_entry_set_conn (VinagreBookmarksEntry *entry, VinagreConnectio
     g_object_unref (entry->priv->conn);
 
   entry->priv->conn = g_object_ref (conn);
+
+  g_free (entry->priv->item);
+  entry->priv->item = NULL;
 }
 
 /**
@@ -188,9 +287,69 @@ vinagre_bookmarks_entry_get_conn (VinagreBookmarksEntry *entry)
 {
   g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), NULL);
 
+  if (!entry->priv->conn && entry->priv->item)
+    vinagre_bookmarks_entry_load_conn (entry);
+
   return entry->priv->conn;
 }
 
+/**
+ * vinagre_bookmarks_entry_get_item:
+ * @entry: A BookmarksEntry
+ *
+ * Return value: (allow-none) (transfer none): The <item> element this entry
+ * was loaded from, as long as its connection has not been created
+ */
+const gchar *
+vinagre_bookmarks_entry_get_item (VinagreBookmarksEntry *entry)
+{
+  g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), NULL);
+
+  return entry->priv->item;
+}
+
+/* The accessors below do not create the connection of lazy entries */
+
+const gchar *
+vinagre_bookmarks_entry_get_protocol (VinagreBookmarksEntry *entry)
+{
+  g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), NULL);
+
+  if (entry->priv->conn)
+    return vinagre_connection_get_protocol (entry->priv->conn);
+  return entry->priv->protocol;
+}
+
+const gchar *
+vinagre_bookmarks_entry_get_host (VinagreBookmarksEntry *entry)
+{
+  g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), NULL);
+
+  if (entry->priv->conn)
+    return vinagre_connection_get_host (entry->priv->conn);
+  return entry->priv->host;
+}
+
+gint
+vinagre_bookmarks_entry_get_port (VinagreBookmarksEntry *entry)
+{
+  g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), 0);
+
+  if (entry->priv->conn)
+    return vinagre_connection_get_port (entry->priv->conn);
+  return entry->priv->port;
+}
+
+gchar *
+vinagre_bookmarks_entry_get_best_name (VinagreBookmarksEntry *entry)
+{
+  g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), NULL);
+
+  if (entry->priv->conn)
+    return vinagre_connection_get_best_name (entry->priv->conn);
+  return g_strdup (entry->priv->label);
+}
+
 void
 vinagre_bookmarks_entry_set_name (VinagreBookmarksEntry *entry, const gchar *name)
 {
@@ -217,9 +376,9 @@ vinagre_bookmarks_entry_add_child (VinagreBookmarksEntry *entry, VinagreBookmark
   g_return_if_fail (entry->priv->node == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER);
   g_return_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (child));
 
-  entry->priv->children = g_slist_insert_sorted (entry->priv->children,
-						 child,
-						 (GCompareFunc)vinagre_bookmarks_entry_compare);
+  /* Sorted once, the next time someone asks for the children */
+  entry->priv->children = g_slist_prepend (entry->priv->children, child);
+  entry->priv->children_sorted = FALSE;
   child->priv->parent = entry;
 }
 
@@ -235,6 +394,7 @@ vinagre_bookmarks_entry_remove_child (VinagreBookmarksEntry *entry,
   if (g_slist_index (entry->priv->children, child) > -1)
     {
       entry->priv->children = g_slist_remove (entry->priv->children, child);
+      child->priv->parent = NULL;
       return TRUE;
     }
 
@@ -263,6 +423,12 @@ vinagre_bookmarks_entry_get_children (VinagreBookmarksEntry *entry)
 {
   g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), NULL);
 
+  if (!entry->priv->children_sorted)
+    {
+      entry->priv->children = vinagre_bookmarks_entry_sort (entry->priv->children);
+      entry->priv->children_sorted = TRUE;
+    }
+
   return entry->priv->children;
 }
 
@@ -292,8 +458,8 @@ vinagre_bookmarks_entry_compare (VinagreBookmarksEntry *a, VinagreBookmarksEntry
   if (a->priv->node == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
     return g_ascii_strcasecmp (a->priv->name, b->priv->name);
 
-  name_a = vinagre_connection_get_best_name (a->priv->conn);
-  name_b = vinagre_connection_get_best_name (b->priv->conn);
+  name_a = vinagre_bookmarks_entry_get_best_name (a);
+  name_b = vinagre_bookmarks_entry_get_best_name (b);
   result = g_ascii_strcasecmp (name_a, name_b);
   g_free (name_a);
   g_free (name_b);
@@ -301,4 +467,63 @@ vinagre_bookmarks_entry_compare (VinagreBookmarksEntry *a, VinagreBookmarksEntry
   return result;
 }
 
+static gint
+sort_item_compare (gconstpointer a,
+		   gconstpointer b,
+		   gpointer      user_data)
+{
+  const SortItem *item_a = a;
+  const SortItem *item_b = b;
+
+  if (item_a->entry->priv->node != item_b->entry->priv->node)
+    return item_a->entry->priv->node - item_b->entry->priv->node;
+
+  return g_ascii_strcasecmp (item_a->name, item_b->name);
+}
+
+/**
+ * vinagre_bookmarks_entry_sort:
+ * @list: (element-type VinagreBookmarksEntry): A list of entries
+ *
+ * Sorts @list in place, in the same order as vinagre_bookmarks_entry_compare().
+ * Names are computed once per entry instead of once per comparison, and
+ * entries which compare equal keep their relative order.
+ *
+ * Return value: (element-type VinagreBookmarksEntry) (transfer none): @list
+ */
+GSList *
+vinagre_bookmarks_entry_sort (GSList *list)
+{
+  SortItem *items;
+  GSList   *l;
+  guint     n, i;
+
+  n = g_slist_length (list);
+  if (n < 2)
+    return list;
+
+  items = g_new (SortItem, n);
+  for (l = list, i = 0; l; l = l->next, i++)
+    {
+      VinagreBookmarksEntry *entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
+
+      items[i].entry = entry;
+      if (entry->priv->node == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+	items[i].name = g_strdup (entry->priv->name);
+      else
+	items[i].name = vinagre_bookmarks_entry_get_best_name (entry);
+    }
+
+  g_qsort_with_data (items, n, sizeof (SortItem), sort_item_compare, NULL);
+
+  for (l = list, i = 0; l; l = l->next, i++)
+    {
+      l->data = items[i].entry;
+      g_free (items[i].name);
+    }
+  g_free (items);
+
+  return list;
+}
+
 /* vim: set ts=8: */
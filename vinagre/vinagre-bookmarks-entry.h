@@ -59,6 +59,11 @@ GType vinagre_bookmarks_entry_get_type (void) G_GNUC_CONST;
 
 VinagreBookmarksEntry *		vinagre_bookmarks_entry_new_folder  (const gchar *name);
 VinagreBookmarksEntry *		vinagre_bookmarks_entry_new_conn    (VinagreConnection *conn);
+VinagreBookmarksEntry *		vinagre_bookmarks_entry_new_conn_lazy (const gchar *protocol,
+								       const gchar *host,
+								       gint         port,
+								       const gchar *label,
+								       const gchar *item);
 
 void				vinagre_bookmarks_entry_add_child   (VinagreBookmarksEntry *entry, VinagreBookmarksEntry *child);
 gboolean			vinagre_bookmarks_entry_remove_child(VinagreBookmarksEntry *entry,
@@ -71,6 +76,12 @@ VinagreBookmarksEntryNode	vinagre_bookmarks_entry_get_node    (VinagreBookmarksE
 
 void				vinagre_bookmarks_entry_set_conn    (VinagreBookmarksEntry *entry, VinagreConnection *conn);
 VinagreConnection *		vinagre_bookmarks_entry_get_conn    (VinagreBookmarksEntry *entry);
+const gchar *			vinagre_bookmarks_entry_get_item    (VinagreBookmarksEntry *entry);
+
+const gchar *			vinagre_bookmarks_entry_get_protocol(VinagreBookmarksEntry *entry);
+const gchar *			vinagre_bookmarks_entry_get_host    (VinagreBookmarksEntry *entry);
+gint				vinagre_bookmarks_entry_get_port    (VinagreBookmarksEntry *entry);
+gchar *				vinagre_bookmarks_entry_get_best_name (VinagreBookmarksEntry *entry);
 
 void				vinagre_bookmarks_entry_set_name    (VinagreBookmarksEntry *entry, const gchar *name);
 const gchar *			vinagre_bookmarks_entry_get_name    (VinagreBookmarksEntry *entry);
@@ -79,6 +90,7 @@ const gchar *			vinagre_bookmarks_entry_get_name    (VinagreBookmarksEntry *entr
 VinagreBookmarksEntry *		vinagre_bookmarks_entry_get_parent  (VinagreBookmarksEntry *entry);
 
 gint				vinagre_bookmarks_entry_compare     (VinagreBookmarksEntry *a, VinagreBookmarksEntry *b);
+GSList *			vinagre_bookmarks_entry_sort        (GSList *list);
 G_END_DECLS
 
 #endif  /* __VINAGRE_BOOKMARKS_ENTRY_H__ */
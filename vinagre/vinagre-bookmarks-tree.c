@@ -29,6 +29,7 @@
 struct _VinagreBookmarksTreePrivate
 {
   GtkWidget *tree;
+  GdkPixbuf *pixbuf;
 };
 
 /* TreeModel */
@@ -70,30 +71,181 @@ vinagre_bookmarks_tree_row_activated_cb (GtkTreeView          *treeview,
     }
 }
 
+static gboolean
+folder_has_subfolders (VinagreBookmarksEntry *entry)
+{
+  GSList *l;
+
+  for (l = vinagre_bookmarks_entry_get_children (entry); l; l = l->next)
+    if (vinagre_bookmarks_entry_get_node (l->data) == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* Position of a folder among the rows of its parent */
+static gint
+folder_position (VinagreBookmarksEntry *entry)
+{
+  VinagreBookmarksEntry *parent;
+  GSList *l;
+  gint    i;
+
+  parent = vinagre_bookmarks_entry_get_parent (entry);
+  if (parent)
+    {
+      l = vinagre_bookmarks_entry_get_children (parent);
+      i = 0;
+    }
+  else
+    {
+      l = vinagre_bookmarks_get_all (vinagre_bookmarks_get_default ());
+      i = 1; /* after the Root Folder row */
+    }
+
+  for (; l; l = l->next)
+    {
+      if (l->data == entry)
+	return i;
+      if (vinagre_bookmarks_entry_get_node (l->data) == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+	i++;
+    }
+
+  return -1;
+}
+
 static void
-vinagre_bookmarks_fill_tree (GSList *entries, GtkTreeStore *store, GtkTreeIter *parent, GdkPixbuf *pixbuf)
+vinagre_bookmarks_tree_add_folder (VinagreBookmarksTree  *tree,
+				   GtkTreeIter           *parent,
+				   VinagreBookmarksEntry *entry,
+				   gint                   position,
+				   GtkTreeIter           *iter)
+{
+  GtkTreeStore *store;
+  GtkTreeIter   child;
+
+  store = GTK_TREE_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree)));
+
+  gtk_tree_store_insert (store, iter, parent, position);
+  gtk_tree_store_set (store, iter,
+                      IMAGE_COL, tree->priv->pixbuf,
+                      NAME_COL, vinagre_bookmarks_entry_get_name (entry),
+                      ENTRY_COL, entry,
+		      -1);
+
+  /* An empty row stands for the subfolders until this one is expanded */
+  if (folder_has_subfolders (entry))
+    gtk_tree_store_append (store, &child, iter);
+}
+
+static gboolean
+is_placeholder (GtkTreeModel *model,
+		GtkTreeIter  *iter)
+{
+  gchar    *name;
+  gboolean  result;
+
+  gtk_tree_model_get (model, iter, NAME_COL, &name, -1);
+  result = name == NULL;
+  g_free (name);
+
+  return result;
+}
+
+static void
+vinagre_bookmarks_fill_tree (VinagreBookmarksTree  *tree,
+			     GtkTreeIter           *parent,
+			     VinagreBookmarksEntry *entry)
+{
+  GtkTreeModel *model;
+  GtkTreeIter   iter;
+  GSList       *l;
+
+  model = gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree));
+  if (!gtk_tree_model_iter_children (model, &iter, parent) ||
+      !is_placeholder (model, &iter))
+    return;
+
+  gtk_tree_store_remove (GTK_TREE_STORE (model), &iter);
+
+  for (l = vinagre_bookmarks_entry_get_children (entry); l; l = l->next)
+    if (vinagre_bookmarks_entry_get_node (l->data) == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+      vinagre_bookmarks_tree_add_folder (tree, parent, l->data, -1, &iter);
+}
+
+static gboolean
+vinagre_bookmarks_tree_test_expand_row_cb (GtkTreeView          *treeview,
+					   GtkTreeIter          *iter,
+					   GtkTreePath          *path,
+					   VinagreBookmarksTree *tree)
 {
-  GSList                *l;
-  GtkTreeIter            iter;
   VinagreBookmarksEntry *entry;
 
-  for (l = entries; l; l = l->next)
+  gtk_tree_model_get (gtk_tree_view_get_model (treeview), iter, ENTRY_COL, &entry, -1);
+  if (entry)
+    {
+      vinagre_bookmarks_fill_tree (tree, iter, entry);
+      g_object_unref (entry);
+    }
+
+  return FALSE;
+}
+
+static gboolean
+find_child_row (GtkTreeModel          *model,
+		GtkTreeIter           *parent,
+		VinagreBookmarksEntry *entry,
+		GtkTreeIter           *iter)
+{
+  VinagreBookmarksEntry *e;
+  gboolean valid;
+
+  for (valid = gtk_tree_model_iter_children (model, iter, parent);
+       valid;
+       valid = gtk_tree_model_iter_next (model, iter))
+    {
+      gtk_tree_model_get (model, iter, ENTRY_COL, &e, -1);
+      if (e)
+	g_object_unref (e);
+      if (e == entry)
+	return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Finds the row of a folder by walking down from the top. With fill, the
+ * rows of its ancestors are created along the way; otherwise FALSE is
+ * returned if they were never expanded.
+ */
+static gboolean
+vinagre_bookmarks_tree_find_row (VinagreBookmarksTree  *tree,
+				 VinagreBookmarksEntry *entry,
+				 gboolean               fill,
+				 GtkTreeIter           *iter)
+{
+  GtkTreeModel          *model;
+  GtkTreeIter            parent;
+  GSList                *ancestors = NULL, *l;
+  VinagreBookmarksEntry *e;
+  gboolean               found = TRUE;
+
+  model = gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree));
+
+  for (e = entry; e; e = vinagre_bookmarks_entry_get_parent (e))
+    ancestors = g_slist_prepend (ancestors, e);
+
+  for (l = ancestors, e = NULL; l && found; e = l->data, l = l->next)
     {
-      entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
-      if (vinagre_bookmarks_entry_get_node (entry) != VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
-	continue;
-
-      gtk_tree_store_append (store, &iter, parent);
-      gtk_tree_store_set (store, &iter,
-                          IMAGE_COL, pixbuf,
-                          NAME_COL, vinagre_bookmarks_entry_get_name (entry),
-                          ENTRY_COL, entry,
-		          -1);
-      vinagre_bookmarks_fill_tree (vinagre_bookmarks_entry_get_children (entry),
-				   store,
-				   &iter,
-				   pixbuf);
+      if (e && fill)
+	vinagre_bookmarks_fill_tree (tree, &parent, e);
+      found = find_child_row (model, e ? &parent : NULL, l->data, iter);
+      parent = *iter;
     }
+
+  g_slist_free (ancestors);
+  return found;
 }
 
 static gboolean
@@ -101,37 +253,125 @@ vinagre_bookmarks_tree_update_list (VinagreBookmarksTree *tree)
 {
   GtkTreeStore     *model;
   GtkTreeIter       iter;
-  GdkPixbuf        *pixbuf;
-  GtkIconTheme     *icon_theme;
   GtkTreeSelection *selection;
-
-  icon_theme = gtk_icon_theme_get_default ();
-  pixbuf = gtk_icon_theme_load_icon  (icon_theme,
-                                      "folder",
-                                      16,
-                                      0,
-                                      NULL);
+  GSList           *l;
 
   model = GTK_TREE_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree)));
+  gtk_tree_store_clear (model);
 
   gtk_tree_store_append (model, &iter, NULL);
   gtk_tree_store_set (model, &iter,
-                      IMAGE_COL, pixbuf,
+                      IMAGE_COL, tree->priv->pixbuf,
                       NAME_COL, _("Root Folder"),
 		      -1);
 
-  vinagre_bookmarks_fill_tree (vinagre_bookmarks_get_all (vinagre_bookmarks_get_default ()),
-			       model,
-			       NULL,
-			       pixbuf);
-
   selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (tree->priv->tree));
   gtk_tree_selection_select_iter (selection, &iter);
 
-  g_object_unref (pixbuf);
+  for (l = vinagre_bookmarks_get_all (vinagre_bookmarks_get_default ()); l; l = l->next)
+    if (vinagre_bookmarks_entry_get_node (l->data) == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+      vinagre_bookmarks_tree_add_folder (tree, NULL, l->data, -1, &iter);
+
   return FALSE;
 }
 
+static void
+entry_added_cb (VinagreBookmarks      *book,
+		VinagreBookmarksEntry *entry,
+		VinagreBookmarksTree  *tree)
+{
+  GtkTreeModel          *model;
+  GtkTreeIter            parent, iter;
+  VinagreBookmarksEntry *parent_entry;
+
+  if (vinagre_bookmarks_entry_get_node (entry) != VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+    return;
+
+  model = gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree));
+  parent_entry = vinagre_bookmarks_entry_get_parent (entry);
+
+  if (!parent_entry)
+    {
+      vinagre_bookmarks_tree_add_folder (tree, NULL, entry, folder_position (entry), &iter);
+      return;
+    }
+
+  if (!vinagre_bookmarks_tree_find_row (tree, parent_entry, FALSE, &parent))
+    return;
+
+  if (!gtk_tree_model_iter_children (model, &iter, &parent))
+    gtk_tree_store_append (GTK_TREE_STORE (model), &iter, &parent);
+  else if (!is_placeholder (model, &iter))
+    vinagre_bookmarks_tree_add_folder (tree, &parent, entry, folder_position (entry), &iter);
+}
+
+static void
+entry_removed_cb (VinagreBookmarks      *book,
+		  VinagreBookmarksEntry *entry,
+		  VinagreBookmarksEntry *parent_entry,
+		  VinagreBookmarksTree  *tree)
+{
+  GtkTreeModel *model;
+  GtkTreeIter   parent, iter;
+
+  if (vinagre_bookmarks_entry_get_node (entry) != VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+    return;
+
+  model = gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree));
+
+  if (parent_entry && !vinagre_bookmarks_tree_find_row (tree, parent_entry, FALSE, &parent))
+    return;
+
+  if (find_child_row (model, parent_entry ? &parent : NULL, entry, &iter))
+    gtk_tree_store_remove (GTK_TREE_STORE (model), &iter);
+}
+
+static void
+entry_changed_cb (VinagreBookmarks      *book,
+		  VinagreBookmarksEntry *entry,
+		  VinagreBookmarksTree  *tree)
+{
+  GtkTreeModel *model;
+  GtkTreeIter   parent, iter;
+  GtkTreePath  *path;
+  gboolean      expanded, has_parent;
+
+  if (vinagre_bookmarks_entry_get_node (entry) != VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+    return;
+
+  if (!vinagre_bookmarks_tree_find_row (tree, entry, FALSE, &iter))
+    return;
+
+  /* The name may have changed, and with it the place among siblings */
+  model = gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree));
+  has_parent = gtk_tree_model_iter_parent (model, &parent, &iter);
+
+  path = gtk_tree_model_get_path (model, &iter);
+  expanded = gtk_tree_view_row_expanded (GTK_TREE_VIEW (tree->priv->tree), path);
+  gtk_tree_path_free (path);
+
+  gtk_tree_store_remove (GTK_TREE_STORE (model), &iter);
+  vinagre_bookmarks_tree_add_folder (tree,
+				     has_parent ? &parent : NULL,
+				     entry,
+				     folder_position (entry),
+				     &iter);
+
+  if (expanded)
+    {
+      path = gtk_tree_model_get_path (model, &iter);
+      gtk_tree_view_expand_row (GTK_TREE_VIEW (tree->priv->tree), path, FALSE);
+      gtk_tree_path_free (path);
+    }
+}
+
+static void
+reloaded_cb (VinagreBookmarks     *book,
+	     VinagreBookmarksTree *tree)
+{
+  vinagre_bookmarks_tree_update_list (tree);
+}
+
 static void
 vinagre_bookmarks_tree_init (VinagreBookmarksTree *tree)
 {
@@ -140,6 +380,7 @@ vinagre_bookmarks_tree_init (VinagreBookmarksTree *tree)
   GtkTreeSelection  *selection;
   GtkTreeStore      *model;
   GtkTreeViewColumn *main_column;
+  VinagreBookmarks  *book;
 
   tree->priv = G_TYPE_INSTANCE_GET_PRIVATE (tree, VINAGRE_TYPE_BOOKMARKS_TREE, VinagreBookmarksTreePrivate);
 
@@ -185,18 +426,51 @@ vinagre_bookmarks_tree_init (VinagreBookmarksTree *tree)
 		    "row-activated",
 		    G_CALLBACK (vinagre_bookmarks_tree_row_activated_cb),
 		    tree);
+  g_signal_connect (tree->priv->tree,
+		    "test-expand-row",
+		    G_CALLBACK (vinagre_bookmarks_tree_test_expand_row_cb),
+		    tree);
 
+  tree->priv->pixbuf = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (),
+						 "folder",
+						 16,
+						 0,
+						 NULL);
   vinagre_bookmarks_tree_update_list (tree);
 
+  book = vinagre_bookmarks_get_default ();
+  g_signal_connect (book, "entry-added", G_CALLBACK (entry_added_cb), tree);
+  g_signal_connect (book, "entry-removed", G_CALLBACK (entry_removed_cb), tree);
+  g_signal_connect (book, "entry-changed", G_CALLBACK (entry_changed_cb), tree);
+  g_signal_connect (book, "reloaded", G_CALLBACK (reloaded_cb), tree);
+
   gtk_container_add (GTK_CONTAINER(scroll), tree->priv->tree);
   gtk_widget_show (tree->priv->tree);
 }
 
+static void
+vinagre_bookmarks_tree_dispose (GObject *object)
+{
+  VinagreBookmarksTree *tree = VINAGRE_BOOKMARKS_TREE (object);
+
+  g_signal_handlers_disconnect_by_data (vinagre_bookmarks_get_default (), tree);
+
+  if (tree->priv->pixbuf)
+    {
+      g_object_unref (tree->priv->pixbuf);
+      tree->priv->pixbuf = NULL;
+    }
+
+  G_OBJECT_CLASS (vinagre_bookmarks_tree_parent_class)->dispose (object);
+}
+
 static void
 vinagre_bookmarks_tree_class_init (VinagreBookmarksTreeClass *klass)
 {
   GObjectClass* object_class = G_OBJECT_CLASS (klass);
 
+  object_class->dispose = vinagre_bookmarks_tree_dispose;
+
   g_type_class_add_private (object_class, sizeof (VinagreBookmarksTreePrivate));
 }
 
@@ -237,66 +511,29 @@ vinagre_bookmarks_tree_get_selected_entry (VinagreBookmarksTree *tree)
     return NULL;
 }
 
-struct _find_entry
-{
-  VinagreBookmarksEntry *entry;
-  gboolean               found;
-  GtkTreePath           *path;
-};
-
-static gboolean
-find_entry (GtkTreeModel *model,
-	    GtkTreePath  *path,
-	    GtkTreeIter  *iter,
-	    gpointer      data)
-{
-  VinagreBookmarksEntry *entry;
-  struct _find_entry    *f = data;
-  gboolean              result = FALSE;
-
-  gtk_tree_model_get (model, 
-		      iter,
-		      ENTRY_COL, &entry,
-			  -1);
-  if (entry == f->entry)
-    {
-      f->found = TRUE;
-      f->path  = gtk_tree_path_copy (path);
-      result = TRUE;
-    }
-
-  if (entry)
-    g_object_unref (entry);
-
-  return result;
-}
-
 gboolean
 vinagre_bookmarks_tree_select_entry (VinagreBookmarksTree *tree,
 				     VinagreBookmarksEntry *entry)
 {
   GtkTreeModel          *model;
-  struct _find_entry     f;
+  GtkTreeIter            iter;
+  GtkTreePath           *path;
 
   if (!entry)
     return FALSE;
   g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_TREE (tree), FALSE);
   g_return_val_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry), FALSE);
 
+  if (!vinagre_bookmarks_tree_find_row (tree, entry, TRUE, &iter))
+    return FALSE;
+
   model = gtk_tree_view_get_model (GTK_TREE_VIEW (tree->priv->tree));
-  f.entry = entry;
-  f.found = FALSE;
+  path = gtk_tree_model_get_path (model, &iter);
+  gtk_tree_view_expand_to_path (GTK_TREE_VIEW (tree->priv->tree), path);
+  gtk_tree_view_set_cursor (GTK_TREE_VIEW (tree->priv->tree), path, NULL, FALSE);
+  gtk_tree_path_free (path);
 
-  gtk_tree_model_foreach (model, find_entry, &f);
-  if (f.found)
-    {
-      gtk_tree_view_expand_to_path (GTK_TREE_VIEW (tree->priv->tree), f.path);
-      gtk_tree_view_set_cursor (GTK_TREE_VIEW (tree->priv->tree), f.path, NULL, FALSE);
-      gtk_tree_path_free (f.path);
-      return TRUE;
-    }
-  else
-    return FALSE;
+  return TRUE;
 }
 
 /* vim: set ts=8: */
@@ -98,14 +98,14 @@ show_dialog_folder (VinagreBookmarks      *book,
     }
 
   vinagre_bookmarks_entry_set_name (entry, name);
-  if (!is_add)
-    {
-      g_object_ref (entry);
-      vinagre_bookmarks_remove_entry (book, entry);
-    }
-  vinagre_bookmarks_add_entry ( book,
-				entry,
-				vinagre_bookmarks_tree_get_selected_entry (VINAGRE_BOOKMARKS_TREE (tree)));
+  if (is_add)
+    vinagre_bookmarks_add_entry (book,
+				 entry,
+				 vinagre_bookmarks_tree_get_selected_entry (VINAGRE_BOOKMARKS_TREE (tree)));
+  else
+    vinagre_bookmarks_update_entry (book,
+				    entry,
+				    vinagre_bookmarks_tree_get_selected_entry (VINAGRE_BOOKMARKS_TREE (tree)));
 
 finalize:
   gtk_widget_destroy (GTK_WIDGET (dialog));
@@ -235,14 +235,14 @@ show_dialog_conn (VinagreBookmarks      *book,
   g_free (protocol);
   g_free (host);
 
-  if (!is_add)
-    {
-      g_object_ref (entry);
-      vinagre_bookmarks_remove_entry (book, entry);
-    }
-  vinagre_bookmarks_add_entry ( book,
-				entry,
-				vinagre_bookmarks_tree_get_selected_entry (VINAGRE_BOOKMARKS_TREE (tree)));
+  if (is_add)
+    vinagre_bookmarks_add_entry (book,
+				 entry,
+				 vinagre_bookmarks_tree_get_selected_entry (VINAGRE_BOOKMARKS_TREE (tree)));
+  else
+    vinagre_bookmarks_update_entry (book,
+				    entry,
+				    vinagre_bookmarks_tree_get_selected_entry (VINAGRE_BOOKMARKS_TREE (tree)));
 
 finalize:
   gtk_widget_destroy (GTK_WIDGET (dialog));
@@ -314,7 +314,7 @@ vinagre_bookmarks_del (VinagreBookmarks      *book,
     }
   else
     {
-      name = vinagre_connection_get_best_name (vinagre_bookmarks_entry_get_conn (entry));
+      name = vinagre_bookmarks_entry_get_best_name (entry);
       title = g_strdup (_("Remove Item?"));
       msg2 = g_strdup (msg1);
     }
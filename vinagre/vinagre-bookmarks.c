@@ -19,16 +19,18 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
-#include <libxml/parser.h>
+#include <libxml/xmlreader.h>
 #include <libxml/xmlwriter.h>
 
 #include "vinagre-bookmarks.h"
 #include "vinagre-bookmarks-entry.h"
 #include "vinagre-bookmarks-migration.h"
 #include "vinagre-connection.h"
+#include "vinagre-debug.h"
 #include "vinagre-plugins-engine.h"
 #include "vinagre-vala.h"
 
@@ -36,12 +38,57 @@ struct _VinagreBookmarksPrivate
 {
   gchar        *filename;
   GSList       *entries;
+  gboolean      entries_sorted;
   GFileMonitor *monitor;
+  GHashTable   *index;      /* "protocol://host:port" -> GQueue of entries */
+  GHashTable   *index_keys; /* entry -> its key in index */
+  guint         save_id;
+  guint         pending_writes;
+  gboolean      dirty;      /* changed while a write was in progress */
+  gchar        *checksum;   /* of the file contents we last wrote or read */
+};
+
+typedef struct
+{
+  VinagreBookmarks *book;
+  gchar            *filename;
+  gchar            *contents;
+  GByteArray       *cache;    /* matches contents, header still to fill */
+} SaveData;
+
+/* Changes made within this many milliseconds are written out together */
+#define SAVE_DELAY 500
+
+/*
+ * The binary cache of the bookmarks file, in the user cache dir. It holds
+ * a header followed by the tree in preorder:
+ *
+ *   header: magic (8 bytes), mtime in usecs (gint64), size (gint64)
+ *   folder: CACHE_FOLDER, name, children..., CACHE_FOLDER_END
+ *   item:   CACHE_ITEM, port (gint32), protocol, host, label, <item> xml
+ *
+ * where strings are a guint32 length followed by the bytes. Integers are
+ * in host byte order; the cache is never shared between machines.
+ */
+#define CACHE_FILE        "bookmarks.cache"
+#define CACHE_MAGIC       "VNGRBKC1"
+#define CACHE_MAGIC_LEN   8
+#define CACHE_HEADER_LEN  (CACHE_MAGIC_LEN + 2 * sizeof (gint64))
+
+enum
+{
+  CACHE_FOLDER = 1,
+  CACHE_FOLDER_END,
+  CACHE_ITEM
 };
 
 enum
 {
   BOOKMARK_CHANGED,
+  ENTRY_ADDED,
+  ENTRY_REMOVED,
+  ENTRY_CHANGED,
+  RELOADED,
   LAST_SIGNAL
 };
 
@@ -52,6 +99,7 @@ static guint signals[LAST_SIGNAL] = { 0 };
 
 /* Prototypes */
 static void vinagre_bookmarks_update_from_file (VinagreBookmarks *book);
+static void vinagre_bookmarks_write_sync       (VinagreBookmarks *book);
 static void vinagre_bookmarks_file_changed     (GFileMonitor     *monitor,
 					        GFile             *file,
 					        GFile             *other_file,
@@ -64,6 +112,8 @@ protocol_added_removed_cb (VinagrePluginsEngine *engine,
 			   VinagreBookmarks     *book)
 {
   vinagre_bookmarks_update_from_file (book);
+
+  g_signal_emit (book, signals[BOOKMARK_CHANGED], 0);
 }
 
 static void
@@ -75,6 +125,15 @@ vinagre_bookmarks_init (VinagreBookmarks *book)
 
   book->priv = G_TYPE_INSTANCE_GET_PRIVATE (book, VINAGRE_TYPE_BOOKMARKS, VinagreBookmarksPrivate);
   book->priv->entries = NULL;
+  book->priv->entries_sorted = TRUE;
+  book->priv->index = g_hash_table_new_full (g_str_hash,
+					     g_str_equal,
+					     g_free,
+					     (GDestroyNotify) g_queue_free);
+  book->priv->index_keys = g_hash_table_new_full (g_direct_hash,
+						  g_direct_equal,
+						  NULL,
+						  g_free);
 
   dir = vinagre_dirs_get_user_data_dir ();
   book->priv->filename = g_build_filename (dir,
@@ -110,12 +169,96 @@ vinagre_bookmarks_init (VinagreBookmarks *book)
 		    book);
 }
 
+static gchar *
+index_key (const gchar *protocol,
+	   const gchar *host,
+	   gint         port)
+{
+  return g_strdup_printf ("%s://%s:%d", protocol, host, port);
+}
+
+static void
+index_add (VinagreBookmarks      *book,
+	   VinagreBookmarksEntry *entry)
+{
+  GSList *l;
+  GQueue *queue;
+  gchar *key;
+
+  switch (vinagre_bookmarks_entry_get_node (entry))
+    {
+      case VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER:
+	for (l = vinagre_bookmarks_entry_get_children (entry); l; l = l->next)
+	  index_add (book, VINAGRE_BOOKMARKS_ENTRY (l->data));
+	break;
+
+      case VINAGRE_BOOKMARKS_ENTRY_NODE_CONN:
+	key = index_key (vinagre_bookmarks_entry_get_protocol (entry),
+			 vinagre_bookmarks_entry_get_host (entry),
+			 vinagre_bookmarks_entry_get_port (entry));
+
+	queue = g_hash_table_lookup (book->priv->index, key);
+	if (!queue)
+	  {
+	    queue = g_queue_new ();
+	    g_hash_table_insert (book->priv->index, g_strdup (key), queue);
+	  }
+	g_queue_push_tail (queue, entry);
+
+	/* The connection may be edited before the entry is removed,
+	   so remember the key it was indexed under */
+	g_hash_table_insert (book->priv->index_keys, entry, key);
+	break;
+
+      default:
+	g_assert_not_reached ();
+    }
+}
+
+static void
+index_remove (VinagreBookmarks      *book,
+	      VinagreBookmarksEntry *entry)
+{
+  GSList *l;
+  GQueue *queue;
+  const gchar *key;
+
+  switch (vinagre_bookmarks_entry_get_node (entry))
+    {
+      case VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER:
+	for (l = vinagre_bookmarks_entry_get_children (entry); l; l = l->next)
+	  index_remove (book, VINAGRE_BOOKMARKS_ENTRY (l->data));
+	break;
+
+      case VINAGRE_BOOKMARKS_ENTRY_NODE_CONN:
+	key = g_hash_table_lookup (book->priv->index_keys, entry);
+	if (!key)
+	  break;
+
+	queue = g_hash_table_lookup (book->priv->index, key);
+	if (queue)
+	  {
+	    g_queue_remove (queue, entry);
+	    if (g_queue_is_empty (queue))
+	      g_hash_table_remove (book->priv->index, key);
+	  }
+	g_hash_table_remove (book->priv->index_keys, entry);
+	break;
+
+      default:
+	g_assert_not_reached ();
+    }
+}
+
 static void
 vinagre_bookmarks_clear_entries (VinagreBookmarks *book)
 {
+  g_hash_table_remove_all (book->priv->index);
+  g_hash_table_remove_all (book->priv->index_keys);
   g_slist_free_full (book->priv->entries, g_object_unref);
 
   book->priv->entries = NULL;
+  book->priv->entries_sorted = TRUE;
 }
 
 static void
@@ -126,6 +269,12 @@ vinagre_bookmarks_finalize (GObject *object)
   g_free (book->priv->filename);
   book->priv->filename = NULL;
 
+  g_free (book->priv->checksum);
+  book->priv->checksum = NULL;
+
+  g_hash_table_destroy (book->priv->index);
+  g_hash_table_destroy (book->priv->index_keys);
+
   G_OBJECT_CLASS (vinagre_bookmarks_parent_class)->finalize (object);
 }
 
@@ -134,6 +283,17 @@ vinagre_bookmarks_dispose (GObject *object)
 {
   VinagreBookmarks *book = VINAGRE_BOOKMARKS (object);
 
+  /* Do not lose changes made right before quitting */
+  if (book->priv->save_id || book->priv->pending_writes || book->priv->dirty)
+    {
+      if (book->priv->save_id)
+	{
+	  g_source_remove (book->priv->save_id);
+	  book->priv->save_id = 0;
+	}
+      vinagre_bookmarks_write_sync (book);
+    }
+
   if (book->priv->entries)
     vinagre_bookmarks_clear_entries (book);
 
@@ -166,44 +326,52 @@ vinagre_bookmarks_class_init (VinagreBookmarksClass *klass)
 			      g_cclosure_marshal_VOID__VOID,
 			      G_TYPE_NONE,
 			      0);
-}
-
-static VinagreConnection *
-find_conn_by_host (GSList      *entries,
-		   const gchar *protocol,
-		   const gchar *host,
-		   gint         port)
-{
-  GSList *l;
-  VinagreConnection *conn;
 
-  for (l = entries; l; l = l->next)
-    {
-      VinagreBookmarksEntry *entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
+  signals[ENTRY_ADDED] =
+		g_signal_new ("entry-added",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_FIRST,
+			      G_STRUCT_OFFSET (VinagreBookmarksClass, entry_added),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__OBJECT,
+			      G_TYPE_NONE,
+			      1,
+			      VINAGRE_TYPE_BOOKMARKS_ENTRY);
 
-      switch (vinagre_bookmarks_entry_get_node (entry))
-	{
-	  case VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER:
-	    if ((conn = find_conn_by_host (vinagre_bookmarks_entry_get_children (entry),
-					   protocol,
-					   host,
-					   port)))
-	      return conn;
-	    break;
+  signals[ENTRY_REMOVED] =
+		g_signal_new ("entry-removed",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_FIRST,
+			      G_STRUCT_OFFSET (VinagreBookmarksClass, entry_removed),
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE,
+			      2,
+			      VINAGRE_TYPE_BOOKMARKS_ENTRY,
+			      VINAGRE_TYPE_BOOKMARKS_ENTRY);
 
-	  case VINAGRE_BOOKMARKS_ENTRY_NODE_CONN:
-	    conn = vinagre_bookmarks_entry_get_conn (entry);
-	    if ( (g_str_equal (host, vinagre_connection_get_host (conn))) &&
-		 (port == vinagre_connection_get_port (conn)) &&
-		 (g_str_equal (protocol, vinagre_connection_get_protocol (conn))) )
-	      return g_object_ref (conn);
-	    break;
+  signals[ENTRY_CHANGED] =
+		g_signal_new ("entry-changed",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_FIRST,
+			      G_STRUCT_OFFSET (VinagreBookmarksClass, entry_changed),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__OBJECT,
+			      G_TYPE_NONE,
+			      1,
+			      VINAGRE_TYPE_BOOKMARKS_ENTRY);
 
-	  default:
-	    g_assert_not_reached ();
-	}
-    }
-  return NULL;
+  /* Every entry was replaced, without entry-* signals. Followed by
+   * "changed" */
+  signals[RELOADED] =
+		g_signal_new ("reloaded",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_FIRST,
+			      G_STRUCT_OFFSET (VinagreBookmarksClass, reloaded),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__VOID,
+			      G_TYPE_NONE,
+			      0);
 }
 
 /**
@@ -217,18 +385,110 @@ vinagre_bookmarks_exists (VinagreBookmarks *book,
                           const gchar      *host,
                           gint              port)
 {
+  VinagreBookmarksEntry *entry;
+  GQueue *queue;
+  gchar *key;
+
   g_return_val_if_fail (VINAGRE_IS_BOOKMARKS (book), NULL);
   g_return_val_if_fail (host != NULL, NULL);
 
-  return find_conn_by_host (book->priv->entries, protocol, host, port);
+  key = index_key (protocol, host, port);
+  queue = g_hash_table_lookup (book->priv->index, key);
+  g_free (key);
+
+  if (!queue)
+    return NULL;
+
+  entry = g_queue_peek_head (queue);
+  return g_object_ref (vinagre_bookmarks_entry_get_conn (entry));
+}
+
+static void
+cache_append_string (GByteArray  *buf,
+		     const gchar *str)
+{
+  guint32 len = str ? strlen (str) : 0;
+
+  g_byte_array_append (buf, (const guint8 *) &len, sizeof (len));
+  if (len)
+    g_byte_array_append (buf, (const guint8 *) str, len);
+}
+
+static gchar *
+cache_item_from_conn (VinagreConnection *conn)
+{
+  xmlTextWriter *writer;
+  xmlBuffer     *buf;
+  gchar         *item = NULL;
+
+  buf = xmlBufferCreate ();
+  if (!buf)
+    return NULL;
+
+  writer = xmlNewTextWriterMemory (buf, 0);
+  if (writer)
+    {
+      xmlTextWriterStartElement (writer, BAD_CAST "item");
+      vinagre_connection_fill_writer (conn, writer);
+      xmlTextWriterEndElement (writer);
+      xmlFreeTextWriter (writer);
+
+      item = g_strdup ((const gchar *) xmlBufferContent (buf));
+    }
+
+  xmlBufferFree (buf);
+  return item;
+}
+
+static void
+cache_append_item (GByteArray            *buf,
+		   VinagreBookmarksEntry *entry,
+		   const gchar           *item)
+{
+  gchar  *label;
+  gint32  port;
+  guint8  type = CACHE_ITEM;
+
+  port = vinagre_bookmarks_entry_get_port (entry);
+  label = vinagre_bookmarks_entry_get_best_name (entry);
+
+  g_byte_array_append (buf, &type, 1);
+  g_byte_array_append (buf, (const guint8 *) &port, sizeof (port));
+  cache_append_string (buf, vinagre_bookmarks_entry_get_protocol (entry));
+  cache_append_string (buf, vinagre_bookmarks_entry_get_host (entry));
+  cache_append_string (buf, label);
+  cache_append_string (buf, item);
+
+  g_free (label);
 }
 
 static void
-vinagre_bookmarks_save_fill_xml (GSList *list, xmlTextWriter *writer)
+cache_append_folder (GByteArray            *buf,
+		     VinagreBookmarksEntry *entry)
+{
+  guint8 type = CACHE_FOLDER;
+
+  g_byte_array_append (buf, &type, 1);
+  cache_append_string (buf, vinagre_bookmarks_entry_get_name (entry));
+}
+
+static void
+cache_append_folder_end (GByteArray *buf)
+{
+  guint8 type = CACHE_FOLDER_END;
+
+  g_byte_array_append (buf, &type, 1);
+}
+
+/* Each <item> is serialized once, for both the file and @cache */
+static void
+vinagre_bookmarks_save_fill_xml (GSList        *list,
+				 xmlTextWriter *writer,
+				 GByteArray    *cache)
 {
   GSList                *l;
   VinagreBookmarksEntry *entry;
-  VinagreConnection     *conn;
+  gchar                 *item;
 
   for (l = list; l; l = l->next)
     {
@@ -238,17 +498,28 @@ vinagre_bookmarks_save_fill_xml (GSList *list, xmlTextWriter *writer)
 	  case VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER:
 	    xmlTextWriterStartElement (writer, BAD_CAST "folder");
 	    xmlTextWriterWriteAttribute (writer, BAD_CAST "name", BAD_CAST vinagre_bookmarks_entry_get_name (entry));
+	    if (cache)
+	      cache_append_folder (cache, entry);
 
-	    vinagre_bookmarks_save_fill_xml (vinagre_bookmarks_entry_get_children (entry), writer);
+	    vinagre_bookmarks_save_fill_xml (vinagre_bookmarks_entry_get_children (entry), writer, cache);
 	    xmlTextWriterEndElement (writer);
+	    if (cache)
+	      cache_append_folder_end (cache);
 	    break;
 
 	  case VINAGRE_BOOKMARKS_ENTRY_NODE_CONN:
-	    conn = vinagre_bookmarks_entry_get_conn (entry);
-
-	    xmlTextWriterStartElement (writer, BAD_CAST "item");
-	    vinagre_connection_fill_writer (conn, writer);
-	    xmlTextWriterEndElement (writer);
+	    /* Entries loaded from the cache are written back untouched */
+	    if (vinagre_bookmarks_entry_get_item (entry))
+	      item = g_strdup (vinagre_bookmarks_entry_get_item (entry));
+	    else
+	      item = cache_item_from_conn (vinagre_bookmarks_entry_get_conn (entry));
+	    if (!item)
+	      break;
+
+	    xmlTextWriterWriteRaw (writer, BAD_CAST item);
+	    if (cache)
+	      cache_append_item (cache, entry, item);
+	    g_free (item);
 	    break;
 
 	  default:
@@ -258,7 +529,8 @@ vinagre_bookmarks_save_fill_xml (GSList *list, xmlTextWriter *writer)
 }
 
 static VinagreBookmarksEntry *
-vinagre_bookmarks_parse_item (xmlNode *root)
+vinagre_bookmarks_parse_item (xmlNode  *root,
+			      gboolean *complete)
 {
   VinagreBookmarksEntry *entry = NULL;
   VinagreConnection     *conn;
@@ -286,6 +558,8 @@ vinagre_bookmarks_parse_item (xmlNode *root)
 
   if (!ext)
     {
+      /* Still in the file, but not in memory */
+      *complete = FALSE;
       goto out;
     }
 
@@ -303,90 +577,484 @@ out:
 }
 
 static void
-vinagre_bookmarks_parse_xml (VinagreBookmarks *book, xmlNode *root, VinagreBookmarksEntry *parent_entry)
+vinagre_bookmarks_insert (GSList                **entries,
+			  VinagreBookmarksEntry  *parent,
+			  VinagreBookmarksEntry  *entry)
 {
-  xmlNode *curr;
+  if (parent)
+    vinagre_bookmarks_entry_add_child (parent, entry);
+  else
+    *entries = g_slist_prepend (*entries, entry);
+}
+
+/*
+ * Reads the children of <vinagre-bookmarks> one node at a time. Only one
+ * <item> subtree is expanded in memory at once, and the reader drops it
+ * as soon as we move past it.
+ */
+static gboolean
+vinagre_bookmarks_parse_reader (xmlTextReaderPtr   reader,
+				GSList           **entries,
+				gboolean          *complete)
+{
+  GSList *folders = NULL;
+  VinagreBookmarksEntry *entry, *parent;
+  const xmlChar *name;
   xmlChar *folder_name;
-  VinagreBookmarksEntry *entry;
+  xmlNode *node;
+  gint depth = 0;
+  int ret;
+
+  if (xmlTextReaderIsEmptyElement (reader))
+    return TRUE;
 
-  for (curr = root; curr; curr = curr->next)
+  ret = xmlTextReaderRead (reader);
+  while (ret == 1)
     {
-      if (curr->type == XML_ELEMENT_NODE)
+      name = xmlTextReaderConstName (reader);
+      parent = folders ? folders->data : NULL;
+
+      if (xmlTextReaderNodeType (reader) == XML_READER_TYPE_END_ELEMENT)
+	{
+	  /* </vinagre-bookmarks> */
+	  if (xmlTextReaderDepth (reader) == 0)
+	    break;
+
+	  if (!xmlStrcmp (name, BAD_CAST "folder") && folders)
+	    {
+	      folders = g_slist_delete_link (folders, folders);
+	      depth--;
+	    }
+	}
+      else if (xmlTextReaderNodeType (reader) == XML_READER_TYPE_ELEMENT)
 	{
-	  if (!xmlStrcmp(curr->name, BAD_CAST "folder"))
+	  /* Like before, ignore anything not directly inside a folder */
+	  if (xmlTextReaderDepth (reader) != depth + 1)
+	    {
+	      ret = xmlTextReaderNext (reader);
+	      continue;
+	    }
+
+	  if (!xmlStrcmp (name, BAD_CAST "folder"))
 	    {
-	      folder_name = xmlGetProp (curr, BAD_CAST "name");
+	      folder_name = xmlTextReaderGetAttribute (reader, BAD_CAST "name");
 	      if (folder_name && *folder_name)
 		{
 		  entry = vinagre_bookmarks_entry_new_folder ((const gchar *) folder_name);
-		  if (parent_entry)
-		    vinagre_bookmarks_entry_add_child (parent_entry, entry);
-		  else
-		    book->priv->entries = g_slist_insert_sorted (book->priv->entries,
-							         entry,
-							        (GCompareFunc)vinagre_bookmarks_entry_compare);
-
-		  vinagre_bookmarks_parse_xml (book, curr->children, entry);
+		  vinagre_bookmarks_insert (entries, parent, entry);
+
+		  if (!xmlTextReaderIsEmptyElement (reader))
+		    {
+		      folders = g_slist_prepend (folders, entry);
+		      depth++;
+		    }
+		  xmlFree (folder_name);
+		}
+	      else
+		{
+		  xmlFree (folder_name);
+		  ret = xmlTextReaderNext (reader);
+		  continue;
 		}
-	      xmlFree (folder_name);
 	    }
-	  else if (!xmlStrcmp(curr->name, BAD_CAST "item"))
+	  else if (!xmlStrcmp (name, BAD_CAST "item"))
 	    {
-	      entry = vinagre_bookmarks_parse_item (curr);
-	      if (entry)
+	      node = xmlTextReaderExpand (reader);
+	      if (!node)
 		{
-		  if (parent_entry)
-		    vinagre_bookmarks_entry_add_child (parent_entry, entry);
-		  else
-		    book->priv->entries = g_slist_insert_sorted (book->priv->entries,
-								 entry,
-								 (GCompareFunc)vinagre_bookmarks_entry_compare);
+		  ret = -1;
+		  break;
 		}
+
+	      entry = vinagre_bookmarks_parse_item (node, complete);
+	      if (entry)
+		vinagre_bookmarks_insert (entries, parent, entry);
+
+	      ret = xmlTextReaderNext (reader);
+	      continue;
 	    }
 	}
+
+      ret = xmlTextReaderRead (reader);
+    }
+
+  g_slist_free (folders);
+  return ret != -1;
+}
+
+static void
+vinagre_bookmarks_set_entries (VinagreBookmarks *book,
+			       GSList           *entries)
+{
+  GSList *l;
+
+  vinagre_bookmarks_clear_entries (book);
+  book->priv->entries = entries;
+  book->priv->entries_sorted = FALSE;
+
+  for (l = book->priv->entries; l; l = l->next)
+    index_add (book, VINAGRE_BOOKMARKS_ENTRY (l->data));
+}
+
+static gchar *
+cache_get_filename (void)
+{
+  gchar *dir, *filename;
+
+  dir = vinagre_dirs_get_user_cache_dir ();
+  filename = g_build_filename (dir, CACHE_FILE, NULL);
+  g_free (dir);
+
+  return filename;
+}
+
+static gboolean
+cache_stat_file (const gchar *filename,
+		 gint64      *mtime,
+		 gint64      *size)
+{
+  GFile     *file;
+  GFileInfo *info;
+
+  file = g_file_new_for_path (filename);
+  info = g_file_query_info (file,
+			    G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+			    G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+			    G_FILE_ATTRIBUTE_STANDARD_SIZE,
+			    G_FILE_QUERY_INFO_NONE,
+			    NULL,
+			    NULL);
+  g_object_unref (file);
+
+  if (!info)
+    return FALSE;
+
+  *mtime = (gint64) g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+	   g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  *size = g_file_info_get_size (info);
+  g_object_unref (info);
+
+  return TRUE;
+}
+
+static gboolean
+cache_read_string (const gchar **p,
+		   const gchar  *end,
+		   gchar       **str)
+{
+  guint32 len;
+
+  if (end - *p < (gssize) sizeof (len))
+    return FALSE;
+  memcpy (&len, *p, sizeof (len));
+  *p += sizeof (len);
+
+  if ((gsize) (end - *p) < len)
+    return FALSE;
+  *str = g_strndup (*p, len);
+  *p += len;
+
+  return TRUE;
+}
+
+static gboolean
+cache_read_entries (const gchar            **p,
+		    const gchar             *end,
+		    VinagreBookmarksEntry   *parent,
+		    GSList                 **entries)
+{
+  VinagreBookmarksEntry *entry;
+  gchar *name, *protocol, *host, *label, *item;
+  gint32 port;
+  gboolean ok;
+
+  while (*p < end)
+    {
+      switch (*(*p)++)
+	{
+	  case CACHE_FOLDER:
+	    if (!cache_read_string (p, end, &name))
+	      return FALSE;
+
+	    entry = vinagre_bookmarks_entry_new_folder (name);
+	    vinagre_bookmarks_insert (entries, parent, entry);
+	    g_free (name);
+
+	    if (!cache_read_entries (p, end, entry, entries))
+	      return FALSE;
+	    break;
+
+	  case CACHE_FOLDER_END:
+	    return parent != NULL;
+
+	  case CACHE_ITEM:
+	    if (end - *p < (gssize) sizeof (port))
+	      return FALSE;
+	    memcpy (&port, *p, sizeof (port));
+	    *p += sizeof (port);
+
+	    protocol = host = label = item = NULL;
+	    ok = cache_read_string (p, end, &protocol) &&
+		 cache_read_string (p, end, &host) &&
+		 cache_read_string (p, end, &label) &&
+		 cache_read_string (p, end, &item);
+
+	    if (ok &&
+		vinagre_plugins_engine_get_plugin_by_protocol (vinagre_plugins_engine_get_default (),
+							       protocol))
+	      {
+		entry = vinagre_bookmarks_entry_new_conn_lazy (protocol, host, port, label, item);
+		vinagre_bookmarks_insert (entries, parent, entry);
+	      }
+
+	    g_free (protocol);
+	    g_free (host);
+	    g_free (label);
+	    g_free (item);
+
+	    if (!ok)
+	      return FALSE;
+	    break;
+
+	  default:
+	    return FALSE;
+	}
+    }
+
+  return parent == NULL;
+}
+
+static gboolean
+vinagre_bookmarks_read_cache (VinagreBookmarks *book)
+{
+  GMappedFile *mapped;
+  const gchar *p, *end;
+  gchar       *filename;
+  gint64       mtime, size, cached_mtime, cached_size;
+  GSList      *entries = NULL;
+  gboolean     ok = FALSE;
+
+  if (!cache_stat_file (book->priv->filename, &mtime, &size))
+    return FALSE;
+
+  filename = cache_get_filename ();
+  mapped = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+  if (!mapped)
+    return FALSE;
+
+  p = g_mapped_file_get_contents (mapped);
+  end = p + g_mapped_file_get_length (mapped);
+
+  if (end - p < (gssize) CACHE_HEADER_LEN ||
+      memcmp (p, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0)
+    goto out;
+  p += CACHE_MAGIC_LEN;
+
+  memcpy (&cached_mtime, p, sizeof (gint64));
+  p += sizeof (gint64);
+  memcpy (&cached_size, p, sizeof (gint64));
+  p += sizeof (gint64);
+
+  if (cached_mtime != mtime || cached_size != size)
+    {
+      vinagre_debug_message (DEBUG_UTILS, "Bookmarks cache is stale");
+      goto out;
+    }
+
+  ok = cache_read_entries (&p, end, NULL, &entries);
+  if (ok)
+    vinagre_bookmarks_set_entries (book, entries);
+  else
+    {
+      vinagre_debug_message (DEBUG_UTILS, "Bookmarks cache is corrupted");
+      g_slist_free_full (entries, g_object_unref);
+    }
+
+out:
+  g_mapped_file_unref (mapped);
+  return ok;
+}
+
+/* The header is filled by cache_write(), once the file is on disk */
+static GByteArray *
+cache_new (void)
+{
+  GByteArray *buf;
+  guint8      header[CACHE_HEADER_LEN] = { 0, };
+
+  memcpy (header, CACHE_MAGIC, CACHE_MAGIC_LEN);
+
+  buf = g_byte_array_new ();
+  g_byte_array_append (buf, header, CACHE_HEADER_LEN);
+
+  return buf;
+}
+
+/* Writes @buf as the cache of @filename. No main loop involved, it also
+ * runs from the save thread. */
+static gboolean
+cache_write (GByteArray   *buf,
+	     const gchar  *filename,
+	     GError      **error)
+{
+  GFile    *file;
+  gchar    *cache_filename, *dir;
+  gint64    mtime, size;
+  gboolean  ok;
+
+  if (!cache_stat_file (filename, &mtime, &size))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+		   "Could not stat %s", filename);
+      return FALSE;
+    }
+
+  memcpy (buf->data + CACHE_MAGIC_LEN, &mtime, sizeof (mtime));
+  memcpy (buf->data + CACHE_MAGIC_LEN + sizeof (mtime), &size, sizeof (size));
+
+  dir = vinagre_dirs_get_user_cache_dir ();
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  /* Bookmarks are nobody else's business, and REPLACE_DESTINATION keeps
+   * GIO from carrying over the mode of an older cache */
+  cache_filename = cache_get_filename ();
+  file = g_file_new_for_path (cache_filename);
+  ok = g_file_replace_contents (file,
+				(const gchar *) buf->data,
+				buf->len,
+				NULL,
+				FALSE,
+				G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+				NULL,
+				NULL,
+				error);
+  g_object_unref (file);
+  g_free (cache_filename);
+
+  return ok;
+}
+
+static void
+cache_append_entries (GByteArray *buf,
+		      GSList     *entries)
+{
+  VinagreBookmarksEntry *entry;
+  GSList *l;
+  gchar  *item;
+
+  for (l = entries; l; l = l->next)
+    {
+      entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
+      switch (vinagre_bookmarks_entry_get_node (entry))
+	{
+	  case VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER:
+	    cache_append_folder (buf, entry);
+	    cache_append_entries (buf, vinagre_bookmarks_entry_get_children (entry));
+	    cache_append_folder_end (buf);
+	    break;
+
+	  case VINAGRE_BOOKMARKS_ENTRY_NODE_CONN:
+	    if (vinagre_bookmarks_entry_get_item (entry))
+	      item = g_strdup (vinagre_bookmarks_entry_get_item (entry));
+	    else
+	      item = cache_item_from_conn (vinagre_bookmarks_entry_get_conn (entry));
+	    if (!item)
+	      break;
+
+	    cache_append_item (buf, entry, item);
+	    g_free (item);
+	    break;
+
+	  default:
+	    g_assert_not_reached ();
+	}
     }
+}
+
+/* Must only be called when the entries match the bookmarks file */
+static void
+vinagre_bookmarks_write_cache (VinagreBookmarks *book)
+{
+  GByteArray *buf;
+  GError     *error = NULL;
 
+  buf = cache_new ();
+  cache_append_entries (buf, vinagre_bookmarks_get_all (book));
+
+  if (!cache_write (buf, book->priv->filename, &error))
+    {
+      vinagre_debug_message (DEBUG_UTILS, "Could not write the bookmarks cache: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_byte_array_free (buf, TRUE);
 }
 
 static void
 vinagre_bookmarks_update_from_file (VinagreBookmarks *book)
 {
-  xmlErrorPtr error;
-  xmlNodePtr  root;
-  xmlDocPtr   doc;
+  xmlErrorPtr      error;
+  xmlTextReaderPtr reader;
+  GSList          *entries = NULL;
+  gboolean         complete = TRUE;
+  int              ret;
 
   if (!g_file_test (book->priv->filename, G_FILE_TEST_EXISTS))
     return;
 
-  doc = xmlReadFile (book->priv->filename, NULL, XML_PARSE_NOERROR);
+  if (vinagre_bookmarks_read_cache (book))
+    {
+      g_signal_emit (book, signals[RELOADED], 0);
+      return;
+    }
 
-  if (!doc)
+  reader = xmlReaderForFile (book->priv->filename, NULL, XML_PARSE_NOERROR);
+  if (!reader)
     {
       error = xmlGetLastError ();
       g_warning (_("Error while initializing bookmarks: %s"), error?error->message: _("Unknown error"));
       return;
     }
 
-  root = xmlDocGetRootElement (doc);
-  if (!root)
+  /* Skip the prolog, up to the root element */
+  do
+    ret = xmlTextReaderRead (reader);
+  while (ret == 1 && xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT);
+
+  if (ret == 0)
     {
       g_warning (_("Error while initializing bookmarks: The file seems to be empty"));
-      xmlFreeDoc (doc);
-      return;
+      goto out;
     }
 
-  if (xmlStrcmp (root->name, BAD_CAST "vinagre-bookmarks"))
+  if (ret == 1 &&
+      xmlStrcmp (xmlTextReaderConstName (reader), BAD_CAST "vinagre-bookmarks"))
     {
       g_warning (_("Error while initializing bookmarks: The file is not a vinagre bookmarks file"));
-      xmlFreeDoc (doc);
-      return;
+      goto out;
     }
 
-  vinagre_bookmarks_clear_entries (book);
-  vinagre_bookmarks_parse_xml (book, root->xmlChildrenNode, NULL);
-  xmlFreeDoc (doc);
-}
+  if (ret < 0 || !vinagre_bookmarks_parse_reader (reader, &entries, &complete))
+    {
+      error = xmlGetLastError ();
+      g_warning (_("Error while initializing bookmarks: %s"), error?error->message: _("Unknown error"));
+      g_slist_free_full (entries, g_object_unref);
+      goto out;
+    }
 
+  vinagre_bookmarks_set_entries (book, entries);
+
+  /* Items of protocols not loaded yet would be missing from the cache */
+  if (complete)
+    vinagre_bookmarks_write_cache (book);
+
+  g_signal_emit (book, signals[RELOADED], 0);
+
+out:
+  xmlFreeTextReader (reader);
+}
 
 static void
 vinagre_bookmarks_file_changed (GFileMonitor      *monitor,
@@ -395,11 +1063,33 @@ vinagre_bookmarks_file_changed (GFileMonitor      *monitor,
 		                GFileMonitorEvent  event_type,
 		                VinagreBookmarks  *book)
 {
+  gchar *contents, *checksum;
+  gsize  length;
+
   if (event_type != G_FILE_MONITOR_EVENT_CHANGED &&
       event_type != G_FILE_MONITOR_EVENT_CREATED &&
       event_type != G_FILE_MONITOR_EVENT_DELETED)
     return;
 
+  /* Our own writes, and repeated events for the same change, leave the
+     contents as we already know them: nothing to reload */
+  if (g_file_get_contents (book->priv->filename, &contents, &length, NULL))
+    {
+      checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+					      (const guchar *) contents,
+					      length);
+      g_free (contents);
+
+      if (g_strcmp0 (checksum, book->priv->checksum) == 0)
+	{
+	  g_free (checksum);
+	  return;
+	}
+
+      g_free (book->priv->checksum);
+      book->priv->checksum = checksum;
+    }
+
   vinagre_bookmarks_update_from_file (book);
 
   g_signal_emit (book, signals[BOOKMARK_CHANGED], 0);
@@ -432,26 +1122,36 @@ vinagre_bookmarks_get_all (VinagreBookmarks *book)
 {
   g_return_val_if_fail (VINAGRE_IS_BOOKMARKS (book), NULL);
 
+  if (!book->priv->entries_sorted)
+    {
+      book->priv->entries = vinagre_bookmarks_entry_sort (book->priv->entries);
+      book->priv->entries_sorted = TRUE;
+    }
+
   return book->priv->entries;
 }
 
-void
-vinagre_bookmarks_save_to_file (VinagreBookmarks *book)
+/* @cache, if not NULL, receives the matching cache */
+static gchar *
+vinagre_bookmarks_to_xml (VinagreBookmarks  *book,
+			  GByteArray       **cache)
 {
   xmlTextWriter *writer;
   xmlBuffer     *buf;
   int            rc;
-  GError        *error;
+  gchar         *contents;
 
-  writer = NULL;
-  buf    = NULL;
-  error  = NULL;
+  writer   = NULL;
+  buf      = NULL;
+  contents = NULL;
+  if (cache)
+    *cache = NULL;
 
   buf = xmlBufferCreate ();
   if (!buf)
     {
       g_warning (_("Error while saving bookmarks: Failed to create the XML structure"));
-      return;
+      return NULL;
     }
 
   writer = xmlNewTextWriterMemory(buf, 0);
@@ -475,7 +1175,10 @@ vinagre_bookmarks_save_to_file (VinagreBookmarks *book)
       goto finalize;
     }
 
-  vinagre_bookmarks_save_fill_xml (book->priv->entries, writer);
+  if (cache)
+    *cache = cache_new ();
+  vinagre_bookmarks_save_fill_xml (vinagre_bookmarks_get_all (book), writer,
+				   cache ? *cache : NULL);
 
   rc = xmlTextWriterEndDocument (writer);
   if (rc < 0)
@@ -484,22 +1187,242 @@ vinagre_bookmarks_save_to_file (VinagreBookmarks *book)
       goto finalize;
     }
 
-  if (!g_file_set_contents (book->priv->filename,
-			    (const char *) buf->content,
-			    -1,
-			    &error))
-    {
-      g_warning (_("Error while saving bookmarks: %s"), error?error->message:_("Unknown error"));
-      if (error)
-	g_error_free (error);
-      goto finalize;
-    }
+  /* Flushes the writer into buf */
+  xmlFreeTextWriter (writer);
+  writer = NULL;
+
+  contents = g_strdup ((const gchar *) xmlBufferContent (buf));
+
+  /* Remember what we are about to write, so the file monitor can
+     recognize it */
+  g_free (book->priv->checksum);
+  book->priv->checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1,
+							contents,
+							-1);
 
 finalize:
   if (writer)
     xmlFreeTextWriter (writer);
   if (buf)
     xmlBufferFree (buf);
+  if (!contents && cache && *cache)
+    {
+      g_byte_array_free (*cache, TRUE);
+      *cache = NULL;
+    }
+
+  return contents;
+}
+
+/* Writes the bookmarks file, then its cache. No main loop involved, it
+ * also runs from the save thread. */
+static gboolean
+vinagre_bookmarks_write_file (const gchar  *filename,
+			      const gchar  *contents,
+			      GByteArray   *cache,
+			      GError      **error)
+{
+  GFile    *file;
+  GError   *cache_error = NULL;
+  gboolean  ok;
+
+  file = g_file_new_for_path (filename);
+  ok = g_file_replace_contents (file,
+				contents,
+				strlen (contents),
+				NULL,
+				FALSE,
+				G_FILE_CREATE_NONE,
+				NULL,
+				NULL,
+				error);
+  g_object_unref (file);
+
+  if (ok && cache && !cache_write (cache, filename, &cache_error))
+    {
+      vinagre_debug_message (DEBUG_UTILS, "Could not write the bookmarks cache: %s", cache_error->message);
+      g_error_free (cache_error);
+    }
+
+  return ok;
+}
+
+static void
+vinagre_bookmarks_write_sync (VinagreBookmarks *book)
+{
+  gchar      *contents;
+  GByteArray *cache;
+  GError     *error = NULL;
+
+  contents = vinagre_bookmarks_to_xml (book, &cache);
+  if (!contents)
+    return;
+
+  if (!vinagre_bookmarks_write_file (book->priv->filename, contents, cache, &error))
+    {
+      g_warning (_("Error while saving bookmarks: %s"), error?error->message:_("Unknown error"));
+      if (error)
+	g_error_free (error);
+    }
+
+  g_byte_array_free (cache, TRUE);
+  g_free (contents);
+}
+
+static void schedule_save (VinagreBookmarks *book);
+
+static void
+save_data_free (SaveData *data)
+{
+  g_free (data->filename);
+  g_free (data->contents);
+  g_byte_array_free (data->cache, TRUE);
+  g_slice_free (SaveData, data);
+}
+
+static void
+save_thread (GSimpleAsyncResult *result,
+	     GObject            *object,
+	     GCancellable       *cancellable)
+{
+  SaveData *data;
+  GError   *error = NULL;
+
+  data = g_simple_async_result_get_op_res_gpointer (result);
+  if (!vinagre_bookmarks_write_file (data->filename, data->contents, data->cache, &error))
+    g_simple_async_result_take_error (result, error);
+}
+
+static void
+save_done_cb (GObject      *source,
+	      GAsyncResult *result,
+	      gpointer      user_data)
+{
+  SaveData *data = user_data;
+  GError   *error = NULL;
+
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result), &error))
+    {
+      g_warning (_("Error while saving bookmarks: %s"), error->message);
+      g_error_free (error);
+    }
+
+  if (data->book)
+    {
+      data->book->priv->pending_writes--;
+      g_object_remove_weak_pointer (G_OBJECT (data->book),
+				    (gpointer *) &data->book);
+
+      /* Writes never overlap, whatever changed meanwhile goes next */
+      if (data->book->priv->dirty)
+	schedule_save (data->book);
+    }
+}
+
+static gboolean
+save_timeout_cb (VinagreBookmarks *book)
+{
+  SaveData           *data;
+  GSimpleAsyncResult *result;
+
+  book->priv->save_id = 0;
+  book->priv->dirty = FALSE;
+
+  data = g_slice_new (SaveData);
+  data->contents = vinagre_bookmarks_to_xml (book, &data->cache);
+  if (!data->contents)
+    {
+      g_slice_free (SaveData, data);
+      return FALSE;
+    }
+
+  /* The callback must not keep us alive: dispose() does the last write */
+  data->book = book;
+  data->filename = g_strdup (book->priv->filename);
+  g_object_add_weak_pointer (G_OBJECT (book), (gpointer *) &data->book);
+  book->priv->pending_writes++;
+
+  /* Both the file and its cache are written from a worker thread; the
+   * cache was built along with the XML, so it matches what is written */
+  result = g_simple_async_result_new (NULL, save_done_cb, data, save_timeout_cb);
+  g_simple_async_result_set_op_res_gpointer (result, data,
+					     (GDestroyNotify) save_data_free);
+  g_simple_async_result_run_in_thread (result, save_thread, G_PRIORITY_DEFAULT, NULL);
+  g_object_unref (result);
+
+  return FALSE;
+}
+
+static void
+schedule_save (VinagreBookmarks *book)
+{
+  /* save_done_cb() comes back here once the current write is over */
+  if (book->priv->pending_writes)
+    {
+      book->priv->dirty = TRUE;
+      return;
+    }
+
+  book->priv->dirty = FALSE;
+  if (book->priv->save_id)
+    return;
+
+  book->priv->save_id = g_timeout_add (SAVE_DELAY,
+				       (GSourceFunc) save_timeout_cb,
+				       book);
+}
+
+/**
+ * vinagre_bookmarks_save_to_file:
+ * @book: A Bookmarks
+ *
+ * Schedules the bookmarks to be written to disk. Calls made in a quick
+ * succession result in a single write.
+ */
+void
+vinagre_bookmarks_save_to_file (VinagreBookmarks *book)
+{
+  g_return_if_fail (VINAGRE_IS_BOOKMARKS (book));
+
+  schedule_save (book);
+}
+
+static void
+vinagre_bookmarks_attach (VinagreBookmarks      *book,
+			  VinagreBookmarksEntry *entry,
+			  VinagreBookmarksEntry *parent)
+{
+  if (parent)
+    vinagre_bookmarks_entry_add_child (parent, entry);
+  else
+    {
+      book->priv->entries = g_slist_prepend (book->priv->entries, entry);
+      book->priv->entries_sorted = FALSE;
+    }
+  index_add (book, entry);
+}
+
+static gboolean
+vinagre_bookmarks_detach (VinagreBookmarks      *book,
+			  VinagreBookmarksEntry *entry)
+{
+  VinagreBookmarksEntry *parent;
+
+  parent = vinagre_bookmarks_entry_get_parent (entry);
+  if (parent)
+    {
+      if (!vinagre_bookmarks_entry_remove_child (parent, entry))
+	return FALSE;
+    }
+  else
+    {
+      if (!g_slist_find (book->priv->entries, entry))
+	return FALSE;
+      book->priv->entries = g_slist_remove (book->priv->entries, entry);
+    }
+
+  index_remove (book, entry);
+  return TRUE;
 }
 
 void
@@ -508,50 +1431,71 @@ vinagre_bookmarks_add_entry (VinagreBookmarks      *book,
                              VinagreBookmarksEntry *parent)
 {
   /* I do not ref entry */
-  if (parent)
-    vinagre_bookmarks_entry_add_child (parent, entry);
-  else
-    book->priv->entries = g_slist_insert_sorted (book->priv->entries,
-						 entry,
-						 (GCompareFunc)vinagre_bookmarks_entry_compare);
+  vinagre_bookmarks_attach (book, entry, parent);
   vinagre_bookmarks_save_to_file (book);
+
+  g_signal_emit (book, signals[ENTRY_ADDED], 0, entry);
+  g_signal_emit (book, signals[BOOKMARK_CHANGED], 0);
 }
 
 gboolean
 vinagre_bookmarks_remove_entry (VinagreBookmarks      *book,
 				VinagreBookmarksEntry *entry)
 {
-  GSList *l;
+  VinagreBookmarksEntry *parent;
 
   g_return_val_if_fail (VINAGRE_IS_BOOKMARKS (book), FALSE);
 
+  parent = vinagre_bookmarks_entry_get_parent (entry);
+  if (!vinagre_bookmarks_detach (book, entry))
+    return FALSE;
+
+  vinagre_bookmarks_save_to_file (book);
+  g_signal_emit (book, signals[ENTRY_REMOVED], 0, entry, parent);
+  g_signal_emit (book, signals[BOOKMARK_CHANGED], 0);
+
   /* I do unref entry */
-  if (g_slist_index (book->priv->entries, entry) > -1)
-    {
-      book->priv->entries = g_slist_remove (book->priv->entries, entry);
-      g_object_unref (entry);
-      vinagre_bookmarks_save_to_file (book);
-      return TRUE;
-    }
+  g_object_unref (entry);
+  return TRUE;
+}
 
-  for (l = book->priv->entries; l; l = l->next)
-    {
-      VinagreBookmarksEntry *e = (VinagreBookmarksEntry *) l->data;
+/**
+ * vinagre_bookmarks_update_entry:
+ * @book: A Bookmarks
+ * @entry: An entry which was edited
+ * @parent: (allow-none): The folder @entry should now be in
+ *
+ * To be called after changing an entry or its connection. Moves @entry
+ * under @parent if needed, and saves the bookmarks.
+ */
+void
+vinagre_bookmarks_update_entry (VinagreBookmarks      *book,
+				VinagreBookmarksEntry *entry,
+				VinagreBookmarksEntry *parent)
+{
+  VinagreBookmarksEntry *old_parent;
 
-      if (vinagre_bookmarks_entry_get_node (e) != VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
-	continue;
+  g_return_if_fail (VINAGRE_IS_BOOKMARKS (book));
+  g_return_if_fail (VINAGRE_IS_BOOKMARKS_ENTRY (entry));
 
-      if (vinagre_bookmarks_entry_remove_child (e, entry))
-	{
-	  g_object_unref (entry);
-	  vinagre_bookmarks_save_to_file (book);
-	  return TRUE;
-	}
-    }
+  old_parent = vinagre_bookmarks_entry_get_parent (entry);
+  if (!vinagre_bookmarks_detach (book, entry))
+    return;
 
-  return FALSE;
-}
+  /* Attaching again also puts it back in order, and indexes the new
+     address */
+  vinagre_bookmarks_attach (book, entry, parent);
+  vinagre_bookmarks_save_to_file (book);
 
+  if (old_parent == parent)
+    g_signal_emit (book, signals[ENTRY_CHANGED], 0, entry);
+  else
+    {
+      g_signal_emit (book, signals[ENTRY_REMOVED], 0, entry, old_parent);
+      g_signal_emit (book, signals[ENTRY_ADDED], 0, entry);
+    }
+  g_signal_emit (book, signals[BOOKMARK_CHANGED], 0);
+}
 
 /**
  * vinagre_bookmarks_name_exists:
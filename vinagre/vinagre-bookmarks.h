@@ -48,7 +48,15 @@ struct _VinagreBookmarksClass
   GObjectClass parent_class;
 
   /* Signals */
-  void (* changed) (VinagreBookmarks *book);
+  void (* changed)       (VinagreBookmarks      *book);
+  void (* entry_added)   (VinagreBookmarks      *book,
+			  VinagreBookmarksEntry *entry);
+  void (* entry_removed) (VinagreBookmarks      *book,
+			  VinagreBookmarksEntry *entry,
+			  VinagreBookmarksEntry *parent);
+  void (* entry_changed) (VinagreBookmarks      *book,
+			  VinagreBookmarksEntry *entry);
+  void (* reloaded)      (VinagreBookmarks      *book);
 };
 
 struct _VinagreBookmarks
@@ -67,6 +75,9 @@ void                vinagre_bookmarks_add_entry    (VinagreBookmarks      *book,
                                                     VinagreBookmarksEntry *parent);
 gboolean           vinagre_bookmarks_remove_entry  (VinagreBookmarks      *book,
                                                     VinagreBookmarksEntry *entry);
+void               vinagre_bookmarks_update_entry  (VinagreBookmarks      *book,
+                                                    VinagreBookmarksEntry *entry,
+                                                    VinagreBookmarksEntry *parent);
 
 VinagreConnection  *vinagre_bookmarks_exists       (VinagreBookmarks *book,
                                                     const gchar      *protocol,
@@ -0,0 +1,411 @@
+/*
+ * vinagre-capture.c
+ * Unattended, scheduled screenshots of a connection
+ * This file is part of vinagre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "vinagre-capture.h"
+#include "vinagre-debug.h"
+
+/* Frames waiting for the encoder; anything beyond is dropped */
+#define MAX_PENDING_FRAMES	2
+/* Delay between a bell/resize event and the actual grab, so the
+ * framebuffer has a chance to reflect what caused the event */
+#define TRIGGER_DELAY		250
+/* Minimum spacing between two event-triggered grabs, in microseconds */
+#define TRIGGER_SPACING		(G_USEC_PER_SEC)
+
+typedef struct
+{
+  gchar  *path;
+  goffset size;
+} CaptureFile;
+
+typedef struct
+{
+  GdkPixbuf *pix;
+  GDateTime *time;
+} CaptureJob;
+
+struct _VinagreCapture
+{
+  gchar                  *directory;
+  gchar                  *prefix;
+  guint                   interval;
+  gboolean                on_bell;
+  gboolean                on_resize;
+  goffset                 max_size;
+  VinagreCaptureGrabFunc  grab_func;
+  gpointer                user_data;
+
+  guint                   timeout_id;
+  guint                   trigger_id;
+  gint64                  last_trigger;
+  GThreadPool            *pool;
+
+  /* Only touched from the worker thread */
+  gchar                  *last_digest;
+  gboolean                scanned;
+  GQueue                  files;
+  goffset                 total_size;
+};
+
+static void
+capture_file_free (CaptureFile *file)
+{
+  g_free (file->path);
+  g_slice_free (CaptureFile, file);
+}
+
+static gchar *
+pixbuf_digest (GdkPixbuf *pix)
+{
+  GChecksum    *sum;
+  const guchar *pixels;
+  gint          y, width, height, rowstride;
+  gsize         row_len;
+  gchar        *result;
+
+  width = gdk_pixbuf_get_width (pix);
+  height = gdk_pixbuf_get_height (pix);
+  rowstride = gdk_pixbuf_get_rowstride (pix);
+  pixels = gdk_pixbuf_get_pixels (pix);
+  row_len = width * ((gdk_pixbuf_get_n_channels (pix) * gdk_pixbuf_get_bits_per_sample (pix) + 7) / 8);
+
+  sum = g_checksum_new (G_CHECKSUM_SHA1);
+  g_checksum_update (sum, (const guchar *) &width, sizeof (width));
+  g_checksum_update (sum, (const guchar *) &height, sizeof (height));
+
+  /* Hash row by row, the padding at the end of each row is garbage */
+  for (y = 0; y < height; y++)
+    g_checksum_update (sum, pixels + y * rowstride, row_len);
+
+  result = g_strdup (g_checksum_get_string (sum));
+  g_checksum_free (sum);
+
+  return result;
+}
+
+static void
+add_file (VinagreCapture *capture, gchar *path)
+{
+  CaptureFile *file;
+  GStatBuf     buf;
+
+  if (g_stat (path, &buf) != 0)
+    {
+      g_free (path);
+      return;
+    }
+
+  file = g_slice_new (CaptureFile);
+  file->path = path;
+  file->size = buf.st_size;
+
+  g_queue_push_tail (&capture->files, file);
+  capture->total_size += file->size;
+}
+
+/* Whether @name is "<prefix>-YYYYmmdd-HHMMSS.mmm.png", as written by
+ * capture_worker. A bare prefix match would also pick up the images of
+ * another connection whose prefix merely starts like ours. */
+static gboolean
+is_capture_name (VinagreCapture *capture, const gchar *name)
+{
+  static const gchar pattern[] = "########-######.###.png";
+  gsize len = strlen (capture->prefix);
+  gint  i;
+
+  if (strncmp (name, capture->prefix, len) != 0 || name[len] != '-')
+    return FALSE;
+
+  name += len + 1;
+  for (i = 0; pattern[i]; i++)
+    if (pattern[i] == '#' ? !g_ascii_isdigit (name[i]) : name[i] != pattern[i])
+      return FALSE;
+
+  return name[i] == '\0';
+}
+
+/* Picks up the images left by previous sessions of this connection, so
+ * the retention cap applies to the whole directory and not only to what
+ * we have written ourselves. */
+static void
+scan_directory (VinagreCapture *capture)
+{
+  GDir        *dir;
+  const gchar *name;
+  GSList      *names = NULL, *l;
+
+  capture->scanned = TRUE;
+
+  if (g_mkdir_with_parents (capture->directory, 0700) != 0)
+    {
+      g_warning (_("Could not create the directory %s: %s"),
+		 capture->directory,
+		 g_strerror (errno));
+      return;
+    }
+
+  dir = g_dir_open (capture->directory, 0, NULL);
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    if (is_capture_name (capture, name))
+      names = g_slist_prepend (names, g_strdup (name));
+  g_dir_close (dir);
+
+  /* File names embed the timestamp, so this is oldest first */
+  names = g_slist_sort (names, (GCompareFunc) strcmp);
+  for (l = names; l; l = l->next)
+    {
+      add_file (capture, g_build_filename (capture->directory, l->data, NULL));
+      g_free (l->data);
+    }
+  g_slist_free (names);
+}
+
+static void
+enforce_retention (VinagreCapture *capture)
+{
+  CaptureFile *file;
+
+  if (capture->max_size == 0)
+    return;
+
+  /* Always keep the newest image, even if it alone exceeds the cap */
+  while (capture->total_size > capture->max_size &&
+	 g_queue_get_length (&capture->files) > 1)
+    {
+      file = g_queue_pop_head (&capture->files);
+      g_unlink (file->path);
+      capture->total_size -= file->size;
+      capture_file_free (file);
+    }
+}
+
+static void
+capture_worker (gpointer data, gpointer user_data)
+{
+  CaptureJob     *job = data;
+  VinagreCapture *capture = user_data;
+  GError         *error = NULL;
+  gchar          *digest, *timestamp, *basename, *path;
+
+  digest = pixbuf_digest (job->pix);
+  if (g_strcmp0 (digest, capture->last_digest) == 0)
+    {
+      vinagre_debug_message (DEBUG_VIEW, "Skipping unchanged frame for %s", capture->prefix);
+      g_free (digest);
+      goto out;
+    }
+
+  g_free (capture->last_digest);
+  capture->last_digest = digest;
+
+  if (!capture->scanned)
+    scan_directory (capture);
+
+  timestamp = g_date_time_format (job->time, "%Y%m%d-%H%M%S");
+  basename = g_strdup_printf ("%s-%s.%03d.png",
+			      capture->prefix,
+			      timestamp,
+			      g_date_time_get_microsecond (job->time) / 1000);
+  path = g_build_filename (capture->directory, basename, NULL);
+  g_free (timestamp);
+  g_free (basename);
+
+  if (gdk_pixbuf_save (job->pix, path, "png", &error, NULL))
+    {
+      add_file (capture, path);
+      enforce_retention (capture);
+    }
+  else
+    {
+      g_warning (_("Error saving screenshot: %s"), error->message);
+      g_error_free (error);
+      g_free (path);
+
+      /* Try again with the next frame */
+      g_free (capture->last_digest);
+      capture->last_digest = NULL;
+    }
+
+out:
+  g_object_unref (job->pix);
+  g_date_time_unref (job->time);
+  g_slice_free (CaptureJob, job);
+}
+
+static void
+grab_frame (VinagreCapture *capture)
+{
+  CaptureJob *job;
+  GdkPixbuf  *pix;
+
+  /* The encoder is lagging behind, do not pile up framebuffer copies */
+  if (g_thread_pool_unprocessed (capture->pool) >= MAX_PENDING_FRAMES)
+    {
+      vinagre_debug_message (DEBUG_VIEW, "Encoder busy, dropping frame for %s", capture->prefix);
+      return;
+    }
+
+  pix = capture->grab_func (capture->user_data);
+  if (!pix)
+    return;
+
+  job = g_slice_new (CaptureJob);
+  job->pix = pix;
+  job->time = g_date_time_new_now_local ();
+
+  g_thread_pool_push (capture->pool, job, NULL);
+}
+
+static gboolean
+capture_timeout_cb (VinagreCapture *capture)
+{
+  grab_frame (capture);
+  return TRUE;
+}
+
+static gboolean
+capture_trigger_cb (VinagreCapture *capture)
+{
+  capture->trigger_id = 0;
+  capture->last_trigger = g_get_monotonic_time ();
+  grab_frame (capture);
+
+  return FALSE;
+}
+
+/**
+ * vinagre_capture_new:
+ * @directory: where images are written
+ * @prefix: file name prefix of the images, identifying the connection
+ * @interval: seconds between two periodic captures, or 0 to disable them
+ * @on_bell: whether a remote bell triggers a capture
+ * @on_resize: whether a remote desktop resize triggers a capture
+ * @max_size: cap in bytes of the images kept in @directory, or 0
+ * @grab_func: function returning the current remote screen
+ * @user_data: data passed to @grab_func
+ *
+ * Frames are hashed and encoded in a background thread; a frame identical
+ * to the previously saved one is not written again.
+ *
+ * Returns: a new #VinagreCapture, free it with vinagre_capture_free()
+ */
+VinagreCapture *
+vinagre_capture_new (const gchar            *directory,
+		     const gchar            *prefix,
+		     guint                   interval,
+		     gboolean                on_bell,
+		     gboolean                on_resize,
+		     goffset                 max_size,
+		     VinagreCaptureGrabFunc  grab_func,
+		     gpointer                user_data)
+{
+  VinagreCapture *capture;
+
+  g_return_val_if_fail (directory != NULL, NULL);
+  g_return_val_if_fail (prefix != NULL, NULL);
+  g_return_val_if_fail (grab_func != NULL, NULL);
+
+  capture = g_slice_new0 (VinagreCapture);
+  capture->directory = g_strdup (directory);
+  capture->prefix = g_strdup (prefix);
+  capture->interval = interval;
+  capture->on_bell = on_bell;
+  capture->on_resize = on_resize;
+  capture->max_size = max_size;
+  capture->grab_func = grab_func;
+  capture->user_data = user_data;
+  g_queue_init (&capture->files);
+
+  /* A single worker keeps the frames ordered */
+  capture->pool = g_thread_pool_new (capture_worker, capture, 1, FALSE, NULL);
+
+  if (interval > 0)
+    capture->timeout_id = g_timeout_add_seconds (interval,
+						 (GSourceFunc) capture_timeout_cb,
+						 capture);
+
+  return capture;
+}
+
+void
+vinagre_capture_trigger (VinagreCapture        *capture,
+			 VinagreCaptureTrigger  trigger)
+{
+  g_return_if_fail (capture != NULL);
+
+  switch (trigger)
+    {
+      case VINAGRE_CAPTURE_TRIGGER_BELL:
+	if (!capture->on_bell)
+	  return;
+	break;
+      case VINAGRE_CAPTURE_TRIGGER_RESIZE:
+	if (!capture->on_resize)
+	  return;
+	break;
+      case VINAGRE_CAPTURE_TRIGGER_TIMER:
+	grab_frame (capture);
+	return;
+      default:
+	g_return_if_reached ();
+    }
+
+  /* Coalesce bursts of events (a bell storm, a series of resizes) */
+  if (capture->trigger_id != 0)
+    return;
+  if (g_get_monotonic_time () - capture->last_trigger < TRIGGER_SPACING)
+    return;
+
+  capture->trigger_id = g_timeout_add (TRIGGER_DELAY,
+				       (GSourceFunc) capture_trigger_cb,
+				       capture);
+}
+
+void
+vinagre_capture_free (VinagreCapture *capture)
+{
+  if (!capture)
+    return;
+
+  if (capture->timeout_id != 0)
+    g_source_remove (capture->timeout_id);
+  if (capture->trigger_id != 0)
+    g_source_remove (capture->trigger_id);
+
+  /* Let the frames already grabbed reach the disk */
+  g_thread_pool_free (capture->pool, FALSE, TRUE);
+
+  g_queue_foreach (&capture->files, (GFunc) capture_file_free, NULL);
+  g_queue_clear (&capture->files);
+  g_free (capture->last_digest);
+  g_free (capture->directory);
+  g_free (capture->prefix);
+  g_slice_free (VinagreCapture, capture);
+}
+
+/* vim: set ts=8: */
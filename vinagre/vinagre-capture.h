@@ -0,0 +1,56 @@
+/*
+ * vinagre-capture.h
+ * Unattended, scheduled screenshots of a connection
+ * This file is part of vinagre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VINAGRE_CAPTURE_H__
+#define __VINAGRE_CAPTURE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VinagreCapture VinagreCapture;
+
+typedef enum
+{
+  VINAGRE_CAPTURE_TRIGGER_TIMER = 1,
+  VINAGRE_CAPTURE_TRIGGER_BELL,
+  VINAGRE_CAPTURE_TRIGGER_RESIZE
+} VinagreCaptureTrigger;
+
+/* Asks the owner for a fresh copy of the remote screen. Called from the
+ * main loop only; returns a new reference or NULL. */
+typedef GdkPixbuf * (*VinagreCaptureGrabFunc) (gpointer user_data);
+
+VinagreCapture *	vinagre_capture_new		(const gchar            *directory,
+							 const gchar            *prefix,
+							 guint                   interval,
+							 gboolean                on_bell,
+							 gboolean                on_resize,
+							 goffset                 max_size,
+							 VinagreCaptureGrabFunc  grab_func,
+							 gpointer                user_data);
+void			vinagre_capture_free		(VinagreCapture *capture);
+
+void			vinagre_capture_trigger		(VinagreCapture        *capture,
+							 VinagreCaptureTrigger  trigger);
+
+G_END_DECLS
+
+#endif  /* __VINAGRE_CAPTURE_H__  */
+/* vim: set ts=8: */
@@ -39,6 +39,7 @@
 #include "vinagre-cache-prefs.h"
 #include "vinagre-plugins-engine.h"
 #include "vinagre-reverse-vnc-listener-dialog.h"
+#include "vinagre-search.h"
 #include "vinagre-vala.h"
 
 void
@@ -197,6 +198,29 @@ vinagre_cmd_remote_take_screenshot (GtkAction     *action,
   vinagre_tab_take_screenshot (vinagre_window_get_active_tab (window));
 }
 
+void
+vinagre_cmd_remote_record (GtkAction     *action,
+			   VinagreWindow *window)
+{
+  VinagreTab *tab;
+  gboolean    active;
+
+  tab = vinagre_window_get_active_tab (window);
+  if (!tab)
+    return;
+
+  /* Also called when the notebook syncs the action with the active tab */
+  active = gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (action));
+  if (active == vinagre_tab_get_recording (tab))
+    return;
+
+  if (active)
+    gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action),
+				  vinagre_tab_record_session (tab));
+  else
+    vinagre_tab_stop_recording (tab);
+}
+
 void
 vinagre_cmd_remote_disconnect_all (GtkAction     *action,
 			       VinagreWindow *window)
@@ -262,10 +286,17 @@ vinagre_cmd_open_bookmark (VinagreWindow     *window,
 			   VinagreConnection *conn)
 {
   VinagreTab *tab;
+  gchar      *host;
 
   g_return_if_fail (VINAGRE_IS_WINDOW (window));
   g_return_if_fail (VINAGRE_IS_CONNECTION (conn));
 
+  host = g_strdup_printf ("%s:%d",
+			  vinagre_connection_get_host (conn),
+			  vinagre_connection_get_port (conn));
+  vinagre_search_record_use (vinagre_search_get_default (), host);
+  g_free (host);
+
   tab = vinagre_window_conn_exists (window, conn);
   if (tab)
     {
@@ -38,6 +38,8 @@ void		vinagre_cmd_remote_disconnect	(GtkAction     *action,
 						 VinagreWindow *window);
 void		vinagre_cmd_remote_take_screenshot (GtkAction     *action,
 						    VinagreWindow *window);
+void		vinagre_cmd_remote_record	(GtkAction     *action,
+						 VinagreWindow *window);
 
 void		vinagre_cmd_remote_disconnect_all	(GtkAction     *action,
 							 VinagreWindow *window);
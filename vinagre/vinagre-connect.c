@@ -36,8 +36,11 @@
 #include "vinagre-prefs.h"
 #include "vinagre-cache-prefs.h"
 #include "vinagre-plugins-engine.h"
+#include "vinagre-search.h"
 #include "vinagre-vala.h"
 
+#define MAX_SEARCH_RESULTS 20
+
 typedef struct {
   GtkBuilder *xml;
   GtkWidget *dialog;
@@ -50,6 +53,8 @@ typedef struct {
   GtkWidget *plugin_box;
   GtkWidget *connect_button;
   GtkWidget *help_button;
+  GtkListStore *search_store;
+  VinagreBookmarksEntry *search_entry;
 } VinagreConnectDialog;
 
 enum {
@@ -57,6 +62,14 @@ enum {
   N_COLUMNS
 };
 
+enum {
+  SEARCH_LABEL,
+  SEARCH_HOST,
+  SEARCH_PROTOCOL,
+  SEARCH_ENTRY,
+  N_SEARCH_COLUMNS
+};
+
 enum {
   PROTOCOL_NAME,
   PROTOCOL_DESCRIPTION,
@@ -66,6 +79,18 @@ enum {
   N_PROTOCOLS
 };
 
+/* Rewrite the history file once it holds this many times more lines than hosts */
+#define HISTORY_FILE_SLACK 2
+#define HISTORY_MIN_LINES 32
+
+typedef struct {
+  GQueue     *hosts;		/* Most recent first */
+  GHashTable *index;		/* host -> its link in hosts */
+  guint       file_lines;	/* Lines in the file, stale ones included */
+} VinagreHistory;
+
+static VinagreHistory *connect_history = NULL;
+
 static gchar*
 history_filename () {
   gchar *dir, *filename;
@@ -101,6 +126,13 @@ protocol_combo_changed (GtkComboBox *combo, VinagreConnectDialog *dialog)
   gtk_label_set_label (GTK_LABEL (dialog->protocol_description_label),
 		       description);
 
+  /* Another protocol means another connection than the chosen bookmark */
+  if (dialog->search_entry)
+    {
+      g_object_unref (dialog->search_entry);
+      dialog->search_entry = NULL;
+    }
+
 #ifdef VINAGRE_HAVE_AVAHI
   if (service)
     gtk_widget_show (dialog->find_button);
@@ -187,43 +219,81 @@ setup_protocol (VinagreConnectDialog *dialog)
   g_free (last_protocol);
 }
 
-static GPtrArray *
-saved_history (void)
+static guint
+history_capacity (void)
 {
-  gchar *filename, *file_contents = NULL;
-  gchar **history_from_file = NULL, **list;
-  gboolean success;
-  gint len;
-  GPtrArray *array;
+  gint size;
 
-  array = g_ptr_array_new_with_free_func (g_free);
+  g_object_get (vinagre_prefs_get_default (), "history-size", &size, NULL);
+  return size > 0 ? (guint) size : G_MAXUINT;
+}
 
-  filename = history_filename ();
-  success = g_file_get_contents (filename,
-				 &file_contents,
-				 NULL,
-				 NULL);
+/* Drops the oldest hosts beyond the limit */
+static void
+history_trim (VinagreHistory *history)
+{
+  gchar *old;
+  guint  capacity;
 
-  if (success)
+  capacity = history_capacity ();
+  while (history->hosts->length > capacity)
     {
-      history_from_file = g_strsplit (file_contents, "\n", 0);
-      len = g_strv_length (history_from_file);
-      if (len > 0 && strlen (history_from_file[len-1]) == 0)
-	{
-	  g_free (history_from_file[len-1]);
-	  history_from_file[len-1] = NULL;
-	}
+      old = g_queue_pop_tail (history->hosts);
+      g_hash_table_remove (history->index, old);
+      g_free (old);
+    }
+}
+
+static void
+history_touch (VinagreHistory *history, const gchar *host)
+{
+  GList *link;
+
+  link = g_hash_table_lookup (history->index, host);
+  if (link)
+    {
+      g_queue_unlink (history->hosts, link);
+      g_queue_push_head_link (history->hosts, link);
+    }
+  else
+    {
+      g_queue_push_head (history->hosts, g_strdup (host));
+      g_hash_table_insert (history->index, history->hosts->head->data, history->hosts->head);
+    }
+
+  history_trim (history);
+}
+
+static VinagreHistory *
+saved_history (void)
+{
+  gchar *filename, *file_contents = NULL;
+  gchar **lines, **l;
+
+  if (connect_history)
+    return connect_history;
 
-      list = history_from_file;
+  connect_history = g_new0 (VinagreHistory, 1);
+  connect_history->hosts = g_queue_new ();
+  connect_history->index = g_hash_table_new (g_str_hash, g_str_equal);
 
-      while (*list != NULL)
-	g_ptr_array_add (array, *list++);
+  /* The file is a log, oldest first: replaying it rebuilds the order */
+  filename = history_filename ();
+  if (g_file_get_contents (filename, &file_contents, NULL, NULL))
+    {
+      lines = g_strsplit (file_contents, "\n", 0);
+      for (l = lines; *l; l++)
+	if (**l)
+	  {
+	    history_touch (connect_history, *l);
+	    connect_history->file_lines++;
+	  }
+      g_strfreev (lines);
     }
 
   g_free (filename);
   g_free (file_contents);
-  g_free (history_from_file);
-  return array;
+  return connect_history;
 }
 
 static void
@@ -233,41 +303,186 @@ control_connect_button (GtkEditable *entry, VinagreConnectDialog *dialog)
 			    gtk_entry_get_text_length (GTK_ENTRY (entry)) > 0);
 }
 
+static void
+search_changed_cb (GtkEditable *editable, VinagreConnectDialog *dialog)
+{
+  GPtrArray           *results;
+  VinagreSearchResult *result;
+  GtkTreeIter          iter;
+  const gchar         *text;
+  gchar               *label;
+  guint                i;
+
+  text = gtk_entry_get_text (GTK_ENTRY (editable));
+
+  /* Typing over a chosen bookmark means connecting somewhere else */
+  if (dialog->search_entry)
+    {
+      g_object_unref (dialog->search_entry);
+      dialog->search_entry = NULL;
+    }
+
+  gtk_list_store_clear (dialog->search_store);
+  if (!*text)
+    return;
+
+  results = vinagre_search_query (vinagre_search_get_default (),
+				  text,
+				  MAX_SEARCH_RESULTS);
+  for (i = 0; i < results->len; i++)
+    {
+      result = g_ptr_array_index (results, i);
+      if (result->source == VINAGRE_SEARCH_SOURCE_HISTORY)
+	label = g_markup_escape_text (result->host, -1);
+      else
+	label = g_markup_printf_escaped ("%s <small>(%s)</small>",
+					 result->label,
+					 result->host);
+
+      gtk_list_store_append (dialog->search_store, &iter);
+      gtk_list_store_set (dialog->search_store, &iter,
+			  SEARCH_LABEL, label,
+			  SEARCH_HOST, result->host,
+			  SEARCH_PROTOCOL, result->protocol,
+			  SEARCH_ENTRY, result->entry,
+			  -1);
+      g_free (label);
+    }
+  g_ptr_array_free (results, TRUE);
+}
+
+static gboolean
+search_match_func (GtkEntryCompletion *completion,
+		   const gchar        *key,
+		   GtkTreeIter        *iter,
+		   gpointer            user_data)
+{
+  /* The store only ever holds matches */
+  return TRUE;
+}
+
+static void
+select_protocol (VinagreConnectDialog *dialog, const gchar *protocol)
+{
+  GtkTreeModel    *model = GTK_TREE_MODEL (dialog->protocol_store);
+  GtkTreeIter      iter;
+  VinagreProtocol *ext;
+  gboolean         valid, found;
+
+  valid = gtk_tree_model_get_iter_first (model, &iter);
+  while (valid)
+    {
+      gtk_tree_model_get (model, &iter, PROTOCOL_PLUGIN, &ext, -1);
+      found = !g_strcmp0 (vinagre_protocol_get_protocol (ext), protocol);
+      g_object_unref (ext);
+
+      if (found)
+	{
+	  gtk_combo_box_set_active_iter (GTK_COMBO_BOX (dialog->protocol_combo), &iter);
+	  return;
+	}
+      valid = gtk_tree_model_iter_next (model, &iter);
+    }
+}
+
+static gboolean
+search_match_selected_cb (GtkEntryCompletion   *completion,
+			  GtkTreeModel         *model,
+			  GtkTreeIter          *iter,
+			  VinagreConnectDialog *dialog)
+{
+  VinagreBookmarksEntry *entry;
+  GtkWidget             *editable;
+  gchar                 *host, *protocol;
+
+  gtk_tree_model_get (model, iter,
+		      SEARCH_HOST, &host,
+		      SEARCH_PROTOCOL, &protocol,
+		      SEARCH_ENTRY, &entry,
+		      -1);
+
+  editable = gtk_entry_completion_get_entry (completion);
+
+  /* The store is in use by the completion right now: leave it alone */
+  g_signal_handlers_block_by_func (editable, search_changed_cb, dialog);
+  gtk_entry_set_text (GTK_ENTRY (editable), host);
+  g_signal_handlers_unblock_by_func (editable, search_changed_cb, dialog);
+  gtk_editable_set_position (GTK_EDITABLE (editable), -1);
+
+  if (protocol)
+    select_protocol (dialog, protocol);
+
+  if (dialog->search_entry)
+    g_object_unref (dialog->search_entry);
+  dialog->search_entry = entry;
+
+  /* Show what the bookmark will do, the user may still change it */
+  if (entry && vinagre_bookmarks_entry_get_conn (entry))
+    gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (dialog->fullscreen_check),
+				  vinagre_connection_get_fullscreen (vinagre_bookmarks_entry_get_conn (entry)));
+
+  g_free (host);
+  g_free (protocol);
+  return TRUE;
+}
+
 static void
 setup_combo (VinagreConnectDialog *dialog)
 {
   GtkListStore *store;
   GtkEntryCompletion *completion;
-  GPtrArray    *history;
-  gint          i, size;
+  GtkCellRenderer *cell;
+  VinagreHistory *history;
+  GPtrArray    *oldest_first;
+  GList        *l;
   GtkEntry     *entry;
 
   entry = GTK_ENTRY (gtk_bin_get_child (GTK_BIN (dialog->host_entry)));
   store = gtk_list_store_new (N_COLUMNS, G_TYPE_STRING);
 
+  /* The limit may have been lowered since the last connection */
   history = saved_history ();
+  history_trim (history);
+  oldest_first = g_ptr_array_sized_new (history->hosts->length);
 
-  g_object_get (vinagre_prefs_get_default (), "history-size", &size, NULL);
-  if (size <= 0)
-    size = G_MAXINT;
-
-  for (i=history->len-1; i>=0 && i>=(gint)history->len-size; i--)
+  for (l = history->hosts->head; l; l = l->next)
    {
       GtkTreeIter iter;
       gtk_list_store_append (store, &iter);
-      gtk_list_store_set (store, &iter, COLUMN_TEXT, g_ptr_array_index (history, i), -1);
+      gtk_list_store_set (store, &iter, COLUMN_TEXT, l->data, -1);
     }
-  g_ptr_array_free (history, TRUE);
+  for (l = history->hosts->tail; l; l = l->prev)
+    g_ptr_array_add (oldest_first, l->data);
+
+  vinagre_search_set_history (vinagre_search_get_default (), oldest_first);
+  g_ptr_array_free (oldest_first, TRUE);
 
   gtk_combo_box_set_model (GTK_COMBO_BOX (dialog->host_entry),
 			   GTK_TREE_MODEL (store));
   gtk_combo_box_set_entry_text_column (GTK_COMBO_BOX (dialog->host_entry),
 				       0);
 
+  /* The completion offers whatever the search index finds, so the
+   * store must be refilled before the completion reacts to the same
+   * change: connect first. */
+  dialog->search_store = gtk_list_store_new (N_SEARCH_COLUMNS,
+					     G_TYPE_STRING,
+					     G_TYPE_STRING,
+					     G_TYPE_STRING,
+					     VINAGRE_TYPE_BOOKMARKS_ENTRY);
+  dialog->search_entry = NULL;
+  g_signal_connect (entry, "changed", G_CALLBACK (search_changed_cb), dialog);
+
   completion = gtk_entry_completion_new ();
-  gtk_entry_completion_set_model (completion, GTK_TREE_MODEL (store));
-  gtk_entry_completion_set_text_column (completion, 0);
-  gtk_entry_completion_set_inline_completion (completion, TRUE);
+  gtk_entry_completion_set_model (completion, GTK_TREE_MODEL (dialog->search_store));
+  gtk_entry_completion_set_match_func (completion, search_match_func, NULL, NULL);
+  cell = gtk_cell_renderer_text_new ();
+  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (completion), cell, TRUE);
+  gtk_cell_layout_add_attribute (GTK_CELL_LAYOUT (completion), cell, "markup", SEARCH_LABEL);
+  g_signal_connect (completion,
+		    "match-selected",
+		    G_CALLBACK (search_match_selected_cb),
+		    dialog);
   gtk_entry_set_completion (entry, completion);
   g_object_unref (completion);
 
@@ -278,40 +493,58 @@ setup_combo (VinagreConnectDialog *dialog)
 static void
 save_history (GtkWidget *combo) {
   gchar *host;
-  GPtrArray *history;
-  guint i;
+  VinagreHistory *history;
+  GList *l;
   gchar *filename, *path;
   GString *content;
+  GFile *file;
+  GFileOutputStream *stream;
   GError *error = NULL;
 
   host = gtk_combo_box_text_get_active_text (GTK_COMBO_BOX_TEXT (combo));
 
   history = saved_history ();
-  for (i=0; i<history->len; i++)
-    if (!g_strcmp0 (g_ptr_array_index (history, i), host))
-      {
-	g_ptr_array_remove_index (history, i);
-	break;
-      }
-
-  g_ptr_array_add (history, host);
-  content = g_string_new (NULL);
-
-  for (i=0; i<history->len; i++)
-    g_string_append_printf (content, "%s\n", (char *) g_ptr_array_index (history, i));
+  history_touch (history, host);
+  vinagre_search_add_history (vinagre_search_get_default (), host);
 
   filename = history_filename ();
   path = g_path_get_dirname (filename);
   g_mkdir_with_parents (path, 0755);
 
-  g_file_set_contents (filename,
-		       content->str,
-		       -1,
-		       &error);
+  content = g_string_new (NULL);
+  if (history->file_lines >= HISTORY_FILE_SLACK * MAX (history->hosts->length, HISTORY_MIN_LINES))
+    {
+      /* Too many stale lines: write out just the current hosts */
+      for (l = history->hosts->tail; l; l = l->prev)
+	g_string_append_printf (content, "%s\n", (char *) l->data);
+
+      if (g_file_set_contents (filename, content->str, -1, &error))
+	history->file_lines = history->hosts->length;
+    }
+  else
+    {
+      g_string_append_printf (content, "%s\n", host);
+
+      file = g_file_new_for_path (filename);
+      stream = g_file_append_to (file, G_FILE_CREATE_NONE, NULL, &error);
+      if (stream)
+	{
+	  if (g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+					 content->str,
+					 content->len,
+					 NULL,
+					 NULL,
+					 &error))
+	    history->file_lines++;
+	  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL);
+	  g_object_unref (stream);
+	}
+      g_object_unref (file);
+    }
 
+  g_free (host);
   g_free (filename);
   g_free (path);
-  g_ptr_array_free (history, TRUE);
   g_string_free (content, TRUE);
 
   if (error) {
@@ -320,6 +553,117 @@ save_history (GtkWidget *combo) {
   }
 }
 
+/* Same type and settings as @conn, which stays untouched */
+static VinagreConnection *
+copy_connection (VinagreConnection *conn)
+{
+  VinagreConnection *copy;
+  GParamSpec       **pspecs;
+  guint              i, n;
+  GValue             value = { 0, };
+
+  copy = g_object_new (G_OBJECT_TYPE (conn), NULL);
+
+  pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (conn), &n);
+  for (i = 0; i < n; i++)
+    {
+      if ((pspecs[i]->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+	  (pspecs[i]->flags & G_PARAM_CONSTRUCT_ONLY))
+	continue;
+
+      g_value_init (&value, pspecs[i]->value_type);
+      g_object_get_property (G_OBJECT (conn), pspecs[i]->name, &value);
+      g_object_set_property (G_OBJECT (copy), pspecs[i]->name, &value);
+      g_value_unset (&value);
+    }
+  g_free (pspecs);
+
+  return copy;
+}
+
+/* A bookmark picked from the search results keeps all its settings, but
+ * for a fullscreen choice made after picking it */
+static VinagreConnection *
+bookmark_connection (VinagreConnectDialog *dialog)
+{
+  VinagreConnection *conn;
+  gboolean           fullscreen;
+
+  conn = vinagre_bookmarks_entry_get_conn (dialog->search_entry);
+  if (!conn)
+    return NULL;
+
+  fullscreen = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (dialog->fullscreen_check));
+  if (fullscreen == vinagre_connection_get_fullscreen (conn))
+    return g_object_ref (conn);
+
+  conn = copy_connection (conn);
+  vinagre_connection_set_fullscreen (conn, fullscreen);
+  return conn;
+}
+
+static VinagreConnection *
+new_connection (VinagreConnectDialog *dialog,
+		const gchar          *host,
+		VinagreWindow        *window)
+{
+  VinagreConnection *conn;
+  VinagreProtocol   *ext;
+  GtkWidget         *options;
+  GtkTreeIter        iter;
+  gchar             *protocol, *actual_host, *error_msg = NULL;
+  gint               port;
+
+  if (!gtk_combo_box_get_active_iter (GTK_COMBO_BOX (dialog->protocol_combo), &iter))
+    {
+      g_warning (_("Could not get the active protocol from the protocol list."));
+      return NULL;
+    }
+
+  gtk_tree_model_get (GTK_TREE_MODEL (dialog->protocol_store), &iter,
+		      PROTOCOL_NAME, &protocol,
+		      PROTOCOL_OPTIONS, &options,
+		      PROTOCOL_PLUGIN, &ext,
+		      -1);
+
+  vinagre_cache_prefs_set_string ("connection", "last-protocol", protocol);
+  g_free (protocol);
+  vinagre_cache_prefs_set_boolean ("connection", "fullscreen", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (dialog->fullscreen_check)));
+
+  conn = vinagre_protocol_new_connection (ext);
+  if (vinagre_connection_split_string (host,
+				       vinagre_connection_get_protocol (conn),
+				       &protocol,
+				       &actual_host,
+				       &port,
+				       &error_msg))
+    {
+      g_object_set (conn,
+		    "host", actual_host,
+		    "port", port,
+		    "fullscreen", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (dialog->fullscreen_check)),
+		    NULL);
+
+      if (options)
+	vinagre_connection_parse_options_widget (conn, options);
+
+      g_free (protocol);
+      g_free (actual_host);
+    }
+  else
+    {
+      vinagre_utils_show_error_dialog (NULL, error_msg ? error_msg : _("Unknown error"),
+				GTK_WINDOW (window));
+    }
+
+  g_object_unref (ext);
+  if (options)
+    g_object_unref (options);
+  g_free (error_msg);
+
+  return conn;
+}
+
 static void
 vinagre_connect_help_button_cb (GtkButton            *button,
 				VinagreConnectDialog *dialog)
@@ -455,71 +799,27 @@ vinagre_connect (VinagreWindow *window)
 
   if (result == GTK_RESPONSE_OK)
     {
-      gchar *host = NULL, *error_msg = NULL, *protocol = NULL, *actual_host;
-      gint port;
-      GtkWidget *options;
-      GtkTreeIter iter;
-      VinagreProtocol *ext;
+      gchar *host;
 
       host = gtk_combo_box_text_get_active_text (GTK_COMBO_BOX_TEXT (dialog.host_entry));
       gtk_widget_hide (GTK_WIDGET (dialog.dialog));
 
-      if (!host || !g_strcmp0 (host, ""))
-	goto fail;
-
-      save_history (dialog.host_entry);
-
-      if (!gtk_combo_box_get_active_iter (GTK_COMBO_BOX (dialog.protocol_combo), &iter))
+      if (host && *host)
 	{
-	  g_warning (_("Could not get the active protocol from the protocol list."));
-	  goto fail;
-	}
+	  save_history (dialog.host_entry);
 
-      gtk_tree_model_get (GTK_TREE_MODEL (dialog.protocol_store), &iter,
-			  PROTOCOL_NAME, &protocol,
-			  PROTOCOL_OPTIONS, &options,
-			  PROTOCOL_PLUGIN, &ext,
-		      -1);
-
-      vinagre_cache_prefs_set_string ("connection", "last-protocol", protocol);
-      g_free (protocol);
-      vinagre_cache_prefs_set_boolean ("connection", "fullscreen", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (dialog.fullscreen_check)));
-
-      conn = vinagre_protocol_new_connection (ext);
-      if (vinagre_connection_split_string (host,
-					   vinagre_connection_get_protocol (conn),
-					   &protocol,
-					   &actual_host,
-					   &port,
-					   &error_msg))
-	{
-	  g_object_set (conn,
-			"host", actual_host,
-			"port", port,
-			"fullscreen", gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (dialog.fullscreen_check)),
-			NULL);
-
-	  if (options)
-	    vinagre_connection_parse_options_widget (conn, options);
-
-	  g_free (protocol);
-	  g_free (actual_host);
+	  if (dialog.search_entry)
+	    conn = bookmark_connection (&dialog);
+	  if (!conn)
+	    conn = new_connection (&dialog, host, window);
 	}
-      else
-	{
-	  vinagre_utils_show_error_dialog (NULL, error_msg ? error_msg : _("Unknown error"),
-				    GTK_WINDOW (window));
-	}
-
-      g_object_unref (ext);
-      if (options)
-	g_object_unref (options);
 
-fail:
       g_free (host);
-      g_free (error_msg);
     }
 
+  if (dialog.search_entry)
+    g_object_unref (dialog.search_entry);
+  g_object_unref (dialog.search_store);
   gtk_widget_destroy (dialog.dialog);
   g_object_unref (dialog.xml);
   return conn;
@@ -46,6 +46,11 @@ struct _VinagreConnectionPrivate
   gboolean fullscreen;
   guint  width;
   guint  height;
+  guint  capture_interval;
+  gboolean capture_on_bell;
+  gboolean capture_on_resize;
+  gchar *capture_directory;
+  guint  capture_max_size;
 };
 
 enum
@@ -61,7 +66,12 @@ enum
   PROP_BEST_NAME,
   PROP_FULLSCREEN,
   PROP_WIDTH,
-  PROP_HEIGHT
+  PROP_HEIGHT,
+  PROP_CAPTURE_INTERVAL,
+  PROP_CAPTURE_ON_BELL,
+  PROP_CAPTURE_ON_RESIZE,
+  PROP_CAPTURE_DIRECTORY,
+  PROP_CAPTURE_MAX_SIZE
 };
 
 #define VINAGRE_CONNECTION_PRIVATE(o)  (G_TYPE_INSTANCE_GET_PRIVATE ((o), VINAGRE_TYPE_CONNECTION, VinagreConnectionPrivate))
@@ -82,6 +92,11 @@ vinagre_connection_init (VinagreConnection *conn)
   conn->priv->fullscreen = FALSE;
   conn->priv->width = DEFAULT_WIDTH;
   conn->priv->height = DEFAULT_HEIGHT;
+  conn->priv->capture_interval = 0;
+  conn->priv->capture_on_bell = FALSE;
+  conn->priv->capture_on_resize = FALSE;
+  conn->priv->capture_directory = NULL;
+  conn->priv->capture_max_size = 0;
 }
 
 static void
@@ -95,6 +110,7 @@ vinagre_connection_finalize (GObject *object)
   g_free (conn->priv->username);
   g_free (conn->priv->password);
   g_free (conn->priv->name);
+  g_free (conn->priv->capture_directory);
 
   G_OBJECT_CLASS (vinagre_connection_parent_class)->finalize (object);
 }
@@ -150,6 +166,26 @@ vinagre_connection_set_property (GObject *object, guint prop_id, const GValue *v
 	vinagre_connection_set_height (conn, g_value_get_uint (value));
 	break;
 
+      case PROP_CAPTURE_INTERVAL:
+	vinagre_connection_set_capture_interval (conn, g_value_get_uint (value));
+	break;
+
+      case PROP_CAPTURE_ON_BELL:
+	vinagre_connection_set_capture_on_bell (conn, g_value_get_boolean (value));
+	break;
+
+      case PROP_CAPTURE_ON_RESIZE:
+	vinagre_connection_set_capture_on_resize (conn, g_value_get_boolean (value));
+	break;
+
+      case PROP_CAPTURE_DIRECTORY:
+	vinagre_connection_set_capture_directory (conn, g_value_get_string (value));
+	break;
+
+      case PROP_CAPTURE_MAX_SIZE:
+	vinagre_connection_set_capture_max_size (conn, g_value_get_uint (value));
+	break;
+
       default:
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	break;
@@ -212,6 +248,26 @@ vinagre_connection_get_property (GObject *object, guint prop_id, GValue *value,
 	g_value_set_uint (value, conn->priv->height);
 	break;
 
+      case PROP_CAPTURE_INTERVAL:
+	g_value_set_uint (value, conn->priv->capture_interval);
+	break;
+
+      case PROP_CAPTURE_ON_BELL:
+	g_value_set_boolean (value, conn->priv->capture_on_bell);
+	break;
+
+      case PROP_CAPTURE_ON_RESIZE:
+	g_value_set_boolean (value, conn->priv->capture_on_resize);
+	break;
+
+      case PROP_CAPTURE_DIRECTORY:
+	g_value_set_string (value, conn->priv->capture_directory);
+	break;
+
+      case PROP_CAPTURE_MAX_SIZE:
+	g_value_set_uint (value, conn->priv->capture_max_size);
+	break;
+
       default:
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	break;
@@ -231,6 +287,31 @@ default_fill_writer (VinagreConnection *conn, xmlTextWriter *writer)
   xmlTextWriterWriteFormatElement (writer, BAD_CAST "fullscreen", "%d", conn->priv->fullscreen);
   xmlTextWriterWriteFormatElement (writer, BAD_CAST "width", "%d", conn->priv->width);
   xmlTextWriterWriteFormatElement (writer, BAD_CAST "height", "%d", conn->priv->height);
+
+  if (vinagre_connection_get_capture_enabled (conn))
+    {
+      xmlTextWriterWriteFormatElement (writer, BAD_CAST "capture_interval", "%u", conn->priv->capture_interval);
+      xmlTextWriterWriteFormatElement (writer, BAD_CAST "capture_on_bell", "%d", conn->priv->capture_on_bell);
+      xmlTextWriterWriteFormatElement (writer, BAD_CAST "capture_on_resize", "%d", conn->priv->capture_on_resize);
+      xmlTextWriterWriteFormatElement (writer, BAD_CAST "capture_max_size", "%u", conn->priv->capture_max_size);
+      if (conn->priv->capture_directory && *conn->priv->capture_directory)
+	xmlTextWriterWriteElement (writer, BAD_CAST "capture_directory", BAD_CAST conn->priv->capture_directory);
+    }
+}
+
+/* The capture settings have no UI and come straight from the file:
+ * anything negative or unparsable means 0, the feature's off value */
+static guint
+parse_capture_value (const gchar *s_value)
+{
+  gint64  value;
+  gchar  *end;
+
+  value = g_ascii_strtoll (s_value, &end, 10);
+  if (end == s_value || value < 0)
+    return 0;
+
+  return MIN (value, G_MAXUINT);
 }
 
 static void
@@ -259,6 +340,16 @@ default_parse_item (VinagreConnection *conn, xmlNode *root)
 	vinagre_connection_set_width (conn, atoi ((const char *)s_value));
       else if (!xmlStrcmp(curr->name, BAD_CAST "height"))
 	vinagre_connection_set_height (conn, atoi ((const char *)s_value));
+      else if (!xmlStrcmp(curr->name, BAD_CAST "capture_interval"))
+	vinagre_connection_set_capture_interval (conn, parse_capture_value ((const gchar *)s_value));
+      else if (!xmlStrcmp(curr->name, BAD_CAST "capture_on_bell"))
+	vinagre_connection_set_capture_on_bell (conn, vinagre_utils_parse_boolean ((const gchar *)s_value));
+      else if (!xmlStrcmp(curr->name, BAD_CAST "capture_on_resize"))
+	vinagre_connection_set_capture_on_resize (conn, vinagre_utils_parse_boolean ((const gchar *)s_value));
+      else if (!xmlStrcmp(curr->name, BAD_CAST "capture_directory"))
+	vinagre_connection_set_capture_directory (conn, (const gchar *)s_value);
+      else if (!xmlStrcmp(curr->name, BAD_CAST "capture_max_size"))
+	vinagre_connection_set_capture_max_size (conn, parse_capture_value ((const gchar *)s_value));
 
       xmlFree (s_value);
     }
@@ -431,6 +522,59 @@ vinagre_connection_class_init (VinagreConnectionClass *klass)
                                                        G_PARAM_CONSTRUCT |
                                                        G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class,
+                                   PROP_CAPTURE_INTERVAL,
+                                   g_param_spec_uint ("capture-interval",
+                                                      "capture interval",
+                                                      "seconds between two unattended screenshots, 0 to disable",
+                                                       0,
+                                                       G_MAXUINT,
+                                                       0,
+                                                       G_PARAM_READWRITE |
+                                                       G_PARAM_CONSTRUCT |
+                                                       G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_CAPTURE_ON_BELL,
+                                   g_param_spec_boolean ("capture-on-bell",
+                                                        "capture on bell",
+                                                        "Whether a remote bell triggers an unattended screenshot",
+                                                        FALSE,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_CAPTURE_ON_RESIZE,
+                                   g_param_spec_boolean ("capture-on-resize",
+                                                        "capture on resize",
+                                                        "Whether a remote desktop resize triggers an unattended screenshot",
+                                                        FALSE,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_CAPTURE_DIRECTORY,
+                                   g_param_spec_string ("capture-directory",
+                                                        "capture directory",
+                                                        "directory where unattended screenshots are written",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class,
+                                   PROP_CAPTURE_MAX_SIZE,
+                                   g_param_spec_uint ("capture-max-size",
+                                                      "capture max size",
+                                                      "megabytes of unattended screenshots to keep, 0 for no limit",
+                                                       0,
+                                                       G_MAXUINT,
+                                                       0,
+                                                       G_PARAM_READWRITE |
+                                                       G_PARAM_CONSTRUCT |
+                                                       G_PARAM_STATIC_STRINGS));
 }
 
 void
@@ -602,6 +746,103 @@ vinagre_connection_get_height (VinagreConnection *conn)
   return conn->priv->height;
 }
 
+void
+vinagre_connection_set_capture_interval (VinagreConnection *conn,
+					 guint interval)
+{
+  g_return_if_fail (VINAGRE_IS_CONNECTION (conn));
+
+  conn->priv->capture_interval = interval;
+}
+guint
+vinagre_connection_get_capture_interval (VinagreConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_CONNECTION (conn), 0);
+
+  return conn->priv->capture_interval;
+}
+
+void
+vinagre_connection_set_capture_on_bell (VinagreConnection *conn,
+					gboolean value)
+{
+  g_return_if_fail (VINAGRE_IS_CONNECTION (conn));
+
+  conn->priv->capture_on_bell = value;
+}
+gboolean
+vinagre_connection_get_capture_on_bell (VinagreConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_CONNECTION (conn), FALSE);
+
+  return conn->priv->capture_on_bell;
+}
+
+void
+vinagre_connection_set_capture_on_resize (VinagreConnection *conn,
+					  gboolean value)
+{
+  g_return_if_fail (VINAGRE_IS_CONNECTION (conn));
+
+  conn->priv->capture_on_resize = value;
+}
+gboolean
+vinagre_connection_get_capture_on_resize (VinagreConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_CONNECTION (conn), FALSE);
+
+  return conn->priv->capture_on_resize;
+}
+
+void
+vinagre_connection_set_capture_directory (VinagreConnection *conn,
+					  const gchar *directory)
+{
+  g_return_if_fail (VINAGRE_IS_CONNECTION (conn));
+
+  g_free (conn->priv->capture_directory);
+  conn->priv->capture_directory = g_strdup (directory);
+}
+const gchar *
+vinagre_connection_get_capture_directory (VinagreConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_CONNECTION (conn), NULL);
+
+  return conn->priv->capture_directory;
+}
+
+void
+vinagre_connection_set_capture_max_size (VinagreConnection *conn,
+					 guint size)
+{
+  g_return_if_fail (VINAGRE_IS_CONNECTION (conn));
+
+  conn->priv->capture_max_size = size;
+}
+guint
+vinagre_connection_get_capture_max_size (VinagreConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_CONNECTION (conn), 0);
+
+  return conn->priv->capture_max_size;
+}
+
+/**
+ * vinagre_connection_get_capture_enabled:
+ * @conn: a Connection
+ *
+ * Returns: %TRUE if any unattended screenshot trigger is set up
+ */
+gboolean
+vinagre_connection_get_capture_enabled (VinagreConnection *conn)
+{
+  g_return_val_if_fail (VINAGRE_IS_CONNECTION (conn), FALSE);
+
+  return conn->priv->capture_interval > 0 ||
+	 conn->priv->capture_on_bell ||
+	 conn->priv->capture_on_resize;
+}
+
 /**
  * vinagre_connection_split_string:
  * @uri: The URI to be splitted.
@@ -832,6 +1073,29 @@ vinagre_connection_get_string_rep (VinagreConnection *conn,
   return result;
 }
 
+/**
+ * vinagre_connection_get_file_prefix:
+ * @conn: a Connection
+ *
+ * Returns: "protocol-host-port", usable as the start of a file name
+ * identifying @conn. Free it with g_free().
+ */
+gchar*
+vinagre_connection_get_file_prefix (VinagreConnection *conn)
+{
+  gchar *prefix;
+
+  g_return_val_if_fail (VINAGRE_IS_CONNECTION (conn), NULL);
+
+  prefix = g_strdup_printf ("%s-%s-%d",
+			    conn->priv->protocol,
+			    conn->priv->host,
+			    conn->priv->port);
+  g_strdelimit (prefix, G_DIR_SEPARATOR_S ":[]", '_');
+
+  return prefix;
+}
+
 void
 vinagre_connection_fill_writer (VinagreConnection *conn,
 				xmlTextWriterPtr   writer)
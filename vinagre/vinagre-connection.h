@@ -100,6 +100,28 @@ guint		    vinagre_connection_get_height	(VinagreConnection *conn);
 void		    vinagre_connection_set_height	(VinagreConnection *conn,
 							 guint height);
 
+guint		    vinagre_connection_get_capture_interval	(VinagreConnection *conn);
+void		    vinagre_connection_set_capture_interval	(VinagreConnection *conn,
+								 guint interval);
+
+gboolean	    vinagre_connection_get_capture_on_bell	(VinagreConnection *conn);
+void		    vinagre_connection_set_capture_on_bell	(VinagreConnection *conn,
+								 gboolean value);
+
+gboolean	    vinagre_connection_get_capture_on_resize	(VinagreConnection *conn);
+void		    vinagre_connection_set_capture_on_resize	(VinagreConnection *conn,
+								 gboolean value);
+
+const gchar*	    vinagre_connection_get_capture_directory	(VinagreConnection *conn);
+void		    vinagre_connection_set_capture_directory	(VinagreConnection *conn,
+								 const gchar *directory);
+
+guint		    vinagre_connection_get_capture_max_size	(VinagreConnection *conn);
+void		    vinagre_connection_set_capture_max_size	(VinagreConnection *conn,
+								 guint size);
+
+gboolean	    vinagre_connection_get_capture_enabled	(VinagreConnection *conn);
+
 VinagreConnection*  vinagre_connection_new_from_string	(const gchar *url, gchar **error_msg, gboolean use_bookmarks);
 VinagreConnection*  vinagre_connection_new_from_file	(const gchar *uri, gchar **error_msg, gboolean use_bookmarks);
 
@@ -112,6 +134,7 @@ gboolean	    vinagre_connection_split_string	(const gchar *uri,
 
 gchar*		    vinagre_connection_get_string_rep	(VinagreConnection *conn,
 							 gboolean has_protocol);
+gchar*		    vinagre_connection_get_file_prefix	(VinagreConnection *conn);
 
 /* Methods that can be overrided */
 
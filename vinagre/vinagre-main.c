@@ -56,6 +56,7 @@ app_init (GtkApplication *app)
   vinagre_debug_message (DEBUG_APP, "Startup");
 
   vinagre_cache_prefs_init ();
+  vinagre_ssh_init ();
 
   window = GTK_WINDOW (vinagre_window_new ());
   gtk_window_set_application (window, app);
@@ -64,9 +65,6 @@ app_init (GtkApplication *app)
 #ifdef VINAGRE_HAVE_TELEPATHY_GLIB
   vinagre_tubes_manager = vinagre_tubes_manager_new (VINAGRE_WINDOW (window));
 #endif
-
-  /* fake call, just to ensure this symbol will be present at vinagre.so */
-  vinagre_ssh_connect (NULL, NULL, -1, NULL, NULL, NULL, NULL, NULL);
 }
 
 static void
@@ -128,6 +126,7 @@ app_command_line (GApplication            *app,
   argv = g_application_command_line_get_arguments (command_line, &argc);
 
   optionstate.help = FALSE;
+  optionstate.play = NULL;
 
   if (!g_option_context_parse (context, &argc, &argv, &error))
     {
@@ -23,6 +23,7 @@
 #include <avahi-gobject/ga-service-resolver.h>
 #include <avahi-common/malloc.h>
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include "vinagre-mdns.h"
 #include "vinagre-connection.h"
@@ -30,15 +31,40 @@
 #include "vinagre-plugins-engine.h"
 #include "vinagre-protocol.h"
 
+/* How many services are resolved at the same time; the rest wait */
+#define MAX_RESOLVERS 8
+
+/* A service announced over IPv4 and IPv6 is only gone once both withdraw it */
+#define PROTO_BIT(proto) ((proto) == GA_PROTOCOL_INET6 ? 2u : 1u)
+#define PROTO_FROM_BITS(bits) ((bits) & 1u ? GA_PROTOCOL_INET : GA_PROTOCOL_INET6)
+
 typedef struct
 {
   GaServiceBrowser *browser;
   VinagreProtocol  *protocol;
 } BrowserEntry;
 
+typedef struct
+{
+  gchar        *key;
+  AvahiIfIndex  iface;
+  GaProtocol    proto;
+  gchar        *name;
+  gchar        *type;
+  gchar        *domain;
+  GList        *link;	/* In the pending queue, NULL once resolving */
+} ResolveRequest;
+
 struct _VinagreMdnsPrivate
 {
-  GSList           *entries;
+  GHashTable       *index;	/* service key -> VinagreBookmarksEntry */
+  GSList           *entries;	/* Sorted view of index, built on demand */
+  gboolean          entries_dirty;
+  GHashTable       *requests;	/* service key -> ResolveRequest */
+  GHashTable       *announced;	/* service key -> PROTO_BITs announcing it */
+  GQueue           *pending;
+  guint             n_resolving;
+  guint             changed_id;
   GaClient         *client;
   GHashTable       *browsers;
 };
@@ -54,6 +80,62 @@ G_DEFINE_TYPE (VinagreMdns, vinagre_mdns, G_TYPE_OBJECT);
 static VinagreMdns *mdns_singleton = NULL;
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* A service is the same one if its name, type and interface match */
+static gchar *
+service_key (AvahiIfIndex  iface,
+	     const gchar  *type,
+	     const gchar  *name)
+{
+  return g_strdup_printf ("%d\t%s\t%s", iface, type, name);
+}
+
+/* Whether @key, made by service_key, is for a service of @type */
+static gboolean
+service_key_has_type (const gchar *key,
+		      const gchar *type)
+{
+  const gchar *p;
+  gsize        len;
+
+  p = strchr (key, '\t');
+  if (!p)
+    return FALSE;
+
+  len = strlen (type);
+  return strncmp (p + 1, type, len) == 0 && p[1 + len] == '\t';
+}
+
+static void
+resolve_request_free (ResolveRequest *request)
+{
+  g_free (request->key);
+  g_free (request->name);
+  g_free (request->type);
+  g_free (request->domain);
+  g_slice_free (ResolveRequest, request);
+}
+
+static gboolean
+mdns_emit_changed (VinagreMdns *mdns)
+{
+  mdns->priv->changed_id = 0;
+  g_signal_emit (mdns, signals[MDNS_CHANGED], 0);
+
+  return FALSE;
+}
+
+/* Services come and go in bursts: tell listeners once per main loop run */
+static void
+mdns_schedule_changed (VinagreMdns *mdns)
+{
+  mdns->priv->entries_dirty = TRUE;
+
+  if (!mdns->priv->changed_id)
+    mdns->priv->changed_id = g_idle_add ((GSourceFunc) mdns_emit_changed, mdns);
+}
+
+static void mdns_start_resolvers (VinagreMdns *mdns);
+
 static void
 mdns_resolver_found (GaServiceResolver *resolver,
                      AvahiIfIndex         iface,
@@ -71,23 +153,24 @@ mdns_resolver_found (GaServiceResolver *resolver,
   VinagreConnection     *conn;
   VinagreBookmarksEntry *entry;
   BrowserEntry          *b_entry;
+  const gchar           *service;
   char                  a[AVAHI_ADDRESS_STR_MAX], *u = NULL;
-  GSList *l;
+
+  mdns->priv->n_resolving--;
+  service = g_object_get_data (G_OBJECT (resolver), "vinagre-mdns-key");
+
+  /* Gone while we were resolving it */
+  if (!g_hash_table_remove (mdns->priv->requests, service))
+    goto out;
+
+  if (g_hash_table_lookup (mdns->priv->index, service))
+    goto out;
 
   b_entry = g_hash_table_lookup (mdns->priv->browsers, type);
   if (!b_entry)
     {
       g_warning ("Service name not found in mDNS resolver hash table. This probably is a bug somewhere.");
-      return;
-    }
-
-  for (l = mdns->priv->entries; l; l = l->next)
-    {
-      VinagreBookmarksEntry *entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
-      if (strcmp (vinagre_connection_get_name (vinagre_bookmarks_entry_get_conn (entry)), name) == 0)
-	{
-	  goto out;
-	}
+      goto out;
     }
 
   for (; txt; txt = txt->next)
@@ -115,15 +198,13 @@ mdns_resolver_found (GaServiceResolver *resolver,
   entry = vinagre_bookmarks_entry_new_conn (conn);
   g_object_unref (conn);
 
-  mdns->priv->entries = g_slist_insert_sorted (mdns->priv->entries,
-					       entry,
-					       (GCompareFunc)vinagre_bookmarks_entry_compare);
-
-  g_signal_emit (mdns, signals[MDNS_CHANGED], 0);
+  g_hash_table_insert (mdns->priv->index, g_strdup (service), entry);
+  mdns_schedule_changed (mdns);
 
 out:
   g_object_unref (resolver);
   g_free (u);
+  mdns_start_resolvers (mdns);
 }
 
 static void
@@ -132,7 +213,61 @@ mdns_resolver_failure (GaServiceResolver *resolver,
                        VinagreMdns       *mdns)
 {
   g_warning ("%s", error->message);
+
+  mdns->priv->n_resolving--;
+  g_hash_table_remove (mdns->priv->requests,
+		       g_object_get_data (G_OBJECT (resolver), "vinagre-mdns-key"));
   g_object_unref (resolver);
+  mdns_start_resolvers (mdns);
+}
+
+static void
+mdns_start_resolvers (VinagreMdns *mdns)
+{
+  GaServiceResolver *resolver;
+  ResolveRequest    *request;
+  GError            *error = NULL;
+
+  while (mdns->priv->n_resolving < MAX_RESOLVERS &&
+	 !g_queue_is_empty (mdns->priv->pending))
+    {
+      request = g_queue_pop_head (mdns->priv->pending);
+      request->link = NULL;
+
+      resolver = ga_service_resolver_new (request->iface,
+					  request->proto,
+					  request->name,
+					  request->type,
+					  request->domain,
+					  GA_PROTOCOL_UNSPEC,
+					  GA_LOOKUP_NO_FLAGS);
+      g_object_set_data_full (G_OBJECT (resolver),
+			      "vinagre-mdns-key",
+			      g_strdup (request->key),
+			      g_free);
+
+      g_signal_connect (resolver,
+			"found",
+			G_CALLBACK (mdns_resolver_found),
+			mdns);
+      g_signal_connect (resolver,
+			"failure",
+			G_CALLBACK (mdns_resolver_failure),
+			mdns);
+
+      if (!ga_service_resolver_attach (resolver,
+				       mdns->priv->client,
+				       &error))
+	{
+	  g_warning (_("Failed to resolve avahi hostname: %s\n"), error->message);
+	  g_clear_error (&error);
+	  g_hash_table_remove (mdns->priv->requests, request->key);
+	  g_object_unref (resolver);
+	  continue;
+	}
+
+      mdns->priv->n_resolving++;
+    }
 }
 
 static void
@@ -145,33 +280,38 @@ mdns_browser_new_cb (GaServiceBrowser   *browser,
                      GaLookupResultFlags flags,
                      VinagreMdns        *mdns)
 {
-  GaServiceResolver *resolver;
-  GError *error = NULL;
+  ResolveRequest *request;
+  gchar          *key;
+  guint           bits;
 
-  resolver = ga_service_resolver_new (iface,
-                                      proto,
-                                      name,
-                                      type,
-                                      domain,
-                                      GA_PROTOCOL_UNSPEC,
-                                      GA_LOOKUP_NO_FLAGS);
-
-  g_signal_connect (resolver,
-                    "found",
-                    G_CALLBACK (mdns_resolver_found),
-                    mdns);
-  g_signal_connect (resolver,
-                    "failure",
-                    G_CALLBACK (mdns_resolver_failure),
-                    mdns);
+  key = service_key (iface, type, name);
+
+  bits = GPOINTER_TO_UINT (g_hash_table_lookup (mdns->priv->announced, key));
+  g_hash_table_insert (mdns->priv->announced,
+		       g_strdup (key),
+		       GUINT_TO_POINTER (bits | PROTO_BIT (proto)));
 
-  if (!ga_service_resolver_attach (resolver,
-                                   mdns->priv->client,
-                                   &error))
+  /* Already known, or on its way: e.g. the same service over IPv4 and IPv6 */
+  if (g_hash_table_lookup (mdns->priv->index, key) ||
+      g_hash_table_lookup (mdns->priv->requests, key))
     {
-      g_warning (_("Failed to resolve avahi hostname: %s\n"), error->message);
-      g_error_free (error);
+      g_free (key);
+      return;
     }
+
+  request = g_slice_new (ResolveRequest);
+  request->key = key;
+  request->iface = iface;
+  request->proto = proto;
+  request->name = g_strdup (name);
+  request->type = g_strdup (type);
+  request->domain = g_strdup (domain);
+
+  g_queue_push_tail (mdns->priv->pending, request);
+  request->link = mdns->priv->pending->tail;
+  g_hash_table_insert (mdns->priv->requests, request->key, request);
+
+  mdns_start_resolvers (mdns);
 }
 
 static void
@@ -184,19 +324,36 @@ mdns_browser_del_cb (GaServiceBrowser   *browser,
                      GaLookupResultFlags flags,
                      VinagreMdns        *mdns)
 {
-  GSList *l;
+  ResolveRequest *request;
+  gchar          *key;
+  guint           bits;
+
+  key = service_key (iface, type, name);
+  request = g_hash_table_lookup (mdns->priv->requests, key);
 
-  for (l = mdns->priv->entries; l; l = l->next)
+  bits = GPOINTER_TO_UINT (g_hash_table_lookup (mdns->priv->announced, key));
+  bits &= ~PROTO_BIT (proto);
+  if (bits)
     {
-      VinagreBookmarksEntry *entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
-      if (strcmp (vinagre_connection_get_name (vinagre_bookmarks_entry_get_conn (entry)), name) == 0)
-	{
-	  mdns->priv->entries = g_slist_remove (mdns->priv->entries, entry);
-	  g_object_unref (entry);
-	  g_signal_emit (mdns, signals[MDNS_CHANGED], 0);
-	  return;
-	}
+      /* Still announced over the other protocol: resolve it over that one */
+      g_hash_table_insert (mdns->priv->announced, key, GUINT_TO_POINTER (bits));
+      if (request && request->link)
+	request->proto = PROTO_FROM_BITS (bits);
+      return;
+    }
+  g_hash_table_remove (mdns->priv->announced, key);
+
+  if (request)
+    {
+      if (request->link)
+	g_queue_delete_link (mdns->priv->pending, request->link);
+      g_hash_table_remove (mdns->priv->requests, key);
     }
+
+  if (g_hash_table_remove (mdns->priv->index, key))
+    mdns_schedule_changed (mdns);
+
+  g_free (key);
 }
 
 static void
@@ -260,20 +417,38 @@ vinagre_mdns_add_service (VinagreMdns     *mdns,
 }
 
 static void
-vinagre_mdns_remove_entries_by_protocol (VinagreMdns *mdns, const gchar *protocol)
+vinagre_mdns_remove_entries_by_protocol (VinagreMdns     *mdns,
+					 VinagreProtocol *protocol)
 {
-  GSList *l, *next;
+  GHashTableIter         iter;
+  VinagreBookmarksEntry *entry;
+  ResolveRequest        *request;
+  const gchar           *service, *key;
 
-  for (l = mdns->priv->entries; l; l = next)
-    {
-      VinagreBookmarksEntry *entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
-      next = l->next;
-      if (strcmp (vinagre_connection_get_protocol (vinagre_bookmarks_entry_get_conn (entry)), protocol) == 0)
-	{
-	  mdns->priv->entries = g_slist_remove (mdns->priv->entries, entry);
-	  g_object_unref (entry);
-	}
-    }
+  service = vinagre_protocol_get_mdns_service (protocol);
+
+  g_hash_table_iter_init (&iter, mdns->priv->announced);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, NULL))
+    if (service_key_has_type (key, service))
+      g_hash_table_iter_remove (&iter);
+
+  g_hash_table_iter_init (&iter, mdns->priv->requests);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&request))
+    if (strcmp (request->type, service) == 0)
+      {
+	if (request->link)
+	  g_queue_delete_link (mdns->priv->pending, request->link);
+	g_hash_table_iter_remove (&iter);
+      }
+
+  g_hash_table_iter_init (&iter, mdns->priv->index);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+    if (strcmp (vinagre_bookmarks_entry_get_protocol (entry),
+		vinagre_protocol_get_protocol (protocol)) == 0)
+      {
+	g_hash_table_iter_remove (&iter);
+	mdns_schedule_changed (mdns);
+      }
 }
 
 static void
@@ -295,8 +470,7 @@ protocol_removed_cb (VinagrePluginsEngine *engine,
   if (!service)
     return;
 
-  vinagre_mdns_remove_entries_by_protocol (mdns,
-					   vinagre_protocol_get_protocol (protocol));
+  vinagre_mdns_remove_entries_by_protocol (mdns, protocol);
   g_hash_table_remove (mdns->priv->browsers, (gconstpointer)service);
 }
 
@@ -311,7 +485,12 @@ vinagre_mdns_init (VinagreMdns *mdns)
 
   mdns->priv = G_TYPE_INSTANCE_GET_PRIVATE (mdns, VINAGRE_TYPE_MDNS, VinagreMdnsPrivate);
 
+  mdns->priv->index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
   mdns->priv->entries = NULL;
+  mdns->priv->entries_dirty = FALSE;
+  mdns->priv->requests = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)resolve_request_free);
+  mdns->priv->announced = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  mdns->priv->pending = g_queue_new ();
   mdns->priv->browsers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)destroy_browser_entry);
   mdns->priv->client = ga_client_new (GA_CLIENT_FLAG_NO_FLAGS);
 
@@ -359,10 +538,28 @@ vinagre_mdns_dispose (GObject *object)
       mdns->priv->client = NULL;
     }
 
-  if (mdns->priv->entries)
+  if (mdns->priv->changed_id)
+    {
+      g_source_remove (mdns->priv->changed_id);
+      mdns->priv->changed_id = 0;
+    }
+
+  if (mdns->priv->index)
     {
-      g_slist_free_full (mdns->priv->entries, g_object_unref);
+      g_slist_free (mdns->priv->entries);
       mdns->priv->entries = NULL;
+      g_hash_table_destroy (mdns->priv->index);
+      mdns->priv->index = NULL;
+    }
+
+  if (mdns->priv->requests)
+    {
+      g_queue_free (mdns->priv->pending);
+      mdns->priv->pending = NULL;
+      g_hash_table_destroy (mdns->priv->requests);
+      mdns->priv->requests = NULL;
+      g_hash_table_destroy (mdns->priv->announced);
+      mdns->priv->announced = NULL;
     }
 
   G_OBJECT_CLASS (vinagre_mdns_parent_class)->dispose (object);
@@ -403,6 +600,22 @@ vinagre_mdns_get_all (VinagreMdns *mdns)
 {
   g_return_val_if_fail (VINAGRE_IS_MDNS (mdns), NULL);
 
+  if (mdns->priv->entries_dirty)
+    {
+      GHashTableIter  iter;
+      gpointer        entry;
+
+      g_slist_free (mdns->priv->entries);
+      mdns->priv->entries = NULL;
+
+      g_hash_table_iter_init (&iter, mdns->priv->index);
+      while (g_hash_table_iter_next (&iter, NULL, &entry))
+	mdns->priv->entries = g_slist_prepend (mdns->priv->entries, entry);
+
+      mdns->priv->entries = vinagre_bookmarks_entry_sort (mdns->priv->entries);
+      mdns->priv->entries_dirty = FALSE;
+    }
+
   return mdns->priv->entries;
 }
 
@@ -216,6 +216,14 @@ vinagre_notebook_update_ui_sentitivity (VinagreNotebook *nb)
 				    nb->priv->active_tab &&
 				    vinagre_tab_get_has_screenshot (nb->priv->active_tab));
 
+  action = gtk_action_group_get_action (action_group, "RemoteRecord");
+  gtk_action_set_sensitive (action, active &&
+				    nb->priv->active_tab &&
+				    vinagre_tab_get_has_screenshot (nb->priv->active_tab));
+  gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action),
+				nb->priv->active_tab &&
+				vinagre_tab_get_recording (nb->priv->active_tab));
+
   if (nb->priv->active_tab)
     {
       GtkWidget *spinner, *icon;
@@ -24,6 +24,7 @@
 #include "vinagre-window.h"
 #include "vinagre-commands.h"
 #include "vinagre-options.h"
+#include "vinagre-player.h"
 #include "vinagre-vala.h"
 
 const GOptionEntry all_options [] =
@@ -44,6 +45,10 @@ const GOptionEntry all_options [] =
   /* Translators: this is a command line option (run vinagre --help) */
     N_("Open a file recognized by Vinagre"), N_("filename")},
 
+  { "play", 0, 0, G_OPTION_ARG_FILENAME, &optionstate.play,
+  /* Translators: this is a command line option (run vinagre --help) */
+    N_("Play back a recorded session"), N_("filename")},
+
   { "help", '?', 0, G_OPTION_ARG_NONE, &optionstate.help,
     N_("Show help"), NULL},
 
@@ -107,6 +112,21 @@ vinagre_options_process_command_line (GtkApplication *app,
       g_strfreev (options->uris);
     }
 
+  if (options->play)
+    {
+      GError *play_error = NULL;
+
+      if (!vinagre_player_open (app, options->play, &play_error))
+	{
+	  errors = g_slist_prepend (errors,
+				    g_strdup_printf ("<i>%s</i>: %s",
+						     options->play,
+						     play_error->message));
+	  g_error_free (play_error);
+	}
+      g_free (options->play);
+    }
+
   if (servers &&
       options->new_window)
     {
@@ -30,6 +30,7 @@ typedef struct {
   gboolean new_window;
   gboolean fullscreen;
   gchar *geometry;
+  gchar *play;
   gboolean help;
 } VinagreCmdLineOptions;
 
@@ -0,0 +1,527 @@
+/*
+ * vinagre-player.c
+ * Playback of recorded sessions
+ * This file is part of vinagre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+#include "vinagre-player.h"
+#include "vinagre-recorder.h"
+#include "vinagre-debug.h"
+
+/* Milliseconds between two frames of the playback */
+#define PLAYER_TICK	40
+
+typedef struct
+{
+  guint8  type;
+  guint32 timestamp;
+  guint32 raw_len;
+  guint32 len;
+  gsize   offset;
+} PlayerChunk;
+
+typedef struct
+{
+  GMappedFile     *file;
+  GArray          *chunks;
+  GArray          *keyframes;
+  GConverter      *decompressor;
+  cairo_surface_t *surface;
+
+  GtkWidget       *window;
+  GtkWidget       *area;
+  GtkWidget       *button;
+  GtkWidget       *scale;
+  GtkWidget       *label;
+  gulong           scale_handler_id;
+
+  guint            next;
+  guint32          position;
+  guint32          duration;
+  gint64           play_start;
+  guint32          play_start_position;
+  guint            timeout_id;
+} VinagrePlayer;
+
+static guint16
+get_uint16 (const guint8 *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static guint32
+get_uint32 (const guint8 *p)
+{
+  return ((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Builds the list of chunks, without inflating any of them. A recording
+ * interrupted in the middle of a chunk is played up to that chunk. */
+static gboolean
+index_chunks (VinagrePlayer *player, GError **error)
+{
+  const guint8 *data;
+  gsize         len, offset;
+  PlayerChunk   chunk;
+  guint         index;
+
+  data = (const guint8 *) g_mapped_file_get_contents (player->file);
+  len = g_mapped_file_get_length (player->file);
+
+  if (len < VINAGRE_RECORDING_MAGIC_LEN ||
+      memcmp (data, VINAGRE_RECORDING_MAGIC, VINAGRE_RECORDING_MAGIC_LEN) != 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			   _("The file is not a session recording."));
+      return FALSE;
+    }
+
+  offset = VINAGRE_RECORDING_MAGIC_LEN;
+  while (offset + VINAGRE_RECORDING_CHUNK_HEADER <= len)
+    {
+      chunk.type = data[offset];
+      chunk.timestamp = get_uint32 (data + offset + 1);
+      chunk.raw_len = get_uint32 (data + offset + 5);
+      chunk.len = get_uint32 (data + offset + 9);
+      chunk.offset = offset + VINAGRE_RECORDING_CHUNK_HEADER;
+
+      if (chunk.len > len - chunk.offset)
+	break;
+      /* Deflate expands at most about 1032:1, anything claiming more is a
+       * corrupted or hostile length we must not allocate for */
+      if (chunk.raw_len > (guint64) chunk.len * 1032 + 64)
+	break;
+      if (chunk.type != VINAGRE_RECORDING_KEYFRAME &&
+	  chunk.type != VINAGRE_RECORDING_UPDATE)
+	break;
+
+      /* Updates before the first keyframe have nothing to apply to */
+      if (chunk.type == VINAGRE_RECORDING_KEYFRAME || player->keyframes->len > 0)
+	{
+	  if (chunk.type == VINAGRE_RECORDING_KEYFRAME)
+	    {
+	      index = player->chunks->len;
+	      g_array_append_val (player->keyframes, index);
+	    }
+	  g_array_append_val (player->chunks, chunk);
+	  player->duration = chunk.timestamp;
+	}
+
+      offset = chunk.offset + chunk.len;
+    }
+
+  if (player->keyframes->len == 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			   _("The session recording is empty."));
+      return FALSE;
+    }
+
+  vinagre_debug_message (DEBUG_VIEW, "Indexed %u chunks, %u keyframes, %u ms",
+			 player->chunks->len, player->keyframes->len, player->duration);
+  return TRUE;
+}
+
+static guint8 *
+inflate_chunk (VinagrePlayer *player, const PlayerChunk *chunk)
+{
+  const guint8     *data;
+  GConverterResult  res;
+  guint8           *out;
+  gsize             read, written, in_pos = 0, out_pos = 0;
+
+  data = (const guint8 *) g_mapped_file_get_contents (player->file) + chunk->offset;
+  out = g_try_malloc (chunk->raw_len);
+  if (!out)
+    return NULL;
+
+  g_converter_reset (player->decompressor);
+  do
+    {
+      res = g_converter_convert (player->decompressor,
+				 data + in_pos, chunk->len - in_pos,
+				 out + out_pos, chunk->raw_len - out_pos,
+				 G_CONVERTER_INPUT_AT_END,
+				 &read, &written,
+				 NULL);
+      if (res == G_CONVERTER_ERROR)
+	{
+	  g_free (out);
+	  return NULL;
+	}
+
+      in_pos += read;
+      out_pos += written;
+    }
+  while (res != G_CONVERTER_FINISHED);
+
+  if (out_pos != chunk->raw_len)
+    {
+      g_free (out);
+      return NULL;
+    }
+
+  return out;
+}
+
+static void
+blit (cairo_surface_t *surface,
+      gint             x,
+      gint             y,
+      gint             width,
+      gint             height,
+      const guint8    *rgb)
+{
+  guchar  *data;
+  guint32 *dst;
+  gint     stride, surface_width, surface_height, row, col;
+
+  surface_width = cairo_image_surface_get_width (surface);
+  surface_height = cairo_image_surface_get_height (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
+
+  for (row = 0; row < height && y + row < surface_height; row++)
+    {
+      const guint8 *src = rgb + (gsize) row * width * 3;
+
+      dst = (guint32 *) (data + (gsize) (y + row) * stride) + x;
+      for (col = 0; col < width && x + col < surface_width; col++, src += 3)
+	dst[col] = 0xff000000 | (src[0] << 16) | (src[1] << 8) | src[2];
+    }
+
+  cairo_surface_mark_dirty_rectangle (surface, x, y, width, height);
+}
+
+static void
+apply_chunk (VinagrePlayer *player, const PlayerChunk *chunk)
+{
+  guint8 *payload;
+  gint    x = 0, y = 0, width, height;
+  gsize   header;
+
+  payload = inflate_chunk (player, chunk);
+  if (!payload)
+    {
+      vinagre_debug_message (DEBUG_VIEW, "Skipping corrupted chunk at %u ms", chunk->timestamp);
+      return;
+    }
+
+  header = chunk->type == VINAGRE_RECORDING_KEYFRAME ? 4 : 8;
+  if (chunk->raw_len < header)
+    goto out;
+
+  if (chunk->type == VINAGRE_RECORDING_UPDATE)
+    {
+      x = get_uint16 (payload);
+      y = get_uint16 (payload + 2);
+    }
+  width = get_uint16 (payload + header - 4);
+  height = get_uint16 (payload + header - 2);
+  if (chunk->raw_len != header + (gsize) width * height * 3)
+    goto out;
+
+  if (chunk->type == VINAGRE_RECORDING_KEYFRAME &&
+      (!player->surface ||
+       cairo_image_surface_get_width (player->surface) != width ||
+       cairo_image_surface_get_height (player->surface) != height))
+    {
+      if (player->surface)
+	cairo_surface_destroy (player->surface);
+      player->surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+      gtk_widget_set_size_request (player->area, width, height);
+    }
+
+  if (player->surface)
+    blit (player->surface, x, y, width, height, payload + header);
+
+out:
+  g_free (payload);
+}
+
+static void
+advance (VinagrePlayer *player, guint32 position)
+{
+  PlayerChunk *chunk;
+
+  while (player->next < player->chunks->len)
+    {
+      chunk = &g_array_index (player->chunks, PlayerChunk, player->next);
+      if (chunk->timestamp > position)
+	break;
+
+      apply_chunk (player, chunk);
+      player->next++;
+    }
+
+  player->position = position;
+  gtk_widget_queue_draw (player->area);
+}
+
+/* Restarts from the last keyframe before @position */
+static void
+seek (VinagrePlayer *player, guint32 position)
+{
+  guint low, high, mid, index;
+
+  low = 0;
+  high = player->keyframes->len;
+  while (high - low > 1)
+    {
+      mid = (low + high) / 2;
+      index = g_array_index (player->keyframes, guint, mid);
+      if (g_array_index (player->chunks, PlayerChunk, index).timestamp <= position)
+	low = mid;
+      else
+	high = mid;
+    }
+
+  index = g_array_index (player->keyframes, guint, low);
+  apply_chunk (player, &g_array_index (player->chunks, PlayerChunk, index));
+  player->next = index + 1;
+
+  advance (player, position);
+}
+
+static void
+update_controls (VinagrePlayer *player)
+{
+  gchar *text;
+
+  g_signal_handler_block (player->scale, player->scale_handler_id);
+  gtk_range_set_value (GTK_RANGE (player->scale), player->position);
+  g_signal_handler_unblock (player->scale, player->scale_handler_id);
+
+  text = g_strdup_printf ("%u:%02u / %u:%02u",
+			  player->position / 60000, (player->position / 1000) % 60,
+			  player->duration / 60000, (player->duration / 1000) % 60);
+  gtk_label_set_text (GTK_LABEL (player->label), text);
+  g_free (text);
+
+  gtk_button_set_label (GTK_BUTTON (player->button),
+			player->timeout_id ? GTK_STOCK_MEDIA_PAUSE : GTK_STOCK_MEDIA_PLAY);
+}
+
+static void
+player_pause (VinagrePlayer *player)
+{
+  if (player->timeout_id)
+    {
+      g_source_remove (player->timeout_id);
+      player->timeout_id = 0;
+    }
+  update_controls (player);
+}
+
+static gboolean
+play_timeout_cb (VinagrePlayer *player)
+{
+  guint32 position;
+
+  position = player->play_start_position +
+	     (g_get_monotonic_time () - player->play_start) / 1000;
+
+  if (position >= player->duration)
+    {
+      advance (player, player->duration);
+      player->timeout_id = 0;
+      update_controls (player);
+      return FALSE;
+    }
+
+  advance (player, position);
+  update_controls (player);
+
+  return TRUE;
+}
+
+static void
+player_play (VinagrePlayer *player)
+{
+  if (player->timeout_id)
+    return;
+
+  if (player->position >= player->duration)
+    seek (player, 0);
+
+  player->play_start = g_get_monotonic_time ();
+  player->play_start_position = player->position;
+  player->timeout_id = g_timeout_add (PLAYER_TICK,
+				      (GSourceFunc) play_timeout_cb,
+				      player);
+  update_controls (player);
+}
+
+static void
+button_clicked_cb (GtkButton *button, VinagrePlayer *player)
+{
+  if (player->timeout_id)
+    player_pause (player);
+  else
+    player_play (player);
+}
+
+static void
+scale_value_changed_cb (GtkRange *range, VinagrePlayer *player)
+{
+  guint32 position = gtk_range_get_value (range);
+
+  /* Going forward only needs the chunks in between */
+  if (position >= player->position)
+    advance (player, position);
+  else
+    seek (player, position);
+
+  player->play_start = g_get_monotonic_time ();
+  player->play_start_position = position;
+  update_controls (player);
+}
+
+static gboolean
+area_draw_cb (GtkWidget *area, cairo_t *cr, VinagrePlayer *player)
+{
+  if (!player->surface)
+    return FALSE;
+
+  cairo_set_source_surface (cr, player->surface, 0, 0);
+  cairo_paint (cr);
+
+  return TRUE;
+}
+
+static void
+player_free (VinagrePlayer *player)
+{
+  if (player->timeout_id)
+    g_source_remove (player->timeout_id);
+  if (player->surface)
+    cairo_surface_destroy (player->surface);
+
+  g_object_unref (player->decompressor);
+  g_array_free (player->chunks, TRUE);
+  g_array_free (player->keyframes, TRUE);
+  g_mapped_file_unref (player->file);
+  g_slice_free (VinagrePlayer, player);
+}
+
+static void
+window_destroy_cb (GtkWidget *window, VinagrePlayer *player)
+{
+  player_free (player);
+}
+
+static void
+setup_window (VinagrePlayer *player, const gchar *filename)
+{
+  GtkWidget *box, *controls, *scroll;
+  gchar     *name, *title;
+
+  player->window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  name = g_filename_display_basename (filename);
+  /* Translators: %s is the file name of a session recording */
+  title = g_strdup_printf (_("%s - Session Recording"), name);
+  gtk_window_set_title (GTK_WINDOW (player->window), title);
+  g_free (title);
+  g_free (name);
+  gtk_window_set_default_size (GTK_WINDOW (player->window), 800, 600);
+
+  box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+  gtk_container_add (GTK_CONTAINER (player->window), box);
+
+  player->area = gtk_drawing_area_new ();
+  g_signal_connect (player->area, "draw", G_CALLBACK (area_draw_cb), player);
+  scroll = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_add_with_viewport (GTK_SCROLLED_WINDOW (scroll), player->area);
+  gtk_box_pack_start (GTK_BOX (box), scroll, TRUE, TRUE, 0);
+
+  controls = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  gtk_container_set_border_width (GTK_CONTAINER (controls), 6);
+  gtk_box_pack_start (GTK_BOX (box), controls, FALSE, FALSE, 0);
+
+  player->button = gtk_button_new_from_stock (GTK_STOCK_MEDIA_PLAY);
+  g_signal_connect (player->button, "clicked", G_CALLBACK (button_clicked_cb), player);
+  gtk_box_pack_start (GTK_BOX (controls), player->button, FALSE, FALSE, 0);
+
+  player->scale = gtk_scale_new_with_range (GTK_ORIENTATION_HORIZONTAL,
+					    0, MAX (player->duration, 1), 1000);
+  gtk_scale_set_draw_value (GTK_SCALE (player->scale), FALSE);
+  player->scale_handler_id = g_signal_connect (player->scale, "value-changed",
+					       G_CALLBACK (scale_value_changed_cb), player);
+  gtk_box_pack_start (GTK_BOX (controls), player->scale, TRUE, TRUE, 0);
+
+  player->label = gtk_label_new (NULL);
+  gtk_box_pack_start (GTK_BOX (controls), player->label, FALSE, FALSE, 0);
+
+  g_signal_connect (player->window, "destroy", G_CALLBACK (window_destroy_cb), player);
+}
+
+/**
+ * vinagre_player_open:
+ * @app: the application owning the player window
+ * @filename: a file written by #VinagreRecorder
+ * @error: return location for a #GError, or %NULL
+ *
+ * Opens a window playing back a recorded session. The file is mapped and
+ * only its chunk headers are read upfront; seeking inflates the nearest
+ * keyframe and the updates that follow it.
+ *
+ * Returns: %TRUE if the recording could be opened
+ */
+gboolean
+vinagre_player_open (GtkApplication *app,
+		     const gchar    *filename,
+		     GError        **error)
+{
+  VinagrePlayer *player;
+  GMappedFile   *file;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (!file)
+    return FALSE;
+
+  player = g_slice_new0 (VinagrePlayer);
+  player->file = file;
+  player->chunks = g_array_new (FALSE, FALSE, sizeof (PlayerChunk));
+  player->keyframes = g_array_new (FALSE, FALSE, sizeof (guint));
+  player->decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+
+  if (!index_chunks (player, error))
+    {
+      player_free (player);
+      return FALSE;
+    }
+
+  setup_window (player, filename);
+  gtk_window_set_application (GTK_WINDOW (player->window), app);
+
+  seek (player, 0);
+  update_controls (player);
+  gtk_widget_show_all (player->window);
+  player_play (player);
+
+  return TRUE;
+}
+
+/* vim: set ts=8: */
@@ -0,0 +1,340 @@
+/*
+ * vinagre-recorder.c
+ * Damage-based recording of a remote session
+ * This file is part of vinagre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+#include "vinagre-recorder.h"
+#include "vinagre-debug.h"
+
+/* Chunks waiting for the encoder before the caller is told to hold back */
+#define MAX_PENDING_CHUNKS	4
+/* Favour speed, screen contents compress well even at the lowest level */
+#define COMPRESSION_LEVEL	1
+
+typedef struct
+{
+  guint8     type;
+  guint32    timestamp;
+  GdkPixbuf *pix;
+  gint       x, y;
+} RecorderJob;
+
+struct _VinagreRecorder
+{
+  gchar         *filename;
+  gint64         start;
+  GThreadPool   *pool;
+
+  /* Only touched from the worker thread */
+  GOutputStream *stream;
+  GConverter    *compressor;
+  gboolean       failed;
+};
+
+static void
+put_uint16 (guint8 *p, guint16 value)
+{
+  p[0] = value >> 8;
+  p[1] = value & 0xff;
+}
+
+static void
+put_uint32 (guint8 *p, guint32 value)
+{
+  p[0] = value >> 24;
+  p[1] = (value >> 16) & 0xff;
+  p[2] = (value >> 8) & 0xff;
+  p[3] = value & 0xff;
+}
+
+/* Serializes the job as header fields followed by packed RGB rows */
+static guint8 *
+job_to_payload (RecorderJob *job, gsize *len)
+{
+  const guchar *pixels, *src;
+  guint8       *payload, *p;
+  gint          width, height, rowstride, n_channels, x, y;
+  gsize         header;
+
+  width = gdk_pixbuf_get_width (job->pix);
+  height = gdk_pixbuf_get_height (job->pix);
+  rowstride = gdk_pixbuf_get_rowstride (job->pix);
+  n_channels = gdk_pixbuf_get_n_channels (job->pix);
+  pixels = gdk_pixbuf_get_pixels (job->pix);
+
+  header = job->type == VINAGRE_RECORDING_KEYFRAME ? 4 : 8;
+  *len = header + (gsize) width * height * 3;
+  payload = g_malloc (*len);
+
+  p = payload;
+  if (job->type == VINAGRE_RECORDING_UPDATE)
+    {
+      put_uint16 (p, job->x);
+      put_uint16 (p + 2, job->y);
+      p += 4;
+    }
+  put_uint16 (p, width);
+  put_uint16 (p + 2, height);
+  p += 4;
+
+  for (y = 0; y < height; y++)
+    {
+      src = pixels + y * rowstride;
+      for (x = 0; x < width; x++, src += n_channels, p += 3)
+	memcpy (p, src, 3);
+    }
+
+  return payload;
+}
+
+static guint8 *
+deflate_payload (GConverter   *compressor,
+		 const guint8 *data,
+		 gsize         len,
+		 gsize        *out_len,
+		 GError      **error)
+{
+  GConverterResult  res;
+  GError           *conv_error = NULL;
+  guint8           *out;
+  gsize             size, read, written, in_pos = 0, out_pos = 0;
+
+  g_converter_reset (compressor);
+
+  size = len + len / 8 + 64;
+  out = g_malloc (size);
+
+  do
+    {
+      res = g_converter_convert (compressor,
+				 data + in_pos, len - in_pos,
+				 out + out_pos, size - out_pos,
+				 G_CONVERTER_INPUT_AT_END,
+				 &read, &written,
+				 &conv_error);
+      if (res == G_CONVERTER_ERROR)
+	{
+	  if (g_error_matches (conv_error, G_IO_ERROR, G_IO_ERROR_NO_SPACE))
+	    {
+	      g_clear_error (&conv_error);
+	      size *= 2;
+	      out = g_realloc (out, size);
+	      continue;
+	    }
+
+	  g_propagate_error (error, conv_error);
+	  g_free (out);
+	  return NULL;
+	}
+
+      in_pos += read;
+      out_pos += written;
+    }
+  while (res != G_CONVERTER_FINISHED);
+
+  *out_len = out_pos;
+  return out;
+}
+
+static gboolean
+write_job (VinagreRecorder *recorder, RecorderJob *job, GError **error)
+{
+  guint8   header[VINAGRE_RECORDING_CHUNK_HEADER];
+  guint8  *payload, *deflated;
+  gsize    len, deflated_len;
+  gboolean result;
+
+  payload = job_to_payload (job, &len);
+  deflated = deflate_payload (recorder->compressor, payload, len, &deflated_len, error);
+  g_free (payload);
+  if (!deflated)
+    return FALSE;
+
+  header[0] = job->type;
+  put_uint32 (header + 1, job->timestamp);
+  put_uint32 (header + 5, len);
+  put_uint32 (header + 9, deflated_len);
+
+  result = g_output_stream_write_all (recorder->stream, header, sizeof (header), NULL, NULL, error) &&
+	   g_output_stream_write_all (recorder->stream, deflated, deflated_len, NULL, NULL, error);
+
+  vinagre_debug_message (DEBUG_VIEW, "Recorded %c chunk at %u ms: %" G_GSIZE_FORMAT " -> %" G_GSIZE_FORMAT " bytes",
+			 job->type, job->timestamp, len, deflated_len);
+
+  g_free (deflated);
+  return result;
+}
+
+static void
+recorder_worker (gpointer data, gpointer user_data)
+{
+  RecorderJob     *job = data;
+  VinagreRecorder *recorder = user_data;
+  GError          *error = NULL;
+
+  if (!recorder->failed && !write_job (recorder, job, &error))
+    {
+      g_warning (_("Error recording the session to %s: %s"),
+		 recorder->filename,
+		 error->message);
+      g_error_free (error);
+      recorder->failed = TRUE;
+    }
+
+  g_object_unref (job->pix);
+  g_slice_free (RecorderJob, job);
+}
+
+static void
+push_job (VinagreRecorder *recorder,
+	  guint8           type,
+	  GdkPixbuf       *pix,
+	  gint             x,
+	  gint             y)
+{
+  RecorderJob *job;
+
+  job = g_slice_new (RecorderJob);
+  job->type = type;
+  job->timestamp = (g_get_monotonic_time () - recorder->start) / 1000;
+  job->pix = g_object_ref (pix);
+  job->x = x;
+  job->y = y;
+
+  g_thread_pool_push (recorder->pool, job, NULL);
+}
+
+/**
+ * vinagre_recorder_new:
+ * @filename: the file to record into, overwritten if it exists
+ * @error: return location for a #GError, or %NULL
+ *
+ * Compression and disk writes happen in a background thread. The caller
+ * feeds a keyframe first, then the damaged areas of the screen.
+ *
+ * Returns: a new #VinagreRecorder, or %NULL on error
+ */
+VinagreRecorder *
+vinagre_recorder_new (const gchar *filename,
+		      GError     **error)
+{
+  VinagreRecorder   *recorder;
+  GFile             *file;
+  GFileOutputStream *out;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  file = g_file_new_for_path (filename);
+  out = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, error);
+  g_object_unref (file);
+  if (!out)
+    return NULL;
+
+  if (!g_output_stream_write_all (G_OUTPUT_STREAM (out),
+				  VINAGRE_RECORDING_MAGIC,
+				  VINAGRE_RECORDING_MAGIC_LEN,
+				  NULL, NULL, error))
+    {
+      g_object_unref (out);
+      return NULL;
+    }
+
+  recorder = g_slice_new0 (VinagreRecorder);
+  recorder->filename = g_strdup (filename);
+  recorder->start = g_get_monotonic_time ();
+  recorder->stream = g_buffered_output_stream_new (G_OUTPUT_STREAM (out));
+  recorder->compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW,
+							     COMPRESSION_LEVEL));
+  g_object_unref (out);
+
+  /* A single worker keeps the chunks ordered */
+  recorder->pool = g_thread_pool_new (recorder_worker, recorder, 1, FALSE, NULL);
+
+  return recorder;
+}
+
+void
+vinagre_recorder_add_keyframe (VinagreRecorder *recorder,
+			       GdkPixbuf       *frame)
+{
+  g_return_if_fail (recorder != NULL);
+  g_return_if_fail (GDK_IS_PIXBUF (frame));
+
+  push_job (recorder, VINAGRE_RECORDING_KEYFRAME, frame, 0, 0);
+}
+
+void
+vinagre_recorder_add_update (VinagreRecorder *recorder,
+			     GdkPixbuf       *pixels,
+			     gint             x,
+			     gint             y)
+{
+  g_return_if_fail (recorder != NULL);
+  g_return_if_fail (GDK_IS_PIXBUF (pixels));
+
+  push_job (recorder, VINAGRE_RECORDING_UPDATE, pixels, x, y);
+}
+
+/**
+ * vinagre_recorder_get_lagging:
+ * @recorder: a #VinagreRecorder
+ *
+ * Chunks are never dropped, since a missing update would corrupt the rest
+ * of the recording. Instead, while this returns %TRUE the caller should keep
+ * accumulating damage and submit it later as fewer, larger updates.
+ *
+ * Returns: whether the encoder is falling behind
+ */
+gboolean
+vinagre_recorder_get_lagging (VinagreRecorder *recorder)
+{
+  g_return_val_if_fail (recorder != NULL, FALSE);
+
+  return g_thread_pool_unprocessed (recorder->pool) >= MAX_PENDING_CHUNKS;
+}
+
+void
+vinagre_recorder_free (VinagreRecorder *recorder)
+{
+  GError *error = NULL;
+
+  if (!recorder)
+    return;
+
+  /* Let the chunks already queued reach the disk */
+  g_thread_pool_free (recorder->pool, FALSE, TRUE);
+
+  if (!g_output_stream_close (recorder->stream, NULL, &error))
+    {
+      g_warning (_("Error recording the session to %s: %s"),
+		 recorder->filename,
+		 error->message);
+      g_error_free (error);
+    }
+
+  g_object_unref (recorder->stream);
+  g_object_unref (recorder->compressor);
+  g_free (recorder->filename);
+  g_slice_free (VinagreRecorder, recorder);
+}
+
+/* vim: set ts=8: */
@@ -0,0 +1,67 @@
+/*
+ * vinagre-recorder.h
+ * Damage-based recording of a remote session
+ * This file is part of vinagre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VINAGRE_RECORDER_H__
+#define __VINAGRE_RECORDER_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Recording file layout, all integers big endian:
+ *
+ *   "VNGREC01"                    magic
+ *   chunk*
+ *
+ * chunk:
+ *   guint8  type                  'K' (keyframe) or 'U' (update)
+ *   guint32 timestamp             milliseconds since the start
+ *   guint32 raw length            payload size once inflated
+ *   guint32 length                size of the deflated payload
+ *   guint8  payload[length]       raw deflate stream
+ *
+ * Keyframe payload: guint16 width, guint16 height, packed RGB rows.
+ * Update payload: guint16 x, y, width, height, packed RGB rows.
+ */
+#define VINAGRE_RECORDING_MAGIC		"VNGREC01"
+#define VINAGRE_RECORDING_MAGIC_LEN	8
+#define VINAGRE_RECORDING_CHUNK_HEADER	13
+#define VINAGRE_RECORDING_KEYFRAME	'K'
+#define VINAGRE_RECORDING_UPDATE	'U'
+
+typedef struct _VinagreRecorder VinagreRecorder;
+
+VinagreRecorder *	vinagre_recorder_new		(const gchar *filename,
+							 GError     **error);
+void			vinagre_recorder_free		(VinagreRecorder *recorder);
+
+void			vinagre_recorder_add_keyframe	(VinagreRecorder *recorder,
+							 GdkPixbuf       *frame);
+void			vinagre_recorder_add_update	(VinagreRecorder *recorder,
+							 GdkPixbuf       *pixels,
+							 gint             x,
+							 gint             y);
+
+gboolean		vinagre_recorder_get_lagging	(VinagreRecorder *recorder);
+
+G_END_DECLS
+
+#endif  /* __VINAGRE_RECORDER_H__  */
+/* vim: set ts=8: */
@@ -54,10 +54,23 @@ typedef struct
   GtkWidget *always_enabled_check;
   GtkWidget *port_label;
   GtkWidget *connectivity_exp;
+  GtkWidget *headless_check;
+  GtkWidget *pending_exp;
+  GtkWidget *pending_view;
+  GtkListStore *pending_store;
   GtkTextBuffer *ip_buffer;
   VinagreReverseVncListener *listener;
+  gulong pending_handler;
+  gulong incoming_handler;
 } VncListenDialog;
 
+enum
+{
+  PENDING_COLUMN_NAME = 0,
+  PENDING_COLUMN_CONN,
+  PENDING_N_COLUMNS
+};
+
 static void
 setup_ip_buffer (VncListenDialog *dialog)
 {
@@ -130,10 +143,84 @@ setup_ip_buffer (VncListenDialog *dialog)
   g_string_free (str, TRUE);
 }
 
+static void
+fill_pending_store (VncListenDialog *dialog)
+{
+  GList *pending, *l;
+  GtkTreeIter iter;
+
+  gtk_list_store_clear (dialog->pending_store);
+
+  pending = vinagre_reverse_vnc_listener_get_pending (dialog->listener);
+  for (l = pending; l; l = l->next)
+    {
+      gchar *name = vinagre_connection_get_string_rep (l->data, TRUE);
+
+      gtk_list_store_append (dialog->pending_store, &iter);
+      gtk_list_store_set (dialog->pending_store, &iter,
+			  PENDING_COLUMN_NAME, name,
+			  PENDING_COLUMN_CONN, l->data,
+			  -1);
+      g_free (name);
+    }
+  g_list_free (pending);
+}
+
+static VinagreConnection *
+get_selected_pending (VncListenDialog *dialog)
+{
+  GtkTreeSelection *selection;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  VinagreConnection *conn = NULL;
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (dialog->pending_view));
+  if (gtk_tree_selection_get_selected (selection, &model, &iter))
+    gtk_tree_model_get (model, &iter, PENDING_COLUMN_CONN, &conn, -1);
+
+  return conn;
+}
+
+static void
+pending_open_clicked_cb (GtkButton *button, VncListenDialog *dialog)
+{
+  VinagreConnection *conn = get_selected_pending (dialog);
+
+  if (!conn)
+    return;
+
+  vinagre_reverse_vnc_listener_open_pending (dialog->listener, conn);
+  g_object_unref (conn);
+}
+
+static void
+pending_reject_clicked_cb (GtkButton *button, VncListenDialog *dialog)
+{
+  VinagreConnection *conn = get_selected_pending (dialog);
+
+  if (!conn)
+    return;
+
+  vinagre_reverse_vnc_listener_reject_pending (dialog->listener, conn);
+  g_object_unref (conn);
+}
+
+static void
+pending_row_activated_cb (GtkTreeView       *view,
+			  GtkTreePath       *path,
+			  GtkTreeViewColumn *column,
+			  VncListenDialog   *dialog)
+{
+  pending_open_clicked_cb (NULL, dialog);
+}
+
 static void
 dialog_destroy (GtkWidget *widget,
 		VncListenDialog *dialog)
 {
+  g_signal_handler_disconnect (dialog->listener, dialog->pending_handler);
+  g_signal_handler_disconnect (dialog->listener, dialog->incoming_handler);
+  g_object_unref (dialog->pending_store);
   g_object_unref (dialog->xml);
   g_object_unref (dialog->listener);
   g_slice_free (VncListenDialog, dialog);
@@ -157,11 +244,36 @@ dialog_response_handler (GtkDialog       *widget,
     }
 }
 
+static void
+update_port_label (VncListenDialog *dialog)
+{
+  GList *endpoints, *l;
+  GString *str;
+
+  endpoints = vinagre_reverse_vnc_listener_get_endpoints (dialog->listener);
+  str = g_string_new (NULL);
+
+  for (l = endpoints; l; l = l->next)
+    {
+      VinagreReverseVncEndpoint *endpoint = l->data;
+
+      if (str->len)
+	g_string_append_c (str, '\n');
+      /* Translators: %s is where reverse connections are listened on, such as 5500 or unix:/path */
+      g_string_append_printf (str, _("On %s: %u accepted, %u refused"),
+			      endpoint->spec, endpoint->accepted, endpoint->refused);
+    }
+
+  gtk_label_set_label (GTK_LABEL (dialog->port_label), str->str);
+
+  g_string_free (str, TRUE);
+  g_list_free (endpoints);
+}
+
 static void
 update_ui_sensitivity (VncListenDialog *dialog)
 {
   gboolean listening;
-  gchar *str;
 
   listening = vinagre_reverse_vnc_listener_is_listening (dialog->listener);
 
@@ -169,13 +281,10 @@ update_ui_sensitivity (VncListenDialog *dialog)
 				listening);
   gtk_widget_set_sensitive (dialog->always_enabled_check, listening);
   gtk_widget_set_sensitive (dialog->connectivity_exp, listening);
+  gtk_widget_set_sensitive (dialog->pending_exp, listening);
 
   if (listening)
-    {
-      str = g_strdup_printf (_("On the port %d"), vinagre_reverse_vnc_listener_get_port (dialog->listener));
-      gtk_label_set_label (GTK_LABEL (dialog->port_label), str);
-      g_free (str);
-    }
+    update_port_label (dialog);
   else
     {
       gtk_expander_set_expanded (GTK_EXPANDER (dialog->connectivity_exp), FALSE);
@@ -254,6 +363,50 @@ vinagre_reverse_vnc_listener_dialog_show (GtkWindow *parent)
   dialog->port_label = GTK_WIDGET (gtk_builder_get_object (xml, "port_label"));
   g_assert (dialog->port_label != NULL);
 
+  dialog->headless_check = GTK_WIDGET (gtk_builder_get_object (xml, "headless_check"));
+  g_assert (dialog->headless_check != NULL);
+  g_settings_bind (vinagre_prefs_get_default_gsettings (), "reverse-headless",
+		   dialog->headless_check, "active",
+		   G_SETTINGS_BIND_DEFAULT);
+
+  dialog->pending_exp = GTK_WIDGET (gtk_builder_get_object (xml, "pending_exp"));
+  g_assert (dialog->pending_exp != NULL);
+
+  dialog->pending_view = GTK_WIDGET (gtk_builder_get_object (xml, "pending_view"));
+  g_assert (dialog->pending_view != NULL);
+  dialog->pending_store = gtk_list_store_new (PENDING_N_COLUMNS,
+					      G_TYPE_STRING,
+					      VINAGRE_TYPE_CONNECTION);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (dialog->pending_view),
+			   GTK_TREE_MODEL (dialog->pending_store));
+  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (dialog->pending_view),
+					       -1, NULL,
+					       gtk_cell_renderer_text_new (),
+					       "text", PENDING_COLUMN_NAME,
+					       NULL);
+  g_signal_connect (dialog->pending_view,
+		    "row-activated",
+		    G_CALLBACK (pending_row_activated_cb),
+		    dialog);
+  g_signal_connect (gtk_builder_get_object (xml, "pending_open_button"),
+		    "clicked",
+		    G_CALLBACK (pending_open_clicked_cb),
+		    dialog);
+  g_signal_connect (gtk_builder_get_object (xml, "pending_reject_button"),
+		    "clicked",
+		    G_CALLBACK (pending_reject_clicked_cb),
+		    dialog);
+
+  fill_pending_store (dialog);
+  dialog->pending_handler = g_signal_connect_swapped (dialog->listener,
+						      "notify::n-pending",
+						      G_CALLBACK (fill_pending_store),
+						      dialog);
+  dialog->incoming_handler = g_signal_connect_swapped (dialog->listener,
+						       "notify::n-incoming",
+						       G_CALLBACK (update_port_label),
+						       dialog);
+
   update_ui_sensitivity (dialog);
 
   g_signal_connect (dialog->dialog,
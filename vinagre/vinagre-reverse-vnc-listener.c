@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -33,29 +34,80 @@
 
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
 
 #include "vinagre-commands.h"
+#include "vinagre-debug.h"
+#include "vinagre-prefs.h"
 #include "vinagre-reverse-vnc-listener.h"
 #include "plugins/vnc/vinagre-vnc-connection.h"
 #include "vinagre-vala.h"
 
+/* Addresses remembered by the rate limiter before the idle ones are
+ * forgotten */
+#define MAX_RATE_SOURCES 1024
+
 struct _VinagreReverseVncListenerPrivate
 {
   GSocketService *service;
   gboolean        listening;
   gint            port;
   VinagreWindow  *window;
+  GList          *endpoints;	/* Endpoint */
+  guint           n_incoming;
+
+  GQueue         *pending;	/* Connections waiting for a tab */
+  GHashTable     *watches;	/* Pending connection -> PendingWatch */
+  guint           open_id;
+  GHashTable     *sources;	/* Address string -> SourceRate */
+  GPtrArray      *allowed;	/* GInetAddressMask, empty allows all */
 };
 
+/* The default when reverse-listen-addresses is empty: the first free port */
+#define FIRST_PORT 5500
+#define LAST_PORT  5600
+
+typedef struct
+{
+  VinagreReverseVncEndpoint public;
+  GInetAddress *inet;		/* NULL for any address */
+  gint          port;
+  gchar        *path;		/* Unix sockets */
+} Endpoint;
+
+/* Gives back the slot of a pending connection whose peer went away or
+ * that waited longer than reverse-pending-timeout */
+typedef struct
+{
+  VinagreReverseVncListener *listener;
+  VinagreConnection         *conn;
+  GSource                   *hangup;
+  guint                      timeout_id;
+} PendingWatch;
+
+/* Token bucket, refilled at reverse-rate-limit tokens a minute */
+typedef struct
+{
+  gdouble tokens;
+  gint64  last;
+} SourceRate;
+
 enum
 {
   PROP_0,
   PROP_LISTENING,
-  PROP_PORT
+  PROP_PORT,
+  PROP_N_PENDING,
+  PROP_N_INCOMING
 };
 
 static VinagreReverseVncListener *listener_singleton = NULL;
 
+static void load_allowed_hosts (VinagreReverseVncListener *listener);
+static void schedule_open (VinagreReverseVncListener *listener);
+static void pending_watch_free (PendingWatch *watch);
+
 G_DEFINE_TYPE (VinagreReverseVncListener, vinagre_reverse_vnc_listener, G_TYPE_OBJECT);
 
 static void
@@ -65,6 +117,23 @@ vinagre_reverse_vnc_listener_init (VinagreReverseVncListener *listener)
 
   listener->priv->listening = FALSE;
   listener->priv->port = 0;
+  listener->priv->pending = g_queue_new ();
+  listener->priv->watches = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						   NULL,
+						   (GDestroyNotify) pending_watch_free);
+  listener->priv->sources = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free, g_free);
+  listener->priv->allowed = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_signal_connect_swapped (vinagre_prefs_get_default_gsettings (),
+			    "changed::reverse-allowed-hosts",
+			    G_CALLBACK (load_allowed_hosts),
+			    listener);
+  g_signal_connect_swapped (vinagre_prefs_get_default_gsettings (),
+			    "changed::reverse-headless",
+			    G_CALLBACK (schedule_open),
+			    listener);
+  load_allowed_hosts (listener);
 }
 
 static void
@@ -74,9 +143,31 @@ vinagre_reverse_vnc_listener_dispose (GObject *object)
 
   vinagre_reverse_vnc_listener_stop (listener);
 
+  g_signal_handlers_disconnect_by_data (vinagre_prefs_get_default_gsettings (),
+					listener);
+
+  if (listener->priv->window)
+    {
+      g_object_unref (listener->priv->window);
+      listener->priv->window = NULL;
+    }
+
   G_OBJECT_CLASS (vinagre_reverse_vnc_listener_parent_class)->dispose (object);
 }
 
+static void
+vinagre_reverse_vnc_listener_finalize (GObject *object)
+{
+  VinagreReverseVncListener *listener = VINAGRE_REVERSE_VNC_LISTENER (object);
+
+  g_queue_free (listener->priv->pending);
+  g_hash_table_destroy (listener->priv->watches);
+  g_hash_table_destroy (listener->priv->sources);
+  g_ptr_array_unref (listener->priv->allowed);
+
+  G_OBJECT_CLASS (vinagre_reverse_vnc_listener_parent_class)->finalize (object);
+}
+
 static void
 vinagre_reverse_vnc_listener_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
 {
@@ -96,6 +187,14 @@ vinagre_reverse_vnc_listener_get_property (GObject *object, guint prop_id, GValu
 	g_value_set_int (value, vinagre_reverse_vnc_listener_get_port (listener));
 	break;
 
+      case PROP_N_PENDING:
+	g_value_set_uint (value, g_queue_get_length (listener->priv->pending));
+	break;
+
+      case PROP_N_INCOMING:
+	g_value_set_uint (value, listener->priv->n_incoming);
+	break;
+
       default:
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	break;
@@ -110,6 +209,7 @@ vinagre_reverse_vnc_listener_class_init (VinagreReverseVncListenerClass *klass)
   g_type_class_add_private (klass, sizeof (VinagreReverseVncListenerPrivate));
 
   object_class->dispose = vinagre_reverse_vnc_listener_dispose;
+  object_class->finalize = vinagre_reverse_vnc_listener_finalize;
   object_class->get_property = vinagre_reverse_vnc_listener_get_property;
 
   g_object_class_install_property (object_class,
@@ -126,15 +226,38 @@ vinagre_reverse_vnc_listener_class_init (VinagreReverseVncListenerClass *klass)
                                    PROP_PORT,
                                    g_param_spec_int ("port",
                                                      "Port",
-	                                             "TCP port in which we are listening for reverse connections",
-                                                     5500,
-                                                     5600,
-                                                     5500,
+	                                             "TCP port of the first TCP endpoint listened on, 0 when there is none",
+                                                     0,
+                                                     G_MAXUINT16,
+                                                     0,
 	                                             G_PARAM_READABLE |
                                                      G_PARAM_STATIC_NICK |
                                                      G_PARAM_STATIC_NAME |
                                                      G_PARAM_STATIC_BLURB));
-
+  g_object_class_install_property (object_class,
+                                   PROP_N_PENDING,
+                                   g_param_spec_uint ("n-pending",
+                                                      "Pending connections",
+	                                              "Number of incoming connections waiting to be opened",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+	                                              G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_NICK |
+                                                      G_PARAM_STATIC_NAME |
+                                                      G_PARAM_STATIC_BLURB));
+  g_object_class_install_property (object_class,
+                                   PROP_N_INCOMING,
+                                   g_param_spec_uint ("n-incoming",
+                                                      "Incoming connections",
+	                                              "Number of connections made to any endpoint, accepted or not",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+	                                              G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_NICK |
+                                                      G_PARAM_STATIC_NAME |
+                                                      G_PARAM_STATIC_BLURB));
 }
 
 VinagreReverseVncListener *
@@ -150,6 +273,322 @@ vinagre_reverse_vnc_listener_get_default (void)
   return g_object_ref (listener_singleton);
 }
 
+static void
+load_allowed_hosts (VinagreReverseVncListener *listener)
+{
+  gchar **hosts;
+  gint    i;
+
+  g_ptr_array_set_size (listener->priv->allowed, 0);
+
+  hosts = g_settings_get_strv (vinagre_prefs_get_default_gsettings (),
+			       "reverse-allowed-hosts");
+  for (i = 0; hosts[i]; i++)
+    {
+      GInetAddressMask *mask;
+      GError *error = NULL;
+
+      mask = g_inet_address_mask_new_from_string (g_strstrip (hosts[i]), &error);
+      if (mask)
+	g_ptr_array_add (listener->priv->allowed, mask);
+      else
+	{
+	  g_warning (_("Ignoring the reverse connection address %s: %s"),
+		     hosts[i], error->message);
+	  g_error_free (error);
+	}
+    }
+
+  g_strfreev (hosts);
+}
+
+/* IPv4 peers of a dual stack socket show up as ::ffff:a.b.c.d */
+static GInetAddress *
+get_source_address (GSocketConnection *connection, guint16 *port)
+{
+  GSocketAddress *address;
+  GInetAddress   *inet, *v4;
+  gchar          *str;
+
+  address = g_socket_connection_get_remote_address (connection, NULL);
+  if (!address)
+    return NULL;
+  if (!G_IS_INET_SOCKET_ADDRESS (address))
+    {
+      g_object_unref (address);
+      return NULL;
+    }
+
+  inet = g_object_ref (g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (address)));
+  if (port)
+    *port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address));
+  g_object_unref (address);
+
+  str = g_inet_address_to_string (inet);
+  if (g_str_has_prefix (str, "::ffff:") && strchr (str, '.'))
+    {
+      v4 = g_inet_address_new_from_string (str + 7);
+      if (v4)
+	{
+	  g_object_unref (inet);
+	  inet = v4;
+	}
+    }
+  g_free (str);
+
+  return inet;
+}
+
+static gboolean
+is_allowed (VinagreReverseVncListener *listener, GInetAddress *address)
+{
+  guint i;
+
+  if (listener->priv->allowed->len == 0)
+    return TRUE;
+  if (!address)
+    return FALSE;
+
+  for (i = 0; i < listener->priv->allowed->len; i++)
+    if (g_inet_address_mask_matches (g_ptr_array_index (listener->priv->allowed, i),
+				     address))
+      return TRUE;
+
+  return FALSE;
+}
+
+typedef struct
+{
+  gdouble burst;
+  gint64  now;
+} RefillData;
+
+static gdouble
+refill (SourceRate *rate, gdouble burst, gint64 now)
+{
+  return MIN (burst,
+	      rate->tokens + (now - rate->last) * burst / (60.0 * G_USEC_PER_SEC));
+}
+
+/* A source whose bucket is full again has not been seen for a while */
+static gboolean
+forget_idle_source (gpointer key, SourceRate *rate, RefillData *data)
+{
+  return refill (rate, data->burst, data->now) >= data->burst;
+}
+
+static gboolean
+within_rate (VinagreReverseVncListener *listener, const gchar *host)
+{
+  SourceRate *rate;
+  RefillData  data;
+  gint        limit;
+  gdouble     burst;
+  gint64      now;
+
+  limit = g_settings_get_int (vinagre_prefs_get_default_gsettings (),
+			      "reverse-rate-limit");
+  if (limit <= 0)
+    return TRUE;
+
+  burst = limit;
+  now = g_get_monotonic_time ();
+
+  rate = g_hash_table_lookup (listener->priv->sources, host);
+  if (!rate)
+    {
+      if (g_hash_table_size (listener->priv->sources) >= MAX_RATE_SOURCES)
+	{
+	  data.burst = burst;
+	  data.now = now;
+	  g_hash_table_foreach_remove (listener->priv->sources,
+				       (GHRFunc) forget_idle_source,
+				       &data);
+
+	  /* Every known source is busy, a new one could be a flood of
+	   * spoofed addresses pushing out the ones being limited */
+	  if (g_hash_table_size (listener->priv->sources) >= MAX_RATE_SOURCES)
+	    return FALSE;
+	}
+
+      rate = g_new (SourceRate, 1);
+      rate->tokens = burst;
+      rate->last = now;
+      g_hash_table_insert (listener->priv->sources, g_strdup (host), rate);
+    }
+
+  rate->tokens = refill (rate, burst, now);
+  rate->last = now;
+
+  if (rate->tokens < 1)
+    return FALSE;
+
+  rate->tokens -= 1;
+  return TRUE;
+}
+
+static gboolean
+open_next (VinagreReverseVncListener *listener)
+{
+  VinagreConnection *conn;
+
+  conn = g_queue_pop_head (listener->priv->pending);
+  if (conn)
+    {
+      g_hash_table_remove (listener->priv->watches, conn);
+      vinagre_cmd_direct_connect (conn, listener->priv->window);
+      g_object_unref (conn);
+      g_object_notify (G_OBJECT (listener), "n-pending");
+    }
+
+  if (g_queue_is_empty (listener->priv->pending))
+    {
+      listener->priv->open_id = 0;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Tabs are opened one per main loop iteration, so a burst of connections
+ * does not freeze the window. In headless mode they wait for the user. */
+static void
+schedule_open (VinagreReverseVncListener *listener)
+{
+  if (listener->priv->open_id ||
+      g_queue_is_empty (listener->priv->pending) ||
+      !listener->priv->window ||
+      g_settings_get_boolean (vinagre_prefs_get_default_gsettings (),
+			      "reverse-headless"))
+    return;
+
+  listener->priv->open_id = g_idle_add_full (G_PRIORITY_LOW,
+					     (GSourceFunc) open_next,
+					     listener,
+					     NULL);
+}
+
+static void
+pending_watch_free (PendingWatch *watch)
+{
+  g_source_destroy (watch->hangup);
+  g_source_unref (watch->hangup);
+  if (watch->timeout_id)
+    g_source_remove (watch->timeout_id);
+  g_slice_free (PendingWatch, watch);
+}
+
+/* Closes a connection nobody is going to open */
+static void
+drop_pending (VinagreReverseVncListener *listener,
+	      VinagreConnection         *conn)
+{
+  GSocket *socket;
+
+  if (!g_queue_remove (listener->priv->pending, conn))
+    return;
+  g_hash_table_remove (listener->priv->watches, conn);
+
+  socket = vinagre_vnc_connection_get_socket (VINAGRE_VNC_CONNECTION (conn));
+  if (socket)
+    g_socket_close (socket, NULL);
+
+  g_object_unref (conn);
+  g_object_notify (G_OBJECT (listener), "n-pending");
+}
+
+static gboolean
+pending_hangup_cb (GSocket      *socket,
+		   GIOCondition  condition,
+		   PendingWatch *watch)
+{
+  vinagre_debug_message (DEBUG_VIEW, "Pending reverse connection from %s went away",
+			 vinagre_connection_get_host (watch->conn));
+  drop_pending (watch->listener, watch->conn);
+
+  return FALSE;
+}
+
+static gboolean
+pending_timeout_cb (PendingWatch *watch)
+{
+  vinagre_debug_message (DEBUG_VIEW, "Pending reverse connection from %s expired",
+			 vinagre_connection_get_host (watch->conn));
+  watch->timeout_id = 0;
+  drop_pending (watch->listener, watch->conn);
+
+  return FALSE;
+}
+
+static void
+watch_pending (VinagreReverseVncListener *listener,
+	       VinagreConnection         *conn,
+	       GSocket                   *socket)
+{
+  PendingWatch *watch;
+  gint timeout;
+
+  watch = g_slice_new0 (PendingWatch);
+  watch->listener = listener;
+  watch->conn = conn;
+
+  /* A peer that only half-closes is left to the timeout: the VNC server
+   * speaks first, so readable data does not tell a hangup */
+  watch->hangup = g_socket_create_source (socket, G_IO_HUP | G_IO_ERR, NULL);
+  g_source_set_callback (watch->hangup,
+			 (GSourceFunc) pending_hangup_cb,
+			 watch,
+			 NULL);
+  g_source_attach (watch->hangup, NULL);
+
+  timeout = g_settings_get_int (vinagre_prefs_get_default_gsettings (),
+				"reverse-pending-timeout");
+  if (timeout > 0)
+    watch->timeout_id = g_timeout_add_seconds (timeout,
+					       (GSourceFunc) pending_timeout_cb,
+					       watch);
+
+  g_hash_table_insert (listener->priv->watches, conn, watch);
+}
+
+static Endpoint *
+find_endpoint (VinagreReverseVncListener *listener,
+	       GSocketConnection         *connection)
+{
+  GSocketAddress *local;
+  Endpoint *found = NULL;
+  GList *l;
+
+  local = g_socket_connection_get_local_address (connection, NULL);
+  if (!local)
+    return NULL;
+
+  for (l = listener->priv->endpoints; l && !found; l = l->next)
+    {
+      Endpoint *endpoint = l->data;
+
+      if (G_IS_UNIX_SOCKET_ADDRESS (local))
+	{
+	  if (endpoint->path &&
+	      g_strcmp0 (endpoint->path,
+			 g_unix_socket_address_get_path (G_UNIX_SOCKET_ADDRESS (local))) == 0)
+	    found = endpoint;
+	}
+      else if (G_IS_INET_SOCKET_ADDRESS (local) && !endpoint->path)
+	{
+	  GInetSocketAddress *inet = G_INET_SOCKET_ADDRESS (local);
+
+	  if (endpoint->port == g_inet_socket_address_get_port (inet) &&
+	      (!endpoint->inet ||
+	       g_inet_address_equal (endpoint->inet, g_inet_socket_address_get_address (inet))))
+	    found = endpoint;
+	}
+    }
+
+  g_object_unref (local);
+  return found;
+}
+
 static gboolean
 incoming (GSocketService *service,
 	  GSocketConnection *connection,
@@ -157,37 +596,223 @@ incoming (GSocketService *service,
 	  VinagreReverseVncListener *listener)
 {
   VinagreConnection *conn;
-  GSocketAddress *address;
+  GInetAddress *address;
+  Endpoint *endpoint;
+  gchar *host = NULL;
+  guint16 port = 0;
+  gint max_pending;
+  gboolean local;
 
   g_return_val_if_fail (listener->priv->window != NULL, FALSE);
 
-  conn = vinagre_vnc_connection_new ();
-  vinagre_vnc_connection_set_socket (VINAGRE_VNC_CONNECTION (conn),
-				     g_socket_connection_get_socket (connection));
+  endpoint = find_endpoint (listener, connection);
+  listener->priv->n_incoming++;
 
-  address = g_socket_connection_get_remote_address (connection, NULL);
+  /* Rejected connections are closed as soon as we return */
+  address = get_source_address (connection, &port);
   if (address)
+    host = g_inet_address_to_string (address);
+
+  /* Whoever reaches a Unix socket was let in by its permissions */
+  local = endpoint && endpoint->path;
+
+  max_pending = g_settings_get_int (vinagre_prefs_get_default_gsettings (),
+				    "reverse-max-pending");
+
+  if (!local && !is_allowed (listener, address))
+    vinagre_debug_message (DEBUG_VIEW, "Reverse connection from %s not allowed", host);
+  /* Before the rate limiter, a refused connection must not cost a token */
+  else if (g_queue_get_length (listener->priv->pending) >= max_pending)
+    vinagre_debug_message (DEBUG_VIEW, "Reverse connection queue full, dropping %s", host);
+  else if (host && !within_rate (listener, host))
+    vinagre_debug_message (DEBUG_VIEW, "Too many reverse connections from %s", host);
+  else
     {
-      gchar *host = g_inet_address_to_string (g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (address)));
+      conn = vinagre_vnc_connection_new ();
+      vinagre_vnc_connection_set_socket (VINAGRE_VNC_CONNECTION (conn),
+					 g_socket_connection_get_socket (connection));
+      if (host)
+	{
+	  vinagre_connection_set_host (conn, host);
+	  vinagre_connection_set_port (conn, port);
+	}
+      else if (local)
+	vinagre_connection_set_host (conn, "localhost");
 
-      vinagre_connection_set_host (conn, host);
-      vinagre_connection_set_port (conn, g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address)));
+      if (endpoint)
+	endpoint->public.accepted++;
 
-      g_object_unref (address);
-      g_free (host);
+      g_queue_push_tail (listener->priv->pending, conn);
+      watch_pending (listener, conn, g_socket_connection_get_socket (connection));
+      g_object_notify (G_OBJECT (listener), "n-pending");
+      schedule_open (listener);
+      goto out;
     }
 
-  vinagre_cmd_direct_connect (conn, listener->priv->window);
+  if (endpoint)
+    endpoint->public.refused++;
+
+out:
+  g_object_notify (G_OBJECT (listener), "n-incoming");
+  if (address)
+    g_object_unref (address);
+  g_free (host);
 
   return TRUE;
 }
 
+static void
+endpoint_free (Endpoint *endpoint)
+{
+  /* Otherwise the next bind fails */
+  if (endpoint->path)
+    g_unlink (endpoint->path);
+
+  if (endpoint->inet)
+    g_object_unref (endpoint->inet);
+  g_free (endpoint->path);
+  g_free (endpoint->public.spec);
+  g_slice_free (Endpoint, endpoint);
+}
+
+/* A socket left behind by a previous run refuses connections; anything
+ * else at that path, or a socket somebody still listens on, is kept and
+ * the bind fails */
+static void
+remove_stale_socket (const gchar *path, GSocketAddress *address)
+{
+  GStatBuf buf;
+  GSocket *socket;
+  GError *error = NULL;
+
+  if (g_lstat (path, &buf) != 0 || !S_ISSOCK (buf.st_mode))
+    return;
+
+  socket = g_socket_new (G_SOCKET_FAMILY_UNIX, G_SOCKET_TYPE_STREAM,
+			 G_SOCKET_PROTOCOL_DEFAULT, NULL);
+  if (!socket)
+    return;
+
+  if (!g_socket_connect (socket, address, NULL, &error))
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_REFUSED))
+	{
+	  vinagre_debug_message (DEBUG_VIEW, "Removing stale socket %s", path);
+	  g_unlink (path);
+	}
+      g_error_free (error);
+    }
+
+  g_object_unref (socket);
+}
+
+/*
+ * A bind spec is one of:
+ *   5500                every address, IPv4 and IPv6
+ *   192.168.0.1:5500    one address
+ *   [::1]:5500
+ *   unix:/path/to/socket
+ */
+static Endpoint *
+add_endpoint (VinagreReverseVncListener *listener,
+	      const gchar               *spec,
+	      GError                   **error)
+{
+  GSocketListener *socket_listener = G_SOCKET_LISTENER (listener->priv->service);
+  GSocketAddress *address = NULL;
+  Endpoint *endpoint;
+  gchar *host = NULL, *end;
+  const gchar *port_str;
+  gint64 port;
+  gboolean res;
+
+  endpoint = g_slice_new0 (Endpoint);
+
+  if (g_str_has_prefix (spec, "unix:"))
+    {
+      endpoint->path = g_strdup (spec + 5);
+
+      address = g_unix_socket_address_new (endpoint->path);
+      remove_stale_socket (endpoint->path, address);
+      endpoint->public.spec = g_strdup (spec);
+    }
+  else
+    {
+      port_str = strrchr (spec, ':');
+      if (spec[0] == '[')
+	{
+	  end = strchr (spec, ']');
+	  if (end && end[1] == ':')
+	    host = g_strndup (spec + 1, end - spec - 1);
+	  port_str = end && end[1] == ':' ? end + 1 : NULL;
+	}
+      else if (port_str)
+	host = g_strndup (spec, port_str - spec);
+
+      port = g_ascii_strtoll (port_str ? port_str + 1 : spec, &end, 10);
+      if ((port_str && !host) || *end || port <= 0 || port > G_MAXUINT16)
+	{
+	  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+		       _("Invalid address: %s"), spec);
+	  g_free (host);
+	  endpoint_free (endpoint);
+	  return NULL;
+	}
+      endpoint->port = port;
+
+      if (host)
+	{
+	  endpoint->inet = g_inet_address_new_from_string (host);
+	  if (!endpoint->inet)
+	    {
+	      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+			   _("Invalid address: %s"), spec);
+	      g_free (host);
+	      endpoint_free (endpoint);
+	      return NULL;
+	    }
+	  address = g_inet_socket_address_new (endpoint->inet, port);
+	}
+      g_free (host);
+
+      endpoint->public.spec = g_strdup (spec);
+    }
+
+  if (address)
+    {
+      res = g_socket_listener_add_address (socket_listener, address,
+					   G_SOCKET_TYPE_STREAM,
+					   G_SOCKET_PROTOCOL_DEFAULT,
+					   NULL, NULL, error);
+      g_object_unref (address);
+    }
+  else
+    res = g_socket_listener_add_inet_port (socket_listener, endpoint->port, NULL, error);
+
+  if (!res)
+    {
+      /* Do not unlink a socket some other program is listening on */
+      g_free (endpoint->path);
+      endpoint->path = NULL;
+      endpoint_free (endpoint);
+      return NULL;
+    }
+
+  listener->priv->endpoints = g_list_append (listener->priv->endpoints, endpoint);
+  if (!listener->priv->port && endpoint->port)
+    listener->priv->port = endpoint->port;
+
+  return endpoint;
+}
+
 void
 vinagre_reverse_vnc_listener_start (VinagreReverseVncListener *listener)
 {
   VinagreReverseVncListenerPrivate *priv = listener->priv;
   GError *error;
-  int port;
+  GString *errors;
+  gchar **specs, *spec;
+  int i, port;
 
   g_return_if_fail (VINAGRE_IS_REVERSE_VNC_LISTENER (listener));
 
@@ -195,23 +820,57 @@ vinagre_reverse_vnc_listener_start (VinagreReverseVncListener *listener)
     return;
 
   priv->service = g_socket_service_new ();
+  priv->port = 0;
 
-  for (port=5500; port<=5600; port++)
+  specs = g_settings_get_strv (vinagre_prefs_get_default_gsettings (),
+			       "reverse-listen-addresses");
+
+  if (!specs[0])
     {
-      error = NULL;
-      if (g_socket_listener_add_inet_port (G_SOCKET_LISTENER (priv->service), port, NULL, &error))
-	break;
-      else
+      for (port = FIRST_PORT; port <= LAST_PORT && !priv->endpoints; port++)
+	{
+	  error = NULL;
+	  spec = g_strdup_printf ("%d", port);
+	  if (!add_endpoint (listener, spec, &error))
+	    {
+	      vinagre_debug_message (DEBUG_VIEW, "%s", error->message);
+	      g_clear_error (&error);
+	    }
+	  g_free (spec);
+	}
+
+      if (!priv->endpoints)
+	vinagre_utils_show_error_dialog (_("Error activating reverse connections"),
+				  _("The program could not find any available TCP ports starting at 5500. Is there any other running program consuming all your TCP ports?"),
+				  GTK_WINDOW (listener->priv->window));
+    }
+  else
+    {
+      errors = g_string_new (NULL);
+      for (i = 0; specs[i]; i++)
 	{
-	  g_message ("%s", error->message);
-	  g_clear_error (&error);
+	  error = NULL;
+	  if (!add_endpoint (listener, g_strstrip (specs[i]), &error))
+	    {
+	      g_string_append_printf (errors, "\n%s: %s", specs[i], error->message);
+	      g_clear_error (&error);
+	    }
 	}
+
+      if (!priv->endpoints)
+	vinagre_utils_show_error_dialog (_("Error activating reverse connections"),
+				  errors->str + 1,
+				  GTK_WINDOW (listener->priv->window));
+      else if (errors->len)
+	g_warning (_("Some reverse connection addresses could not be used:%s"), errors->str);
+
+      g_string_free (errors, TRUE);
     }
-  if (port > 5600)
+
+  g_strfreev (specs);
+
+  if (!priv->endpoints)
     {
-      vinagre_utils_show_error_dialog (_("Error activating reverse connections"),
-				_("The program could not find any available TCP ports starting at 5500. Is there any other running program consuming all your TCP ports?"),
-				GTK_WINDOW (listener->priv->window));
       g_object_unref (priv->service);
       priv->service = NULL;
       return;
@@ -220,7 +879,6 @@ vinagre_reverse_vnc_listener_start (VinagreReverseVncListener *listener)
   g_signal_connect (priv->service, "incoming", G_CALLBACK (incoming), listener);
   g_socket_service_start (priv->service);
 
-  priv->port = port;
   priv->listening = TRUE;
   g_object_notify (G_OBJECT (listener), "listening");
 }
@@ -239,6 +897,25 @@ vinagre_reverse_vnc_listener_stop (VinagreReverseVncListener *listener)
   g_object_unref (priv->service);
   priv->service = NULL;
 
+  if (priv->open_id)
+    {
+      g_source_remove (priv->open_id);
+      priv->open_id = 0;
+    }
+
+  /* Closes the sockets nobody took */
+  if (!g_queue_is_empty (priv->pending))
+    {
+      g_hash_table_remove_all (priv->watches);
+      g_queue_foreach (priv->pending, (GFunc) g_object_unref, NULL);
+      g_queue_clear (priv->pending);
+      g_object_notify (G_OBJECT (listener), "n-pending");
+    }
+  g_hash_table_remove_all (priv->sources);
+
+  g_list_free_full (priv->endpoints, (GDestroyNotify) endpoint_free);
+  priv->endpoints = NULL;
+
   priv->listening = FALSE;
   g_object_notify (G_OBJECT (listener), "listening");
 }
@@ -251,6 +928,16 @@ vinagre_reverse_vnc_listener_is_listening (VinagreReverseVncListener *listener)
   return listener->priv->listening;
 }
 
+/**
+ * vinagre_reverse_vnc_listener_get_port:
+ * @listener: a #VinagreReverseVncListener
+ *
+ * With several endpoints this is the port of the first TCP one that could
+ * be bound; vinagre_reverse_vnc_listener_get_endpoints() lists them all.
+ *
+ * Returns: the TCP port, or 0 when not listening or when only Unix
+ * sockets are bound
+ */
 gint
 vinagre_reverse_vnc_listener_get_port (VinagreReverseVncListener *listener)
 {
@@ -269,4 +956,65 @@ vinagre_reverse_vnc_listener_set_window (VinagreReverseVncListener *listener,
     g_object_unref (listener->priv->window);
 
   listener->priv->window = window ? g_object_ref (window) : NULL;
+  schedule_open (listener);
+}
+
+/**
+ * vinagre_reverse_vnc_listener_get_endpoints:
+ * @listener: a #VinagreReverseVncListener
+ *
+ * Returns: (transfer container): the #VinagreReverseVncEndpoint listened
+ * on, owned by @listener until it stops
+ */
+GList *
+vinagre_reverse_vnc_listener_get_endpoints (VinagreReverseVncListener *listener)
+{
+  GList *res = NULL, *l;
+
+  g_return_val_if_fail (VINAGRE_IS_REVERSE_VNC_LISTENER (listener), NULL);
+
+  for (l = listener->priv->endpoints; l; l = l->next)
+    res = g_list_prepend (res, &((Endpoint *) l->data)->public);
+
+  return g_list_reverse (res);
+}
+
+/**
+ * vinagre_reverse_vnc_listener_get_pending:
+ * @listener: a #VinagreReverseVncListener
+ *
+ * Returns: (transfer container): the connections accepted but not opened
+ * yet, oldest first
+ */
+GList *
+vinagre_reverse_vnc_listener_get_pending (VinagreReverseVncListener *listener)
+{
+  g_return_val_if_fail (VINAGRE_IS_REVERSE_VNC_LISTENER (listener), NULL);
+
+  return g_list_copy (listener->priv->pending->head);
+}
+
+void
+vinagre_reverse_vnc_listener_open_pending (VinagreReverseVncListener *listener,
+					   VinagreConnection         *conn)
+{
+  g_return_if_fail (VINAGRE_IS_REVERSE_VNC_LISTENER (listener));
+  g_return_if_fail (listener->priv->window != NULL);
+
+  if (!g_queue_remove (listener->priv->pending, conn))
+    return;
+  g_hash_table_remove (listener->priv->watches, conn);
+
+  vinagre_cmd_direct_connect (conn, listener->priv->window);
+  g_object_unref (conn);
+  g_object_notify (G_OBJECT (listener), "n-pending");
+}
+
+void
+vinagre_reverse_vnc_listener_reject_pending (VinagreReverseVncListener *listener,
+					     VinagreConnection         *conn)
+{
+  g_return_if_fail (VINAGRE_IS_REVERSE_VNC_LISTENER (listener));
+
+  drop_pending (listener, conn);
 }
@@ -23,6 +23,8 @@
 
 #include <glib.h>
 
+#include "vinagre-connection.h"
+
 G_BEGIN_DECLS
 
 #define VINAGRE_TYPE_REVERSE_VNC_LISTENER             (vinagre_reverse_vnc_listener_get_type ())
@@ -35,6 +37,7 @@ G_BEGIN_DECLS
 typedef struct _VinagreReverseVncListenerClass   VinagreReverseVncListenerClass;
 typedef struct _VinagreReverseVncListener        VinagreReverseVncListener;
 typedef struct _VinagreReverseVncListenerPrivate VinagreReverseVncListenerPrivate;
+typedef struct _VinagreReverseVncEndpoint        VinagreReverseVncEndpoint;
 
 struct _VinagreReverseVncListenerClass
 {
@@ -47,6 +50,13 @@ struct _VinagreReverseVncListener
   VinagreReverseVncListenerPrivate *priv;
 };
 
+struct _VinagreReverseVncEndpoint
+{
+  gchar *spec;		/* As in the reverse-listen-addresses setting */
+  guint  accepted;
+  guint  refused;
+};
+
 
 GType vinagre_reverse_vnc_listener_get_type (void) G_GNUC_CONST;
 
@@ -58,6 +68,13 @@ gint			vinagre_reverse_vnc_listener_get_port (VinagreReverseVncListener *listene
 void			vinagre_reverse_vnc_listener_set_window (VinagreReverseVncListener *listener,
 								 VinagreWindow *window);
 
+GList*			vinagre_reverse_vnc_listener_get_endpoints (VinagreReverseVncListener *listener);
+GList*			vinagre_reverse_vnc_listener_get_pending (VinagreReverseVncListener *listener);
+void			vinagre_reverse_vnc_listener_open_pending (VinagreReverseVncListener *listener,
+								   VinagreConnection *conn);
+void			vinagre_reverse_vnc_listener_reject_pending (VinagreReverseVncListener *listener,
+								     VinagreConnection *conn);
+
 G_END_DECLS
 
 #endif /* VINAGRE_REVERSE_VNC_LISTENER_H_  */
@@ -0,0 +1,941 @@
+/*
+ * vinagre-search.c
+ * In-memory index of known hosts for the connect dialog
+ * This file is part of vinagre
+ *
+ * Copyright (C) 2026 - The Vinagre developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gi18n.h>
+
+#include "vinagre-search.h"
+#include "vinagre-bookmarks.h"
+#include "vinagre-debug.h"
+#include "vinagre-vala.h"
+
+#ifdef VINAGRE_HAVE_AVAHI
+#include "vinagre-mdns.h"
+#endif
+
+/*
+ * Every item is indexed by the trigrams of its lower-cased text. The
+ * start of each word also yields the grams of its first one and two
+ * characters, padded with WORD_START, so that short queries are
+ * looked up the same way and match word prefixes.
+ */
+#define WORD_START '\001'
+#define GRAM(a, b, c) (((guint32) (guchar) (a) << 16) | \
+		       ((guint32) (guchar) (b) << 8) | \
+		       (guint32) (guchar) (c))
+
+/* Compact the item array once this many removed slots pile up */
+#define COMPACT_THRESHOLD 1024
+
+/* Rewrite the usage file once it holds this many times more lines than hosts */
+#define USAGE_FILE_SLACK 2
+#define USAGE_MIN_LINES 32
+
+typedef struct
+{
+  guint   uses;
+  guint64 last_used;
+} SearchUsage;
+
+typedef struct
+{
+  VinagreSearchResult  result;
+  guint                id;
+  gchar               *key;
+  gchar               *collate_key;	/* Of the label, for ordering ties */
+  SearchUsage         *usage;		/* NULL until the host is first used */
+} SearchItem;
+
+struct _VinagreSearchPrivate
+{
+  GPtrArray  *items;	/* id -> SearchItem, NULL once removed */
+  guint       n_removed;
+  GHashTable *grams;	/* trigram -> GArray of ids, in ascending order */
+  GHashTable *entries;	/* VinagreBookmarksEntry -> SearchItem */
+  GHashTable *history;	/* host -> SearchItem */
+  GHashTable *usage;	/* host -> SearchUsage */
+  guint64     clock;	/* Ticks once per use of any host */
+  guint       usage_lines;	/* Lines in the usage file, stale ones included */
+};
+
+G_DEFINE_TYPE (VinagreSearch, vinagre_search, G_TYPE_OBJECT);
+
+static VinagreSearch *search_singleton = NULL;
+
+static void
+search_item_free (SearchItem *item)
+{
+  if (!item)
+    return;
+
+  g_free (item->result.label);
+  g_free (item->result.host);
+  g_free (item->result.protocol);
+  if (item->result.entry)
+    g_object_unref (item->result.entry);
+  g_free (item->key);
+  g_free (item->collate_key);
+  g_slice_free (SearchItem, item);
+}
+
+static gboolean
+is_word_char (guchar c)
+{
+  return c >= 0x80 || g_ascii_isalnum (c);
+}
+
+static void
+key_grams (const gchar *key,
+	   GArray      *grams)
+{
+  const guchar *p;
+  guint32       gram;
+
+  for (p = (const guchar *) key; *p; p++)
+    {
+      if (is_word_char (p[0]) &&
+	  (p == (const guchar *) key || !is_word_char (p[-1])))
+	{
+	  gram = GRAM (WORD_START, WORD_START, p[0]);
+	  g_array_append_val (grams, gram);
+	  if (p[1])
+	    {
+	      gram = GRAM (WORD_START, p[0], p[1]);
+	      g_array_append_val (grams, gram);
+	    }
+	}
+
+      if (p[1] && p[2])
+	{
+	  gram = GRAM (p[0], p[1], p[2]);
+	  g_array_append_val (grams, gram);
+	}
+    }
+}
+
+static gboolean
+posting_find (GArray *ids,
+	      guint   id,
+	      guint  *index)
+{
+  guint lo = 0, hi = ids->len, mid, value;
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      value = g_array_index (ids, guint, mid);
+      if (value < id)
+	lo = mid + 1;
+      else if (value > id)
+	hi = mid;
+      else
+	{
+	  if (index)
+	    *index = mid;
+	  return TRUE;
+	}
+    }
+
+  return FALSE;
+}
+
+/*
+ * Like posting_find, for ids asked in ascending order: the search starts
+ * at *cursor and gallops, and *cursor is left on the first id not below
+ * @id, so walking a whole list costs about as much as merging it.
+ */
+static gboolean
+posting_seek (GArray *ids,
+	      guint   id,
+	      guint  *cursor)
+{
+  guint lo = *cursor, hi, step = 1, mid;
+
+  while (lo + step < ids->len && g_array_index (ids, guint, lo + step) < id)
+    {
+      lo += step;
+      step *= 2;
+    }
+
+  hi = MIN (lo + step, ids->len);
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (g_array_index (ids, guint, mid) < id)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  *cursor = lo;
+  return lo < ids->len && g_array_index (ids, guint, lo) == id;
+}
+
+static void
+search_index_item (VinagreSearch *search,
+		   SearchItem    *item)
+{
+  GArray *grams, *ids;
+  guint   i;
+  guint32 gram;
+
+  grams = g_array_new (FALSE, FALSE, sizeof (guint32));
+  key_grams (item->key, grams);
+
+  for (i = 0; i < grams->len; i++)
+    {
+      gram = g_array_index (grams, guint32, i);
+      ids = g_hash_table_lookup (search->priv->grams, GUINT_TO_POINTER (gram));
+      if (!ids)
+	{
+	  ids = g_array_new (FALSE, FALSE, sizeof (guint));
+	  g_hash_table_insert (search->priv->grams, GUINT_TO_POINTER (gram), ids);
+	}
+      /* Ids only grow, so the newest item is always last */
+      else if (g_array_index (ids, guint, ids->len - 1) == item->id)
+	continue;
+
+      g_array_append_val (ids, item->id);
+    }
+
+  g_array_free (grams, TRUE);
+}
+
+static void
+search_unindex_item (VinagreSearch *search,
+		     SearchItem    *item)
+{
+  GArray *grams, *ids;
+  guint   i, index;
+  guint32 gram;
+
+  grams = g_array_new (FALSE, FALSE, sizeof (guint32));
+  key_grams (item->key, grams);
+
+  for (i = 0; i < grams->len; i++)
+    {
+      gram = g_array_index (grams, guint32, i);
+      ids = g_hash_table_lookup (search->priv->grams, GUINT_TO_POINTER (gram));
+      if (!ids || !posting_find (ids, item->id, &index))
+	continue;
+
+      g_array_remove_index (ids, index);
+      if (ids->len == 0)
+	g_hash_table_remove (search->priv->grams, GUINT_TO_POINTER (gram));
+    }
+
+  g_array_free (grams, TRUE);
+}
+
+/* Renumbers the live items, dropping the slots of removed ones */
+static void
+search_compact (VinagreSearch *search)
+{
+  GPtrArray  *items;
+  SearchItem *item;
+  guint       i;
+
+  items = g_ptr_array_new_with_free_func ((GDestroyNotify) search_item_free);
+  g_hash_table_remove_all (search->priv->grams);
+
+  for (i = 0; i < search->priv->items->len; i++)
+    {
+      item = g_ptr_array_index (search->priv->items, i);
+      if (!item)
+	continue;
+
+      item->id = items->len;
+      g_ptr_array_add (items, item);
+      search_index_item (search, item);
+    }
+
+  g_ptr_array_set_free_func (search->priv->items, NULL);
+  g_ptr_array_free (search->priv->items, TRUE);
+  search->priv->items = items;
+  search->priv->n_removed = 0;
+}
+
+static SearchItem *
+search_add_item (VinagreSearch         *search,
+		 VinagreSearchSource    source,
+		 const gchar           *label,
+		 const gchar           *host,
+		 const gchar           *protocol,
+		 const gchar           *folders,
+		 VinagreBookmarksEntry *entry)
+{
+  SearchItem *item;
+  GString    *text;
+
+  item = g_slice_new0 (SearchItem);
+  item->result.source = source;
+  item->result.label = g_strdup (label);
+  item->result.host = g_strdup (host);
+  item->result.protocol = g_strdup (protocol);
+  item->result.entry = entry ? g_object_ref (entry) : NULL;
+
+  text = g_string_new (label);
+  g_string_append_printf (text, " %s", host);
+  if (protocol)
+    g_string_append_printf (text, " %s", protocol);
+  if (folders)
+    g_string_append_printf (text, " %s", folders);
+  item->key = g_utf8_strdown (text->str, text->len);
+  item->collate_key = g_utf8_collate_key (label, -1);
+  item->usage = g_hash_table_lookup (search->priv->usage, host);
+  g_string_free (text, TRUE);
+
+  item->id = search->priv->items->len;
+  g_ptr_array_add (search->priv->items, item);
+  search_index_item (search, item);
+
+  return item;
+}
+
+static void
+search_remove_item (VinagreSearch *search,
+		    SearchItem    *item)
+{
+  search_unindex_item (search, item);
+  search->priv->items->pdata[item->id] = NULL;
+  search_item_free (item);
+
+  if (++search->priv->n_removed > COMPACT_THRESHOLD &&
+      search->priv->n_removed > search->priv->items->len / 2)
+    search_compact (search);
+}
+
+static void
+search_add_entry (VinagreSearch         *search,
+		  VinagreSearchSource    source,
+		  VinagreBookmarksEntry *entry)
+{
+  VinagreBookmarksEntry *parent;
+  SearchItem            *item;
+  GString               *folders;
+  GSList                *l;
+  gchar                 *label, *host;
+
+  if (vinagre_bookmarks_entry_get_node (entry) == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+    {
+      for (l = vinagre_bookmarks_entry_get_children (entry); l; l = l->next)
+	search_add_entry (search, source, l->data);
+      return;
+    }
+
+  folders = g_string_new (NULL);
+  for (parent = vinagre_bookmarks_entry_get_parent (entry);
+       parent;
+       parent = vinagre_bookmarks_entry_get_parent (parent))
+    g_string_append_printf (folders, " %s", vinagre_bookmarks_entry_get_name (parent));
+
+  label = vinagre_bookmarks_entry_get_best_name (entry);
+  host = g_strdup_printf ("%s:%d",
+			  vinagre_bookmarks_entry_get_host (entry),
+			  vinagre_bookmarks_entry_get_port (entry));
+
+  item = search_add_item (search,
+			  source,
+			  label,
+			  host,
+			  vinagre_bookmarks_entry_get_protocol (entry),
+			  folders->len ? folders->str : NULL,
+			  entry);
+  g_hash_table_insert (search->priv->entries, entry, item);
+
+  g_free (label);
+  g_free (host);
+  g_string_free (folders, TRUE);
+}
+
+static void
+search_remove_entry (VinagreSearch         *search,
+		     VinagreBookmarksEntry *entry)
+{
+  SearchItem *item;
+  GSList     *l;
+
+  if (vinagre_bookmarks_entry_get_node (entry) == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+    {
+      for (l = vinagre_bookmarks_entry_get_children (entry); l; l = l->next)
+	search_remove_entry (search, l->data);
+      return;
+    }
+
+  item = g_hash_table_lookup (search->priv->entries, entry);
+  if (!item)
+    return;
+
+  g_hash_table_remove (search->priv->entries, entry);
+  search_remove_item (search, item);
+}
+
+static void
+search_remove_source (VinagreSearch       *search,
+		      VinagreSearchSource  source)
+{
+  GHashTableIter  iter;
+  SearchItem     *item;
+
+  g_hash_table_iter_init (&iter, search->priv->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+    if (item->result.source == source)
+      {
+	g_hash_table_iter_remove (&iter);
+	search_remove_item (search, item);
+      }
+}
+
+static void
+search_load_bookmarks (VinagreSearch *search)
+{
+  GSList *l;
+
+  search_remove_source (search, VINAGRE_SEARCH_SOURCE_BOOKMARK);
+  for (l = vinagre_bookmarks_get_all (vinagre_bookmarks_get_default ()); l; l = l->next)
+    search_add_entry (search, VINAGRE_SEARCH_SOURCE_BOOKMARK, l->data);
+}
+
+static void
+bookmarks_entry_added_cb (VinagreBookmarks      *book,
+			  VinagreBookmarksEntry *entry,
+			  VinagreSearch         *search)
+{
+  search_add_entry (search, VINAGRE_SEARCH_SOURCE_BOOKMARK, entry);
+}
+
+static void
+bookmarks_entry_removed_cb (VinagreBookmarks      *book,
+			    VinagreBookmarksEntry *entry,
+			    VinagreBookmarksEntry *parent,
+			    VinagreSearch         *search)
+{
+  search_remove_entry (search, entry);
+}
+
+static void
+bookmarks_entry_changed_cb (VinagreBookmarks      *book,
+			    VinagreBookmarksEntry *entry,
+			    VinagreSearch         *search)
+{
+  search_remove_entry (search, entry);
+  search_add_entry (search, VINAGRE_SEARCH_SOURCE_BOOKMARK, entry);
+}
+
+static void
+bookmarks_reloaded_cb (VinagreBookmarks *book,
+		       VinagreSearch    *search)
+{
+  search_load_bookmarks (search);
+}
+
+#ifdef VINAGRE_HAVE_AVAHI
+static void
+mdns_changed_cb (VinagreMdns   *mdns,
+		 VinagreSearch *search)
+{
+  GSList *l;
+
+  search_remove_source (search, VINAGRE_SEARCH_SOURCE_MDNS);
+  for (l = vinagre_mdns_get_all (mdns); l; l = l->next)
+    search_add_entry (search, VINAGRE_SEARCH_SOURCE_MDNS, l->data);
+}
+#endif
+
+static gchar *
+usage_filename (void)
+{
+  gchar *dir, *filename;
+
+  dir = vinagre_dirs_get_user_data_dir ();
+  filename = g_build_filename (dir, "search-usage", NULL);
+  g_free (dir);
+  return filename;
+}
+
+static void
+search_touch (VinagreSearch *search,
+	      const gchar   *host,
+	      guint          uses,
+	      guint64        last_used)
+{
+  SearchUsage *usage;
+  SearchItem  *item;
+  guint        i;
+
+  usage = g_hash_table_lookup (search->priv->usage, host);
+  if (!usage)
+    {
+      usage = g_new0 (SearchUsage, 1);
+      g_hash_table_insert (search->priv->usage, g_strdup (host), usage);
+
+      /* Once per host: the items keep it so that ranking needs no lookup */
+      for (i = 0; i < search->priv->items->len; i++)
+	{
+	  item = g_ptr_array_index (search->priv->items, i);
+	  if (item && !strcmp (item->result.host, host))
+	    item->usage = usage;
+	}
+    }
+
+  usage->uses += MIN (uses, G_MAXUINT - usage->uses);
+  usage->last_used = MAX (usage->last_used, last_used);
+  search->priv->clock = MAX (search->priv->clock, last_used);
+}
+
+/* The file is a log of "USES LAST_USED HOST" lines: replaying it sums the uses */
+static void
+search_load_usage (VinagreSearch *search)
+{
+  gchar   *filename, *contents = NULL, **lines, **l, *p, *end;
+  guint64  uses, last_used;
+
+  filename = usage_filename ();
+  if (g_file_get_contents (filename, &contents, NULL, NULL))
+    {
+      lines = g_strsplit (contents, "\n", 0);
+      for (l = lines; *l; l++)
+	{
+	  if (!**l)
+	    continue;
+	  search->priv->usage_lines++;
+
+	  p = *l;
+	  uses = g_ascii_strtoull (p, &end, 10);
+	  if (end == p || *end != ' ')
+	    continue;
+	  p = end + 1;
+	  last_used = g_ascii_strtoull (p, &end, 10);
+	  if (end == p || *end != ' ' || !end[1])
+	    continue;
+
+	  search_touch (search, end + 1, MIN (uses, G_MAXUINT), last_used);
+	}
+      g_strfreev (lines);
+    }
+
+  g_free (filename);
+  g_free (contents);
+}
+
+static void
+search_save_usage (VinagreSearch *search,
+		   const gchar   *host)
+{
+  GHashTableIter     iter;
+  SearchUsage       *usage;
+  const gchar       *key;
+  gchar             *filename, *path;
+  GString           *content;
+  GFile             *file;
+  GFileOutputStream *stream;
+  GError            *error = NULL;
+
+  filename = usage_filename ();
+  path = g_path_get_dirname (filename);
+  g_mkdir_with_parents (path, 0755);
+
+  content = g_string_new (NULL);
+  if (search->priv->usage_lines >= USAGE_FILE_SLACK * MAX (g_hash_table_size (search->priv->usage), USAGE_MIN_LINES))
+    {
+      /* Too many stale lines: write out one line per host */
+      g_hash_table_iter_init (&iter, search->priv->usage);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &usage))
+	g_string_append_printf (content, "%u %" G_GUINT64_FORMAT " %s\n",
+				usage->uses, usage->last_used, key);
+
+      if (g_file_set_contents (filename, content->str, -1, &error))
+	search->priv->usage_lines = g_hash_table_size (search->priv->usage);
+    }
+  else
+    {
+      g_string_append_printf (content, "1 %" G_GUINT64_FORMAT " %s\n",
+			      search->priv->clock, host);
+
+      file = g_file_new_for_path (filename);
+      stream = g_file_append_to (file, G_FILE_CREATE_NONE, NULL, &error);
+      if (stream)
+	{
+	  if (g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+					 content->str,
+					 content->len,
+					 NULL,
+					 NULL,
+					 &error))
+	    search->priv->usage_lines++;
+	  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL);
+	  g_object_unref (stream);
+	}
+      g_object_unref (file);
+    }
+
+  g_free (filename);
+  g_free (path);
+  g_string_free (content, TRUE);
+
+  if (error)
+    {
+      g_warning (_("Error while saving search usage file: %s"), error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+vinagre_search_init (VinagreSearch *search)
+{
+  VinagreBookmarks *book;
+
+  search->priv = G_TYPE_INSTANCE_GET_PRIVATE (search, VINAGRE_TYPE_SEARCH, VinagreSearchPrivate);
+
+  search->priv->items = g_ptr_array_new_with_free_func ((GDestroyNotify) search_item_free);
+  search->priv->grams = g_hash_table_new_full (g_direct_hash,
+					       g_direct_equal,
+					       NULL,
+					       (GDestroyNotify) g_array_unref);
+  search->priv->entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+  search->priv->history = g_hash_table_new (g_str_hash, g_str_equal);
+  search->priv->usage = g_hash_table_new_full (g_str_hash,
+					       g_str_equal,
+					       g_free,
+					       g_free);
+  search_load_usage (search);
+
+  book = vinagre_bookmarks_get_default ();
+  search_load_bookmarks (search);
+  g_signal_connect (book, "entry-added", G_CALLBACK (bookmarks_entry_added_cb), search);
+  g_signal_connect (book, "entry-removed", G_CALLBACK (bookmarks_entry_removed_cb), search);
+  g_signal_connect (book, "entry-changed", G_CALLBACK (bookmarks_entry_changed_cb), search);
+  g_signal_connect (book, "reloaded", G_CALLBACK (bookmarks_reloaded_cb), search);
+
+#ifdef VINAGRE_HAVE_AVAHI
+  mdns_changed_cb (vinagre_mdns_get_default (), search);
+  g_signal_connect (vinagre_mdns_get_default (),
+		    "changed",
+		    G_CALLBACK (mdns_changed_cb),
+		    search);
+#endif
+}
+
+static void
+vinagre_search_dispose (GObject *object)
+{
+  VinagreSearch *search = VINAGRE_SEARCH (object);
+
+  if (search->priv->items)
+    {
+      g_signal_handlers_disconnect_by_data (vinagre_bookmarks_get_default (), search);
+#ifdef VINAGRE_HAVE_AVAHI
+      g_signal_handlers_disconnect_by_data (vinagre_mdns_get_default (), search);
+#endif
+
+      g_hash_table_destroy (search->priv->entries);
+      g_hash_table_destroy (search->priv->history);
+      g_hash_table_destroy (search->priv->usage);
+      g_hash_table_destroy (search->priv->grams);
+      g_ptr_array_free (search->priv->items, TRUE);
+      search->priv->items = NULL;
+    }
+
+  G_OBJECT_CLASS (vinagre_search_parent_class)->dispose (object);
+}
+
+static void
+vinagre_search_class_init (VinagreSearchClass *klass)
+{
+  GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (VinagreSearchPrivate));
+
+  object_class->dispose = vinagre_search_dispose;
+}
+
+VinagreSearch *
+vinagre_search_get_default (void)
+{
+  if (G_UNLIKELY (!search_singleton))
+    search_singleton = VINAGRE_SEARCH (g_object_new (VINAGRE_TYPE_SEARCH,
+						     NULL));
+  return search_singleton;
+}
+
+/* Hosts used often and lately come first */
+static gdouble
+search_score (VinagreSearch *search,
+	      SearchItem    *item)
+{
+  SearchUsage *usage = item->usage;
+
+  if (!usage)
+    return 0;
+
+  return usage->uses / (1.0 + (search->priv->clock - usage->last_used) / 16.0);
+}
+
+static gint
+search_compare (SearchItem *a,
+		gdouble     score_a,
+		SearchItem *b,
+		gdouble     score_b)
+{
+  if (score_a != score_b)
+    return score_a > score_b ? -1 : 1;
+  if (a->result.source != b->result.source)
+    return a->result.source - b->result.source;
+  return strcmp (a->collate_key, b->collate_key);
+}
+
+/**
+ * vinagre_search_query:
+ * @search: the index
+ * @text: what the user typed
+ * @max_results: how many results to return at most
+ *
+ * Looks up the hosts matching every word of @text, best first. A
+ * word of one or two characters matches the start of a word; longer
+ * ones match anywhere.
+ *
+ * Return value: (transfer container) (element-type VinagreSearchResult):
+ * results owned by the index, valid until it next changes.
+ */
+GPtrArray *
+vinagre_search_query (VinagreSearch *search,
+		      const gchar   *text,
+		      guint          max_results)
+{
+  GPtrArray   *results, *lists;
+  GArray      *shortest = NULL, *ids;
+  SearchItem **top, *item;
+  gdouble     *scores, score;
+  guint       *cursors;
+  gchar       *lower, **terms, **term;
+  guint        i, j, n_top = 0, len;
+  gboolean     found = TRUE;
+  gint64       start;
+
+  g_return_val_if_fail (VINAGRE_IS_SEARCH (search), NULL);
+  g_return_val_if_fail (text != NULL, NULL);
+  g_return_val_if_fail (max_results > 0, NULL);
+
+  start = g_get_monotonic_time ();
+  results = g_ptr_array_new ();
+  lists = g_ptr_array_new ();
+  lower = g_utf8_strdown (text, -1);
+  terms = g_strsplit_set (lower, " \t", -1);
+
+  for (term = terms; *term && found; term++)
+    {
+      len = strlen (*term);
+      if (len == 0)
+	continue;
+
+      if (len < 3)
+	{
+	  ids = g_hash_table_lookup (search->priv->grams,
+				     GUINT_TO_POINTER (len == 1 ?
+						       GRAM (WORD_START, WORD_START, (*term)[0]) :
+						       GRAM (WORD_START, (*term)[0], (*term)[1])));
+	  found = ids != NULL;
+	  if (found)
+	    g_ptr_array_add (lists, ids);
+	  continue;
+	}
+
+      for (i = 0; i + 2 < len && found; i++)
+	{
+	  ids = g_hash_table_lookup (search->priv->grams,
+				     GUINT_TO_POINTER (GRAM ((*term)[i], (*term)[i + 1], (*term)[i + 2])));
+	  found = ids != NULL;
+	  if (found)
+	    g_ptr_array_add (lists, ids);
+	}
+    }
+
+  if (!found || lists->len == 0)
+    goto out;
+
+  for (i = 0; i < lists->len; i++)
+    if (!shortest || ((GArray *) g_ptr_array_index (lists, i))->len < shortest->len)
+      shortest = g_ptr_array_index (lists, i);
+
+  top = g_new (SearchItem *, max_results);
+  scores = g_new (gdouble, max_results);
+  cursors = g_new0 (guint, lists->len);
+
+  for (i = 0; i < shortest->len; i++)
+    {
+      item = g_ptr_array_index (search->priv->items, g_array_index (shortest, guint, i));
+
+      for (j = 0; j < lists->len; j++)
+	if (g_ptr_array_index (lists, j) != shortest &&
+	    !posting_seek (g_ptr_array_index (lists, j), item->id, &cursors[j]))
+	  break;
+      if (j < lists->len)
+	continue;
+
+      /* Sharing the trigrams does not mean containing the word */
+      for (term = terms; *term; term++)
+	if (strlen (*term) >= 3 && !strstr (item->key, *term))
+	  break;
+      if (*term)
+	continue;
+
+      score = search_score (search, item);
+      if (n_top == max_results &&
+	  search_compare (item, score, top[n_top - 1], scores[n_top - 1]) >= 0)
+	continue;
+
+      if (n_top < max_results)
+	n_top++;
+      for (j = n_top - 1;
+	   j > 0 && search_compare (item, score, top[j - 1], scores[j - 1]) < 0;
+	   j--)
+	{
+	  top[j] = top[j - 1];
+	  scores[j] = scores[j - 1];
+	}
+      top[j] = item;
+      scores[j] = score;
+    }
+
+  for (i = 0; i < n_top; i++)
+    g_ptr_array_add (results, &top[i]->result);
+
+  vinagre_debug_message (DEBUG_UTILS, "'%s': %u candidates, %u results in %.3f ms",
+			 text, shortest->len, n_top,
+			 (g_get_monotonic_time () - start) / 1000.0);
+
+  g_free (top);
+  g_free (scores);
+  g_free (cursors);
+
+out:
+  g_ptr_array_free (lists, TRUE);
+  g_strfreev (terms);
+  g_free (lower);
+  return results;
+}
+
+/**
+ * vinagre_search_record_use:
+ * @search: the index
+ * @host: the host text of a result
+ *
+ * Counts a connection to @host towards its rank, and saves the count
+ * so it still does after a restart.
+ */
+void
+vinagre_search_record_use (VinagreSearch *search,
+			   const gchar   *host)
+{
+  g_return_if_fail (VINAGRE_IS_SEARCH (search));
+  g_return_if_fail (host != NULL);
+
+  search_touch (search, host, 1, search->priv->clock + 1);
+  search_save_usage (search, host);
+}
+
+/**
+ * vinagre_search_add_history:
+ * @search: the index
+ * @host: a host just connected to from the connect dialog
+ */
+void
+vinagre_search_add_history (VinagreSearch *search,
+			    const gchar   *host)
+{
+  SearchItem *item;
+
+  g_return_if_fail (VINAGRE_IS_SEARCH (search));
+  g_return_if_fail (host != NULL);
+
+  if (!g_hash_table_lookup (search->priv->history, host))
+    {
+      item = search_add_item (search,
+			      VINAGRE_SEARCH_SOURCE_HISTORY,
+			      host,
+			      host,
+			      NULL,
+			      NULL,
+			      NULL);
+      g_hash_table_insert (search->priv->history, item->result.host, item);
+    }
+
+  vinagre_search_record_use (search, host);
+}
+
+/**
+ * vinagre_search_set_history:
+ * @search: the index
+ * @history: (element-type utf8): the saved history, oldest first
+ *
+ * Makes the history part of the index match @history. Hosts seen for
+ * the first time rank by their place in it.
+ */
+void
+vinagre_search_set_history (VinagreSearch *search,
+			    GPtrArray     *history)
+{
+  GHashTable     *wanted;
+  GHashTableIter  iter;
+  SearchItem     *item;
+  const gchar    *host;
+  guint           i;
+
+  g_return_if_fail (VINAGRE_IS_SEARCH (search));
+  g_return_if_fail (history != NULL);
+
+  wanted = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i < history->len; i++)
+    g_hash_table_add (wanted, g_ptr_array_index (history, i));
+
+  g_hash_table_iter_init (&iter, search->priv->history);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+    if (!g_hash_table_contains (wanted, item->result.host))
+      {
+	g_hash_table_iter_remove (&iter);
+	search_remove_item (search, item);
+      }
+
+  for (i = 0; i < history->len; i++)
+    {
+      host = g_ptr_array_index (history, i);
+      if (g_hash_table_lookup (search->priv->history, host))
+	continue;
+
+      item = search_add_item (search,
+			      VINAGRE_SEARCH_SOURCE_HISTORY,
+			      host,
+			      host,
+			      NULL,
+			      NULL,
+			      NULL);
+      g_hash_table_insert (search->priv->history, item->result.host, item);
+
+      /* A guess at the rank, so not logged on its own */
+      if (!g_hash_table_lookup (search->priv->usage, host))
+	search_touch (search, host, 1, search->priv->clock + 1);
+    }
+
+  g_hash_table_destroy (wanted);
+}
+
+/* vim: set ts=8: */
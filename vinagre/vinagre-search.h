@@ -0,0 +1,87 @@
+/*
+ * vinagre-search.h
+ * In-memory index of known hosts for the connect dialog
+ * This file is part of vinagre
+ *
+ * Copyright (C) 2026 - The Vinagre developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VINAGRE_SEARCH_H__
+#define __VINAGRE_SEARCH_H__
+
+#include <glib-object.h>
+
+#include "vinagre-bookmarks-entry.h"
+
+G_BEGIN_DECLS
+
+#define VINAGRE_TYPE_SEARCH             (vinagre_search_get_type ())
+#define VINAGRE_SEARCH(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), VINAGRE_TYPE_SEARCH, VinagreSearch))
+#define VINAGRE_SEARCH_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), VINAGRE_TYPE_SEARCH, VinagreSearchClass))
+#define VINAGRE_IS_SEARCH(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), VINAGRE_TYPE_SEARCH))
+#define VINAGRE_IS_SEARCH_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), VINAGRE_TYPE_SEARCH))
+#define VINAGRE_SEARCH_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), VINAGRE_TYPE_SEARCH, VinagreSearchClass))
+
+typedef struct _VinagreSearchClass   VinagreSearchClass;
+typedef struct _VinagreSearch        VinagreSearch;
+typedef struct _VinagreSearchPrivate VinagreSearchPrivate;
+typedef struct _VinagreSearchResult  VinagreSearchResult;
+
+typedef enum
+{
+  VINAGRE_SEARCH_SOURCE_BOOKMARK,
+  VINAGRE_SEARCH_SOURCE_MDNS,
+  VINAGRE_SEARCH_SOURCE_HISTORY
+} VinagreSearchSource;
+
+struct _VinagreSearchClass
+{
+  GObjectClass parent_class;
+};
+
+struct _VinagreSearch
+{
+  GObject parent_instance;
+  VinagreSearchPrivate *priv;
+};
+
+struct _VinagreSearchResult
+{
+  VinagreSearchSource    source;
+  gchar                 *label;		/* What the user knows the host by */
+  gchar                 *host;		/* Text for the host entry */
+  gchar                 *protocol;	/* NULL for history */
+  VinagreBookmarksEntry *entry;		/* NULL for history */
+};
+
+GType		vinagre_search_get_type		(void) G_GNUC_CONST;
+
+VinagreSearch	*vinagre_search_get_default	(void);
+
+GPtrArray	*vinagre_search_query		(VinagreSearch *search,
+						 const gchar   *text,
+						 guint          max_results);
+void		vinagre_search_set_history	(VinagreSearch *search,
+						 GPtrArray     *history);
+void		vinagre_search_add_history	(VinagreSearch *search,
+						 const gchar   *host);
+void		vinagre_search_record_use	(VinagreSearch *search,
+						 const gchar   *host);
+
+G_END_DECLS
+
+#endif  /* __VINAGRE_SEARCH_H__  */
+/* vim: set ts=8: */
@@ -0,0 +1,502 @@
+/*
+ * vinagre-ssh-gateway.c
+ * SSH connections shared by every tunnel through the same host
+ * This file is part of vinagre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <unistd.h>
+#ifndef G_OS_WIN32
+#include <sys/wait.h>
+#endif
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "vinagre-ssh-gateway.h"
+#include "vinagre-ssh.h"
+#include "vinagre-debug.h"
+
+/* Should vinagre go away without closing a gateway, ssh drops it on its
+ * own this long after the last forwarded connection is closed */
+#define GATEWAY_PERSIST_SECONDS 60
+
+/* A gateway silent for GATEWAY_ALIVE_INTERVAL * GATEWAY_ALIVE_COUNT seconds
+ * is dropped by ssh, taking its forwarded connections along */
+#define GATEWAY_ALIVE_INTERVAL 15
+#define GATEWAY_ALIVE_COUNT 3
+
+/*
+ * A gateway is an OpenSSH master connection. Logging in happens once, every
+ * tunnel through the host is then added to the master as a new forwarding
+ * and rides on the same authenticated session.
+ */
+struct _VinagreSshGateway
+{
+  gint   ref_count;
+  gchar *name;		/* As typed by the user, the key in the table */
+  gchar *host;
+  gint   port;
+  gchar *control_path;
+  gboolean ready;	/* Logged in */
+  GSList *waiters;	/* Results to complete once logged in */
+};
+
+static GHashTable *gateways = NULL;
+
+static void
+split_gateway (const gchar *gateway, gchar **host, gint *port)
+{
+  if (g_strrstr (gateway, ":") == NULL)
+    {
+      *host = g_strdup (gateway);
+      *port = 22;
+    }
+  else
+    {
+      gchar **server = g_strsplit (gateway, ":", 2);
+      *host = g_strdup (server[0]);
+      *port = server[1] ? atoi (server[1]) : 22;
+      g_strfreev (server);
+    }
+}
+
+typedef struct
+{
+  GSimpleAsyncResult *result;
+  gint                stderr_fd;
+} ControlData;
+
+static void
+gateway_control_exited_cb (GPid     pid,
+			   gint     status,
+			   gpointer user_data)
+{
+  ControlData *data = user_data;
+  GString     *ssh_stderr;
+  gchar        buf[256];
+  gssize       n;
+  gboolean     res;
+
+  /* ssh is gone, so this no longer blocks */
+  ssh_stderr = g_string_new (NULL);
+  while ((n = read (data->stderr_fd, buf, sizeof (buf))) > 0)
+    g_string_append_len (ssh_stderr, buf, n);
+  close (data->stderr_fd);
+  g_spawn_close_pid (pid);
+
+#ifdef G_OS_WIN32
+  res = status == 0;
+#else
+  res = WIFEXITED (status) && WEXITSTATUS (status) == 0;
+#endif
+
+  if (!res)
+    {
+      if (*g_strstrip (ssh_stderr->str))
+	g_simple_async_result_set_error (data->result,
+					 VINAGRE_SSH_ERROR,
+					 VINAGRE_SSH_ERROR_FAILED,
+					 "%s",
+					 ssh_stderr->str);
+      else
+	g_simple_async_result_set_error (data->result,
+					 VINAGRE_SSH_ERROR,
+					 VINAGRE_SSH_ERROR_FAILED,
+					 "%s",
+					 _("The connection to the SSH host was lost"));
+    }
+
+  g_simple_async_result_complete (data->result);
+  g_object_unref (data->result);
+  g_string_free (ssh_stderr, TRUE);
+  g_slice_free (ControlData, data);
+}
+
+/*
+ * Sends a command to the master. It never touches the network, but a
+ * wedged master may take its time to answer, so the main loop keeps
+ * running meanwhile. The gateway may be freed before the answer comes.
+ */
+static void
+gateway_control_async (VinagreSshGateway   *gateway,
+		       const gchar         *operation,
+		       const gchar         *forward,
+		       GAsyncReadyCallback  callback,
+		       gpointer             user_data)
+{
+  ControlData *data;
+  gchar       *args[9];
+  gint         i = 0;
+  GPid         pid;
+  GError      *error = NULL;
+
+  args[i++] = (gchar *) SSH_PROGRAM;
+  args[i++] = (gchar *) "-S";
+  args[i++] = gateway->control_path;
+  args[i++] = (gchar *) "-O";
+  args[i++] = (gchar *) operation;
+  if (forward)
+    {
+      args[i++] = (gchar *) "-L";
+      args[i++] = (gchar *) forward;
+    }
+  args[i++] = gateway->host;
+  args[i] = NULL;
+
+  data = g_slice_new (ControlData);
+  data->result = g_simple_async_result_new (NULL, callback, user_data,
+					    gateway_control_async);
+
+  if (!g_spawn_async_with_pipes (NULL, args, NULL,
+				 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD |
+				 G_SPAWN_STDOUT_TO_DEV_NULL,
+				 NULL, NULL,
+				 &pid,
+				 NULL, NULL, &data->stderr_fd,
+				 &error))
+    {
+      g_simple_async_result_take_error (data->result, error);
+      g_simple_async_result_complete_in_idle (data->result);
+      g_object_unref (data->result);
+      g_slice_free (ControlData, data);
+      return;
+    }
+
+  g_child_watch_add (pid, gateway_control_exited_cb, data);
+}
+
+static gboolean
+gateway_control_finish (GAsyncResult  *result,
+			GError       **error)
+{
+  g_return_val_if_fail (g_simple_async_result_is_valid (result, NULL,
+							gateway_control_async),
+			FALSE);
+
+  return !g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result),
+						 error);
+}
+
+static void
+gateway_free (VinagreSshGateway *gateway)
+{
+  g_free (gateway->name);
+  g_free (gateway->host);
+  g_free (gateway->control_path);
+  g_slice_free (VinagreSshGateway, gateway);
+}
+
+static void
+gateway_login_cb (GObject      *source,
+		  GAsyncResult *res,
+		  gpointer      user_data)
+{
+  VinagreSshGateway *gateway = user_data;
+  GError *error = NULL;
+  GSList *waiters, *l;
+
+  if (vinagre_ssh_connect_finish (res, &error))
+    {
+      gateway->ready = TRUE;
+      vinagre_debug_message (DEBUG_VIEW, "Opened SSH gateway %s", gateway->name);
+    }
+  else if (g_hash_table_lookup (gateways, gateway->name) == gateway)
+    g_hash_table_remove (gateways, gateway->name);
+
+  waiters = gateway->waiters;
+  gateway->waiters = NULL;
+
+  for (l = waiters; l; l = l->next)
+    {
+      GSimpleAsyncResult *result = l->data;
+
+      if (error)
+	g_simple_async_result_set_from_error (result, error);
+      else
+	g_simple_async_result_set_op_res_gpointer (result,
+						   vinagre_ssh_gateway_ref (gateway),
+						   NULL);
+      g_simple_async_result_complete (result);
+      g_object_unref (result);
+    }
+
+  g_slist_free (waiters);
+  g_clear_error (&error);
+
+  /* The reference held by the login */
+  vinagre_ssh_gateway_unref (gateway);
+}
+
+static VinagreSshGateway *
+gateway_open (GtkWindow *parent, const gchar *name, GError **error)
+{
+  VinagreSshGateway *gateway;
+  gchar **master_str, **command_str;
+
+  gateway = g_slice_new0 (VinagreSshGateway);
+  gateway->ref_count = 1;
+  gateway->name = g_strdup (name);
+  split_gateway (name, &gateway->host, &gateway->port);
+
+  gateway->control_path = vinagre_ssh_new_socket_path ("gateway", error);
+  if (!gateway->control_path)
+    {
+      gateway_free (gateway);
+      return NULL;
+    }
+
+  master_str = g_new (gchar *, 6);
+  master_str[0] = g_strdup ("-oControlMaster=yes");
+  master_str[1] = g_strdup_printf ("-oControlPath=%s", gateway->control_path);
+  master_str[2] = g_strdup_printf ("-oControlPersist=%d", GATEWAY_PERSIST_SECONDS);
+  master_str[3] = g_strdup_printf ("-oServerAliveInterval=%d", GATEWAY_ALIVE_INTERVAL);
+  master_str[4] = g_strdup_printf ("-oServerAliveCountMax=%d", GATEWAY_ALIVE_COUNT);
+  master_str[5] = NULL;
+
+  /* Once the check is printed the master goes to the background */
+  command_str = g_new (gchar *, 3);
+  command_str[0] = g_strdup ("echo");
+  command_str[1] = g_strdup (VINAGRE_SSH_CHECK);
+  command_str[2] = NULL;
+
+  vinagre_ssh_connect_async (parent,
+			     gateway->host,
+			     gateway->port,
+			     NULL,
+			     master_str,
+			     command_str,
+			     gateway_login_cb,
+			     gateway);
+
+  g_strfreev (master_str);
+  g_strfreev (command_str);
+
+  return gateway;
+}
+
+/* Shares gw if it is there, logs in otherwise */
+static void
+gateway_get (GtkWindow          *parent,
+	     const gchar        *name,
+	     VinagreSshGateway  *gw,
+	     GSimpleAsyncResult *result)
+{
+  GError *error = NULL;
+
+  if (!gw)
+    {
+      gw = gateway_open (parent, name, &error);
+      if (!gw)
+	{
+	  g_simple_async_result_take_error (result, error);
+	  g_simple_async_result_complete_in_idle (result);
+	  g_object_unref (result);
+	  return;
+	}
+      g_hash_table_insert (gateways, gw->name, gw);
+    }
+
+  if (gw->ready)
+    {
+      g_simple_async_result_set_op_res_gpointer (result,
+						 vinagre_ssh_gateway_ref (gw),
+						 NULL);
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+    }
+  else
+    gw->waiters = g_slist_append (gw->waiters, result);
+}
+
+typedef struct
+{
+  GSimpleAsyncResult *result;
+  GtkWindow          *parent;
+  VinagreSshGateway  *gateway;
+} CheckData;
+
+static void
+gateway_checked_cb (GObject      *source,
+		    GAsyncResult *res,
+		    gpointer      user_data)
+{
+  CheckData         *data = user_data;
+  VinagreSshGateway *gw = data->gateway;
+
+  if (!gateway_control_finish (res, NULL))
+    {
+      /* The tunnels still holding it are dead as well */
+      vinagre_debug_message (DEBUG_VIEW, "SSH gateway %s went away", gw->name);
+      gw->ready = FALSE;
+      if (g_hash_table_lookup (gateways, gw->name) == gw)
+	g_hash_table_remove (gateways, gw->name);
+    }
+
+  /* Another tab may have logged in again while we asked */
+  gateway_get (data->parent,
+	       gw->name,
+	       g_hash_table_lookup (gateways, gw->name),
+	       data->result);
+
+  if (data->parent)
+    g_object_unref (data->parent);
+  vinagre_ssh_gateway_unref (gw);
+  g_slice_free (CheckData, data);
+}
+
+/**
+ * vinagre_ssh_gateway_get_async:
+ * @parent: transient parent of the login dialogs, or %NULL
+ * @gateway: the SSH host, as user@host:port
+ * @callback: called once logged in, or on failure
+ * @user_data: data for @callback
+ *
+ * Logs into @gateway, unless a connection to it is already open, in which
+ * case that one is shared once the master answers it is still there. Tabs
+ * asking for a gateway whose login is under way wait for that same login.
+ */
+void
+vinagre_ssh_gateway_get_async (GtkWindow           *parent,
+			       const gchar         *gateway,
+			       GAsyncReadyCallback  callback,
+			       gpointer             user_data)
+{
+  GSimpleAsyncResult *result;
+  VinagreSshGateway *gw;
+  CheckData *data;
+
+  g_return_if_fail (gateway != NULL);
+
+  result = g_simple_async_result_new (NULL, callback, user_data,
+				      vinagre_ssh_gateway_get_async);
+
+  if (!gateways)
+    gateways = g_hash_table_new (g_str_hash, g_str_equal);
+
+  gw = g_hash_table_lookup (gateways, gateway);
+  if (gw && gw->ready)
+    {
+      data = g_slice_new (CheckData);
+      data->result = result;
+      data->parent = parent ? g_object_ref (parent) : NULL;
+      data->gateway = vinagre_ssh_gateway_ref (gw);
+      gateway_control_async (gw, "check", NULL, gateway_checked_cb, data);
+      return;
+    }
+
+  gateway_get (parent, gateway, gw, result);
+}
+
+/**
+ * vinagre_ssh_gateway_get_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: a reference to the gateway, or %NULL on error
+ */
+VinagreSshGateway *
+vinagre_ssh_gateway_get_finish (GAsyncResult  *result,
+				GError       **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result, NULL,
+							vinagre_ssh_gateway_get_async),
+			NULL);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
+
+  return g_simple_async_result_get_op_res_gpointer (simple);
+}
+
+VinagreSshGateway *
+vinagre_ssh_gateway_ref (VinagreSshGateway *gateway)
+{
+  g_return_val_if_fail (gateway != NULL, NULL);
+
+  gateway->ref_count++;
+  return gateway;
+}
+
+/* Closes the connection along with the last tunnel using it */
+void
+vinagre_ssh_gateway_unref (VinagreSshGateway *gateway)
+{
+  g_return_if_fail (gateway != NULL);
+
+  if (--gateway->ref_count > 0)
+    return;
+
+  if (g_hash_table_lookup (gateways, gateway->name) == gateway)
+    g_hash_table_remove (gateways, gateway->name);
+
+  /* Nobody waits for the answer */
+  if (gateway->ready)
+    {
+      gateway_control_async (gateway, "exit", NULL, NULL, NULL);
+      vinagre_debug_message (DEBUG_VIEW, "Closed SSH gateway %s", gateway->name);
+    }
+
+  gateway_free (gateway);
+}
+
+/**
+ * vinagre_ssh_gateway_add_forward_async:
+ * @gateway: a #VinagreSshGateway
+ * @forward: a -L specification, as local:remote_host:remote_port
+ * @callback: called once ssh answers
+ * @user_data: data for @callback
+ */
+void
+vinagre_ssh_gateway_add_forward_async (VinagreSshGateway   *gateway,
+				       const gchar         *forward,
+				       GAsyncReadyCallback  callback,
+				       gpointer             user_data)
+{
+  g_return_if_fail (gateway != NULL);
+  g_return_if_fail (forward != NULL);
+
+  gateway_control_async (gateway, "forward", forward, callback, user_data);
+}
+
+/**
+ * vinagre_ssh_gateway_add_forward_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: whether ssh is now listening on the local end
+ */
+gboolean
+vinagre_ssh_gateway_add_forward_finish (GAsyncResult  *result,
+					GError       **error)
+{
+  return gateway_control_finish (result, error);
+}
+
+/* Nobody waits for the answer */
+void
+vinagre_ssh_gateway_cancel_forward (VinagreSshGateway *gateway,
+				    const gchar       *forward)
+{
+  g_return_if_fail (gateway != NULL);
+  g_return_if_fail (forward != NULL);
+
+  gateway_control_async (gateway, "cancel", forward, NULL, NULL);
+}
+
+/* vim: set ts=8: */
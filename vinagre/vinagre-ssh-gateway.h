@@ -0,0 +1,50 @@
+/*
+ * vinagre-ssh-gateway.h
+ * SSH connections shared by every tunnel through the same host
+ * This file is part of vinagre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VINAGRE_SSH_GATEWAY_H__
+#define __VINAGRE_SSH_GATEWAY_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VinagreSshGateway VinagreSshGateway;
+
+void			vinagre_ssh_gateway_get_async		(GtkWindow           *parent,
+								 const gchar         *gateway,
+								 GAsyncReadyCallback  callback,
+								 gpointer             user_data);
+VinagreSshGateway *	vinagre_ssh_gateway_get_finish		(GAsyncResult  *result,
+								 GError       **error);
+VinagreSshGateway *	vinagre_ssh_gateway_ref			(VinagreSshGateway *gateway);
+void			vinagre_ssh_gateway_unref		(VinagreSshGateway *gateway);
+
+void			vinagre_ssh_gateway_add_forward_async	(VinagreSshGateway   *gateway,
+								 const gchar         *forward,
+								 GAsyncReadyCallback  callback,
+								 gpointer             user_data);
+gboolean		vinagre_ssh_gateway_add_forward_finish	(GAsyncResult  *result,
+								 GError       **error);
+void			vinagre_ssh_gateway_cancel_forward	(VinagreSshGateway *gateway,
+								 const gchar       *forward);
+
+G_END_DECLS
+
+#endif  /* __VINAGRE_SSH_GATEWAY_H__  */
+/* vim: set ts=8: */
@@ -22,24 +22,25 @@
 #include <config.h>
 
 #include "vinagre-ssh.h"
+#include "vinagre-cache-prefs.h"
+#include "vinagre-debug.h"
 #include "vinagre-vala.h"
 #include "pty_open.h"
 
 #ifdef G_OS_WIN32
 #undef DATADIR
 #include <winsock2.h>
-#include <gio/gwin32inputstream.h>
-#include <gio/gwin32outputstream.h>
 #else /* !G_OS_WIN32 */
 #include <arpa/inet.h>
 #include <netinet/in.h>
-#include <gio/gunixinputstream.h>
-#include <gio/gunixoutputstream.h>
+#include <signal.h>
 #endif /* G_OS_WIN32 */
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <libsecret/secret.h>
 
 static const int SSH_READ_TIMEOUT = 40; /* seconds */
@@ -58,64 +59,179 @@ typedef enum {
 static SSHClientVendor vendor = SSH_VENDOR_INVALID;
 
 static SSHClientVendor
-get_ssh_client_vendor (void)
+get_ssh_client_vendor (const gchar *ssh_stderr)
 {
-  char *ssh_stderr;
-  char *args[3];
-  gint ssh_exitcode;
-  SSHClientVendor res = SSH_VENDOR_INVALID;
-  
-  args[0] = g_strdup (SSH_PROGRAM);
-  args[1] = g_strdup ("-V");
-  args[2] = NULL;
-  if (g_spawn_sync (NULL, args, NULL,
-		    G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
-		    NULL, NULL,
-		    NULL, &ssh_stderr,
-		    &ssh_exitcode, NULL))
-    {
-      if (ssh_stderr == NULL)
-	res = SSH_VENDOR_INVALID;
-      else if ((strstr (ssh_stderr, "OpenSSH") != NULL) ||
-	       (strstr (ssh_stderr, "Sun_SSH") != NULL))
-	res = SSH_VENDOR_OPENSSH;
-      else if (strstr (ssh_stderr, "SSH Secure Shell") != NULL)
-	res = SSH_VENDOR_SSH;
-      else
-	res = SSH_VENDOR_INVALID;
+  if ((strstr (ssh_stderr, "OpenSSH") != NULL) ||
+      (strstr (ssh_stderr, "Sun_SSH") != NULL))
+    return SSH_VENDOR_OPENSSH;
+  else if (strstr (ssh_stderr, "SSH Secure Shell") != NULL)
+    return SSH_VENDOR_SSH;
+  else
+    return SSH_VENDOR_INVALID;
+}
+
+/*
+ * "ssh -V" is run once in the background and its answer kept in the cache
+ * prefs, next to the path and mtime of the binary it came from. Logins
+ * started while it runs are spawned as soon as it is done.
+ */
+typedef struct {
+  GIOChannel *channel;
+  GString    *output;
+  gchar      *client;		/* Cache key of the binary being probed */
+} VendorProbe;
+
+typedef struct _SshLogin SshLogin;
+
+static VendorProbe *probe = NULL;
+static GSList *probe_waiters = NULL;
+
+static void login_start (SshLogin *login);
+
+/* Returns: "path:mtime" of the ssh binary, or %NULL if there is none */
+static gchar *
+get_ssh_client_key (void)
+{
+  gchar *path, *key;
+  GStatBuf buf;
+
+  path = g_find_program_in_path (SSH_PROGRAM);
+  if (!path)
+    return NULL;
+
+  if (g_stat (path, &buf) == 0)
+    key = g_strdup_printf ("%s:%" G_GINT64_FORMAT, path, (gint64) buf.st_mtime);
+  else
+    key = NULL;
+
+  g_free (path);
+  return key;
+}
+
+static void
+probe_done (SSHClientVendor result)
+{
+  GSList *waiters, *l;
+
+  vendor = result;
+  if (vendor != SSH_VENDOR_INVALID)
+    {
+      vinagre_cache_prefs_set_string ("ssh", "client", probe->client);
+      vinagre_cache_prefs_set_integer ("ssh", "vendor", vendor);
     }
-  
-  g_free (ssh_stderr);
-  g_free (args[0]);
-  g_free (args[1]);
-  
-  return res;
+  vinagre_debug_message (DEBUG_VIEW, "SSH client %s is vendor %d", probe->client, vendor);
+
+  if (probe->channel)
+    g_io_channel_unref (probe->channel);
+  g_string_free (probe->output, TRUE);
+  g_free (probe->client);
+  g_slice_free (VendorProbe, probe);
+  probe = NULL;
+
+  waiters = probe_waiters;
+  probe_waiters = NULL;
+  for (l = waiters; l; l = l->next)
+    login_start (l->data);
+  g_slist_free (waiters);
 }
 
 static gboolean
-wait_for_reply (int stdout_fd, GError **error)
+probe_output_cb (GIOChannel   *channel,
+		 GIOCondition  condition,
+		 gpointer      user_data)
 {
-  fd_set ifds;
-  struct timeval tv;
-  int ret;
-  
-  FD_ZERO (&ifds);
-  FD_SET (stdout_fd, &ifds);
-  
-  tv.tv_sec = SSH_READ_TIMEOUT;
-  tv.tv_usec = 0;
-      
-  ret = select (stdout_fd+1, &ifds, NULL, NULL, &tv);
+  gchar buffer[256];
+  gsize len = 0;
+  GIOStatus status;
+
+  status = g_io_channel_read_chars (channel, buffer, sizeof (buffer), &len, NULL);
+  if (status == G_IO_STATUS_AGAIN)
+    return TRUE;
+  if (status == G_IO_STATUS_NORMAL)
+    {
+      g_string_append_len (probe->output, buffer, len);
+      return TRUE;
+    }
 
-  if (ret <= 0)
+  probe_done (get_ssh_client_vendor (probe->output->str));
+  return FALSE;
+}
+
+static void
+probe_child_cb (GPid pid, gint status, gpointer user_data)
+{
+  g_spawn_close_pid (pid);
+}
+
+static void
+probe_start (void)
+{
+  gchar *args[3];
+  GPid pid;
+  gint stderr_fd;
+
+  probe = g_slice_new0 (VendorProbe);
+  probe->output = g_string_new (NULL);
+  probe->client = get_ssh_client_key ();
+
+  args[0] = (gchar *) SSH_PROGRAM;
+  args[1] = (gchar *) "-V";
+  args[2] = NULL;
+  if (!probe->client ||
+      !g_spawn_async_with_pipes (NULL, args, NULL,
+				 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD |
+				 G_SPAWN_STDOUT_TO_DEV_NULL,
+				 NULL, NULL,
+				 &pid, NULL, NULL, &stderr_fd,
+				 NULL))
     {
-      g_set_error_literal (error,
-			   VINAGRE_SSH_ERROR,
-			   VINAGRE_SSH_ERROR_TIMEOUT,
-			   _("Timed out when logging into SSH host"));
-      return FALSE;
+      probe_done (SSH_VENDOR_INVALID);
+      return;
     }
-  return TRUE;
+
+  g_child_watch_add (pid, probe_child_cb, NULL);
+
+#ifdef G_OS_WIN32
+  probe->channel = g_io_channel_win32_new_fd (stderr_fd);
+#else /* !G_OS_WIN32 */
+  probe->channel = g_io_channel_unix_new (stderr_fd);
+#endif /* G_OS_WIN32 */
+  g_io_channel_set_encoding (probe->channel, NULL, NULL);
+  g_io_channel_set_close_on_unref (probe->channel, TRUE);
+  g_io_add_watch (probe->channel,
+		  G_IO_IN | G_IO_HUP | G_IO_ERR,
+		  probe_output_cb,
+		  NULL);
+}
+
+/**
+ * vinagre_ssh_init:
+ *
+ * Finds out which SSH client is installed, so the first tunnel does not
+ * have to. Must be called after vinagre_cache_prefs_init().
+ */
+void
+vinagre_ssh_init (void)
+{
+  gchar *client, *cached;
+
+  if (vendor != SSH_VENDOR_INVALID || probe)
+    return;
+
+  client = get_ssh_client_key ();
+  cached = vinagre_cache_prefs_get_string ("ssh", "client", NULL);
+
+  if (client && g_strcmp0 (client, cached) == 0)
+    vendor = vinagre_cache_prefs_get_integer ("ssh", "vendor", SSH_VENDOR_INVALID);
+
+  if (vendor != SSH_VENDOR_OPENSSH && vendor != SSH_VENDOR_SSH)
+    {
+      vendor = SSH_VENDOR_INVALID;
+      probe_start ();
+    }
+
+  g_free (client);
+  g_free (cached);
 }
 
 static char **
@@ -306,519 +422,906 @@ get_hostname_and_fingerprint_from_line (const gchar *buffer,
   return TRUE;
 }
 
-/**
- * _ask_question:
- * @parent: transient parent, or NULL for none
- * @message: The message to be displayed, if it contains multiple lines,
- *  the first one is considered as the title.
- * @choices: NULL-terminated array of button's labels of the dialog
- * @choice: Place to store the selected button. Zero is the first.
- *
- * Displays a dialog with a message and some options to the user.
- *
- * Returns TRUE if the user has selected any option, FALSE if the dialog
- *  was canceled.
- */
-static gboolean
-_ask_question (GtkWindow  *parent,
-			    const char *message,
-			    char       **choices,
-			    int        *choice)
+static gchar *
+get_username (const gchar *host, const gchar *username)
 {
-  gchar **messages;
-  GtkWidget *d;
-  int i, n_choices, result;
-
-  g_return_val_if_fail (message && choices && choice, FALSE);
-
-  messages = g_strsplit (message, "\n", 2);
+  gchar *pos;
 
-  d = gtk_message_dialog_new (parent,
-			      GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-			      GTK_MESSAGE_QUESTION,
-			      GTK_BUTTONS_NONE,
-			      "%s",
-			      messages[0]);
+  if (username)
+    return g_strdup (username);
 
-  if (g_strv_length (messages) > 1)
-    gtk_message_dialog_format_secondary_markup (GTK_MESSAGE_DIALOG (d),
-						"%s",
-						messages[1]);
-  g_strfreev (messages);
+  pos = strchr (host, '@');
+  if (pos)
+    return g_strndup (host, pos - host);
 
-  n_choices = g_strv_length (choices);
-  for (i = 0; i < n_choices; i++)
-    gtk_dialog_add_button (GTK_DIALOG (d), choices[i], i);
+  return g_strdup (g_get_user_name ());
+}
 
-  result = gtk_dialog_run (GTK_DIALOG (d));
-  gtk_widget_destroy (d);
+static gchar *
+get_hostname (const gchar *host)
+{
+  gchar *pos;
 
-  if (result == GTK_RESPONSE_NONE || result == GTK_RESPONSE_DELETE_EVENT)
-    return FALSE;
+  pos = strchr (host, '@');
+  if (pos)
+    return g_strdup (pos+1);
 
-  *choice = result;
-  return TRUE;
+  return g_strdup (host);
 }
 
+/* Returns FALSE, filling @error, if @line is ssh telling why it failed */
 static gboolean
-handle_login (GtkWindow *parent,
-	      const   gchar *host,
-	      int     port,
-	      const   gchar *user,
-	      int     tty_fd,
-	      int     stdout_fd,
-	      int     stderr_fd,
-              GError  **error)
-{
-  GInputStream *prompt_stream, *stdout_stream;
-  GOutputStream *reply_stream;
-  fd_set ifds;
-  struct timeval tv;
-  int ret;
-  int prompt_fd;
-  char buffer[1024];
-  gsize len;
-  gboolean ret_val, save_in_keyring;
-  gsize bytes_written;
-  const gchar *authtype;
-  gchar *object, *password;
-  GError *secret_error = NULL;
-  gchar *label;
-
-  object = password = NULL;
-  authtype = NULL;
-  ret_val = TRUE;
-  save_in_keyring = FALSE;
-
-  if (vendor == SSH_VENDOR_SSH) 
-    prompt_fd = stderr_fd;
+check_stderr_line (const gchar *line, GError **error)
+{
+  if (strstr (line, "Permission denied") != NULL)
+    g_set_error_literal (error,
+			 VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_PERMISSION_DENIED,
+			 _("Permission denied"));
+  else if (strstr (line, "Name or service not known") != NULL)
+    g_set_error_literal (error,
+			 VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_HOST_NOT_FOUND,
+			 _("Hostname not known"));
+  else if (strstr (line, "No route to host") != NULL)
+    g_set_error_literal (error,
+			 VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_HOST_NOT_FOUND,
+			 _("No route to host"));
+  else if (strstr (line, "Connection refused") != NULL)
+    g_set_error_literal (error,
+			 VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_PERMISSION_DENIED,
+			 _("Connection refused by server"));
+  else if (strstr (line, "Host key verification failed") != NULL)
+    g_set_error_literal (error,
+			 VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_FAILED,
+			 _("Host key verification failed"));
   else
-    prompt_fd = tty_fd;
+    return TRUE;
+
+  return FALSE;
+}
+
+/*
+ * The login runs from the main loop: every pipe to ssh gets a watch and
+ * whatever ssh prints moves the state machine along. The password and host
+ * key questions are answered from callbacks, so other tabs keep working
+ * while the user makes up their mind.
+ */
+typedef enum {
+  LOGIN_WAITING = 0,	/* For ssh to print something */
+  LOGIN_ASKING,		/* The keyring or the user */
+  LOGIN_DONE
+} SshLoginState;
+
+struct _SshLogin {
+  gint                ref_count;
+  SshLoginState       state;
+  gboolean            stopped;
+  GSimpleAsyncResult *result;
+  GtkWindow          *parent;
+
+  gchar              *user;
+  gchar              *host;
+  gint                port;
+
+  GPid                pid;
+  gint                stdin_fd;
+  gint                held_fd;
+  GIOChannel         *tty;
+  GIOChannel         *out;
+  GIOChannel         *err;
+  GIOChannel         *prompt;	/* Either tty or err, depending on the vendor */
+  guint               out_watch;
+  guint               err_watch;
+  guint               prompt_watch;
+  guint               timeout_id;
+
+  GString            *err_line;
+  GError             *err_error;	/* First failure ssh told about */
+
+  const gchar        *authtype;
+  gchar              *object;
+  gchar              *password;
+  gboolean            tried_keyring;
+  gboolean            save_in_keyring;
+  const gchar        *echo;		/* Answer the tty is about to echo */
+
+  gchar             **extra_arguments;	/* Until ssh is spawned */
+  gchar             **command;
+};
+
+static SshLogin *
+login_ref (SshLogin *login)
+{
+  login->ref_count++;
+  return login;
+}
+
+static void
+login_unref (SshLogin *login)
+{
+  if (--login->ref_count > 0)
+    return;
+
+  if (login->tty)
+    g_io_channel_unref (login->tty);
+  if (login->out)
+    g_io_channel_unref (login->out);
+  if (login->err)
+    g_io_channel_unref (login->err);
+  if (login->stdin_fd != -1)
+    close (login->stdin_fd);
+  if (login->held_fd != -1)
+    close (login->held_fd);
+
+  g_object_unref (login->result);
+  if (login->parent)
+    g_object_unref (login->parent);
+
+  g_free (login->user);
+  g_free (login->host);
+  g_free (login->object);
+  g_strfreev (login->extra_arguments);
+  g_strfreev (login->command);
+  secret_password_free (login->password);
+  g_string_free (login->err_line, TRUE);
+  if (login->err_error)
+    g_error_free (login->err_error);
+
+  g_slice_free (SshLogin, login);
+}
+
+static GIOChannel *
+login_channel_new (gint fd)
+{
+  GIOChannel *channel;
 
 #ifdef G_OS_WIN32
   g_critical ("untested Windows code");
-  prompt_stream = g_win32_input_stream_new (prompt_fd, FALSE);
-  stdout_stream = g_win32_input_stream_new (stdout_fd, FALSE);
-  reply_stream = g_win32_output_stream_new (tty_fd, FALSE);
+  channel = g_io_channel_win32_new_fd (fd);
 #else /* !G_OS_WIN32 */
-  prompt_stream = g_unix_input_stream_new (prompt_fd, FALSE);
-  stdout_stream = g_unix_input_stream_new (stdout_fd, FALSE);
-  reply_stream = g_unix_output_stream_new (tty_fd, FALSE);
+  channel = g_io_channel_unix_new (fd);
 #endif /* G_OS_WIN32 */
 
-  while (1)
-    {
-      FD_ZERO (&ifds);
-      FD_SET (stdout_fd, &ifds);
-      FD_SET (prompt_fd, &ifds);
-      
-      tv.tv_sec = SSH_READ_TIMEOUT;
-      tv.tv_usec = 0;
-      
-      ret = select (MAX (stdout_fd, prompt_fd)+1, &ifds, NULL, NULL, &tv);
-      
-      if (ret <= 0)
-        {
-          g_set_error_literal (error,
-	                       G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-        	               _("Timed out when logging in"));
-          ret_val = FALSE;
-          break;
-        }
+  g_io_channel_set_encoding (channel, NULL, NULL);
+  g_io_channel_set_buffered (channel, FALSE);
+  g_io_channel_set_flags (channel, G_IO_FLAG_NONBLOCK, NULL);
+  g_io_channel_set_close_on_unref (channel, TRUE);
 
-      if (FD_ISSET (stdout_fd, &ifds))  /* Got reply to our check */
-        {
-          len = g_input_stream_read (stdout_stream,
-                                     buffer, sizeof (buffer) - 1,
-                                     NULL, error);
-          if (len == -1)
-            {
-              ret_val = FALSE;
-              break;
-            }
-
-          if (len == 0) /* Error, let's exit and look at stderr */
-            {
-              ret_val = TRUE;
-              break;
-            }
-
-          buffer[len] = 0;
-          if (strncmp (buffer, VINAGRE_SSH_CHECK, VINAGRE_SSH_CHECK_LENGTH) == 0)
-            break;
-          else
-            {
-	      g_set_error_literal (error,
-				   VINAGRE_SSH_ERROR,
-				   VINAGRE_SSH_ERROR_PERMISSION_DENIED,
-				   _("Permission denied"));
-              ret_val = FALSE;
-              break;
-            }
-        }
+  return channel;
+}
 
-      g_assert (FD_ISSET (prompt_fd, &ifds));
+static GIOStatus
+login_read (GIOChannel *channel, gchar *buffer, gsize size)
+{
+  gsize len = 0;
+  GIOStatus status;
 
-      len = g_input_stream_read (prompt_stream,
-                                 buffer, sizeof (buffer) - 1,
-                                 NULL, error);
-      if (len == -1)
-        {
-          ret_val = FALSE;
-          break;
-        }
-      buffer[len] = 0;
+  status = g_io_channel_read_chars (channel, buffer, size - 1, &len, NULL);
+  buffer[len] = 0;
 
-      if (strncmp (buffer, "\r\n", 2) == 0)
-        continue;
+  return status;
+}
 
-      secret_password_free (password);
-      password = NULL;
+static gboolean
+login_reply (SshLogin *login, const gchar *reply)
+{
+  gsize bytes_written;
 
-      if (g_str_has_suffix (buffer, "password: ") ||
-          g_str_has_suffix (buffer, "Password: ") ||
-          g_str_has_suffix (buffer, "Password:")  ||
-          g_str_has_prefix (buffer, "Password for ") ||
-          g_str_has_prefix (buffer, "Enter Kerberos password") ||
-          g_str_has_prefix (buffer, "Enter passphrase for key"))
-        {
-	  authtype = get_authtype_from_password_line (buffer);
-	  object = get_object_from_password_line (buffer);
-
-	  /* Search password in the keyring */
-          password = secret_password_lookup_sync (SECRET_SCHEMA_COMPAT_NETWORK, NULL, NULL,
-                                                  "user", user,
-                                                  "server", host,
-                                                  "object", object,
-                                                  "protocol", "ssh",
-                                                  "authtype", authtype,
-                                                  "port", port,
-                                                  NULL);
-
-	  /* If the password was not found in keyring then ask for it */
-          if (password == NULL)
-	    {
-	      gchar *full_host;
-	      gboolean res;
-
-	      full_host = g_strjoin ("@", user, host, NULL);
-	      res = vinagre_utils_request_credential (parent, "SSH", full_host, NULL, NULL,
-		  FALSE, FALSE, TRUE, 0, NULL, NULL, &password, &save_in_keyring);
-	      g_free (full_host);
-              if (!res)
-                {
-                  g_set_error_literal (error,
-				       VINAGRE_SSH_ERROR,
-                                       VINAGRE_SSH_ERROR_PASSWORD_CANCELED,
-        	                       _("Password dialog canceled"));
-                  ret_val = FALSE;
-                  break;
-                }
-            }
-
-          if (!g_output_stream_write_all (reply_stream,
-                                          password, strlen (password),
-                                          &bytes_written,
-                                          NULL, NULL) ||
-              !g_output_stream_write_all (reply_stream,
-                                          "\n", 1,
-                                          &bytes_written,
-                                          NULL, NULL))
-            {
-              g_set_error_literal (error,
-	                           G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
-        	                   _("Could not send password"));
-              ret_val = FALSE;
-              break;
-            }
-        }
-      else if (g_str_has_prefix (buffer, "The authenticity of host '") ||
-               strstr (buffer, "Key fingerprint:") != NULL)
-        {
-	  const gchar *choices[] = {_("Log In Anyway"), _("Cancel Login"), NULL};
-	  const gchar *choice_string;
-	  gchar *hostname = NULL;
-	  gchar *fingerprint = NULL;
-	  gint choice;
-	  gchar *message;
-
-	  get_hostname_and_fingerprint_from_line (buffer, &hostname, &fingerprint);
-
-	  message = g_strdup_printf (_("The identity of the remote host (%s) is unknown.\n"
-				       "This happens when you log in to a host the first time.\n\n"
-				       "The identity sent by the remote host is %s. "
-				       "If you want to be absolutely sure it is safe to continue, "
-				       "contact the system administrator."),
-				     hostname ? hostname : host, fingerprint);
-
-	  g_free (hostname);
-	  g_free (fingerprint);
-
-	  if (!_ask_question (NULL,
-					   message,
-					   (char **)choices,
-					   &choice))
-	    {
-	      g_set_error_literal (error,
-				   VINAGRE_SSH_ERROR,
-				   VINAGRE_SSH_ERROR_PASSWORD_CANCELED,
-				   _("Login dialog canceled"));
-	      g_free (message);
-	      ret_val = FALSE;
-	      break;
-	    }
-	  g_free (message);
-
-	  choice_string = (choice == 0) ? "yes" : "no";
-	  if (!g_output_stream_write_all (reply_stream,
-					  choice_string,
-					  strlen (choice_string),
-					  &bytes_written,
-					  NULL, NULL) ||
-	      !g_output_stream_write_all (reply_stream,
-					  "\n", 1,
-					  &bytes_written,
-					  NULL, NULL))
-	    {
-	      g_set_error_literal (error,
-				   VINAGRE_SSH_ERROR,
-				   VINAGRE_SSH_ERROR_IO_ERROR,
-				   _("Can't send host identity confirmation"));
-	      ret_val = FALSE;
-	      break;
-	    }
-	}
-      else
-        {
-	  g_set_error_literal (error,
-			       VINAGRE_SSH_ERROR,
-			       VINAGRE_SSH_ERROR_PERMISSION_DENIED,
-			       _("Permission denied"));
-	  ret_val = FALSE;
-	  break;
-        }
+  return g_io_channel_write_chars (login->tty, reply, -1,
+				   &bytes_written, NULL) == G_IO_STATUS_NORMAL &&
+	 g_io_channel_write_chars (login->tty, "\n", 1,
+				   &bytes_written, NULL) == G_IO_STATUS_NORMAL;
+}
+
+static void
+login_remove_timeout (SshLogin *login)
+{
+  if (login->timeout_id)
+    {
+      g_source_remove (login->timeout_id);
+      login->timeout_id = 0;
     }
-  
-  if (ret_val && save_in_keyring)
-    {
-      /* Login succeed, save password in keyring */
-      label = g_strdup_printf (_("Secure shell password: %s"), host);
-      secret_password_store_sync (SECRET_SCHEMA_COMPAT_NETWORK, NULL, label,
-                                  password, NULL, &secret_error,
-                                  "user", user,
-                                  "server", host,
-                                  "object", object,
-                                  "protocol", "ssh",
-                                  "authtype", authtype,
-                                  "port", port,
-                                  NULL);
-      g_free (label);
-
-      if (secret_error != NULL) {
-        vinagre_utils_show_error_dialog (_("Error saving the credentials on the keyring."),
-                                         secret_error->message,
-                                         parent);
-        g_error_free (secret_error);
-      }
-    }
-
-  g_free (object);
-  secret_password_free (password);
-  g_object_unref (prompt_stream);
-  g_object_unref (stdout_stream);
-  g_object_unref (reply_stream);
-
-  return ret_val;
 }
 
-static gchar *
-get_username (const gchar *host, const gchar *username)
+static void login_finish (SshLogin *login, GError *error);
+
+static gboolean
+login_timeout_cb (SshLogin *login)
 {
-  gchar *pos;
+  login->timeout_id = 0;
+  login_finish (login,
+		g_error_new_literal (G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+				     _("Timed out when logging in")));
+  return FALSE;
+}
 
-  if (username)
-    return g_strdup (username);
+/* ssh is given SSH_READ_TIMEOUT seconds of silence, the user is not */
+static void
+login_touch (SshLogin *login)
+{
+  login_remove_timeout (login);
 
-  pos = strchr (host, '@');
-  if (pos)
-    return g_strndup (host, pos - host);
+  if (login->state == LOGIN_WAITING)
+    login->timeout_id = g_timeout_add_seconds (SSH_READ_TIMEOUT,
+					       (GSourceFunc) login_timeout_cb,
+					       login);
+}
 
-  return g_strdup (g_get_user_name ());
+static void
+login_stop (SshLogin *login)
+{
+  if (login->stopped)
+    return;
+  login->stopped = TRUE;
+
+  if (login->out_watch)
+    g_source_remove (login->out_watch);
+  if (login->err_watch)
+    g_source_remove (login->err_watch);
+  if (login->prompt_watch)
+    g_source_remove (login->prompt_watch);
+  login->out_watch = login->err_watch = login->prompt_watch = 0;
+  login_remove_timeout (login);
+
+  login_unref (login);
 }
 
-static gchar *
-get_hostname (const gchar *host)
+static void
+login_password_stored_cb (GObject      *source,
+			  GAsyncResult *res,
+			  gpointer      user_data)
 {
-  gchar *pos;
+  SshLogin *login = user_data;
+  GError *error = NULL;
 
-  pos = strchr (host, '@');
-  if (pos)
-    return g_strdup (pos+1);
+  if (!secret_password_store_finish (res, &error))
+    {
+      vinagre_utils_show_error_dialog (_("Error saving the credentials on the keyring."),
+				       error->message,
+				       login->parent);
+      g_error_free (error);
+    }
 
-  return g_strdup (host);
+  login_unref (login);
 }
 
-static gboolean
-look_for_stderr_errors (GInputStream *is, GError **error)
+/* Takes @error */
+static void
+login_finish (SshLogin *login, GError *error)
 {
-  GDataInputStream *error_stream;
-  char *line = NULL;
-  gboolean ret;
+  if (login->state == LOGIN_DONE)
+    {
+      if (error)
+	g_error_free (error);
+      return;
+    }
 
-  error_stream = g_data_input_stream_new (is);
+  login->state = LOGIN_DONE;
+  login_remove_timeout (login);
 
-  while (1)
+  if (error)
     {
+      g_simple_async_result_take_error (login->result, error);
 #ifndef G_OS_WIN32
-      if (!g_pollable_input_stream_is_readable (G_POLLABLE_INPUT_STREAM (is)))
-        {
-          ret = TRUE;
-          break;
-        }
+      if (login->pid > 0)
+	kill (login->pid, SIGTERM);
 #endif
+    }
+  else
+    {
+      g_simple_async_result_set_op_res_gboolean (login->result, TRUE);
+
+      if (login->save_in_keyring)
+	{
+	  gchar *label;
+
+	  /* Login succeed, save password in keyring */
+	  label = g_strdup_printf (_("Secure shell password: %s"), login->host);
+	  secret_password_store (SECRET_SCHEMA_COMPAT_NETWORK, NULL, label,
+				 login->password, NULL,
+				 login_password_stored_cb, login_ref (login),
+				 "user", login->user,
+				 "server", login->host,
+				 "object", login->object,
+				 "protocol", "ssh",
+				 "authtype", login->authtype,
+				 "port", login->port,
+				 NULL);
+	  g_free (label);
+	}
+    }
 
-      line = g_data_input_stream_read_line (error_stream, NULL, NULL, NULL);
+  g_simple_async_result_complete_in_idle (login->result);
 
-      if (line == NULL)
-        {
-          ret = TRUE;
-          break;
-        }
-    
-      if (strstr (line, "Permission denied") != NULL)
-        {
-          g_set_error_literal (error,
-	                       VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_PERMISSION_DENIED,
-        	               _("Permission denied"));
-          ret = FALSE;
-          break;
-        }
-      else if (strstr (line, "Name or service not known") != NULL)
-        {
-          g_set_error_literal (error,
-	                       VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_HOST_NOT_FOUND,
-        	               _("Hostname not known"));
-          ret = FALSE;
-          break;
-        }
-      else if (strstr (line, "No route to host") != NULL)
-        {
-          g_set_error_literal (error,
-	                       VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_HOST_NOT_FOUND,
-        	               _("No route to host"));
-          ret = FALSE;
-          break;
-        }
-      else if (strstr (line, "Connection refused") != NULL)
-        {
-          g_set_error_literal (error,
-	                       VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_PERMISSION_DENIED,
-        	               _("Connection refused by server"));
-          ret = FALSE;
-          break;
-        }
-      else if (strstr (line, "Host key verification failed") != NULL) 
-        {
-          g_set_error_literal (error,
-	                       VINAGRE_SSH_ERROR, VINAGRE_SSH_ERROR_FAILED,
-        	               _("Host key verification failed"));
-          ret = FALSE;
-          break;
-        }
-      
+  /* On success ssh is left alone until it closes its stdout, a master
+   * connection going to the background must not find its pipes gone */
+  if (error)
+    login_stop (login);
+}
+
+static void
+login_parse_stderr (SshLogin *login, const gchar *data)
+{
+  gchar *eol;
+
+  g_string_append (login->err_line, data);
+
+  while ((eol = strchr (login->err_line->str, '\n')) != NULL)
+    {
+      *eol = 0;
+      if (!login->err_error)
+	check_stderr_line (login->err_line->str, &login->err_error);
+      g_string_erase (login->err_line, 0, eol - login->err_line->str + 1);
+    }
+}
+
+/* ssh went away before printing the check, its last words tell why */
+static GError *
+login_error_from_stderr (SshLogin *login)
+{
+  gchar buffer[1024];
+  GError *error;
+
+  if (login->err && login->err != login->prompt)
+    {
+      while (login_read (login->err, buffer, sizeof (buffer)) == G_IO_STATUS_NORMAL)
+	login_parse_stderr (login, buffer);
+
+      if (!login->err_error)
+	check_stderr_line (login->err_line->str, &login->err_error);
     }
 
-  if (line)
-    g_free (line);
+  if (login->err_error)
+    {
+      error = login->err_error;
+      login->err_error = NULL;
+      return error;
+    }
 
-  g_object_unref (error_stream);
-  return ret;
+  return g_error_new_literal (VINAGRE_SSH_ERROR,
+			      VINAGRE_SSH_ERROR_FAILED,
+			      _("The connection to the SSH host was lost"));
 }
 
-gboolean
-vinagre_ssh_connect (GtkWindow *parent,
-		     const gchar *hostname,
-		     gint port,
-		     const gchar *username,
-		     gchar **extra_arguments,
-		     gchar **command,
-		     gint *tty,
-		     GError **error)
-{
-  int tty_fd, stdin_fd, stdout_fd, stderr_fd, held_fd;
-  GPid pid;
-  gchar *user, *host, **args;
-  gboolean res;
-  GInputStream *is;
+static gboolean
+login_stdout_cb (GIOChannel   *channel,
+		 GIOCondition  condition,
+		 SshLogin     *login)
+{
+  gchar buffer[1024];
+  GIOStatus status;
 
-  if (!hostname)
-    return FALSE;
+  status = login_read (channel, buffer, sizeof (buffer));
+  if (status == G_IO_STATUS_AGAIN)
+    return TRUE;
 
-  if (vendor == SSH_VENDOR_INVALID)
-    vendor = get_ssh_client_vendor ();
-  if (vendor == SSH_VENDOR_INVALID)
+  if (status != G_IO_STATUS_NORMAL)
     {
-      g_set_error_literal (error,
-			   VINAGRE_SSH_ERROR,
-			   VINAGRE_SSH_ERROR_INVALID_CLIENT,
-			   _("Unable to find a valid SSH program"));
+      login->out_watch = 0;
+      if (login->state != LOGIN_DONE)
+	login_finish (login, login_error_from_stderr (login));
+      else
+	login_stop (login);
       return FALSE;
     }
 
-  if (port <= 0)
-    port = 22;
+  if (login->state == LOGIN_DONE)
+    return TRUE;
 
-  user = get_username (hostname, username);
-  host = get_hostname (hostname);
+  /* Got reply to our check */
+  if (strncmp (buffer, VINAGRE_SSH_CHECK, VINAGRE_SSH_CHECK_LENGTH) == 0)
+    login_finish (login, NULL);
+  else
+    login_finish (login,
+		  g_error_new_literal (VINAGRE_SSH_ERROR,
+				       VINAGRE_SSH_ERROR_PERMISSION_DENIED,
+				       _("Permission denied")));
+  return TRUE;
+}
 
-  args = setup_ssh_commandline (host, port, user, extra_arguments, command);
-  if (!spawn_ssh (args,
-		  &pid,
-		  &tty_fd, &stdin_fd, &stdout_fd, &stderr_fd, &held_fd,
-		  error))
+static gboolean
+login_stderr_cb (GIOChannel   *channel,
+		 GIOCondition  condition,
+		 SshLogin     *login)
+{
+  gchar buffer[1024];
+  GIOStatus status;
+
+  status = login_read (channel, buffer, sizeof (buffer));
+  if (status == G_IO_STATUS_AGAIN)
+    return TRUE;
+
+  if (status != G_IO_STATUS_NORMAL)
     {
-      g_strfreev (args);
-      g_free (user);
-      g_free (host);
+      login->err_watch = 0;
       return FALSE;
     }
 
-  if (tty_fd == -1)
-    res = wait_for_reply (stdout_fd, error);
+  /* Keep draining it once logged in, ssh must never block on a full pipe */
+  if (login->state != LOGIN_DONE)
+    login_parse_stderr (login, buffer);
+  if (login->state == LOGIN_WAITING)
+    login_touch (login);
+
+  return TRUE;
+}
+
+static void
+login_send_password (SshLogin *login)
+{
+  if (!login_reply (login, login->password))
+    {
+      login_finish (login,
+		    g_error_new_literal (G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+					 _("Could not send password")));
+      return;
+    }
+
+  login->state = LOGIN_WAITING;
+  login_touch (login);
+}
+
+static void
+login_password_response_cb (GtkDialog *dialog,
+			    gint       response,
+			    SshLogin  *login)
+{
+  GtkBuilder *xml;
+  GtkEntry *entry;
+  GtkToggleButton *check;
+
+  if (login->state != LOGIN_ASKING)
+    {
+      /* ssh went away while the dialog was up */
+    }
+  else if (response != GTK_RESPONSE_OK)
+    login_finish (login,
+		  g_error_new_literal (VINAGRE_SSH_ERROR,
+				       VINAGRE_SSH_ERROR_PASSWORD_CANCELED,
+				       _("Password dialog canceled")));
+  else
+    {
+      xml = g_object_get_data (G_OBJECT (dialog), "builder");
+      entry = GTK_ENTRY (gtk_builder_get_object (xml, "password_entry"));
+      check = GTK_TOGGLE_BUTTON (gtk_builder_get_object (xml, "save_credential_check"));
+
+      login->password = g_strdup (gtk_entry_get_text (entry));
+      login->save_in_keyring = gtk_toggle_button_get_active (check);
+      login_send_password (login);
+    }
+
+  gtk_widget_destroy (GTK_WIDGET (dialog));
+  login_unref (login);
+}
+
+static void
+login_password_changed_cb (GtkEditable *entry,
+			   GtkWidget   *ok_button)
+{
+  gtk_widget_set_sensitive (ok_button,
+			    gtk_entry_get_text_length (GTK_ENTRY (entry)) > 0);
+}
+
+static void
+login_request_password (SshLogin *login)
+{
+  GtkBuilder *xml;
+  GtkWidget *d, *ok_button, *entry;
+  gchar *full_host, *label;
+
+  xml = vinagre_utils_get_builder ();
+  d = GTK_WIDGET (gtk_builder_get_object (xml, "auth_required_dialog"));
+  g_object_set_data_full (G_OBJECT (d), "builder", xml, g_object_unref);
+  gtk_window_set_transient_for (GTK_WINDOW (d), login->parent);
+
+  /* Translators: %s is a protocol, like VNC or SSH */
+  label = g_strdup_printf (_("%s authentication is required"), "SSH");
+  gtk_label_set_label (GTK_LABEL (gtk_builder_get_object (xml, "auth_required_label")),
+		       label);
+  g_free (label);
+
+  full_host = g_strjoin ("@", login->user, login->host, NULL);
+  gtk_label_set_label (GTK_LABEL (gtk_builder_get_object (xml, "host_label")),
+		       full_host);
+  g_free (full_host);
+
+  gtk_widget_hide (GTK_WIDGET (gtk_builder_get_object (xml, "username_label")));
+  gtk_widget_hide (GTK_WIDGET (gtk_builder_get_object (xml, "username_entry")));
+  gtk_widget_hide (GTK_WIDGET (gtk_builder_get_object (xml, "domain_label")));
+  gtk_widget_hide (GTK_WIDGET (gtk_builder_get_object (xml, "domain_entry")));
+
+  ok_button = GTK_WIDGET (gtk_builder_get_object (xml, "ok_button"));
+  gtk_button_set_image (GTK_BUTTON (ok_button),
+			gtk_image_new_from_stock (GTK_STOCK_DIALOG_AUTHENTICATION,
+						  GTK_ICON_SIZE_BUTTON));
+  gtk_widget_set_sensitive (ok_button, FALSE);
+
+  entry = GTK_WIDGET (gtk_builder_get_object (xml, "password_entry"));
+  g_signal_connect (entry, "changed",
+		    G_CALLBACK (login_password_changed_cb),
+		    ok_button);
+  gtk_widget_grab_focus (entry);
+
+  /* The answer comes back through the main loop, like the host key one */
+  g_signal_connect (d, "response",
+		    G_CALLBACK (login_password_response_cb),
+		    login_ref (login));
+  gtk_widget_show (d);
+}
+
+static void
+login_password_lookup_cb (GObject      *source,
+			  GAsyncResult *res,
+			  gpointer      user_data)
+{
+  SshLogin *login = user_data;
+  gchar *password;
+
+  password = secret_password_lookup_finish (res, NULL);
+
+  if (login->state != LOGIN_ASKING)
+    secret_password_free (password);
+  else if (password)
+    {
+      login->password = password;
+      login_send_password (login);
+    }
   else
-    res = handle_login (parent, host, port, user, tty_fd, stdout_fd, stderr_fd, error);
+    /* If the password was not found in keyring then ask for it */
+    login_request_password (login);
+
+  login_unref (login);
+}
 
-  /* ssh has opened the PTY slave by now, so we can close it */
-  if (held_fd != -1) close(held_fd);
+static void
+login_ask_password (SshLogin *login, const gchar *line)
+{
+  login->state = LOGIN_ASKING;
+  login_remove_timeout (login);
+
+  login->authtype = get_authtype_from_password_line (line);
+  g_free (login->object);
+  login->object = get_object_from_password_line (line);
+  secret_password_free (login->password);
+  login->password = NULL;
+
+  /* ssh asking again means the keyring had it wrong */
+  if (login->tried_keyring)
+    {
+      login_request_password (login);
+      return;
+    }
+  login->tried_keyring = TRUE;
+
+  /* Search password in the keyring */
+  secret_password_lookup (SECRET_SCHEMA_COMPAT_NETWORK, NULL,
+			  login_password_lookup_cb, login_ref (login),
+			  "user", login->user,
+			  "server", login->host,
+			  "object", login->object,
+			  "protocol", "ssh",
+			  "authtype", login->authtype,
+			  "port", login->port,
+			  NULL);
+}
 
+static void
+login_host_key_response_cb (GtkDialog *dialog,
+			    gint       response,
+			    SshLogin  *login)
+{
+  gtk_widget_destroy (GTK_WIDGET (dialog));
+
+  if (login->state != LOGIN_ASKING)
+    {
+      /* ssh went away while the dialog was up */
+    }
+  else if (response == GTK_RESPONSE_NONE || response == GTK_RESPONSE_DELETE_EVENT)
+    login_finish (login,
+		  g_error_new_literal (VINAGRE_SSH_ERROR,
+				       VINAGRE_SSH_ERROR_PASSWORD_CANCELED,
+				       _("Login dialog canceled")));
+  else
+    {
+      login->echo = (response == 0) ? "yes" : "no";
+      if (login_reply (login, login->echo))
+	{
+	  login->state = LOGIN_WAITING;
+	  login_touch (login);
+	}
+      else
+	login_finish (login,
+		      g_error_new_literal (VINAGRE_SSH_ERROR,
+					   VINAGRE_SSH_ERROR_IO_ERROR,
+					   _("Can't send host identity confirmation")));
+    }
+
+  login_unref (login);
+}
+
+static void
+login_ask_host_key (SshLogin *login, const gchar *line)
+{
+  gchar *hostname = NULL;
+  gchar *fingerprint = NULL;
+  gchar *message, **messages;
+  GtkWidget *d;
+
+  login->state = LOGIN_ASKING;
+  login_remove_timeout (login);
+
+  get_hostname_and_fingerprint_from_line (line, &hostname, &fingerprint);
+
+  message = g_strdup_printf (_("The identity of the remote host (%s) is unknown.\n"
+			       "This happens when you log in to a host the first time.\n\n"
+			       "The identity sent by the remote host is %s. "
+			       "If you want to be absolutely sure it is safe to continue, "
+			       "contact the system administrator."),
+			     hostname ? hostname : login->host, fingerprint);
+  messages = g_strsplit (message, "\n", 2);
+
+  d = gtk_message_dialog_new (login->parent,
+			      GTK_DIALOG_MODAL,
+			      GTK_MESSAGE_QUESTION,
+			      GTK_BUTTONS_NONE,
+			      "%s",
+			      messages[0]);
+  gtk_message_dialog_format_secondary_markup (GTK_MESSAGE_DIALOG (d),
+					      "%s",
+					      messages[1]);
+
+  g_strfreev (messages);
+  g_free (message);
+  g_free (hostname);
+  g_free (fingerprint);
+
+  gtk_dialog_add_button (GTK_DIALOG (d), _("Log In Anyway"), 0);
+  gtk_dialog_add_button (GTK_DIALOG (d), _("Cancel Login"), 1);
+
+  g_signal_connect (d, "response",
+		    G_CALLBACK (login_host_key_response_cb),
+		    login_ref (login));
+  gtk_widget_show (d);
+}
+
+static gboolean
+login_prompt_cb (GIOChannel   *channel,
+		 GIOCondition  condition,
+		 SshLogin     *login)
+{
+  gchar buffer[1024];
+  GIOStatus status;
+  GError *error = NULL;
+
+  status = login_read (channel, buffer, sizeof (buffer));
+  if (status == G_IO_STATUS_AGAIN)
+    return TRUE;
+
+  /* The end of ssh is noticed on its stdout */
+  if (status != G_IO_STATUS_NORMAL)
+    {
+      login->prompt_watch = 0;
+      return FALSE;
+    }
+
+  if (login->state != LOGIN_WAITING || strncmp (buffer, "\r\n", 2) == 0)
+    return TRUE;
+
+  if (login->echo && g_str_has_prefix (buffer, login->echo))
+    {
+      login->echo = NULL;
+      login_touch (login);
+      return TRUE;
+    }
+
+  if (g_str_has_suffix (buffer, "password: ") ||
+      g_str_has_suffix (buffer, "Password: ") ||
+      g_str_has_suffix (buffer, "Password:")  ||
+      g_str_has_prefix (buffer, "Password for ") ||
+      g_str_has_prefix (buffer, "Enter Kerberos password") ||
+      g_str_has_prefix (buffer, "Enter passphrase for key"))
+    login_ask_password (login, buffer);
+  else if (g_str_has_prefix (buffer, "The authenticity of host '") ||
+	   strstr (buffer, "Key fingerprint:") != NULL)
+    login_ask_host_key (login, buffer);
+  else
+    {
+      if (check_stderr_line (buffer, &error))
+	error = g_error_new_literal (VINAGRE_SSH_ERROR,
+				     VINAGRE_SSH_ERROR_PERMISSION_DENIED,
+				     _("Permission denied"));
+      login_finish (login, error);
+    }
+
+  return TRUE;
+}
+
+static void
+login_start (SshLogin *login)
+{
+  int tty_fd, stdout_fd, stderr_fd;
+  GError *error = NULL;
+  gchar **args;
+
+  if (vendor == SSH_VENDOR_INVALID)
+    {
+      g_simple_async_result_set_error (login->result,
+				       VINAGRE_SSH_ERROR,
+				       VINAGRE_SSH_ERROR_INVALID_CLIENT,
+				       "%s",
+				       _("Unable to find a valid SSH program"));
+      g_simple_async_result_complete_in_idle (login->result);
+      login_unref (login);
+      return;
+    }
+
+  args = setup_ssh_commandline (login->host, login->port, login->user,
+				login->extra_arguments, login->command);
+  g_strfreev (login->extra_arguments);
+  g_strfreev (login->command);
+  login->extra_arguments = login->command = NULL;
+
+  if (!spawn_ssh (args,
+		  &login->pid,
+		  &tty_fd, &login->stdin_fd, &stdout_fd, &stderr_fd,
+		  &login->held_fd,
+		  &error))
+    {
+      g_strfreev (args);
+      login->stdin_fd = login->held_fd = -1;
+      g_simple_async_result_take_error (login->result, error);
+      g_simple_async_result_complete_in_idle (login->result);
+      login_unref (login);
+      return;
+    }
   g_strfreev (args);
-  g_free (user);
-  g_free (host);
 
-  if (!res)
-    return FALSE;
+  login->out = login_channel_new (stdout_fd);
+  login->err = login_channel_new (stderr_fd);
+  if (tty_fd != -1)
+    {
+      login->tty = login_channel_new (tty_fd);
+      login->prompt = vendor == SSH_VENDOR_SSH ? login->err : login->tty;
+      login->prompt_watch = g_io_add_watch (login->prompt,
+					    G_IO_IN | G_IO_HUP | G_IO_ERR,
+					    (GIOFunc) login_prompt_cb,
+					    login);
+    }
 
-#ifdef G_OS_WIN32
-  u_long mode = 1;
-  ioctlsocket (stderr_fd, FIONBIO, &mode);
-  is = g_win32_input_stream_new (stderr_fd, FALSE);
-#else /* !G_OS_WIN32 */
-  is = g_unix_input_stream_new (stderr_fd, FALSE);
-#endif /* G_OS_WIN32 */
-  
-  res = look_for_stderr_errors (is, error);
+  login->out_watch = g_io_add_watch (login->out,
+				     G_IO_IN | G_IO_HUP | G_IO_ERR,
+				     (GIOFunc) login_stdout_cb,
+				     login);
+  if (login->err != login->prompt)
+    login->err_watch = g_io_add_watch (login->err,
+				       G_IO_IN | G_IO_HUP | G_IO_ERR,
+				       (GIOFunc) login_stderr_cb,
+				       login);
+
+  login_touch (login);
+}
 
-  g_object_unref (is);
+/**
+ * vinagre_ssh_connect_async:
+ * @parent: transient parent of the login dialogs, or %NULL
+ * @hostname: the SSH host, optionally as user@host
+ * @port: the SSH port, or 0 for the default one
+ * @username: the user to log in as, or %NULL to take it from @hostname
+ * @extra_arguments: extra ssh options, or %NULL
+ * @command: the remote command, which must print %VINAGRE_SSH_CHECK
+ * @callback: called once logged in, or on failure
+ * @user_data: data for @callback
+ *
+ * Spawns ssh and drives its login from the main loop. ssh itself is left
+ * running afterwards.
+ */
+void
+vinagre_ssh_connect_async (GtkWindow           *parent,
+			   const gchar         *hostname,
+			   gint                 port,
+			   const gchar         *username,
+			   gchar              **extra_arguments,
+			   gchar              **command,
+			   GAsyncReadyCallback  callback,
+			   gpointer             user_data)
+{
+  SshLogin *login;
 
-  if (!res)
-    return FALSE;
+  g_return_if_fail (hostname != NULL);
+
+  if (port <= 0)
+    port = 22;
+
+  login = g_slice_new0 (SshLogin);
+  login->ref_count = 1;
+  login->result = g_simple_async_result_new (NULL, callback, user_data,
+					     vinagre_ssh_connect_async);
+  login->parent = parent ? g_object_ref (parent) : NULL;
+  login->user = get_username (hostname, username);
+  login->host = get_hostname (hostname);
+  login->port = port;
+  login->stdin_fd = login->held_fd = -1;
+  login->err_line = g_string_new (NULL);
+  login->extra_arguments = g_strdupv (extra_arguments);
+  login->command = g_strdupv (command);
+
+  /* Try again, ssh may have been installed since */
+  if (vendor == SSH_VENDOR_INVALID && !probe)
+    probe_start ();
+
+  if (probe)
+    probe_waiters = g_slist_append (probe_waiters, login);
+  else
+    login_start (login);
+}
+
+/**
+ * vinagre_ssh_connect_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: whether ssh logged in and ran the command
+ */
+gboolean
+vinagre_ssh_connect_finish (GAsyncResult  *result,
+			    GError       **error)
+{
+  g_return_val_if_fail (g_simple_async_result_is_valid (result, NULL,
+							vinagre_ssh_connect_async),
+			FALSE);
 
-  if (tty)
-    *tty = tty_fd;
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result), error))
+    return FALSE;
 
   return TRUE;
 }
 
+/**
+ * vinagre_ssh_new_socket_path:
+ * @prefix: what the socket is used for
+ * @error: return location for a #GError, or %NULL
+ *
+ * Picks the path of a Unix socket for ssh to listen on. It lives in a
+ * directory only the user can enter, so no other local user can reach the
+ * remote host through it.
+ *
+ * Returns: a newly allocated path, or %NULL on error
+ */
+gchar *
+vinagre_ssh_new_socket_path (const gchar *prefix, GError **error)
+{
+  static gchar *dir = NULL;
+  static guint serial = 0;
+  gchar *name, *path;
+
+  /* Names are unique within the process, no need to probe for a free one */
+  if (!dir)
+    {
+      gchar *tmp = g_build_filename (g_get_user_runtime_dir (), "vinagre", NULL);
+
+      if (g_mkdir_with_parents (tmp, 0700) < 0)
+	{
+	  int errsv = errno;
+
+	  g_set_error (error,
+		       G_IO_ERROR,
+		       g_io_error_from_errno (errsv),
+		       _("Could not create the directory %s: %s"),
+		       tmp,
+		       g_strerror (errsv));
+	  g_free (tmp);
+	  return NULL;
+	}
+
+      dir = tmp;
+    }
+
+  name = g_strdup_printf ("%s-%d-%u", prefix, (int) getpid (), ++serial);
+  path = g_build_filename (dir, name, NULL);
+
+  g_free (name);
+  return path;
+}
+
 GQuark 
 vinagre_ssh_error_quark (void)
 {
@@ -43,14 +43,21 @@ typedef enum
 #define VINAGRE_SSH_ERROR vinagre_ssh_error_quark()
 GQuark vinagre_ssh_error_quark (void);
 
-gboolean vinagre_ssh_connect (GtkWindow *parent,
-			      const gchar *hostname,
-			      gint port,
-			      const gchar *username,
-			      gchar **extra_arguments,
-			      gchar **command,
-			      gint *tty,
-			      GError **error);
+void vinagre_ssh_init (void);
+
+void vinagre_ssh_connect_async (GtkWindow *parent,
+				const gchar *hostname,
+				gint port,
+				const gchar *username,
+				gchar **extra_arguments,
+				gchar **command,
+				GAsyncReadyCallback callback,
+				gpointer user_data);
+gboolean vinagre_ssh_connect_finish (GAsyncResult *result,
+				     GError **error);
+
+gchar *vinagre_ssh_new_socket_path (const gchar *prefix,
+				    GError **error);
 
 G_END_DECLS
 
@@ -27,6 +27,8 @@
 #include <libsecret/secret.h>
 
 #include "vinagre-tab.h"
+#include "vinagre-capture.h"
+#include "vinagre-recorder.h"
 #include "vinagre-notebook.h"
 #include "vinagre-prefs.h"
 #include "view/autoDrawer.h"
@@ -35,6 +37,13 @@
 
 #define VINAGRE_TAB_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE ((object), VINAGRE_TYPE_TAB, VinagreTabPrivate))
 
+/* Milliseconds between two flushes of the damaged area while recording */
+#define RECORD_TICK		100
+/* Keyframes let the player seek without replaying the whole session */
+#define RECORD_KEYFRAME_INTERVAL	(10 * G_USEC_PER_SEC)
+/* Past this many rectangles, record their bounding box instead */
+#define RECORD_MAX_RECTS	32
+
 struct _VinagreTabPrivate
 {
   GtkWidget         *view;
@@ -48,6 +57,13 @@ struct _VinagreTabPrivate
   GtkWidget         *layout;
   GtkWidget         *toolbar;
   gboolean          has_screenshot;
+  VinagreCapture    *capture;
+  VinagreRecorder   *recorder;
+  cairo_region_t    *damage;
+  guint              record_timeout_id;
+  gint64             last_keyframe;
+  gint               record_width;
+  gint               record_height;
 };
 
 G_DEFINE_ABSTRACT_TYPE (VinagreTab, vinagre_tab, GTK_TYPE_BOX)
@@ -185,6 +201,14 @@ vinagre_tab_dispose (GObject *object)
 {
   VinagreTab *tab = VINAGRE_TAB (object);
 
+  if (tab->priv->capture)
+    {
+      vinagre_capture_free (tab->priv->capture);
+      tab->priv->capture = NULL;
+    }
+
+  vinagre_tab_stop_recording (tab);
+
   if (tab->priv->conn)
     {
       g_signal_handlers_disconnect_by_func (tab->priv->window,
@@ -236,6 +260,9 @@ default_get_screenshot (VinagreTab *tab)
   GtkAllocation alloc;
   GdkPixbuf *pix;
 
+  if (!tab->priv->view)
+    return NULL;
+
   gtk_widget_get_allocation (tab->priv->view, &alloc);
   s = cairo_image_surface_create (CAIRO_FORMAT_RGB24, alloc.width, alloc.height);
   cr = cairo_create (s);
@@ -251,6 +278,16 @@ default_get_screenshot (VinagreTab *tab)
   return pix;
 }
 
+/* Only the protocol knows where its framebuffer is */
+static gboolean
+default_get_regions (VinagreTab         *tab,
+		     const GdkRectangle *areas,
+		     gint                n_areas,
+		     GdkPixbuf         **regions)
+{
+  return FALSE;
+}
+
 static void
 menu_position (GtkMenu    *menu,
 	       gint       *x,
@@ -429,6 +466,7 @@ vinagre_tab_class_init (VinagreTabClass *klass)
 
   klass->impl_get_tooltip = NULL;
   klass->impl_get_screenshot = default_get_screenshot;
+  klass->impl_get_regions = default_get_regions;
   klass->impl_get_dimensions = default_get_dimensions;
   klass->impl_get_always_sensitive_actions = default_get_always_sensitive_actions;
   klass->impl_get_connected_actions = default_get_connected_actions;
@@ -662,6 +700,29 @@ vinagre_tab_add_view (VinagreTab *tab, GtkWidget *view)
   gtk_widget_override_background_color (viewport, GTK_STATE_NORMAL, &color);
 }
 
+/**
+ * vinagre_tab_remove_view:
+ * @tab: a Tab
+ *
+ * Destroys the view added with vinagre_tab_add_view(), for protocols
+ * whose display may go away and come back while the tab stays.
+ */
+void
+vinagre_tab_remove_view (VinagreTab *tab)
+{
+  GtkWidget *viewport;
+
+  g_return_if_fail (VINAGRE_IS_TAB (tab));
+
+  if (!tab->priv->view)
+    return;
+
+  viewport = gtk_bin_get_child (GTK_BIN (tab->priv->scroll));
+  if (viewport)
+    gtk_widget_destroy (viewport);
+  tab->priv->view = NULL;
+}
+
 /**
  * vinagre_tab_get_view:
  * @tab: a Tab
@@ -720,10 +781,76 @@ vinagre_tab_get_state (VinagreTab *tab)
   return tab->priv->state;
 }
 
+static GdkPixbuf *
+capture_grab (VinagreTab *tab)
+{
+  if (tab->priv->state != VINAGRE_TAB_STATE_CONNECTED)
+    return NULL;
+
+  return VINAGRE_TAB_GET_CLASS (tab)->impl_get_screenshot (tab);
+}
+
+static void
+start_capture (VinagreTab *tab)
+{
+  VinagreConnection *conn = tab->priv->conn;
+  gchar             *directory, *prefix;
+
+  if (tab->priv->capture || !tab->priv->has_screenshot)
+    return;
+  if (!vinagre_connection_get_capture_enabled (conn))
+    return;
+
+  if (vinagre_connection_get_capture_directory (conn) &&
+      *vinagre_connection_get_capture_directory (conn))
+    directory = g_strdup (vinagre_connection_get_capture_directory (conn));
+  else
+    {
+      gchar *data_dir = vinagre_dirs_get_user_data_dir ();
+      directory = g_build_filename (data_dir, "captures", NULL);
+      g_free (data_dir);
+    }
+
+  prefix = vinagre_connection_get_file_prefix (conn);
+
+  tab->priv->capture = vinagre_capture_new (directory,
+					    prefix,
+					    vinagre_connection_get_capture_interval (conn),
+					    vinagre_connection_get_capture_on_bell (conn),
+					    vinagre_connection_get_capture_on_resize (conn),
+					    (goffset) vinagre_connection_get_capture_max_size (conn) * 1024 * 1024,
+					    (VinagreCaptureGrabFunc) capture_grab,
+					    tab);
+  g_free (directory);
+  g_free (prefix);
+}
+
 void
 vinagre_tab_set_state (VinagreTab *tab, VinagreTabState state)
 {
   tab->priv->state = state;
+
+  if (state == VINAGRE_TAB_STATE_CONNECTED)
+    start_capture (tab);
+  else
+    vinagre_tab_stop_recording (tab);
+}
+
+/**
+ * vinagre_tab_trigger_capture:
+ * @tab: a Tab
+ * @trigger: the remote event that happened
+ *
+ * Lets subclasses report bell and resize events, which take an
+ * unattended screenshot if the connection asks for it.
+ */
+void
+vinagre_tab_trigger_capture (VinagreTab *tab, VinagreCaptureTrigger trigger)
+{
+  g_return_if_fail (VINAGRE_IS_TAB (tab));
+
+  if (tab->priv->capture)
+    vinagre_capture_trigger (tab->priv->capture, trigger);
 }
 
 /**
@@ -1114,4 +1241,244 @@ vinagre_tab_get_has_screenshot (VinagreTab *tab)
   return tab->priv->has_screenshot;
 }
 
+static void
+record_keyframe (VinagreTab *tab)
+{
+  GdkRectangle area = { 0, };
+  GdkPixbuf   *pix;
+
+  vinagre_tab_get_dimensions (tab, &area.width, &area.height);
+  if (area.width <= 0 || area.height <= 0)
+    return;
+
+  if (!VINAGRE_TAB_GET_CLASS (tab)->impl_get_regions (tab, &area, 1, &pix) || !pix)
+    return;
+
+  vinagre_recorder_add_keyframe (tab->priv->recorder, pix);
+  g_object_unref (pix);
+
+  tab->priv->record_width = area.width;
+  tab->priv->record_height = area.height;
+  tab->priv->last_keyframe = g_get_monotonic_time ();
+  cairo_region_destroy (tab->priv->damage);
+  tab->priv->damage = cairo_region_create ();
+}
+
+/* One framebuffer snapshot per tick, whatever the number of rectangles */
+static void
+record_rectangles (VinagreTab *tab, const cairo_rectangle_int_t *rects, gint n)
+{
+  GdkPixbuf *pixs[RECORD_MAX_RECTS];
+  gint       i;
+
+  if (!VINAGRE_TAB_GET_CLASS (tab)->impl_get_regions (tab, rects, n, pixs))
+    return;
+
+  for (i = 0; i < n; i++)
+    if (pixs[i])
+      {
+	vinagre_recorder_add_update (tab->priv->recorder, pixs[i], rects[i].x, rects[i].y);
+	g_object_unref (pixs[i]);
+      }
+}
+
+static gboolean
+record_timeout_cb (VinagreTab *tab)
+{
+  cairo_rectangle_int_t bounds = { 0, }, rects[RECORD_MAX_RECTS];
+  int                   i, n;
+
+  /* Keep accumulating damage until the encoder catches up */
+  if (vinagre_recorder_get_lagging (tab->priv->recorder))
+    return TRUE;
+
+  vinagre_tab_get_dimensions (tab, &bounds.width, &bounds.height);
+  if (bounds.width <= 0 || bounds.height <= 0)
+    return TRUE;
+
+  if (bounds.width != tab->priv->record_width ||
+      bounds.height != tab->priv->record_height ||
+      g_get_monotonic_time () - tab->priv->last_keyframe >= RECORD_KEYFRAME_INTERVAL)
+    {
+      record_keyframe (tab);
+      return TRUE;
+    }
+
+  cairo_region_intersect_rectangle (tab->priv->damage, &bounds);
+  n = cairo_region_num_rectangles (tab->priv->damage);
+  if (n == 0)
+    return TRUE;
+
+  if (n > RECORD_MAX_RECTS)
+    {
+      cairo_region_get_extents (tab->priv->damage, &rects[0]);
+      n = 1;
+    }
+  else
+    for (i = 0; i < n; i++)
+      cairo_region_get_rectangle (tab->priv->damage, i, &rects[i]);
+
+  record_rectangles (tab, rects, n);
+
+  cairo_region_destroy (tab->priv->damage);
+  tab->priv->damage = cairo_region_create ();
+
+  return TRUE;
+}
+
+/**
+ * vinagre_tab_add_damage:
+ * @tab: a Tab
+ * @area: the updated area, in framebuffer coordinates
+ *
+ * Called by the protocols whenever the server updates their framebuffer.
+ */
+void
+vinagre_tab_add_damage (VinagreTab *tab, const GdkRectangle *area)
+{
+  g_return_if_fail (VINAGRE_IS_TAB (tab));
+
+  if (tab->priv->damage)
+    cairo_region_union_rectangle (tab->priv->damage, area);
+}
+
+/**
+ * vinagre_tab_start_recording:
+ * @tab: a Tab
+ * @filename: the file to record into
+ * @error: return location for a #GError, or %NULL
+ *
+ * Records the session from now on. Only the areas of the framebuffer
+ * reported through vinagre_tab_add_damage() are stored, plus a full
+ * keyframe every few seconds.
+ *
+ * Returns: %TRUE if the recording started
+ */
+gboolean
+vinagre_tab_start_recording (VinagreTab   *tab,
+			     const gchar  *filename,
+			     GError      **error)
+{
+  g_return_val_if_fail (VINAGRE_IS_TAB (tab), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  if (tab->priv->recorder)
+    return TRUE;
+
+  tab->priv->recorder = vinagre_recorder_new (filename, error);
+  if (!tab->priv->recorder)
+    return FALSE;
+
+  tab->priv->damage = cairo_region_create ();
+  record_keyframe (tab);
+  tab->priv->record_timeout_id = g_timeout_add (RECORD_TICK,
+						(GSourceFunc) record_timeout_cb,
+						tab);
+
+  return TRUE;
+}
+
+void
+vinagre_tab_stop_recording (VinagreTab *tab)
+{
+  g_return_if_fail (VINAGRE_IS_TAB (tab));
+
+  if (!tab->priv->recorder)
+    return;
+
+  g_source_remove (tab->priv->record_timeout_id);
+  tab->priv->record_timeout_id = 0;
+
+  /* Whatever changed since the last tick */
+  if (cairo_region_num_rectangles (tab->priv->damage) > 0)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_extents (tab->priv->damage, &rect);
+      record_rectangles (tab, &rect, 1);
+    }
+
+  vinagre_recorder_free (tab->priv->recorder);
+  tab->priv->recorder = NULL;
+  cairo_region_destroy (tab->priv->damage);
+  tab->priv->damage = NULL;
+  tab->priv->record_width = tab->priv->record_height = 0;
+}
+
+gboolean
+vinagre_tab_get_recording (VinagreTab *tab)
+{
+  g_return_val_if_fail (VINAGRE_IS_TAB (tab), FALSE);
+
+  return tab->priv->recorder != NULL;
+}
+
+/**
+ * vinagre_tab_record_session:
+ * @tab: a Tab
+ *
+ * Asks the user where to record the session, then starts recording.
+ *
+ * Returns: %TRUE if the session is being recorded
+ */
+gboolean
+vinagre_tab_record_session (VinagreTab *tab)
+{
+  GtkWidget     *dialog;
+  GtkFileFilter *filter;
+  GDateTime     *localtime;
+  gchar         *name, *timestamp, *suggested_filename;
+
+  g_return_val_if_fail (VINAGRE_IS_TAB (tab), FALSE);
+
+  if (tab->priv->recorder)
+    return TRUE;
+  if (!tab->priv->has_screenshot || tab->priv->state != VINAGRE_TAB_STATE_CONNECTED)
+    return FALSE;
+
+  dialog = gtk_file_chooser_dialog_new (_("Record Session"),
+				      GTK_WINDOW (tab->priv->window),
+				      GTK_FILE_CHOOSER_ACTION_SAVE,
+				      GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+				      GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+				      NULL);
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog), TRUE);
+  gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT);
+
+  name = vinagre_connection_get_best_name (tab->priv->conn);
+  localtime = g_date_time_new_now_local ();
+  timestamp =  g_date_time_format (localtime, "%F %H:%M:%S");
+  /* Translators: This is the suggested filename (in save dialog) when recording a session. First %s will be replaced by the friendly name of the connection and the second %s by the current date and time. */
+  suggested_filename = g_strdup_printf (_("Recording of %s at %s.vrec"), name, timestamp);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog), suggested_filename);
+  g_free (suggested_filename);
+  g_free (name);
+  g_free (timestamp);
+  g_date_time_unref (localtime);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, _("Session recordings"));
+  gtk_file_filter_add_pattern (filter, "*.vrec");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_ACCEPT)
+    {
+      GError *error = NULL;
+      gchar *filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+      if (!vinagre_tab_start_recording (tab, filename, &error))
+	{
+	  vinagre_utils_show_error_dialog (_("Error recording the session"),
+				    error->message,
+				    GTK_WINDOW (tab->priv->window));
+	  g_error_free (error);
+	}
+      g_free (filename);
+    }
+
+  gtk_widget_destroy (dialog);
+
+  return tab->priv->recorder != NULL;
+}
+
 /* vim: set ts=8: */
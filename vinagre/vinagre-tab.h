@@ -39,6 +39,7 @@ typedef struct _VinagreTabPrivate VinagreTabPrivate;
 typedef struct _VinagreTab        VinagreTab;
 typedef struct _VinagreTabClass   VinagreTabClass;
 
+#include "vinagre-capture.h"
 #include "vinagre-connection.h"
 #include "vinagre-notebook.h"
 #include "vinagre-window.h"
@@ -83,6 +84,15 @@ struct _VinagreTabClass
   /* Abstract functions */
   gchar *	(* impl_get_tooltip)			(VinagreTab *tab);
   GdkPixbuf *	(* impl_get_screenshot)			(VinagreTab *tab);
+
+  /* Copies the given areas of the framebuffer, in framebuffer coordinates
+   * within the size returned by impl_get_dimensions, into @regions, NULL
+   * for an area outside of it. All of them come from one snapshot, so
+   * FALSE means there is no framebuffer at all. */
+  gboolean	(* impl_get_regions)			(VinagreTab *tab,
+							 const GdkRectangle *areas,
+							 gint n_areas,
+							 GdkPixbuf **regions);
 };
 
 GType			vinagre_tab_get_type		(void) G_GNUC_CONST;
@@ -94,6 +104,7 @@ VinagreConnection *	vinagre_tab_get_conn		(VinagreTab *tab);
 VinagreWindow *		vinagre_tab_get_window		(VinagreTab *tab);
 
 void			vinagre_tab_add_view		(VinagreTab *tab, GtkWidget *view);
+void			vinagre_tab_remove_view		(VinagreTab *tab);
 GtkWidget *		vinagre_tab_get_view		(VinagreTab *tab);
 
 void			vinagre_tab_set_title		(VinagreTab *tab,
@@ -110,6 +121,15 @@ void			vinagre_tab_set_has_screenshot	(VinagreTab *tab, gboolean has_screenshot)
 gboolean		vinagre_tab_get_has_screenshot	(VinagreTab *tab);
 void			vinagre_tab_take_screenshot	(VinagreTab *tab);
 
+gboolean		vinagre_tab_start_recording	(VinagreTab   *tab,
+							 const gchar  *filename,
+							 GError      **error);
+void			vinagre_tab_stop_recording	(VinagreTab *tab);
+void			vinagre_tab_add_damage		(VinagreTab *tab,
+							 const GdkRectangle *area);
+gboolean		vinagre_tab_get_recording	(VinagreTab *tab);
+gboolean		vinagre_tab_record_session	(VinagreTab *tab);
+
 gchar *			vinagre_tab_get_tooltip		(VinagreTab *tab);
 void			vinagre_tab_get_dimensions	(VinagreTab *tab, int *w, int *h);
 
@@ -136,6 +156,8 @@ void			vinagre_tab_remove_from_notebook	(VinagreTab *tab);
 void			vinagre_tab_add_recent_used		(VinagreTab *tab);
 void			vinagre_tab_set_state			(VinagreTab *tab,
 								 VinagreTabState state);
+void			vinagre_tab_trigger_capture		(VinagreTab *tab,
+								 VinagreCaptureTrigger trigger);
 
 void			vinagre_tab_add_actions			(VinagreTab *tab,
 								 const GtkActionEntry *entries,
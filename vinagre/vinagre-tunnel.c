@@ -0,0 +1,289 @@
+/*
+ * vinagre-tunnel.c
+ * SSH Tunneling for Vinagre
+ * This file is part of vinagre
+ *
+ * Copyright (C) 2009 - Jonh Wendell <wendell@bani.com.br>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <unistd.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
+
+#include "vinagre-tunnel.h"
+#include "vinagre-ssh.h"
+#include "vinagre-ssh-gateway.h"
+
+/*
+ * ssh listens on a Unix socket named after the tunnel instead of a local
+ * TCP port, so there is no free port to look for, nothing to race with and
+ * no limit on the number of tunnels besides the open files.
+ */
+struct _VinagreTunnel
+{
+  VinagreSshGateway *gateway;
+  gchar             *path;
+  gchar             *forward;
+  gboolean           forwarding;
+};
+
+typedef struct
+{
+  VinagreTunnel *tunnel;
+  GCancellable  *cancellable;
+} TunnelRequest;
+
+static void
+tunnel_request_free (TunnelRequest *request)
+{
+  vinagre_tunnel_free (request->tunnel);
+  if (request->cancellable)
+    g_object_unref (request->cancellable);
+  g_slice_free (TunnelRequest, request);
+}
+
+static void
+tunnel_forward_cb (GObject      *source,
+		   GAsyncResult *res,
+		   gpointer      user_data)
+{
+  GSimpleAsyncResult *result = user_data;
+  TunnelRequest *request;
+  GError *error = NULL;
+
+  request = g_simple_async_result_get_op_res_gpointer (result);
+
+  /* Added even if the tab went away meanwhile: freeing the tunnel
+   * cancels it again */
+  if (vinagre_ssh_gateway_add_forward_finish (res, &error))
+    request->tunnel->forwarding = TRUE;
+
+  if (!error)
+    g_cancellable_set_error_if_cancelled (request->cancellable, &error);
+  if (error)
+    g_simple_async_result_take_error (result, error);
+
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+}
+
+static void
+tunnel_gateway_cb (GObject      *source,
+		   GAsyncResult *res,
+		   gpointer      user_data)
+{
+  GSimpleAsyncResult *result = user_data;
+  TunnelRequest *request;
+  VinagreTunnel *tunnel;
+  GError *error = NULL;
+
+  request = g_simple_async_result_get_op_res_gpointer (result);
+  tunnel = request->tunnel;
+
+  /* A tab closed during the login must not get a forward added for it */
+  tunnel->gateway = vinagre_ssh_gateway_get_finish (res, &error);
+  if (tunnel->gateway &&
+      !g_cancellable_set_error_if_cancelled (request->cancellable, &error))
+    {
+      vinagre_ssh_gateway_add_forward_async (tunnel->gateway,
+					     tunnel->forward,
+					     tunnel_forward_cb,
+					     result);
+      return;
+    }
+
+  g_simple_async_result_take_error (result, error);
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+}
+
+/**
+ * vinagre_tunnel_new_async:
+ * @parent: transient parent of the login dialogs, or %NULL
+ * @host: the host to reach through @gateway
+ * @port: the port to reach on @host
+ * @gateway: the SSH host, as user@host:port
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: called once the tunnel is up, or on failure
+ * @user_data: data for @callback
+ *
+ * Tunnels through the same gateway share one SSH connection, only the
+ * first one has to log in.
+ */
+void
+vinagre_tunnel_new_async (GtkWindow           *parent,
+			  const gchar         *host,
+			  const gchar         *port,
+			  const gchar         *gateway,
+			  GCancellable        *cancellable,
+			  GAsyncReadyCallback  callback,
+			  gpointer             user_data)
+{
+  GSimpleAsyncResult *result;
+  TunnelRequest *request;
+  GError *error = NULL;
+
+  g_return_if_fail (host != NULL);
+  g_return_if_fail (port != NULL);
+  g_return_if_fail (gateway != NULL);
+
+  result = g_simple_async_result_new (NULL, callback, user_data,
+				      vinagre_tunnel_new_async);
+
+  request = g_slice_new0 (TunnelRequest);
+  request->tunnel = g_slice_new0 (VinagreTunnel);
+  request->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+  g_simple_async_result_set_op_res_gpointer (result, request,
+					     (GDestroyNotify) tunnel_request_free);
+
+  request->tunnel->path = vinagre_ssh_new_socket_path ("tunnel", &error);
+  if (!request->tunnel->path)
+    {
+      g_simple_async_result_take_error (result, error);
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+      return;
+    }
+
+  request->tunnel->forward = g_strdup_printf ("%s:%s:%s",
+					      request->tunnel->path, host, port);
+  vinagre_ssh_gateway_get_async (parent, gateway, tunnel_gateway_cb, result);
+}
+
+/**
+ * vinagre_tunnel_new_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns: a new tunnel, or %NULL on error
+ */
+VinagreTunnel *
+vinagre_tunnel_new_finish (GAsyncResult  *result,
+			   GError       **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+  TunnelRequest *request;
+  VinagreTunnel *tunnel;
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result, NULL,
+							vinagre_tunnel_new_async),
+			NULL);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
+
+  request = g_simple_async_result_get_op_res_gpointer (simple);
+  tunnel = request->tunnel;
+  request->tunnel = NULL;
+
+  return tunnel;
+}
+
+/**
+ * vinagre_tunnel_connect:
+ * @tunnel: a #VinagreTunnel
+ * @error: return location for a #GError, or %NULL
+ *
+ * Opens a new stream to the remote end of the tunnel. It can be called as
+ * many times as the protocol needs connections.
+ *
+ * Returns: a connected file descriptor owned by the caller, or -1 on error
+ */
+gint
+vinagre_tunnel_connect (VinagreTunnel *tunnel,
+			GError       **error)
+{
+  GSocket        *socket;
+  GSocketAddress *address;
+  gint            fd = -1;
+
+  g_return_val_if_fail (tunnel != NULL, -1);
+
+  socket = g_socket_new (G_SOCKET_FAMILY_UNIX,
+			 G_SOCKET_TYPE_STREAM,
+			 G_SOCKET_PROTOCOL_DEFAULT,
+			 error);
+  if (!socket)
+    return -1;
+
+  address = g_unix_socket_address_new (tunnel->path);
+  if (g_socket_connect (socket, address, NULL, error))
+    {
+      /* The socket closes its descriptor on finalize, hand out a copy */
+      fd = dup (g_socket_get_fd (socket));
+      if (fd < 0)
+	{
+	  int errsv = errno;
+
+	  g_set_error_literal (error,
+			       G_IO_ERROR,
+			       g_io_error_from_errno (errsv),
+			       g_strerror (errsv));
+	}
+    }
+
+  g_object_unref (address);
+  g_object_unref (socket);
+  return fd;
+}
+
+/**
+ * vinagre_tunnel_is_alive:
+ * @tunnel: a #VinagreTunnel
+ *
+ * Tells a session closed by the server from a lost gateway: ssh accepts on
+ * the tunnel socket for as long as its master connection is up.
+ *
+ * Returns: %TRUE if new connections can still be made through @tunnel
+ */
+gboolean
+vinagre_tunnel_is_alive (VinagreTunnel *tunnel)
+{
+  gint fd;
+
+  g_return_val_if_fail (tunnel != NULL, FALSE);
+
+  fd = vinagre_tunnel_connect (tunnel, NULL);
+  if (fd < 0)
+    return FALSE;
+
+  close (fd);
+  return TRUE;
+}
+
+/* Connections already made through the tunnel stay open until the
+ * gateway itself is closed */
+void
+vinagre_tunnel_free (VinagreTunnel *tunnel)
+{
+  if (!tunnel)
+    return;
+
+  if (tunnel->forwarding)
+    vinagre_ssh_gateway_cancel_forward (tunnel->gateway, tunnel->forward);
+  if (tunnel->gateway)
+    vinagre_ssh_gateway_unref (tunnel->gateway);
+  if (tunnel->path)
+    g_unlink (tunnel->path);
+
+  g_free (tunnel->forward);
+  g_free (tunnel->path);
+  g_slice_free (VinagreTunnel, tunnel);
+}
+
+/* vim: set ts=8: */
@@ -1,5 +1,5 @@
 /*
- * vinagre-spice-tunnel.h
+ * vinagre-tunnel.h
  * SSH Tunneling for Vinagre
  * This file is part of vinagre
  *
@@ -19,28 +19,30 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef __VINAGRE_SPICE_TUNNEL_H__
-#define __VINAGRE_SPICE_TUNNEL_H__
+#ifndef __VINAGRE_TUNNEL_H__
+#define __VINAGRE_TUNNEL_H__
 
 #include <gtk/gtk.h>
 
 G_BEGIN_DECLS
 
-typedef enum
-{
-  VINAGRE_SPICE_TUNNEL_ERROR_NO_FREE_PORT = 1
-} VinagreSpiceTunnelError;
-
-#define VINAGRE_SPICE_TUNNEL_ERROR vinagre_spice_tunnel_error_quark()
-GQuark vinagre_spice_tunnel_error_quark (void);
-
-gboolean vinagre_spice_tunnel_create (GtkWindow *parent,
-				    gchar **original_host,
-				    gchar **original_port,
-				    gchar *gateway,
-				    GError **error);
+typedef struct _VinagreTunnel VinagreTunnel;
+
+void		vinagre_tunnel_new_async	(GtkWindow           *parent,
+						 const gchar         *host,
+						 const gchar         *port,
+						 const gchar         *gateway,
+						 GCancellable        *cancellable,
+						 GAsyncReadyCallback  callback,
+						 gpointer             user_data);
+VinagreTunnel *	vinagre_tunnel_new_finish	(GAsyncResult  *result,
+						 GError       **error);
+gint		vinagre_tunnel_connect		(VinagreTunnel *tunnel,
+						 GError       **error);
+gboolean	vinagre_tunnel_is_alive		(VinagreTunnel *tunnel);
+void		vinagre_tunnel_free		(VinagreTunnel *tunnel);
 
 G_END_DECLS
 
-#endif  /* __VINAGRE_SPICE_TUNNEL_H__  */
+#endif  /* __VINAGRE_TUNNEL_H__  */
 /* vim: set ts=8: */
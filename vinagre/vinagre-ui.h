@@ -95,7 +95,10 @@ static const GtkActionEntry vinagre_remote_initialized_entries[] =
 
 static const GtkToggleActionEntry vinagre_remote_initialized_toggle_entries[] =
 {
- {0,},
+  /* Remote menu */
+  { "RemoteRecord", GTK_STOCK_MEDIA_RECORD, N_("_Record Session"), NULL,
+    N_("Record the current remote desktop to a file"),
+    G_CALLBACK (vinagre_cmd_remote_record), FALSE }
 };
 
 G_END_DECLS
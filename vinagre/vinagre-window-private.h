@@ -37,6 +37,7 @@ struct _VinagreWindowPrivate
   GtkWidget       *statusbar;	
   guint           generic_message_cid;
   guint           tip_message_cid;
+  guint           pending_message_cid;
 
   /* Menus & Toolbars */
   GtkUIManager   *manager;
@@ -48,7 +49,9 @@ struct _VinagreWindowPrivate
   GtkActionGroup *bookmarks_list_action_group;
   GtkActionGroup *recent_action_group;
   GtkAction      *recent_action;
-  guint           bookmarks_list_menu_ui_id;
+  GHashTable     *bookmarks_sections;
+  GtkWidget      *bookmarks_menu;
+  gboolean        bookmarks_dirty;
   guint           recents_menu_ui_id;
   guint           update_recents_menu_ui_id;
 
@@ -58,6 +58,12 @@ vinagre_window_dispose (GObject *object)
 {
   VinagreWindow *window = VINAGRE_WINDOW (object);
 
+  if (window->priv->bookmarks_sections)
+    {
+      g_hash_table_destroy (window->priv->bookmarks_sections);
+      window->priv->bookmarks_sections = NULL;
+    }
+
   if (window->priv->manager)
     {
       g_object_unref (window->priv->manager);
@@ -75,6 +81,7 @@ vinagre_window_dispose (GObject *object)
 
     if (window->priv->listener)
     {
+        g_signal_handlers_disconnect_by_data (window->priv->listener, window);
         g_object_unref (window->priv->listener);
         window->priv->listener = NULL;
     }
@@ -375,6 +382,10 @@ create_menu_bar_and_toolbar (VinagreWindow *window,
 				vinagre_remote_initialized_entries,
 				G_N_ELEMENTS (vinagre_remote_initialized_entries),
 				window);
+  gtk_action_group_add_toggle_actions (action_group,
+				       vinagre_remote_initialized_toggle_entries,
+				       G_N_ELEMENTS (vinagre_remote_initialized_toggle_entries),
+				       window);
   gtk_action_group_set_sensitive (action_group, FALSE);
   gtk_ui_manager_insert_action_group (manager, action_group, 0);
   g_object_unref (action_group);
@@ -508,141 +519,334 @@ static void
 _open_bookmark (GtkAction *action, gpointer user_data)
 {
     VinagreWindow *window = VINAGRE_WINDOW (user_data);
-    VinagreConnection *connection = VINAGRE_CONNECTION (g_object_get_data (G_OBJECT (action), "conn"));
+    VinagreBookmarksEntry *entry = VINAGRE_BOOKMARKS_ENTRY (g_object_get_data (G_OBJECT (action), "entry"));
+    VinagreConnection *connection = vinagre_bookmarks_entry_get_conn (entry);
 
-    vinagre_cmd_open_bookmark (window, connection);
+    if (connection)
+      vinagre_cmd_open_bookmark (window, connection);
 }
 
+#define BOOKMARKS_LIST_PATH "/MenuBar/BookmarksMenu/BookmarksList"
+#define AVAHI_LIST_PATH     "/MenuBar/BookmarksMenu/AvahiList"
+
+/*
+ * The Bookmarks menu is made of sections: the two top level lists, and
+ * the contents of each folder. A section is only built when the menu
+ * holding it is shown, and is rebuilt only when its entries changed.
+ */
+typedef struct
+{
+  gchar                 *path;     /* of the menu or placeholder holding it */
+  guint                  merge_id;
+  GSList                *actions;
+  GPtrArray             *entries;  /* what the section shows, in order */
+  GPtrArray             *keys;     /* what each entry looked like */
+  VinagreBookmarksEntry *folder;   /* NULL for the top level lists */
+  gboolean               mdns;
+} BookmarksSection;
+
+static void bookmarks_folder_show_cb (GtkWidget *menu, GtkAction *action);
+
 static void
-vinagre_window_populate_bookmarks (VinagreWindow *window,
-				   const gchar   *group,
-				   GSList        *entries,
-				   const gchar   *parent)
+bookmarks_section_free (BookmarksSection *section)
+{
+  g_free (section->path);
+  g_slist_free (section->actions);
+  g_ptr_array_free (section->entries, TRUE);
+  g_ptr_array_free (section->keys, TRUE);
+  if (section->folder)
+    g_object_unref (section->folder);
+  g_slice_free (BookmarksSection, section);
+}
+
+static gchar *
+bookmarks_entry_key (VinagreBookmarksEntry *entry)
+{
+  gchar *name, *key;
+
+  if (vinagre_bookmarks_entry_get_node (entry) == VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER)
+    return g_strdup (vinagre_bookmarks_entry_get_name (entry));
+
+  name = vinagre_bookmarks_entry_get_best_name (entry);
+  key = g_strdup_printf ("%s\n%s:%d",
+			 name,
+			 vinagre_bookmarks_entry_get_host (entry),
+			 vinagre_bookmarks_entry_get_port (entry));
+  g_free (name);
+
+  return key;
+}
+
+static GSList *
+bookmarks_section_get_entries (BookmarksSection *section)
+{
+  if (section->folder)
+    return vinagre_bookmarks_entry_get_children (section->folder);
+
+#ifdef VINAGRE_HAVE_AVAHI
+  if (section->mdns)
+    return vinagre_mdns_get_all (vinagre_mdns_get_default ());
+#endif
+
+  return vinagre_bookmarks_get_all (vinagre_bookmarks_get_default ());
+}
+
+static gboolean
+bookmarks_section_changed (BookmarksSection *section)
+{
+  GSList *l;
+  gchar  *key;
+  guint   i = 0;
+  gboolean changed = FALSE;
+
+  for (l = bookmarks_section_get_entries (section); l && !changed; l = l->next, i++)
+    {
+      if (i >= section->entries->len ||
+	  g_ptr_array_index (section->entries, i) != l->data)
+	return TRUE;
+
+      key = bookmarks_entry_key (VINAGRE_BOOKMARKS_ENTRY (l->data));
+      changed = g_strcmp0 (key, g_ptr_array_index (section->keys, i)) != 0;
+      g_free (key);
+    }
+
+  return changed || i != section->entries->len;
+}
+
+static GtkAction *
+bookmarks_section_add_entry (VinagreWindow         *window,
+			     BookmarksSection      *section,
+			     VinagreBookmarksEntry *entry)
 {
   static guint           i = 0;
-  GSList                *l;
-  VinagreBookmarksEntry *entry;
-  gchar                 *action_name, *action_label, *path, *tooltip;
+  gchar                 *action_name, *action_label, *tooltip;
   GtkAction             *action;
   VinagreWindowPrivate  *p = window->priv;
-  VinagreConnection     *conn;
   VinagreProtocol       *ext;
 
-  for (l = entries; l; l = l->next)
+  switch (vinagre_bookmarks_entry_get_node (entry))
     {
-      entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
-      switch (vinagre_bookmarks_entry_get_node (entry))
-	{
-	  case VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER:
-	    action_label = _escape_underscores (vinagre_bookmarks_entry_get_name (entry), -1);
-	    action_name = g_strdup_printf ("BOOKMARK_FOLDER_ACTION_%d", ++i);
-	    action = gtk_action_new (action_name,
-				     action_label,
-				     NULL,
-				     NULL);
-	    g_object_set (G_OBJECT (action), "icon-name", "folder", "hide-if-empty", FALSE, NULL);
-	    gtk_action_group_add_action (p->bookmarks_list_action_group,
-					 action);
-	    g_object_unref (action);
-
-	    path = g_strdup_printf ("/MenuBar/BookmarksMenu/%s%s", group, parent?parent:"");
-	    gtk_ui_manager_add_ui (p->manager,
-				   p->bookmarks_list_menu_ui_id,
-				   path,
-				   action_label, action_name,
-				   GTK_UI_MANAGER_MENU,
-				   FALSE);
-	    g_free (path);
-    	    g_free (action_name);
-
-	    path = g_strdup_printf ("%s/%s", parent?parent:"", action_label);
-	    g_free (action_label);
-
-	    vinagre_window_populate_bookmarks (window, group, vinagre_bookmarks_entry_get_children (entry), path);
-	    g_free (path);
-	    break;
-
-	  case VINAGRE_BOOKMARKS_ENTRY_NODE_CONN:
-	    conn = vinagre_bookmarks_entry_get_conn (entry);
-	    ext = vinagre_plugins_engine_get_plugin_by_protocol (vinagre_plugins_engine_get_default (),
-								 vinagre_connection_get_protocol (conn));
-	    if (!ext)
-	     continue;
-
-	    action_name = vinagre_connection_get_best_name (conn);
-	    action_label = _escape_underscores (action_name, -1);
-	    g_free (action_name);
-
-	    action_name = g_strdup_printf ("BOOKMARK_ITEM_ACTION_%d", ++i);
-
-	    /* Translators: This is server:port, a statusbar tooltip when mouse is over a bookmark item on menu */
-	    tooltip = g_strdup_printf (_("Open %s:%d"),
-					vinagre_connection_get_host (conn),
-					vinagre_connection_get_port (conn));
-	    action = gtk_action_new (action_name,
-				     action_label,
-				     tooltip,
-				     NULL);
-	    g_object_set (G_OBJECT (action),
-			  "icon-name",
-			  vinagre_protocol_get_icon_name (ext),
-			  NULL);
-	    g_object_set_data (G_OBJECT (action), "conn", conn);
-	    gtk_action_group_add_action (p->bookmarks_list_action_group,
-					 action);
-
-	    path = g_strdup_printf ("/MenuBar/BookmarksMenu/%s%s", group, parent?parent:"");
-	    gtk_ui_manager_add_ui (p->manager,
-				   p->bookmarks_list_menu_ui_id,
-				   path,
-				   action_label, action_name,
-				   GTK_UI_MANAGER_MENUITEM,
-				   FALSE);
-
-            g_signal_connect (action, "activate", G_CALLBACK (_open_bookmark), window);
-
-	    g_object_unref (action);
-	    g_free (action_name);
-	    g_free (action_label);
-	    g_free (tooltip);
-	    g_free (path);
-	    break;
-
-	  default:
-	    g_assert_not_reached ();
-	}
+      case VINAGRE_BOOKMARKS_ENTRY_NODE_FOLDER:
+	action_label = _escape_underscores (vinagre_bookmarks_entry_get_name (entry), -1);
+	action_name = g_strdup_printf ("BOOKMARK_FOLDER_ACTION_%d", ++i);
+	action = gtk_action_new (action_name,
+				 action_label,
+				 NULL,
+				 NULL);
+	g_object_set (G_OBJECT (action), "icon-name", "folder", "hide-if-empty", FALSE, NULL);
+
+	gtk_ui_manager_add_ui (p->manager,
+			       section->merge_id,
+			       section->path,
+			       action_name, action_name,
+			       GTK_UI_MANAGER_MENU,
+			       FALSE);
+	g_object_set_data_full (G_OBJECT (action), "path",
+				g_strdup_printf ("%s/%s", section->path, action_name),
+				g_free);
+	break;
+
+      case VINAGRE_BOOKMARKS_ENTRY_NODE_CONN:
+	/* Do not create the connection until the item is activated */
+	ext = vinagre_plugins_engine_get_plugin_by_protocol (vinagre_plugins_engine_get_default (),
+							     vinagre_bookmarks_entry_get_protocol (entry));
+	if (!ext)
+	  return NULL;
+
+	action_name = vinagre_bookmarks_entry_get_best_name (entry);
+	action_label = _escape_underscores (action_name, -1);
+	g_free (action_name);
+
+	action_name = g_strdup_printf ("BOOKMARK_ITEM_ACTION_%d", ++i);
+
+	/* Translators: This is server:port, a statusbar tooltip when mouse is over a bookmark item on menu */
+	tooltip = g_strdup_printf (_("Open %s:%d"),
+				    vinagre_bookmarks_entry_get_host (entry),
+				    vinagre_bookmarks_entry_get_port (entry));
+	action = gtk_action_new (action_name,
+				 action_label,
+				 tooltip,
+				 NULL);
+	g_object_set (G_OBJECT (action),
+		      "icon-name",
+		      vinagre_protocol_get_icon_name (ext),
+		      NULL);
+	g_signal_connect (action, "activate", G_CALLBACK (_open_bookmark), window);
+
+	gtk_ui_manager_add_ui (p->manager,
+			       section->merge_id,
+			       section->path,
+			       action_name, action_name,
+			       GTK_UI_MANAGER_MENUITEM,
+			       FALSE);
+	g_free (tooltip);
+	break;
+
+      default:
+	g_assert_not_reached ();
     }
+
+  g_object_set_data_full (G_OBJECT (action), "entry", g_object_ref (entry), g_object_unref);
+  g_object_set_data (G_OBJECT (action), "window", window);
+  gtk_action_group_add_action (p->bookmarks_list_action_group, action);
+  section->actions = g_slist_prepend (section->actions, action);
+  g_object_unref (action);
+
+  g_free (action_name);
+  g_free (action_label);
+
+  return action;
 }
 
-void
-vinagre_window_update_bookmarks_list_menu (VinagreWindow *window)
+static void
+bookmarks_section_build (VinagreWindow         *window,
+			 const gchar           *path,
+			 VinagreBookmarksEntry *folder,
+			 gboolean               mdns)
 {
   VinagreWindowPrivate *p = window->priv;
-  GList  *actions, *l;
-  GSList *favs, *mdnss = NULL;
+  BookmarksSection *section;
+  GSList           *l;
+  GtkAction        *action;
+  GtkWidget        *item, *menu;
 
-  g_return_if_fail (p->bookmarks_list_action_group != NULL);
+  section = g_slice_new0 (BookmarksSection);
+  section->path = g_strdup (path);
+  section->merge_id = gtk_ui_manager_new_merge_id (p->manager);
+  section->entries = g_ptr_array_new_with_free_func (g_object_unref);
+  section->keys = g_ptr_array_new_with_free_func (g_free);
+  section->folder = folder ? g_object_ref (folder) : NULL;
+  section->mdns = mdns;
+
+  for (l = bookmarks_section_get_entries (section); l; l = l->next)
+    {
+      VinagreBookmarksEntry *entry = VINAGRE_BOOKMARKS_ENTRY (l->data);
+
+      g_ptr_array_add (section->entries, g_object_ref (entry));
+      g_ptr_array_add (section->keys, bookmarks_entry_key (entry));
+      bookmarks_section_add_entry (window, section, entry);
+    }
+
+  g_hash_table_insert (p->bookmarks_sections, section->path, section);
+
+  /* Folders get their contents the first time they are opened */
+  gtk_ui_manager_ensure_update (p->manager);
+  for (l = section->actions; l; l = l->next)
+    {
+      action = GTK_ACTION (l->data);
+      if (!g_object_get_data (G_OBJECT (action), "path"))
+	continue;
+
+      item = gtk_ui_manager_get_widget (p->manager,
+					g_object_get_data (G_OBJECT (action), "path"));
+      menu = item ? gtk_menu_item_get_submenu (GTK_MENU_ITEM (item)) : NULL;
+      if (menu)
+	g_signal_connect (menu, "show", G_CALLBACK (bookmarks_folder_show_cb), action);
+    }
+}
+
+/* Removes the section at path, along with the sections of its folders */
+static void
+bookmarks_section_remove_tree (VinagreWindow *window,
+			       const gchar   *path)
+{
+  VinagreWindowPrivate *p = window->priv;
+  GHashTableIter    iter;
+  BookmarksSection *section;
+  GSList           *l;
+  gchar            *prefix;
+  gsize             len;
+
+  prefix = g_strconcat (path, "/", NULL);
+  len = strlen (path);
+
+  g_hash_table_iter_init (&iter, p->bookmarks_sections);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &section))
+    {
+      if (strncmp (section->path, path, len) != 0 ||
+	  (section->path[len] != '\0' && !g_str_has_prefix (section->path, prefix)))
+	continue;
+
+      gtk_ui_manager_remove_ui (p->manager, section->merge_id);
+      for (l = section->actions; l; l = l->next)
+	gtk_action_group_remove_action (p->bookmarks_list_action_group,
+					GTK_ACTION (l->data));
+
+      g_hash_table_iter_remove (&iter);
+    }
+
+  g_free (prefix);
+}
+
+static void
+vinagre_window_sync_bookmarks (VinagreWindow *window)
+{
+  VinagreWindowPrivate *p = window->priv;
+  BookmarksSection *section;
+  GList *paths, *l;
 
-  if (p->bookmarks_list_menu_ui_id != 0)
-    gtk_ui_manager_remove_ui (p->manager, p->bookmarks_list_menu_ui_id);
+  p->bookmarks_dirty = FALSE;
 
-  actions = gtk_action_group_list_actions (p->bookmarks_list_action_group);
-  for (l = actions; l != NULL; l = l->next)
+  /* Sorted, so that a folder goes away with its parent before being
+     compared to what it was */
+  paths = g_hash_table_get_keys (p->bookmarks_sections);
+  for (l = paths; l; l = l->next)
+    l->data = g_strdup (l->data);
+  paths = g_list_sort (paths, (GCompareFunc) strcmp);
+
+  for (l = paths; l; l = l->next)
     {
-      gtk_action_group_remove_action (p->bookmarks_list_action_group,
-				      GTK_ACTION (l->data));
+      section = g_hash_table_lookup (p->bookmarks_sections, l->data);
+      if (section && bookmarks_section_changed (section))
+	bookmarks_section_remove_tree (window, section->path);
     }
-  g_list_free (actions);
+  g_list_free_full (paths, g_free);
 
-  favs = vinagre_bookmarks_get_all (vinagre_bookmarks_get_default ());
+  if (!g_hash_table_lookup (p->bookmarks_sections, BOOKMARKS_LIST_PATH))
+    bookmarks_section_build (window, BOOKMARKS_LIST_PATH, NULL, FALSE);
 
 #ifdef VINAGRE_HAVE_AVAHI
-  mdnss = vinagre_mdns_get_all (vinagre_mdns_get_default ());
+  if (!g_hash_table_lookup (p->bookmarks_sections, AVAHI_LIST_PATH))
+    bookmarks_section_build (window, AVAHI_LIST_PATH, NULL, TRUE);
 #endif
+}
+
+static void
+bookmarks_menu_show_cb (GtkWidget     *menu,
+			VinagreWindow *window)
+{
+  if (window->priv->bookmarks_dirty)
+    vinagre_window_sync_bookmarks (window);
+}
+
+static void
+bookmarks_folder_show_cb (GtkWidget *menu,
+			  GtkAction *action)
+{
+  VinagreWindow *window = g_object_get_data (G_OBJECT (action), "window");
+  const gchar   *path = g_object_get_data (G_OBJECT (action), "path");
+
+  if (!g_hash_table_lookup (window->priv->bookmarks_sections, path))
+    bookmarks_section_build (window,
+			     path,
+			     g_object_get_data (G_OBJECT (action), "entry"),
+			     FALSE);
+}
+
+void
+vinagre_window_update_bookmarks_list_menu (VinagreWindow *window)
+{
+  VinagreWindowPrivate *p = window->priv;
+
+  g_return_if_fail (p->bookmarks_list_action_group != NULL);
+
+  if (!p->manager)
+    return;
 
-  p->bookmarks_list_menu_ui_id = (g_slist_length (favs) > 0||g_slist_length (mdnss) > 0) ? gtk_ui_manager_new_merge_id (p->manager) : 0;
-  vinagre_window_populate_bookmarks (window, "BookmarksList", favs, NULL);
-  vinagre_window_populate_bookmarks (window, "AvahiList", mdnss, NULL);
+  /* Wait until the menu is opened, unless it is open right now */
+  p->bookmarks_dirty = TRUE;
+  if (p->bookmarks_menu && gtk_widget_get_visible (p->bookmarks_menu))
+    vinagre_window_sync_bookmarks (window);
 }
 
 static void
@@ -694,6 +898,8 @@ create_statusbar (VinagreWindow *window,
 	(GTK_STATUSBAR (window->priv->statusbar), "generic_message");
   window->priv->tip_message_cid = gtk_statusbar_get_context_id
 	(GTK_STATUSBAR (window->priv->statusbar), "tip_message");
+  window->priv->pending_message_cid = gtk_statusbar_get_context_id
+	(GTK_STATUSBAR (window->priv->statusbar), "pending_message");
 
   gtk_box_pack_end (GTK_BOX (main_box),
 		    window->priv->statusbar,
@@ -713,17 +919,44 @@ _create_notebook (VinagreWindow *window, GtkWidget *main_box)
     gtk_widget_show (GTK_WIDGET (window->priv->notebook));
 }
 
+/* Reverse connections parked in headless mode are otherwise only visible
+ * from the reverse connections dialog */
+static void
+_update_pending_message (VinagreWindow *window)
+{
+    guint n_pending;
+    gchar *message;
+
+    g_object_get (window->priv->listener, "n-pending", &n_pending, NULL);
+
+    gtk_statusbar_pop (GTK_STATUSBAR (window->priv->statusbar),
+                       window->priv->pending_message_cid);
+    if (n_pending == 0)
+        return;
+
+    message = g_strdup_printf (ngettext ("%u reverse connection is waiting",
+                                         "%u reverse connections are waiting",
+                                         n_pending),
+                               n_pending);
+    gtk_statusbar_push (GTK_STATUSBAR (window->priv->statusbar),
+                        window->priv->pending_message_cid, message);
+    g_free (message);
+}
+
 /* Initialise the reverse connections dialog, and start the listener if it is
  * enabled. */
 static void
 _init_reverse_connections (VinagreWindow *window)
 {
     gboolean always;
-    VinagreReverseVncListener *listener = window->priv->listener;
+    VinagreReverseVncListener *listener;
 
     listener = vinagre_reverse_vnc_listener_get_default ();
+    window->priv->listener = listener;
 
     vinagre_reverse_vnc_listener_set_window (listener, window);
+    g_signal_connect_swapped (listener, "notify::n-pending",
+        G_CALLBACK (_update_pending_message), window);
 
     g_object_get (vinagre_prefs_get_default (), "always-enable-listening",
         &always, NULL);
@@ -810,6 +1043,10 @@ protocol_added_removed_cb (VinagrePluginsEngine *engine,
 			   VinagreProtocol      *protocol,
 			   VinagreWindow        *window)
 {
+  /* Items of that protocol may appear or go away without the entries
+     changing, so start over */
+  if (window->priv->manager)
+    bookmarks_section_remove_tree (window, "/MenuBar/BookmarksMenu");
   vinagre_window_update_bookmarks_list_menu (window);
 }
 
@@ -844,6 +1081,16 @@ vinagre_window_init (VinagreWindow *window)
   init_widgets_visibility (window);
 //  vinagre_window_merge_tab_ui (window);
 
+  window->priv->bookmarks_sections = g_hash_table_new_full (g_str_hash,
+							    g_str_equal,
+							    NULL,
+							    (GDestroyNotify) bookmarks_section_free);
+  window->priv->bookmarks_menu = gtk_menu_item_get_submenu (GTK_MENU_ITEM (gtk_ui_manager_get_widget (window->priv->manager,
+													"/MenuBar/BookmarksMenu")));
+  g_signal_connect (window->priv->bookmarks_menu,
+		    "show",
+		    G_CALLBACK (bookmarks_menu_show_cb),
+		    window);
   vinagre_window_update_bookmarks_list_menu (window);
   g_signal_connect_swapped (vinagre_bookmarks_get_default (),
                             "changed",